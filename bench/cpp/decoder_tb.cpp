@@ -0,0 +1,443 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/decoder_tb.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A Verilator based, cycle accurate, test bench and throughput
+//		benchmark for the QOI decoder.  Images, read from PPM or PNG
+//	files, are first compressed by the software model in sw/qoi.cpp.  The
+//	resulting QOI files, headers and trailers included, are then placed
+//	back to back into a single byte stream, and fed to the decoder DW bits
+//	at a time--much as they would be read from memory.  Some beats, chosen
+//	at random, are only partially filled.  Random gaps may be placed
+//	between beats, and random backpressure may be applied to the decoder's
+//	video output.  Every pixel produced is checked against the original
+//	image, as are the TLAST (end of frame) and TUSER (end of line) signals
+//	the decoder generates from each frame's header.  The following
+//	statistics are reported for each frame:
+//
+//	- Cycles, from the first pixel produced to the last, and the decoder's
+//		resulting throughput in pixels per clock
+//	- Bytes, the size of the QOI file, and its size as a percentage of
+//		the 24-bit (32-bit, with ALPHA) uncompressed image size
+//
+//	When built with ALPHA, the decoder is expected to have OPT_ALPHA set.
+//	Images are then read, compressed, and checked with their alpha
+//	channels.
+//
+//	Usage: decoder_tb [-b pct] [-g pct] [-n count] [-s seed]
+//			[-t trace.vcd] image ...
+//
+//	-b pct	Holds m_ready low (backpressure) pct% of the time
+//	-g pct	Leaves pct% of the input cycles idle (gaps)
+//	-n cnt	Decodes each image cnt times (default: 1)
+//	-s seed	Seeds the random number generator
+//	-t file	Records a VCD trace of the entire simulation
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "verilated.h"
+#include "Vqoi_decoder.h"
+#include "testb.h"
+#include "imgfile.h"
+#include "qoi.h"
+
+// These must match the parameters the decoder was Verilated with
+#ifndef	DW
+#define	DW	64
+#endif
+#ifndef	ALPHA
+#define	ALPHA	0
+#endif
+
+#define	DB		(DW/8)
+#define	NCHAN		((ALPHA) ? 4 : 3)
+#define	PXMASK		((ALPHA) ? 0xffffffffu : 0x0ffffffu)
+#define	MAX_IDLE	100000
+
+// Per frame statistics
+// {{{
+typedef	struct	FRAMESTATS_S {
+	const char	*m_name;
+	const IMGFILE	*m_img;
+	// The height given in the frame's header, which may lie
+	unsigned	m_height;
+	uint64_t	m_start, m_end, m_bytes;
+	unsigned	m_errors;
+	bool		m_syncok;
+} FRAMESTATS;
+// }}}
+
+class	DECODER_TB : public TESTB<Vqoi_decoder> {
+public:
+	unsigned	m_backpressure, m_gaps;
+
+	// Input side: every QOI file, back to back
+	std::vector<uint8_t>	m_stream;
+	size_t		m_pos;
+	// Output side: the next pixel expected
+	std::vector<FRAMESTATS>	m_frames;
+	unsigned	m_oframe, m_pixel, m_szerrs;
+	uint64_t	m_last_activity;
+
+	DECODER_TB(void) : m_backpressure(0), m_gaps(0), m_pos(0),
+			m_oframe(0), m_pixel(0), m_szerrs(0),
+			m_last_activity(0) {
+		m_core->i_qvalid = 0;
+		m_core->m_ready  = 1;
+	}
+
+	// set_byte
+	// {{{
+	// Place byte k of the current beat into i_qdata, where byte zero is
+	// found in the MSBs
+	void	set_byte(unsigned k, uint8_t v) {
+		unsigned	pos = DW-8-8*k;
+#if	(DW <= 32)
+		m_core->i_qdata &= ~(0x0ffu << pos);
+		m_core->i_qdata |= (uint32_t)v << pos;
+#elif	(DW <= 64)
+		m_core->i_qdata &= ~(0x0ffull << pos);
+		m_core->i_qdata |= (uint64_t)v << pos;
+#else
+		m_core->i_qdata[pos/32] &= ~(0x0ffu << (pos%32));
+		m_core->i_qdata[pos/32] |= (uint32_t)v << (pos%32);
+#endif
+	}
+	// }}}
+
+	// load
+	// {{{
+	// Load the next beat.  One in four beats, on average, is given fewer
+	// bytes than the full bus width.  The unused bytes are filled with
+	// garbage, which the decoder must ignore.
+	void	load(void) {
+		unsigned	nb = DB;
+
+		if ((rand() & 3) == 0)
+			nb = 1 + (rand() % DB);
+		if (nb > m_stream.size() - m_pos)
+			nb = m_stream.size() - m_pos;
+
+		for(unsigned k=0; k<DB; k++)
+			set_byte(k, (k < nb) ? m_stream[m_pos+k] : rand());
+		m_core->i_qbytes = nb % DB;
+		m_core->i_qvalid = 1;
+	}
+	// }}}
+
+	bool	done(void) {
+		return m_oframe >= m_frames.size();
+	}
+
+	// Reset the core, without sending it anything
+	void	reset(void) {
+		m_core->i_reset = 1;
+		TESTB<Vqoi_decoder>::tick();
+		m_core->i_reset = 0;
+	}
+
+	void	tick(void) {
+		// {{{
+		bool	iaccept, oaccept;
+
+		// Set our inputs for this cycle
+		// {{{
+		if (!m_core->i_qvalid && m_pos < m_stream.size()
+				&& (unsigned)(rand() % 100) >= m_gaps)
+			load();
+		m_core->m_ready = ((unsigned)(rand() % 100) >= m_backpressure);
+		eval();
+		// }}}
+
+		iaccept = m_core->i_qvalid && m_core->o_qready;
+		oaccept = m_core->m_valid && m_core->m_ready;
+		if (m_core->o_err)
+			m_szerrs++;
+
+		// Check the outputs
+		// {{{
+		if (oaccept && m_oframe < m_frames.size()) {
+			FRAMESTATS	*f = &m_frames[m_oframe];
+			const IMGFILE	*img = f->m_img;
+			// A frame ends at the last pixel of its header, even
+			// if its stream carries on
+			unsigned	npix = img->m_width * f->m_height;
+			bool		hlast, vlast;
+
+			hlast = ((m_pixel % img->m_width) + 1 >= img->m_width);
+			vlast = (m_pixel + img->m_width >= npix);
+
+			if (m_pixel == 0)
+				f->m_start = m_tickcount;
+			f->m_end = m_tickcount;
+			if ((m_core->m_data & PXMASK)
+					!= img->m_pixels[m_pixel]) {
+				if (f->m_errors == 0)
+					fprintf(stderr, "ERR: %s, pixel %d is 0x%06x, not 0x%06x\n",
+						f->m_name, m_pixel,
+						m_core->m_data & PXMASK,
+						img->m_pixels[m_pixel]);
+				f->m_errors++;
+			}
+
+			// By default, TUSER marks the end of a line, and TLAST
+			// the end of the frame
+			if (m_core->m_user != hlast
+					|| m_core->m_last != (hlast && vlast))
+				f->m_syncok = false;
+
+			m_last_activity = m_tickcount;
+			m_pixel++;
+			if (m_pixel >= npix) {
+				m_pixel = 0;
+				m_oframe++;
+			}
+		}
+		// }}}
+
+		TESTB<Vqoi_decoder>::tick();
+
+		// Step the input
+		// {{{
+		if (iaccept) {
+			unsigned nb = (m_core->i_qbytes == 0)
+						? DB : m_core->i_qbytes;
+
+			m_core->i_qvalid = 0;
+			m_last_activity = m_tickcount;
+			m_pos += nb;
+		}
+		// }}}
+	}
+	// }}}
+};
+
+static	void	usage(void) {
+	// {{{
+	fprintf(stderr,
+"USAGE: decoder_tb [-b pct] [-e] [-g pct] [-n count] [-s seed] [-t trace.vcd]\n"
+"\t\t[-x] image ...\n"
+"\n"
+"\t-b pct\tHolds m_ready low (backpressure) pct%% of the time\n"
+"\t-e\tGives every other frame a header one line short, and checks\n"
+"\t\tthat the decoder flags each of them\n"
+"\t-g pct\tLeaves pct%% of the input cycles idle\n"
+"\t-n cnt\tDecodes each image cnt times (default: 1)\n"
+"\t-s seed\tSeeds the random number generator\n"
+"\t-t file\tRecords a VCD trace of the simulation\n"
+"\t-x\tDamages the end marker of every other frame, and checks that\n"
+"\t\tthe decoder flags each, and finds the frame following\n");
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	DECODER_TB	*tb = new DECODER_TB;
+	std::vector<IMGFILE>	images;
+	const char	*trace = NULL;
+	unsigned	repeats = 1, seed = 1;
+	int		opt;
+	bool		fail = false, short_headers = false,
+			bad_trailers = false;
+
+	// Process arguments
+	// {{{
+	while((opt = getopt(argc, argv, "b:eg:n:s:t:xh")) != -1) {
+		switch(opt) {
+		case 'b': tb->m_backpressure = atoi(optarg); break;
+		case 'e': short_headers = true; break;
+		case 'g': tb->m_gaps = atoi(optarg); break;
+		case 'n': repeats = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 't': trace = optarg; break;
+		case 'x': bad_trailers = true; break;
+		default: usage(); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind >= argc || repeats < 1 || tb->m_gaps >= 100
+			|| tb->m_backpressure >= 100) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	images.resize(argc - optind);
+	for(int k=optind; k<argc; k++) {
+		IMGFILE	*img = &images[k-optind];
+
+		if (!load_image(argv[k], *img, ALPHA))
+			exit(EXIT_FAILURE);
+		if (img->m_width * img->m_height == 0) {
+			fprintf(stderr, "ERR: %s is empty\n", argv[k]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// }}}
+
+	// Compress each image, and build our stream of QOI files
+	// {{{
+	qoi::Encoder		encoder;
+	std::vector<uint8_t>	qf;
+	unsigned		expected_szerrs = 0;
+
+	encoder.alpha(ALPHA);
+	for(unsigned k=0; k<images.size(); k++) {
+		FRAMESTATS	f;
+
+		f.m_name = argv[optind+k];
+		f.m_img  = &images[k];
+		f.m_start = f.m_end = 0;
+		f.m_errors = 0;
+		f.m_syncok = true;
+
+		encoder.encode(images[k].m_width, images[k].m_height,
+				images[k].m_pixels.data(), qf);
+		f.m_bytes = qf.size();
+
+		for(unsigned r=0; r<repeats; r++) {
+			size_t	base = tb->m_stream.size();
+
+			tb->m_stream.insert(tb->m_stream.end(),
+						qf.begin(), qf.end());
+			bool	damaged = false;
+
+			f.m_height = images[k].m_height;
+			if (short_headers && (tb->m_frames.size() & 1)
+					&& f.m_height > 1) {
+				// The height is found, big endian, in bytes
+				// 8-11 of the header.  The frame should end
+				// a line early, and be flagged there.
+				f.m_height--;
+				for(unsigned b=0; b<4; b++)
+					tb->m_stream[base+8+b]
+						= f.m_height >> (24-8*b);
+				damaged = true;
+			}
+
+			if (bad_trailers && (tb->m_frames.size() & 1)) {
+				// Without its end marker, the frame should
+				// still end at the last pixel of its header
+				tb->m_stream[base + qf.size() - 1] = 0;
+				damaged = true;
+			}
+
+			if (damaged)
+				expected_szerrs++;
+			tb->m_frames.push_back(f);
+		}
+	}
+	// }}}
+
+	srand(seed);
+	if (trace)
+		tb->opentrace(trace);
+	tb->reset();
+
+	// Run the simulation
+	// {{{
+	while(!tb->done() && tb->m_tickcount - tb->m_last_activity < MAX_IDLE)
+		tb->tick();
+	if (!tb->done()) {
+		fprintf(stderr, "ERR: The decoder stopped producing pixels\n");
+		fail = true;
+	}
+
+	// Let any size error from the last pixel reach o_err
+	for(unsigned k=0; k<4; k++)
+		tb->tick();
+	if (tb->m_szerrs != expected_szerrs) {
+		fprintf(stderr, "ERR: %u size errors flagged, not %u\n",
+			tb->m_szerrs, expected_szerrs);
+		fail = true;
+	}
+	// }}}
+
+	// Report on each frame
+	// {{{
+	uint64_t	tpix = 0, tcycles = 0, tbytes = 0;
+
+	printf("%-24s %9s %9s %7s %9s %6s\n", "Image", "Size",
+		"Cycles", "Px/Clk", "Bytes", "Ratio");
+
+	for(unsigned k=0; k<tb->m_oframe; k++) {
+		const FRAMESTATS *f = &tb->m_frames[k];
+		const IMGFILE	*img = f->m_img;
+		uint64_t	npix, cycles;
+		char		sz[32];
+
+		if (f->m_errors > 0) {
+			fprintf(stderr, "ERR: %s, %d pixels differ\n",
+				f->m_name, f->m_errors);
+			fail = true;
+		} if (!f->m_syncok) {
+			fprintf(stderr, "ERR: %s, TLAST or TUSER is misplaced\n",
+				f->m_name);
+			fail = true;
+		}
+
+		npix   = (uint64_t)img->m_width * img->m_height;
+		cycles = f->m_end - f->m_start + 1;
+		snprintf(sz, sizeof(sz), "%dx%d", img->m_width, img->m_height);
+		printf("%-24s %9s %9lu %7.3f %9lu %5.1f%%\n", f->m_name, sz,
+			(unsigned long)cycles, npix / (double)cycles,
+			(unsigned long)f->m_bytes,
+			100.0 * f->m_bytes / ((double)NCHAN * npix));
+
+		tpix    += npix;
+		tcycles += cycles;
+		tbytes  += f->m_bytes;
+	}
+
+	if (tcycles > 0)
+		printf("%-24s %9s %9lu %7.3f %9lu %5.1f%%\n", "Total", "",
+			(unsigned long)tcycles, tpix / (double)tcycles,
+			(unsigned long)tbytes,
+			100.0 * tbytes / ((double)NCHAN * tpix));
+	// }}}
+
+	delete tb;
+
+	if (fail) {
+		printf("FAIL!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("SUCCESS!\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,526 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/decompress_tb.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A Verilator based, cycle accurate, test bench and throughput
+//		benchmark for the QOI decompressor.  Images, read from PPM or
+//	PNG files, are first compressed by the software model in sw/qoi.cpp.
+//	Their header and trailer are then removed, and the remaining code
+//	words are fed to the decompressor, one code word per beat, with
+//	optional random gaps between them.  Random backpressure may also be
+//	applied to the decompressor's pixel output.  Every pixel produced is
+//	checked against the original image, and TLAST must mark the last
+//	pixel of each frame.  The following statistics are reported for each
+//	frame:
+//
+//	- Cycles, from the first pixel produced to the last, and the
+//		decompressor's resulting throughput in pixels per clock
+//	- Bubbles, the number of cycles within the frame where no pixel was
+//		available, even though the word needed to produce it had
+//		already been offered
+//	- Code words, and their number per pixel
+//
+//	Without gaps or backpressure, the decompressor should produce one
+//	pixel per clock without any bubbles.
+//
+//	The -w option adds frames of worst case code words for the
+//	decompressor's table, built from random ops rather than images:
+//	INDEX words right after the words that wrote the entries they read,
+//	or two words after them, INDEX words back to back, INDEX words of
+//	empty entries, or of entries from the frame before, and short runs
+//	in between.  These are checked against the software decoder.  They
+//	should decompress without bubbles as well, with or without
+//	OPT_TBLREG.
+//
+//	Usage: decompress_tb [-b pct] [-g pct] [-n count] [-s seed]
+//			[-t trace.vcd] [-w count] image ...
+//
+//	-b pct	Holds m_ready low (backpressure) pct% of the time
+//	-g pct	Leaves pct% of the input cycles idle (gaps)
+//	-n cnt	Decompresses each image cnt times (default: 1)
+//	-s seed	Seeds the random number generator
+//	-t file	Records a VCD trace of the entire simulation
+//	-w cnt	Adds cnt frames of worst case table hazards
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "verilated.h"
+#include "Vqoi_decompress.h"
+#include "testb.h"
+#include "imgfile.h"
+#include "qoi.h"
+
+#define	MAX_IDLE	100000
+
+// Per frame state and statistics
+// {{{
+typedef	struct	FRAMESTATS_S {
+	const char	*m_name;
+	const IMGFILE	*m_img;
+	// The compressed frame, one 40-bit code word per entry
+	std::vector<uint64_t>	m_words;
+	uint64_t	m_start, m_end, m_bubbles;
+	unsigned	m_errors;
+	bool		m_lastok;
+} FRAMESTATS;
+// }}}
+
+// split_words
+// {{{
+// Break the body of a QOI frame (less its header and trailer) into code
+// words, with the first byte of each word in the MSBs of a 40-bit beat
+static	void	split_words(const uint8_t *data, size_t len,
+			std::vector<uint64_t> &words) {
+	size_t	pos = 0;
+
+	words.clear();
+	while(pos < len) {
+		unsigned	nb;
+		uint64_t	w = 0;
+
+		if (data[pos] == qoi::OP_RGB)
+			nb = 4;
+		else if (data[pos] == qoi::OP_RGBA)
+			nb = 5;
+		else if ((data[pos] & 0xc0) == qoi::OP_LUMA)
+			nb = 2;
+		else
+			nb = 1;
+
+		for(unsigned k=0; k<5; k++) {
+			w <<= 8;
+			if (k < nb && pos+k < len)
+				w |= data[pos+k];
+		}
+
+		words.push_back(w);
+		pos += nb;
+	}
+}
+// }}}
+
+// mkhazard
+// {{{
+// Builds one frame of nops random code words, chosen to stress the table's
+// forwarding logic, and returns it as QOI ops--less header or trailer.  A
+// software copy of the table is kept only to know which entries were
+// written last.  hist[] holds the hashes of the last two words written, and
+// carries over from one frame to the next, so that a frame may also start by
+// reading an entry last written by the frame before it.
+static	unsigned	ahash(uint32_t px) {
+	// As qoi::hash(), but with alpha (kept in the MSBs)
+	return (((px >> 16) & 0x0ff) * 3 + ((px >> 8) & 0x0ff) * 5
+			+ (px & 0x0ff) * 7 + (px >> 24) * 11) & 0x3f;
+}
+
+static	void	mkhazard(unsigned nops, unsigned hist[2],
+			std::vector<uint8_t> &ops, size_t &npix) {
+	uint32_t	tbl[64], px = 0xff000000;
+
+	memset(tbl, 0, sizeof(tbl));
+	ops.clear();
+	npix = 0;
+	for(unsigned k=0; k<nops; k++) {
+		unsigned	r = rand() % 16, h;
+		int		dr, dg, db;
+
+		npix++;
+		switch(r) {
+		case 0: case 1: case 2: case 3:	// INDEX, of the last write
+		case 4: case 5:			// or the one before it
+			h = hist[(r < 4) ? 0 : 1];
+			ops.push_back(qoi::OP_INDEX | h);
+			px = tbl[h];
+			break;
+		case 6:	// INDEX, of any entry, whether or not it's been written
+			h = rand() & 0x3f;
+			ops.push_back(qoi::OP_INDEX | h);
+			px = tbl[h];
+			break;
+		case 7: case 8: case 9:
+			// {{{
+			ops.push_back(qoi::OP_DIFF | (rand() & 0x3f));
+			dr = ((ops.back() >> 4) & 3) - 2;
+			dg = ((ops.back() >> 2) & 3) - 2;
+			db = ( ops.back()       & 3) - 2;
+			px = (px & 0xff000000)
+				| (((px >> 16) + dr) & 0x0ff) << 16
+				| (((px >>  8) + dg) & 0x0ff) << 8
+				| ((px + db) & 0x0ff);
+			break;
+			// }}}
+		case 10: case 11:
+			// {{{
+			ops.push_back(qoi::OP_LUMA | (rand() & 0x3f));
+			ops.push_back(rand() & 0x0ff);
+			dg = (ops[ops.size()-2] & 0x3f) - 32;
+			dr = dg + (ops.back() >> 4) - 8;
+			db = dg + (ops.back() & 0x0f) - 8;
+			px = (px & 0xff000000)
+				| (((px >> 16) + dr) & 0x0ff) << 16
+				| (((px >>  8) + dg) & 0x0ff) << 8
+				| ((px + db) & 0x0ff);
+			break;
+			// }}}
+		case 12:
+			// {{{
+			ops.push_back(qoi::OP_RGB);
+			px = (px & 0xff000000) | (rand() & 0x0ffffff);
+			for(int b=16; b>=0; b-=8)
+				ops.push_back((px >> b) & 0x0ff);
+			break;
+			// }}}
+		case 13:
+			// {{{
+			ops.push_back(qoi::OP_RGBA);
+			px = rand() & 0x0ffffff;
+			px |= (uint32_t)((rand() & 1) ? 0xff : (rand() & 0x0ff))
+					<< 24;
+			for(int b=16; b>=0; b-=8)
+				ops.push_back((px >> b) & 0x0ff);
+			ops.push_back(px >> 24);
+			break;
+			// }}}
+		default:	// A short run, of one to four pixels
+			ops.push_back(qoi::OP_RUN | (rand() & 3));
+			npix += ops.back() & 3;
+			break;
+		}
+
+		tbl[ahash(px)] = px;
+		hist[1] = hist[0];
+		hist[0] = ahash(px);
+	}
+}
+// }}}
+
+class	DECOMPRESS_TB : public TESTB<Vqoi_decompress> {
+public:
+	unsigned	m_backpressure, m_gaps;
+
+	std::vector<FRAMESTATS>	m_frames;
+	// Input side: the next word to be sent
+	unsigned	m_frame, m_word;
+	// Output side: the next pixel expected
+	unsigned	m_oframe, m_pixel;
+	uint64_t	m_last_activity;
+
+	DECOMPRESS_TB(void) : m_backpressure(0), m_gaps(0), m_frame(0),
+			m_word(0), m_oframe(0), m_pixel(0),
+			m_last_activity(0) {
+		m_core->s_valid = 0;
+		m_core->m_ready = 1;
+	}
+
+	bool	done(void) {
+		return m_oframe >= m_frames.size();
+	}
+
+	// Reset the core, without sending it anything
+	void	reset(void) {
+		m_core->i_reset = 1;
+		TESTB<Vqoi_decompress>::tick();
+		m_core->i_reset = 0;
+	}
+
+	void	tick(void) {
+		// {{{
+		bool	iaccept, oaccept;
+
+		// Set our inputs for this cycle
+		// {{{
+		if (!m_core->s_valid && m_frame < m_frames.size()
+				&& (unsigned)(rand() % 100) >= m_gaps) {
+			const FRAMESTATS *f = &m_frames[m_frame];
+
+			m_core->s_data  = f->m_words[m_word];
+			m_core->s_last  = (m_word + 1 >= f->m_words.size());
+			m_core->s_valid = 1;
+		}
+		m_core->m_ready = ((unsigned)(rand() % 100) >= m_backpressure);
+		eval();
+		// }}}
+
+		iaccept = m_core->s_valid && m_core->s_ready;
+		oaccept = m_core->m_valid && m_core->m_ready;
+
+		// Check the outputs
+		// {{{
+		if (m_oframe < m_frames.size()) {
+			FRAMESTATS	*f = &m_frames[m_oframe];
+			const IMGFILE	*img = f->m_img;
+			unsigned	npix = img->m_width * img->m_height;
+
+			if (oaccept) {
+				bool	last = (m_pixel + 1 >= npix);
+
+				if (m_pixel == 0)
+					f->m_start = m_tickcount;
+				f->m_end = m_tickcount;
+				if ((m_core->m_data & 0x0ffffff)
+						!= img->m_pixels[m_pixel]) {
+					if (f->m_errors == 0)
+						fprintf(stderr, "ERR: %s, pixel %d is 0x%06x, not 0x%06x\n",
+							f->m_name, m_pixel,
+							m_core->m_data & 0x0ffffff,
+							img->m_pixels[m_pixel]);
+					f->m_errors++;
+				}
+				if (m_core->m_last != last)
+					f->m_lastok = false;
+				m_last_activity = m_tickcount;
+				m_pixel++;
+				if (last) {
+					m_pixel = 0;
+					m_oframe++;
+				}
+			} else if (!m_core->m_valid && m_pixel > 0
+					&& (m_frame > m_oframe
+					|| m_core->s_valid))
+				// Once a frame has started, count every cycle
+				// it could have produced a pixel but didn't--
+				// so long as we weren't waiting on the input
+				f->m_bubbles++;
+		}
+		// }}}
+
+		TESTB<Vqoi_decompress>::tick();
+
+		// Step the input
+		// {{{
+		if (iaccept) {
+			m_core->s_valid = 0;
+			m_last_activity = m_tickcount;
+			m_word++;
+			if (m_word >= m_frames[m_frame].m_words.size()) {
+				m_word = 0;
+				m_frame++;
+			}
+		}
+		// }}}
+	}
+	// }}}
+};
+
+static	void	usage(void) {
+	// {{{
+	fprintf(stderr,
+"USAGE: decompress_tb [-b pct] [-g pct] [-n count] [-s seed] [-t trace.vcd]\n"
+"\t\t[-w count] image ...\n"
+"\n"
+"\t-b pct\tHolds m_ready low (backpressure) pct%% of the time\n"
+"\t-g pct\tLeaves pct%% of the input cycles idle\n"
+"\t-n cnt\tDecompresses each image cnt times (default: 1)\n"
+"\t-s seed\tSeeds the random number generator\n"
+"\t-t file\tRecords a VCD trace of the simulation\n"
+"\t-w cnt\tAdds cnt frames of worst case table hazards\n");
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	DECOMPRESS_TB	*tb = new DECOMPRESS_TB;
+	std::vector<IMGFILE>	images, hazards;
+	std::vector<std::string>	hnames;
+	const char	*trace = NULL;
+	unsigned	repeats = 1, seed = 1, nhazards = 0;
+	int		opt;
+	bool		fail = false;
+
+	// Process arguments
+	// {{{
+	while((opt = getopt(argc, argv, "b:g:n:s:t:w:h")) != -1) {
+		switch(opt) {
+		case 'b': tb->m_backpressure = atoi(optarg); break;
+		case 'g': tb->m_gaps = atoi(optarg); break;
+		case 'n': repeats = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 't': trace = optarg; break;
+		case 'w': nhazards = atoi(optarg); break;
+		default: usage(); exit(EXIT_FAILURE);
+		}
+	}
+
+	if ((optind >= argc && nhazards == 0) || repeats < 1 || tb->m_gaps >= 100
+			|| tb->m_backpressure >= 100) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	images.resize(argc - optind);
+	for(int k=optind; k<argc; k++) {
+		IMGFILE	*img = &images[k-optind];
+
+		if (!load_image(argv[k], *img))
+			exit(EXIT_FAILURE);
+		if (img->m_width * img->m_height == 0) {
+			fprintf(stderr, "ERR: %s is empty\n", argv[k]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// }}}
+
+	// Compress each image, and build our list of frames
+	// {{{
+	qoi::Encoder		encoder;
+	std::vector<uint8_t>	qf;
+
+	for(unsigned k=0; k<images.size(); k++) {
+		FRAMESTATS	f;
+
+		f.m_name = argv[optind+k];
+		f.m_img  = &images[k];
+		f.m_start = f.m_end = f.m_bubbles = 0;
+		f.m_errors = 0;
+		f.m_lastok = true;
+
+		// Strip the 14 byte header and 8 byte trailer
+		encoder.encode(images[k].m_width, images[k].m_height,
+				images[k].m_pixels.data(), qf);
+		split_words(&qf[14], qf.size() - 14 - 8, f.m_words);
+
+		for(unsigned r=0; r<repeats; r++)
+			tb->m_frames.push_back(f);
+	}
+	// }}}
+
+	srand(seed);
+
+	// Then add any worst case frames, checked against the software decoder
+	// {{{
+	qoi::Decoder	decoder;
+	unsigned	hist[2] = { 0, 0 };
+
+	hazards.resize(nhazards);
+	hnames.resize(nhazards);
+	for(unsigned k=0; k<nhazards; k++) {
+		FRAMESTATS	f;
+		size_t		npix;
+
+		mkhazard(4096, hist, qf, npix);
+		if (decoder.decompress(qf.data(), qf.size(), npix,
+					hazards[k].m_pixels) != qf.size()) {
+			fprintf(stderr, "ERR: Hazard frame %d, %s\n", k,
+				decoder.error());
+			exit(EXIT_FAILURE);
+		}
+		hazards[k].m_width  = npix;
+		hazards[k].m_height = 1;
+		hnames[k] = "hazard-" + std::to_string(k);
+
+		f.m_name = hnames[k].c_str();
+		f.m_img  = &hazards[k];
+		f.m_start = f.m_end = f.m_bubbles = 0;
+		f.m_errors = 0;
+		f.m_lastok = true;
+		split_words(qf.data(), qf.size(), f.m_words);
+		tb->m_frames.push_back(f);
+	}
+	// }}}
+
+	if (trace)
+		tb->opentrace(trace);
+	tb->reset();
+
+	// Run the simulation
+	// {{{
+	while(!tb->done() && tb->m_tickcount - tb->m_last_activity < MAX_IDLE)
+		tb->tick();
+	if (!tb->done()) {
+		fprintf(stderr, "ERR: The decompressor stopped producing pixels\n");
+		fail = true;
+	}
+	// }}}
+
+	// Report on each frame
+	// {{{
+	uint64_t	tpix = 0, tcycles = 0, tbubbles = 0, twords = 0;
+
+	printf("%-24s %9s %9s %7s %8s %9s %6s\n", "Image", "Size",
+		"Cycles", "Px/Clk", "Bubbles", "Words", "Wd/Px");
+
+	for(unsigned k=0; k<tb->m_oframe; k++) {
+		const FRAMESTATS *f = &tb->m_frames[k];
+		const IMGFILE	*img = f->m_img;
+		uint64_t	npix, cycles, nwords;
+		char		sz[32];
+
+		if (f->m_errors > 0) {
+			fprintf(stderr, "ERR: %s, %d pixels differ\n",
+				f->m_name, f->m_errors);
+			fail = true;
+		} if (!f->m_lastok) {
+			fprintf(stderr, "ERR: %s, TLAST is misplaced\n",
+				f->m_name);
+			fail = true;
+		}
+
+		npix   = (uint64_t)img->m_width * img->m_height;
+		cycles = f->m_end - f->m_start + 1;
+		nwords = f->m_words.size();
+		snprintf(sz, sizeof(sz), "%dx%d", img->m_width, img->m_height);
+		printf("%-24s %9s %9lu %7.3f %8lu %9lu %6.3f\n", f->m_name, sz,
+			(unsigned long)cycles, npix / (double)cycles,
+			(unsigned long)f->m_bubbles, (unsigned long)nwords,
+			nwords / (double)npix);
+
+		tpix     += npix;
+		tcycles  += cycles;
+		tbubbles += f->m_bubbles;
+		twords   += nwords;
+	}
+
+	if (tcycles > 0)
+		printf("%-24s %9s %9lu %7.3f %8lu %9lu %6.3f\n", "Total", "",
+			(unsigned long)tcycles, tpix / (double)tcycles,
+			(unsigned long)tbubbles, (unsigned long)twords,
+			twords / (double)tpix);
+	// }}}
+
+	delete tb;
+
+	if (fail) {
+		printf("FAIL!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("SUCCESS!\n");
+	exit(EXIT_SUCCESS);
+}
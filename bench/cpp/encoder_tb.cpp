@@ -0,0 +1,1034 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/encoder_tb.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A Verilator based, cycle accurate, test bench and throughput
+//		benchmark for the QOI encoder.  Images, read from PPM or PNG
+//	files, are streamed through the encoder's AXI video stream input, with
+//	optional random gaps between pixels.  Random backpressure may also be
+//	applied to the encoder's output.  Every compressed frame is then
+//	checked, byte for byte, against the software model of the encoder in
+//	sw/qoi.cpp, as well as decoded and checked against the original image.
+//	The following statistics are reported for each frame:
+//
+//	- Cycles, from the first pixel accepted to the last, and the encoder's
+//		resulting throughput in pixels per clock
+//	- Stalls, the number of cycles where a pixel was offered but not
+//		accepted
+//	- Compressed bytes, both in total and as a percentage of the 24-bit
+//		(32-bit, with ALPHA) uncompressed image size
+//
+//	When built with ALPHA, the encoder is expected to have OPT_ALPHA set.
+//	Images are then read with their alpha channels (if any), and checked
+//	as four channel images.
+//
+//	The compressor's pipeline occupancy, from its OPT_PERFCOUNTERS
+//	counters, is then reported for each of its stages: the fraction of
+//	clocks each stage spent moving, stalled, or idle, summed across all
+//	measured frames.  Output stalls come from backpressure (i_qready),
+//	while stalls upstream of a moving output come from gaps in the video.
+//	The rate of each stage is the number of items it passed on per clock
+//	that it held one, moving/(moving+stalled).  Without backpressure, the
+//	encoder's output packer takes one QOI op every clock, no matter how the
+//	ops straddle bus words, so the output's rate falls short of 1.000 only
+//	by the few clocks the first op of each frame waits on the header.
+//
+//	The encoder needs one frame to synchronize, and takes its header size
+//	from the frame prior, so each image is sent once to warm the encoder
+//	up before it is measured.
+//
+//	With -r, each image is also sent once more, before it is measured,
+//	with i_restart (OPT_FASTSTART) raised half way down.  The frame in
+//	progress is cut short and discarded, and the frame that follows must
+//	then match the model's encoding of the rest of the image.
+//
+//	With -d, delta frames (OPT_DELTA) are enabled, and each image is
+//	followed by four more frames: the same image again, then with a few
+//	lines changed, then the original once more--all three of which must
+//	be delta frames--and finally the original with a key frame requested.
+//	Every frame is compared against the model, also with delta frames
+//	enabled, and decoded from the frame before it.
+//
+//	With -a, pixels are predicted from the line above (OPT_ABOVE), and
+//	every frame, now a "qoiv" frame, is compared against the model doing
+//	the same.  This can't be combined with -d.
+//
+//	With -c or -k, the encoder (OPT_CROP) keeps only a rectangle of each
+//	image, and/or only one of every so many pixels, lines, or frames.
+//	The model is then given only the pixels that were kept.  When frames
+//	are skipped, each frame is sent that many more times, so that the
+//	same frames as before are kept and checked.
+//
+//	With -u, the encoder (OPT_BUDGET) is given a line and/or frame
+//	budget.  Frames the budget degrades can no longer match the model, so
+//	they need only decode to an image of the right size.  Every frame
+//	must then stay within its frame budget, plus the slack documented in
+//	rtl/qoi_encoder.v.  o_overrun may only be raised for a frame that
+//	used up its budget, and must be for any frame that ran over by more
+//	than the ops within the compressor.  o_quant may only step by one
+//	level at a time, and must have been raised for any frame that ran
+//	over its line budget by more than those same ops.
+//
+//	Usage: encoder_tb [-a] [-b pct] [-c x,y,w,h] [-d] [-g pct]
+//			[-k px,ln,frm] [-n count] [-r] [-s seed]
+//			[-u line,frame] [-o file.qoi] [-t trace.vcd] image ...
+//
+//	-a	Predicts pixels from the line above.  Requires OPT_ABOVE and
+//		PPC == 1
+//	-b pct	Holds i_qready low (backpressure) pct% of the time
+//	-c x,y,w,h  Crops each image to the w by h rectangle at x,y.  A
+//		width or height of zero extends it to the edge of the image.
+//		Requires OPT_CROP and PPC == 1
+//	-d	Checks delta frames.  Requires OPT_DELTA, PPC == 1, and no
+//		ALPHA
+//	-g pct	Leaves pct% of the input cycles idle (gaps)
+//	-k px,ln,frm  Keeps one of every px+1 pixels, ln+1 lines, and frm+1
+//		frames.  Requires OPT_CROP and PPC == 1.  Skipping frames can't
+//		be combined with -d or -r
+//	-n cnt	Measures each image cnt times (default: 1)
+//	-r	Checks a fast start (restart) part way through each image.
+//		Requires OPT_FASTSTART
+//	-s seed	Seeds the random number generator
+//	-u line,frame  Sets the line budget, in bytes per line, and the frame
+//		budget, in bytes per frame.  Either may be zero, to disable
+//		it.  A frame budget must otherwise be at least 64 bytes.
+//		Requires OPT_BUDGET, and can't be combined with -d, -r, or
+//		skipping frames
+//	-o file	Writes every measured QOI frame to this file, one after
+//		the other
+//	-t file	Records a VCD trace of the entire simulation
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "verilated.h"
+#include "Vqoi_encoder.h"
+#include "testb.h"
+#include "imgfile.h"
+#include "qoi.h"
+
+// These must match the parameters the encoder was Verilated with
+#ifndef	DW
+#define	DW	64
+#endif
+#ifndef	PPC
+#define	PPC	1
+#endif
+#ifndef	ALPHA
+#define	ALPHA	0
+#endif
+
+// As must the encoder's options.  rtl/Makefile turns these on by default
+#ifndef	OPT_FASTSTART
+#define	OPT_FASTSTART	1
+#endif
+#ifndef	OPT_DELTA
+#define	OPT_DELTA	1
+#endif
+#ifndef	OPT_CROP
+#define	OPT_CROP	1
+#endif
+#ifndef	OPT_ABOVE
+#define	OPT_ABOVE	1
+#endif
+#ifndef	OPT_BUDGET
+#define	OPT_BUDGET	1
+#endif
+#ifndef	LGINFIFO
+#define	LGINFIFO	0
+#endif
+
+#if	(ALPHA && PPC > 1)
+#error "OPT_ALPHA is only supported with one pixel per clock"
+#endif
+
+// Delta frames require one pixel per clock, and no alpha
+#define	DELTA		(OPT_DELTA && (PPC == 1) && !ALPHA)
+// Cropping and decimation require one pixel per clock
+#define	CROP		(OPT_CROP && (PPC == 1))
+// As does prediction from the line above
+#define	ABOVE		(OPT_ABOVE && (PPC == 1))
+
+#define	DB		(DW/8)
+#define	NCHAN		((ALPHA) ? 4 : 3)
+#define	MAX_IDLE	100000
+// Occupancy counters: a clock count, then moving and stalled counts for
+// each of the compressor's pipeline stages, first stage first
+#define	NPERF		13
+#define	NSTAGES		((NPERF-1)/2)
+// Every frame has a 14 byte header and an 8 byte trailer
+#define	HDRBYTES	14
+#define	TRLBYTES	8
+// The budget's slack, as rtl/qoi_encoder.v documents it: the ops of up to
+// BUDGET_BEATS beats of pixels may be within the compressor when a frame
+// runs out of budget, at up to five bytes a pixel
+#define	BUDGET_BEATS	((1 << LGINFIFO) + 7)
+#define	BUDGET_SLACK	(BUDGET_BEATS * 5 * PPC)
+// The smallest frame budget that's checked.  Any smaller, and the frame
+// may run out of budget before the last one has left the output packer
+#define	MIN_BUDGET	64
+
+typedef	std::vector<uint8_t>	QOIFRAME;
+typedef	struct	{ uint32_t m_count[NPERF]; } PERFCOUNTS;
+
+// Per frame statistics
+// {{{
+typedef	struct	FRAMESTATS_S {
+	const char	*m_name;
+	const IMGFILE	*m_img;
+	bool		m_measured, m_restart, m_keyframe;
+	// True for the extra copies of a frame the encoder is to skip
+	bool		m_skipped;
+	// The pixels the encoder should keep from m_img
+	const IMGFILE	*m_model;
+	// The line the encoder restarted after, or -1 if it didn't
+	int		m_cut;
+	// The magic number this frame must have with -d, if any
+	const char	*m_magic;
+	// True if the budget may have quantized, or repeated, any of this
+	// frame's pixels
+	bool		m_quantized, m_overran;
+	uint64_t	m_start, m_end, m_stalls;
+} FRAMESTATS;
+// }}}
+
+// Cropping and decimation
+// {{{
+typedef	struct	CROPSPEC_S {
+	unsigned	m_x, m_y, m_w, m_h, m_skipx, m_skipy, m_skipf;
+} CROPSPEC;
+
+static	CROPSPEC	crop = { 0, 0, 0, 0, 0, 0, 0 };
+
+static	bool	kept(unsigned pos, unsigned start, unsigned len, unsigned skip) {
+	return pos >= start && (len == 0 || pos < start + len)
+					&& (pos - start) % (skip + 1) == 0;
+}
+
+// The number of lines kept, of lines zero through y of the incoming frame
+static	unsigned kept_lines(int y) {
+	unsigned	n = 0;
+
+	for(int k=0; k<=y; k++)
+		if (kept(k, crop.m_y, crop.m_h, crop.m_skipy))
+			n++;
+	return n;
+}
+
+// The incoming line holding kept line j
+static	unsigned source_line(unsigned j) {
+	return crop.m_y + j * (crop.m_skipy + 1);
+}
+
+// Select the pixels the encoder should keep
+static	void	crop_image(const IMGFILE &src, IMGFILE &dst) {
+	dst.m_width = dst.m_height = 0;
+	dst.m_pixels.clear();
+	for(unsigned y=0; y<src.m_height; y++) {
+		if (!kept(y, crop.m_y, crop.m_h, crop.m_skipy))
+			continue;
+		dst.m_height++;
+		dst.m_width = 0;
+		for(unsigned x=0; x<src.m_width; x++) {
+			if (!kept(x, crop.m_x, crop.m_w, crop.m_skipx))
+				continue;
+			dst.m_width++;
+			dst.m_pixels.push_back(src.m_pixels[
+					(size_t)y * src.m_width + x]);
+		}
+	}
+}
+// }}}
+
+class	ENCODER_TB : public TESTB<Vqoi_encoder> {
+public:
+	unsigned	m_backpressure, m_gaps;
+
+	// Input side: the frames still to be sent
+	std::vector<FRAMESTATS>	m_frames;
+	unsigned	m_frame, m_x, m_y;
+	bool		m_restarted, m_keyreq;
+
+	// Output side: the frames the encoder has produced, the
+	// compressor's occupancy counts for each, and whether o_overrun was
+	// raised during each
+	std::vector<QOIFRAME>	m_qframes;
+	std::vector<PERFCOUNTS>	m_qperf;
+	std::vector<bool>	m_qoverrun;
+	QOIFRAME	m_packet;
+	uint64_t	m_last_activity;
+
+	// The budget's outputs, as of the last clock, and whether o_quant
+	// ever jumped more than one level
+	unsigned	m_quant;
+	bool		m_overrun, m_overrun_rose, m_quant_jumped;
+
+	ENCODER_TB(void) : m_backpressure(0), m_gaps(0), m_frame(0),
+			m_x(0), m_y(0), m_restarted(false), m_keyreq(false),
+			m_last_activity(0), m_quant(0), m_overrun(false),
+			m_overrun_rose(false), m_quant_jumped(false) {
+		m_core->s_valid  = 0;
+		m_core->i_qready = 1;
+		m_core->i_restart = 0;
+		m_core->i_delta = 0;
+		m_core->i_keyframe = 0;
+		m_core->i_keyint = 0;
+		m_core->i_above = 0;
+		m_core->i_crop_x = 0;
+		m_core->i_crop_y = 0;
+		m_core->i_crop_w = 0;
+		m_core->i_crop_h = 0;
+		m_core->i_skip_x = 0;
+		m_core->i_skip_y = 0;
+		m_core->i_skip_frames = 0;
+		m_core->i_line_budget = 0;
+		m_core->i_frame_budget = 0;
+	}
+
+	// set_data
+	// {{{
+	// Place pixel k of the current beat into the s_data word.  The first
+	// pixel of each beat goes into the MSBs.
+	void	set_data(unsigned k, uint32_t px) {
+#if	(PPC <= 1)
+		m_core->s_data = px;
+#elif	(PPC <= 2)
+		unsigned	pos = 24*(PPC-1-k);
+
+		m_core->s_data &= ~(0x0ffffffUL << pos);
+		m_core->s_data |= (uint64_t)px << pos;
+#else
+		unsigned	pos = 24*(PPC-1-k);
+
+		for(unsigned b=0; b<24; b++) {
+			unsigned	w = (pos+b) / 32, s = (pos+b) % 32;
+
+			m_core->s_data[w] &= ~(1u << s);
+			m_core->s_data[w] |= ((px >> b) & 1) << s;
+		}
+#endif
+	}
+	// }}}
+
+	// out_byte
+	// {{{
+	// Return byte k of o_qdata, where byte zero is the first byte in the
+	// stream, found in the MSBs
+	uint8_t	out_byte(unsigned k) {
+		unsigned	pos = DW-8-8*k;
+#if	(DW <= 64)
+		return (uint8_t)(m_core->o_qdata >> pos);
+#else
+		return (uint8_t)(m_core->o_qdata[pos/32] >> (pos%32));
+#endif
+	}
+	// }}}
+
+	// perf
+	// {{{
+	// Return the occupancy counters, o_perf, as of the end of the last
+	// frame to leave the compressor.  The clock count is in the MSBs.
+	PERFCOUNTS	perf(void) {
+		PERFCOUNTS	p;
+
+		for(unsigned k=0; k<NPERF; k++)
+			p.m_count[k] = m_core->o_perf[NPERF-1-k];
+		return p;
+	}
+	// }}}
+
+	// load
+	// {{{
+	// Load the next beat of video into the core's input.  Following the
+	// encoder's default (OPT_TUSER_IS_SOF == 0) convention, TUSER marks
+	// the last pixel in a line and TLAST the last pixel in a frame.
+	void	load(void) {
+		const IMGFILE	*img = m_frames[m_frame].m_img;
+		bool		hlast, vlast;
+
+		for(unsigned k=0; k<PPC; k++)
+			set_data(k, img->m_pixels[m_y*img->m_width+m_x+k]);
+
+		hlast = (m_x + PPC >= img->m_width);
+		vlast = (m_y + 1 >= img->m_height);
+		m_core->s_user = hlast;
+		m_core->s_last = hlast && vlast;
+		m_core->s_valid = 1;
+	}
+	// }}}
+
+	bool	done(void) {
+		return m_frame >= m_frames.size() && !m_core->s_valid;
+	}
+
+	// Reset the core, without sending it anything
+	void	reset(void) {
+		m_core->i_reset = 1;
+		TESTB<Vqoi_encoder>::tick();
+		m_core->i_reset = 0;
+	}
+
+	void	tick(void) {
+		// {{{
+		bool	iaccept, oaccept, olast = false;
+
+		// Set our inputs for this cycle
+		// {{{
+		if (!m_core->s_valid && m_frame < m_frames.size()
+				&& (unsigned)(rand() % 100) >= m_gaps)
+			load();
+		m_core->i_qready = ((unsigned)(rand() % 100) >= m_backpressure);
+
+		// Request a restart half way through, once per frame
+		m_core->i_restart = 0;
+		if (m_frame < m_frames.size() && m_frames[m_frame].m_restart
+				&& !m_restarted && m_x == 0
+				&& m_y == source_line(
+				(m_frames[m_frame].m_model->m_height-1)/2)) {
+			m_core->i_restart = 1;
+			m_restarted = true;
+		}
+
+		// Request a key frame (below) once the frame before it has
+		// started to leave, and so can no longer be affected
+		m_core->i_keyframe = m_keyreq;
+		m_keyreq = false;
+		eval();
+		// }}}
+
+		// Sample the handshakes before the clock edge
+		// {{{
+		iaccept = m_core->s_valid && m_core->s_ready;
+		if (m_core->s_valid && !m_core->s_ready)
+			m_frames[m_frame].m_stalls++;
+		if (m_core->o_restarted)
+			m_frames[m_frame].m_cut = m_y;
+
+		// The budget degrades whatever pixels enter the compressor
+		// while it's active.  These may belong to any frame from the
+		// one being sent back to the oldest that hasn't yet left.
+		if (m_core->o_quant != m_quant) {
+			unsigned	quant = m_core->o_quant;
+
+			if (quant + 1 != m_quant && quant != m_quant + 1)
+				m_quant_jumped = true;
+			m_quant = quant;
+		}
+		if (m_core->o_overrun && !m_overrun)
+			m_overrun_rose = true;
+		m_overrun = m_core->o_overrun;
+		if (m_quant != 0 || m_overrun) {
+			for(unsigned k=m_qframes.size()+1; k<=m_frame
+					&& k<m_frames.size(); k++) {
+				if (m_quant != 0)
+					m_frames[k].m_quantized = true;
+				if (m_overrun)
+					m_frames[k].m_overran = true;
+			}
+		}
+
+		oaccept = m_core->o_qvalid && m_core->i_qready;
+		if (oaccept) {
+			unsigned nb = (m_core->o_qbytes == 0)
+						? DB : m_core->o_qbytes;
+
+			// Frame k produces compressed frame k-1, so this
+			// starts the frame before k = m_qframes.size()+2.
+			// (The first frame is always a key frame anyway.)
+			if (m_packet.empty() && m_qframes.size()+2
+							< m_frames.size()
+					&& m_frames[m_qframes.size()+2]
+							.m_keyframe)
+				m_keyreq = true;
+
+			for(unsigned k=0; k<nb; k++)
+				m_packet.push_back(out_byte(k));
+			olast = m_core->o_qlast;
+			m_last_activity = m_tickcount;
+		}
+		// }}}
+
+		TESTB<Vqoi_encoder>::tick();
+
+		// Step the input
+		// {{{
+		if (iaccept) {
+			FRAMESTATS	*f = &m_frames[m_frame];
+
+			if (m_x == 0 && m_y == 0)
+				f->m_start = m_tickcount;
+			f->m_end = m_tickcount;
+			m_core->s_valid = 0;
+			m_last_activity = m_tickcount;
+
+			m_x += PPC;
+			if (m_x >= f->m_img->m_width) {
+				m_x = 0;
+				m_y++;
+				if (m_y >= f->m_img->m_height) {
+					m_y = 0;
+					m_frame++;
+					m_restarted = false;
+				}
+			}
+		}
+		// }}}
+
+		if (olast) {
+			m_qframes.push_back(m_packet);
+			m_qperf.push_back(perf());
+			m_qoverrun.push_back(m_overrun_rose);
+			m_overrun_rose = false;
+			m_packet.clear();
+		}
+	}
+	// }}}
+};
+
+// restarted
+// {{{
+// The number of lines kept before the encoder restarted.  When cropping, the
+// last pixel of each line is held back until the next pixel is kept, so the
+// restart is only seen once the line after the cut has started.
+static	unsigned cut_lines(const FRAMESTATS &f) {
+	return kept_lines((CROP) ? f.m_cut - 1 : f.m_cut);
+}
+
+// True if the encoder restarted part way through this frame, and so split
+// it in two.  No split is made if the restart came in its last (kept) line.
+static	bool	restarted(const FRAMESTATS &f) {
+	return f.m_cut >= 0 && cut_lines(f) > 0
+				&& cut_lines(f) < f.m_model->m_height;
+}
+
+static	unsigned restarts(const std::vector<FRAMESTATS> &frames) {
+	unsigned	n = 0;
+
+	for(unsigned k=0; k<frames.size(); k++)
+		if (restarted(frames[k]))
+			n++;
+	return n;
+}
+// }}}
+
+// The number of frames the encoder keeps
+static	unsigned unskipped(const std::vector<FRAMESTATS> &frames) {
+	unsigned	n = 0;
+
+	for(unsigned k=0; k<frames.size(); k++)
+		if (!frames[k].m_skipped)
+			n++;
+	return n;
+}
+
+static	void	usage(void) {
+	// {{{
+	fprintf(stderr,
+"USAGE: encoder_tb [-a] [-b pct] [-c x,y,w,h] [-d] [-g pct] [-k px,ln,frm]\n"
+"\t\t[-n count] [-r] [-s seed] [-u line,frame] [-o file.qoi]\n"
+"\t\t[-t trace.vcd] image ...\n"
+"\n"
+"\t-a\tPredicts pixels from the line above\n"
+"\t-b pct\tHolds i_qready low (backpressure) pct%% of the time\n"
+"\t-c x,y,w,h  Crops each image to the w by h rectangle at x,y\n"
+"\t-d\tChecks delta frames\n"
+"\t-g pct\tLeaves pct%% of the input cycles idle\n"
+"\t-k px,ln,frm  Keeps one of every px+1 pixels, ln+1 lines, frm+1 frames\n"
+"\t-n cnt\tMeasures each image cnt times (default: 1)\n"
+"\t-r\tChecks a fast start (restart) part way through each image\n"
+"\t-s seed\tSeeds the random number generator\n"
+"\t-u line,frame  Sets the line and frame budgets, in bytes\n"
+"\t-o file\tWrites all measured QOI frames to this file\n"
+"\t-t file\tRecords a VCD trace of the simulation\n");
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	ENCODER_TB	*tb = new ENCODER_TB;
+	std::vector<IMGFILE>	images, changed, cimages, cchanged;
+	std::vector<std::string>	dnames;
+	const char	*outfname = NULL, *trace = NULL;
+	unsigned	repeats = 1, seed = 1, nrestarts = 0, ndeltas = 0,
+			line_budget = 0, frame_budget = 0, noverruns = 0,
+			nquantized = 0;
+	int		opt;
+	bool		fail = false, restart = false, delta = false,
+			cropped = false, above = false, budget = false;
+
+	// Process arguments
+	// {{{
+	while((opt = getopt(argc, argv, "ab:c:dg:k:n:rs:u:o:t:h")) != -1) {
+		switch(opt) {
+		case 'a': above = true; break;
+		case 'b': tb->m_backpressure = atoi(optarg); break;
+		case 'c':
+			if (sscanf(optarg, "%u,%u,%u,%u", &crop.m_x, &crop.m_y,
+					&crop.m_w, &crop.m_h) != 4) {
+				usage(); exit(EXIT_FAILURE);
+			} cropped = true; break;
+		case 'd': delta = true; break;
+		case 'g': tb->m_gaps = atoi(optarg); break;
+		case 'k':
+			if (sscanf(optarg, "%u,%u,%u", &crop.m_skipx,
+					&crop.m_skipy, &crop.m_skipf) != 3
+					|| crop.m_skipx > 255
+					|| crop.m_skipy > 255
+					|| crop.m_skipf > 255) {
+				usage(); exit(EXIT_FAILURE);
+			} cropped = true; break;
+		case 'n': repeats = atoi(optarg); break;
+		case 'r': restart = true; break;
+		case 's': seed = atoi(optarg); break;
+		case 'u':
+			if (sscanf(optarg, "%u,%u", &line_budget,
+					&frame_budget) != 2
+					|| line_budget > 0x0ffff
+					|| (frame_budget != 0
+					&& frame_budget < MIN_BUDGET)) {
+				usage(); exit(EXIT_FAILURE);
+			} budget = true; break;
+		case 'o': outfname = optarg; break;
+		case 't': trace = optarg; break;
+		default: usage(); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind >= argc || repeats < 1 || tb->m_gaps >= 100
+			|| tb->m_backpressure >= 100 || (delta && restart)
+			|| (delta && above)
+			|| (crop.m_skipf > 0 && (delta || restart))
+			|| (budget && (delta || restart || crop.m_skipf > 0))) {
+		usage();
+		exit(EXIT_FAILURE);
+	} else if (budget && !OPT_BUDGET) {
+		fprintf(stderr, "ERR: Budgets require OPT_BUDGET\n");
+		exit(EXIT_FAILURE);
+	} else if (restart && !OPT_FASTSTART) {
+		fprintf(stderr, "ERR: Restarts require OPT_FASTSTART\n");
+		exit(EXIT_FAILURE);
+	} else if (delta && !DELTA) {
+		fprintf(stderr, "ERR: Delta frames require OPT_DELTA, PPC=1, and no ALPHA\n");
+		exit(EXIT_FAILURE);
+	} else if (cropped && !CROP) {
+		fprintf(stderr, "ERR: Cropping requires OPT_CROP and PPC=1\n");
+		exit(EXIT_FAILURE);
+	} else if (above && !ABOVE) {
+		fprintf(stderr, "ERR: Prediction from the line above requires OPT_ABOVE and PPC=1\n");
+		exit(EXIT_FAILURE);
+	}
+
+	images.resize(argc - optind);
+	for(int k=optind; k<argc; k++) {
+		IMGFILE	*img = &images[k-optind];
+
+		if (!load_image(argv[k], *img, ALPHA))
+			exit(EXIT_FAILURE);
+		if (img->m_width % PPC) {
+			fprintf(stderr, "ERR: %s: Width (%d) is not a multiple of %d pixels per clock\n",
+				argv[k], img->m_width, PPC);
+			exit(EXIT_FAILURE);
+		} else if (img->m_width <= crop.m_x
+				|| img->m_height <= crop.m_y) {
+			fprintf(stderr, "ERR: %s: The crop rectangle lies outside of the image\n",
+				argv[k]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// }}}
+
+	// Build our list of frames, warming up with each image before
+	// measuring it.  Restarts are made in a second warm up frame, since
+	// the encoder ignores them until it has synchronized.
+	// {{{
+	changed = images;
+	cimages.resize(images.size());
+	cchanged.resize(images.size());
+	dnames.reserve(4 * images.size());
+	for(unsigned k=0; k<images.size(); k++) {
+		for(int r=(restart) ? -1 : 0; r<=(int)repeats + ((delta) ? 4:0);
+				r++) {
+			FRAMESTATS	f;
+
+			f.m_name  = argv[optind+k];
+			f.m_img   = &images[k];
+			f.m_model = &cimages[k];
+			f.m_measured = (r > 0);
+			f.m_skipped  = false;
+			f.m_restart  = (r == 0 && restart);
+			// A warm up frame's header holds the size of the
+			// image before it, and so may even become a delta
+			// frame.  With -d, each image restarts from a key
+			// frame once it's measured.
+			f.m_keyframe = (delta && r == 1);
+			f.m_magic = (f.m_keyframe) ? "qoif" : NULL;
+			f.m_cut   = -1;
+			f.m_start = f.m_end = f.m_stalls = 0;
+			f.m_quantized = f.m_overran = false;
+
+			if (r > (int)repeats) {
+				// The delta frames, with -d
+				static const char *const suffix[4] = {
+					"+same", "+changed", "+restored",
+					"+key" };
+				unsigned d = r - repeats - 1;
+
+				dnames.push_back(std::string(f.m_name)
+							+ suffix[d]);
+				f.m_name = dnames.back().c_str();
+				if (d == 1) {
+					f.m_img   = &changed[k];
+					f.m_model = &cchanged[k];
+				}
+				f.m_keyframe = (d == 3);
+				f.m_magic = (d == 3) ? "qoif" : "qoid";
+			}
+			tb->m_frames.push_back(f);
+
+			// Copies of the frame for the encoder to skip
+			f.m_measured = f.m_restart = f.m_keyframe = false;
+			f.m_magic   = NULL;
+			f.m_skipped = true;
+			for(unsigned c=0; c<crop.m_skipf; c++)
+				tb->m_frames.push_back(f);
+		}
+
+		// A few lines change: a third and two thirds of the way down
+		// what's kept of the image, so that a crop can't hide them
+		crop_image(images[k], cimages[k]);
+		for(unsigned p=1; p<3; p++) {
+			IMGFILE		*img = &changed[k];
+			unsigned	j = cimages[k].m_height * p / 3, x, y;
+
+			if (j >= cimages[k].m_height)
+				j = cimages[k].m_height - 1;
+			y = source_line(j);
+			x = crop.m_x + ((j+p) % cimages[k].m_width)
+						* (crop.m_skipx + 1);
+			img->m_pixels[(size_t)y * img->m_width + x]
+						^= (p == 1) ? 0x0408102 : 0x0204081;
+		}
+
+		crop_image(changed[k], cchanged[k]);
+	}
+	tb->m_core->i_delta = delta;
+	tb->m_core->i_above = above;
+	tb->m_core->i_crop_x = crop.m_x;
+	tb->m_core->i_crop_y = crop.m_y;
+	tb->m_core->i_crop_w = crop.m_w;
+	tb->m_core->i_crop_h = crop.m_h;
+	tb->m_core->i_skip_x = crop.m_skipx;
+	tb->m_core->i_skip_y = crop.m_skipy;
+	tb->m_core->i_skip_frames = crop.m_skipf;
+	tb->m_core->i_line_budget = line_budget;
+	tb->m_core->i_frame_budget = frame_budget;
+	// }}}
+
+	srand(seed);
+	if (trace)
+		tb->opentrace(trace);
+	tb->reset();
+
+	// Run the simulation
+	// {{{
+	// The encoder consumes its first frame synchronizing, so we can
+	// expect one less compressed frame than the number it keeps--plus
+	// one more for every restart
+	while((!tb->done() || tb->m_qframes.size()+1 < unskipped(tb->m_frames)
+						+ restarts(tb->m_frames))
+			&& tb->m_tickcount - tb->m_last_activity < MAX_IDLE)
+		tb->tick();
+	if (!tb->done())
+		fprintf(stderr, "ERR: The encoder stopped accepting pixels\n");
+	for(unsigned k=0; k<16; k++)
+		tb->tick();
+	// }}}
+
+	// Check and report on each frame
+	// {{{
+	FILE		*fout = NULL;
+	uint64_t	tpix = 0, tcycles = 0, tstalls = 0, tbytes = 0;
+	uint64_t	tperf[NPERF];
+	qoi::Encoder	encoder;
+	qoi::Decoder	decoder;
+	QOIFRAME	golden;
+	std::vector<uint32_t>	pixels, ref;
+
+	memset(tperf, 0, sizeof(tperf));
+	encoder.alpha(ALPHA);
+	decoder.alpha(ALPHA);
+	// The encoder's defaults: LGLBUF=6, LGLINES=11
+	encoder.delta(delta, 0, 63, 2048);
+	// ... and LGABOVE=11
+	encoder.above(above, 2048);
+	if (outfname) {
+		fout = fopen(outfname, "wb");
+		if (!fout) {
+			fprintf(stderr, "ERR: Could not open %s\n", outfname);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("%-24s %9s %9s %7s %8s %9s %6s\n", "Image", "Size",
+		"Cycles", "Px/Clk", "Stalls", "Bytes", "Ratio");
+
+	// q counts the compressed frames, which only line up with the frames
+	// kept (k) until the first restart
+	for(unsigned k=1, q=0; k<tb->m_frames.size();
+				q += (tb->m_frames[k].m_skipped) ? 0:1, k++) {
+		const FRAMESTATS *f = &tb->m_frames[k];
+		const IMGFILE	*img = f->m_model;
+		uint64_t	npix, cycles, nbytes;
+		char		sz[32];
+
+		if (f->m_skipped)
+			continue;
+
+		if (f->m_restart && !restarted(*f)) {
+			fprintf(stderr, "ERR: %s: The encoder didn't restart\n",
+				f->m_name);
+			fail = true;
+		} else if (restarted(*f)) {
+			// Skip the frame that was cut short, and check the
+			// one that replaced it: the rest of the image
+			unsigned	cut = cut_lines(*f);
+
+			q++;
+			encoder.encode(img->m_width, img->m_height - cut,
+				&img->m_pixels[(size_t)cut * img->m_width],
+				golden);
+			if (q >= tb->m_qframes.size()
+					|| tb->m_qframes[q] != golden) {
+				fprintf(stderr, "ERR: %s: The frame following a restart after line %d differs from the model\n",
+					f->m_name, f->m_cut);
+				fail = true;
+			}
+			nrestarts++;
+		}
+
+		if (!f->m_measured)
+			continue;
+
+		if (q >= tb->m_qframes.size()) {
+			fprintf(stderr, "ERR: No compressed frame found for %s\n",
+				f->m_name);
+			fail = true;
+			continue;
+		}
+
+		const QOIFRAME	&qf = tb->m_qframes[q];
+		unsigned	dw, dh;
+		bool		degraded = f->m_quantized || f->m_overran;
+
+		npix = (uint64_t)img->m_width * img->m_height;
+
+		// The encoder must match the software model, byte for byte,
+		// unless the budget degraded the frame
+		if (f->m_keyframe)
+			encoder.keyframe();
+		encoder.encode(img->m_width, img->m_height,
+				img->m_pixels.data(), golden);
+		if (!degraded && qf != golden) {
+			size_t	pos = 0;
+
+			while(pos < qf.size() && pos < golden.size()
+					&& qf[pos] == golden[pos])
+				pos++;
+			fprintf(stderr, "ERR: %s differs from the model at byte %lu (of %lu)\n",
+				f->m_name, (unsigned long)pos,
+				(unsigned long)golden.size());
+			fail = true;
+		}
+
+		if (delta && f->m_magic && (qf.size() < 4
+				|| memcmp(qf.data(), f->m_magic, 4) != 0)) {
+			fprintf(stderr, "ERR: %s should have been a \"%s\" frame\n",
+				f->m_name, f->m_magic);
+			fail = true;
+		}
+		if (qf.size() >= 4 && memcmp(qf.data(), "qoid", 4) == 0)
+			ndeltas++;
+		if (above && (qf.size() < 4
+				|| memcmp(qf.data(), "qoiv", 4) != 0)) {
+			fprintf(stderr, "ERR: %s should have been a \"qoiv\" frame\n",
+				f->m_name);
+			fail = true;
+		}
+
+		// ... and the result must decode to our original image, from
+		// the frame before it if need be
+		if (!decoder.decode(qf.data(), qf.size(), dw, dh, pixels,
+				(delta) ? &ref : NULL)) {
+			fprintf(stderr, "ERR: %s failed to decode: %s\n",
+				f->m_name, decoder.error());
+			fail = true;
+		} else if (dw != img->m_width || dh != img->m_height
+				|| (!degraded && pixels != img->m_pixels)) {
+			fprintf(stderr, "ERR: %s decodes to a different image\n",
+				f->m_name);
+			fail = true;
+		}
+		ref = img->m_pixels;
+
+		// A budget's limits
+		// {{{
+		if (budget) {
+			uint64_t	ops = 0;
+
+			if (qf.size() > HDRBYTES + TRLBYTES)
+				ops = qf.size() - HDRBYTES - TRLBYTES;
+
+			// Once it has run out, the rest of the frame costs
+			// (at most) one QOI_OP_RUN per 62 pixels
+			if (frame_budget != 0 && ops > frame_budget
+					+ BUDGET_SLACK + (npix + 61) / 62) {
+				fprintf(stderr, "ERR: %s: %lu bytes of ops exceeds the %u byte frame budget\n",
+					f->m_name, (unsigned long)ops,
+					frame_budget);
+				fail = true;
+			}
+
+			// o_overrun must be raised once the budget is used up,
+			// and only then.  It may be missed if the budget runs
+			// out only as the frame's last ops are leaving.
+			if (tb->m_qoverrun[q] && (frame_budget == 0
+						|| ops < frame_budget)) {
+				fprintf(stderr, "ERR: %s: o_overrun was raised, but this frame (%lu bytes) didn't run over\n",
+					f->m_name, (unsigned long)ops);
+				fail = true;
+			} else if (!tb->m_qoverrun[q] && frame_budget != 0
+					&& ops >= frame_budget + BUDGET_SLACK) {
+				fprintf(stderr, "ERR: %s: This frame (%lu bytes) ran over, but o_overrun was never raised\n",
+					f->m_name, (unsigned long)ops);
+				fail = true;
+			}
+
+			// Likewise, the quantizer must have been active for
+			// any frame that ran over its line budget
+			if (line_budget != 0 && !f->m_quantized
+					&& ops > line_budget * (uint64_t)img->m_height
+						+ BUDGET_SLACK) {
+				fprintf(stderr, "ERR: %s: This frame (%lu bytes) ran over its line budget, but o_quant was never raised\n",
+					f->m_name, (unsigned long)ops);
+				fail = true;
+			}
+
+			if (tb->m_qoverrun[q])
+				noverruns++;
+			if (f->m_quantized)
+				nquantized++;
+		}
+		// }}}
+
+		if (fout)
+			fwrite(qf.data(), 1, qf.size(), fout);
+
+		cycles = f->m_end - f->m_start + 1;
+		nbytes = qf.size();
+		snprintf(sz, sizeof(sz), "%dx%d", img->m_width, img->m_height);
+		printf("%-24s %9s %9lu %7.3f %8lu %9lu %5.1f%%\n", f->m_name, sz,
+			(unsigned long)cycles, npix / (double)cycles,
+			(unsigned long)f->m_stalls, (unsigned long)nbytes,
+			100.0 * nbytes / ((double)NCHAN * npix));
+
+		tpix    += npix;
+		tcycles += cycles;
+		tstalls += f->m_stalls;
+		tbytes  += nbytes;
+		for(unsigned p=0; p<NPERF; p++)
+			tperf[p] += tb->m_qperf[q].m_count[p];
+	}
+
+	if (fout)
+		fclose(fout);
+
+	if (tcycles > 0)
+		printf("%-24s %9s %9lu %7.3f %8lu %9lu %5.1f%%\n", "Total", "",
+			(unsigned long)tcycles, tpix / (double)tcycles,
+			(unsigned long)tstalls, (unsigned long)tbytes,
+			100.0 * tbytes / ((double)NCHAN * tpix));
+	if (restart)
+		printf("%u restart(s) checked\n", nrestarts);
+	if (delta)
+		printf("%u delta frame(s) checked\n", ndeltas);
+	if (budget) {
+		if (tb->m_quant_jumped || (line_budget == 0 && nquantized > 0)) {
+			fprintf(stderr, "ERR: o_quant didn't step one level at a time, from zero\n");
+			fail = true;
+		}
+		printf("%u frame(s) quantized, %u overran their budget\n",
+			nquantized, noverruns);
+	}
+	// }}}
+
+	// Report on the compressor's pipeline occupancy
+	// {{{
+	// The counters are zero if the encoder wasn't built with
+	// OPT_PERFCOUNTERS, as when PPC > 1
+	if (tperf[0] > 0) {
+		static const char *const stages[NSTAGES] = { "Input",
+			"1: Hash", "2: Index", "3: Lookup", "4: Compare",
+			"Output" };
+
+		printf("\n%-12s %8s %8s %8s %7s   (of %lu clocks)\n", "Stage",
+			"Moving", "Stalled", "Idle", "Rate",
+			(unsigned long)tperf[0]);
+		for(unsigned k=0; k<NSTAGES; k++) {
+			uint64_t moving = tperf[1+2*k], stalled = tperf[2+2*k];
+
+			printf("%-12s %7.1f%% %7.1f%% %7.1f%% %7.3f\n", stages[k],
+				100.0 * moving / tperf[0],
+				100.0 * stalled / tperf[0],
+				100.0 * (tperf[0] - moving - stalled) / tperf[0],
+				(moving + stalled > 0)
+					? moving / (double)(moving + stalled) : 0.0);
+		}
+	}
+	// }}}
+
+	delete tb;
+
+	if (fail) {
+		printf("FAIL!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("SUCCESS!\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,676 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/framebuffer_tb.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A Verilator based, cycle accurate, test bench for the QOI
+//		frame buffer.  Images, read from PPM or PNG files, are first
+//	compressed by the software model in sw/qoi.cpp, and then placed back
+//	to back into a region of a simulated memory, which the frame buffer
+//	is set to play back.  The memory stalls at random, and acknowledges
+//	each request after a random latency.  The frame buffer runs on its
+//	own bus clock, and produces video on a second, pixel clock.
+//
+//	Every pixel produced is checked against the original images, as are
+//	TLAST (end of frame) and TUSER (end of line), across as many passes
+//	through the region as are requested--so playback must wrap from the
+//	end of the region back to its beginning.  Every bus request is
+//	checked as well: it must be held while stalled, must never fall
+//	outside of the region, and must follow the request before it, save
+//	that it starts over at the beginning of the region after the last
+//	word, or after every start.  Optionally:
+//
+//	- Playback may be stopped, and then restarted, at random points.
+//		Once stopped, the bus must go idle, and stay so, and the video
+//		(after any pixels still on their way) must stop.  Once
+//		restarted, playback must begin again from the first frame.
+//	- A bus error may be returned in place of one acknowledgment.  The
+//		bus cycle must then end at once, and playback must halt with
+//		its bus error flag set, until restarted.
+//	- The display may be checked for underflow.  The video output then
+//		is never held back, and must never run dry within a frame.
+//
+//	When built with ALPHA, the frame buffer is expected to have OPT_ALPHA
+//	set, and images are checked with their alpha channels.
+//
+//	Usage: framebuffer_tb [-b pct] [-e] [-k pct] [-l clocks] [-n passes]
+//			[-p pct] [-r count] [-s seed] [-t trace.vcd] [-u]
+//			image ...
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <deque>
+
+#include "verilated.h"
+#include "Vqoi_framebuffer.h"
+#include "testb.h"
+#include "imgfile.h"
+#include "qoi.h"
+
+// These must match the parameters the frame buffer was Verilated with
+#ifndef	DW
+#define	DW	64
+#endif
+#ifndef	ALPHA
+#define	ALPHA	0
+#endif
+
+#define	DB		(DW/8)
+#define	PXMASK		((ALPHA) ? 0xffffffffu : 0x0ffffffu)
+#define	MAX_IDLE	100000
+// The bus clock period.  The pixel clock's is set from the command line.
+#define	BUS_PERIOD	100
+
+// Register addresses
+#define	ADDR_CTRL	0
+#define	ADDR_MSW	1
+#define	ADDR_LSW	2
+#define	ADDR_LEN	3
+#define	ADDR_ERRS	4
+
+// Status bits
+#define	STAT_ENABLE	(1u<<31)
+#define	STAT_BUSY	(1u<<30)
+#define	STAT_BUSERR	(1u<<29)
+#define	STAT_SIZEERR	(1u<<28)
+
+// Where the region starts in memory.  It must be bus aligned
+#define	REGION_BASE	0x00140000u
+
+// A request awaiting its acknowledgment
+// {{{
+typedef	struct	BUSREQ_S {
+	uint64_t	m_due;	// The bus clock it is acknowledged on
+	unsigned	m_word;	// Word offset into the region
+	bool		m_err;	// Return a bus error, rather than an ack
+} BUSREQ;
+// }}}
+
+class	FRAMEBUFFER_TB : public TESTB<Vqoi_framebuffer> {
+public:
+	unsigned	m_backpressure, m_stall, m_latency, m_pix_period;
+	bool		m_fail;
+
+	// Clocks
+	// {{{
+	uint64_t	m_time, m_bus_next, m_pix_next, m_bus_ticks;
+	bool		m_bus_edge;
+	// }}}
+
+	// Memory
+	// {{{
+	std::vector<uint8_t>	m_mem;	// The region, padded to whole words
+	unsigned	m_len, m_nwords;
+	std::deque<BUSREQ>	m_pending;
+	unsigned	m_nextword;	// The word the next request should read
+	uint64_t	m_nreqs, m_errat;
+	bool		m_ack, m_stalled, m_halted, m_errseen;
+	uint32_t	m_stalled_addr;
+	// }}}
+
+	// Video
+	// {{{
+	std::vector<const IMGFILE *>	m_frames;
+	std::vector<const char *>	m_names;
+	unsigned	m_oframe, m_pixel, m_errors, m_underflows;
+	bool		m_syncok;
+	uint64_t	m_npix, m_nframes, m_last_pixel, m_last_activity;
+	// }}}
+
+	FRAMEBUFFER_TB(void) : m_backpressure(0), m_stall(0), m_latency(1),
+			m_pix_period(BUS_PERIOD), m_fail(false),
+			m_time(0), m_bus_next(BUS_PERIOD),
+			m_pix_next(BUS_PERIOD), m_bus_ticks(0),
+			m_bus_edge(false), m_len(0), m_nwords(0),
+			m_nextword(0), m_nreqs(0), m_errat(0),
+			m_ack(false), m_stalled(false), m_halted(false),
+			m_errseen(false), m_stalled_addr(0),
+			m_oframe(0), m_pixel(0), m_errors(0), m_underflows(0),
+			m_syncok(true), m_npix(0),
+			m_nframes(0), m_last_pixel(0), m_last_activity(0) {
+		m_core->i_pix_clk = 0;
+		m_core->i_wb_cyc  = 0;
+		m_core->i_wb_stb  = 0;
+		m_core->i_wb_we   = 0;
+		m_core->i_wb_sel  = 0x0f;
+		m_core->i_dma_stall = 0;
+		m_core->i_dma_ack = 0;
+		m_core->i_dma_err = 0;
+		m_core->m_vid_ready = 1;
+	}
+
+	void	fail(const char *msg, unsigned v = 0) {
+		// {{{
+		if (!m_fail) {
+			fprintf(stderr, "ERR: ");
+			fprintf(stderr, msg, v);
+			fprintf(stderr, ", at bus clock %lu\n",
+					(unsigned long)m_bus_ticks);
+		}
+		m_fail = true;
+	}
+	// }}}
+
+	// set_word
+	// {{{
+	// Place word k of the region into i_dma_data, with its first byte in
+	// the MSBs
+	void	set_word(unsigned k) {
+		for(unsigned b=0; b<DB; b++) {
+			unsigned	pos = DW-8-8*b;
+			uint8_t		v = m_mem[k*DB+b];
+#if	(DW <= 32)
+			m_core->i_dma_data &= ~(0x0ffu << pos);
+			m_core->i_dma_data |= (uint32_t)v << pos;
+#elif	(DW <= 64)
+			m_core->i_dma_data &= ~(0x0ffull << pos);
+			m_core->i_dma_data |= (uint64_t)v << pos;
+#else
+			m_core->i_dma_data[pos/32] &= ~(0x0ffu << (pos%32));
+			m_core->i_dma_data[pos/32] |= (uint32_t)v << (pos%32);
+#endif
+		}
+	}
+	// }}}
+
+	// load
+	// {{{
+	// Place the compressed images into memory.  Any bytes following the
+	// region, in its last word, look like the start of another frame, so
+	// the decoder is sure to notice if it's ever given them.
+	void	load(const std::vector<uint8_t> &region) {
+		static const char	magic[] = "qoif";
+
+		m_len = region.size();
+		m_nwords = (m_len + DB - 1) / DB;
+		m_mem = region;
+		for(unsigned k=0; m_mem.size() < (size_t)m_nwords * DB; k++)
+			m_mem.push_back(magic[k % 4]);
+	}
+	// }}}
+
+	// bus_clock
+	// {{{
+	// Set the memory's inputs for the coming bus clock, and check (and
+	// accept) any request
+	void	bus_clock(void) {
+		uint32_t	addr;
+
+		m_core->i_dma_stall = ((unsigned)(rand() % 100) < m_stall);
+		m_core->i_dma_ack = 0;
+		m_core->i_dma_err = 0;
+		m_ack = false;
+		if (!m_core->o_dma_cyc)
+			// An abandoned cycle gets no more acknowledgments
+			m_pending.clear();
+		else if (!m_pending.empty()
+				&& m_pending.front().m_due <= m_bus_ticks) {
+			if (m_pending.front().m_err)
+				m_core->i_dma_err = 1;
+			else
+				m_core->i_dma_ack = 1;
+			set_word(m_pending.front().m_word);
+			m_ack = true;
+		}
+		eval();
+
+		if (m_core->o_dma_stb && !m_core->o_dma_cyc)
+			fail("STB raised without CYC");
+		if (m_core->o_dma_we)
+			fail("Frame buffer is writing to memory");
+		if (m_halted && m_core->o_dma_cyc)
+			fail("Bus is in use while playback is halted");
+		if (m_stalled && m_core->o_dma_cyc && (!m_core->o_dma_stb
+				|| m_core->o_dma_addr != m_stalled_addr))
+			fail("Stalled request dropped or changed");
+
+		addr = REGION_BASE / DB + m_nextword;
+		if (m_core->o_dma_stb && !m_core->i_dma_stall) {
+			BUSREQ	req;
+
+			if (m_core->o_dma_addr != addr)
+				fail("Request for word 0x%08x, out of order",
+					m_core->o_dma_addr);
+			req.m_due  = m_bus_ticks + 1 + (rand() % m_latency);
+			if (!m_pending.empty()
+					&& req.m_due <= m_pending.back().m_due)
+				req.m_due = m_pending.back().m_due + 1;
+			req.m_word = m_nextword;
+			req.m_err  = (m_errat != 0 && m_nreqs + 1 == m_errat);
+			m_pending.push_back(req);
+			m_nreqs++;
+			m_last_activity = m_bus_ticks;
+
+			m_nextword++;
+			if (m_nextword >= m_nwords)
+				m_nextword = 0;
+		}
+
+		m_stalled = m_core->o_dma_stb && m_core->i_dma_stall;
+		m_stalled_addr = m_core->o_dma_addr;
+	}
+
+	void	bus_clock_done(void) {
+		if (m_ack && m_pending.front().m_err) {
+			m_errseen = true;
+			m_halted  = true;
+			if (m_core->o_dma_cyc)
+				fail("Bus cycle continues after a bus error");
+		}
+		if (m_ack)
+			m_pending.pop_front();
+		m_bus_ticks++;
+	}
+	// }}}
+
+	// pix_clock
+	// {{{
+	// Accept, and check, any pixel
+	void	pix_clock(void) {
+		const IMGFILE	*img;
+		unsigned	npix;
+		bool		hlast, vlast;
+
+		m_core->m_vid_ready = ((unsigned)(rand() % 100)
+							>= m_backpressure);
+		eval();
+
+		if (m_pixel > 0 && m_core->m_vid_ready
+				&& !m_core->m_vid_valid)
+			m_underflows++;
+
+		if (!m_core->m_vid_valid || !m_core->m_vid_ready)
+			return;
+
+		img  = m_frames[m_oframe];
+		npix = img->m_width * img->m_height;
+		hlast = ((m_pixel % img->m_width) + 1 >= img->m_width);
+		vlast = (m_pixel + img->m_width >= npix);
+
+		if ((m_core->m_vid_data & PXMASK) != img->m_pixels[m_pixel]) {
+			if (m_errors == 0)
+				fprintf(stderr, "ERR: %s, pixel %d is 0x%06x, not 0x%06x\n",
+					m_names[m_oframe], m_pixel,
+					m_core->m_vid_data & PXMASK,
+					img->m_pixels[m_pixel]);
+			m_errors++;
+		}
+
+		if (m_core->m_vid_user != hlast
+				|| m_core->m_vid_last != (hlast && vlast))
+			m_syncok = false;
+
+		m_last_pixel = m_bus_ticks;
+		m_last_activity = m_bus_ticks;
+		m_npix++;
+		m_pixel++;
+		if (m_pixel >= npix) {
+			m_pixel = 0;
+			m_nframes++;
+			m_oframe++;
+			if (m_oframe >= m_frames.size())
+				m_oframe = 0;
+		}
+	}
+	// }}}
+
+	// tick
+	// {{{
+	// Step to the next rising clock edge, whichever clock it belongs to
+	void	tick(void) {
+		bool	bus, pix;
+
+		m_time = (m_bus_next < m_pix_next) ? m_bus_next : m_pix_next;
+		bus = (m_bus_next == m_time);
+		pix = (m_pix_next == m_time);
+		m_bus_edge = bus;
+		m_tickcount++;
+
+		if (bus)
+			bus_clock();
+		if (pix)
+			pix_clock();
+		eval();
+		if (m_trace) m_trace->dump(m_time-1);
+
+		if (bus)
+			m_core->i_clk = 1;
+		if (pix)
+			m_core->i_pix_clk = 1;
+		eval();
+		if (m_trace) m_trace->dump(m_time);
+		m_core->i_clk = 0;
+		m_core->i_pix_clk = 0;
+		eval();
+		if (m_trace) {
+			m_trace->dump(m_time+1);
+			m_trace->flush();
+		}
+
+		if (bus) {
+			bus_clock_done();
+			m_bus_next += BUS_PERIOD;
+		} if (pix)
+			m_pix_next += m_pix_period;
+	}
+
+	// Step to the end of the next bus clock
+	void	bus_tick(void) {
+		do {
+			tick();
+		} while(!m_bus_edge);
+	}
+	// }}}
+
+	void	reset(void) {
+		// {{{
+		m_core->i_reset = 1;
+		for(unsigned k=0; k<4; k++)
+			bus_tick();
+		m_core->i_reset = 0;
+	}
+	// }}}
+
+	// Control port
+	// {{{
+	void	wb_write(unsigned a, uint32_t v) {
+		m_core->i_wb_cyc  = 1;
+		m_core->i_wb_stb  = 1;
+		m_core->i_wb_we   = 1;
+		m_core->i_wb_addr = a;
+		m_core->i_wb_data = v;
+		bus_tick();
+		m_core->i_wb_cyc  = 0;
+		m_core->i_wb_stb  = 0;
+		m_core->i_wb_we   = 0;
+		if (!m_core->o_wb_ack)
+			fail("No acknowledgment from the control port");
+	}
+
+	uint32_t	wb_read(unsigned a) {
+		m_core->i_wb_cyc  = 1;
+		m_core->i_wb_stb  = 1;
+		m_core->i_wb_we   = 0;
+		m_core->i_wb_addr = a;
+		bus_tick();
+		m_core->i_wb_cyc  = 0;
+		m_core->i_wb_stb  = 0;
+		if (!m_core->o_wb_ack)
+			fail("No acknowledgment from the control port");
+		return m_core->o_wb_data;
+	}
+	// }}}
+
+	// start
+	// {{{
+	// Set up the region, and start playback from its beginning
+	void	start(void) {
+		uint32_t	stat;
+
+		wb_write(ADDR_MSW, 0);
+		wb_write(ADDR_LSW, REGION_BASE);
+		wb_write(ADDR_LEN, m_len);
+		if (wb_read(ADDR_LSW) != REGION_BASE
+				|| wb_read(ADDR_LEN) != m_len)
+			fail("Region doesn't read back as written");
+
+		m_nextword = 0;
+		m_oframe = m_pixel = 0;
+		m_halted = false;
+		wb_write(ADDR_CTRL, 1);
+
+		stat = wb_read(ADDR_CTRL);
+		if (!(stat & STAT_ENABLE))
+			fail("Playback failed to start, status 0x%08x", stat);
+		if (stat & STAT_BUSERR)
+			fail("Bus error flag not cleared on start, status 0x%08x",
+				stat);
+		m_last_activity = m_bus_ticks;
+	}
+	// }}}
+
+	// stop
+	// {{{
+	// Stop playback, and wait for the bus to go idle.  From then on, no
+	// more requests may be made, and the video must stop.
+	void	stop(void) {
+		uint32_t	stat;
+		uint64_t	idle;
+
+		wb_write(ADDR_CTRL, 0);
+		idle = m_bus_ticks;
+		do {
+			stat = wb_read(ADDR_CTRL);
+		} while((stat & STAT_BUSY) && m_bus_ticks - idle < MAX_IDLE);
+		if (stat & (STAT_BUSY | STAT_ENABLE))
+			fail("Playback failed to stop, status 0x%08x", stat);
+		hold();
+	}
+
+	// Wait, while halted, checking that both bus and video stay idle
+	void	hold(void) {
+		uint64_t	idle;
+		unsigned	nclocks = 200 + (rand() % 200);
+
+		m_halted = true;
+		idle = m_bus_ticks;
+		for(unsigned k=0; k<nclocks; k++)
+			bus_tick();
+		if (m_last_pixel > idle + 64)
+			fail("Video continues after playback has stopped");
+	}
+	// }}}
+
+	bool	busy(void) {
+		return m_bus_ticks - m_last_activity < MAX_IDLE && !m_fail;
+	}
+};
+
+static	void	usage(void) {
+	// {{{
+	fprintf(stderr,
+"USAGE: framebuffer_tb [-b pct] [-e] [-k pct] [-l clocks] [-n passes]\n"
+"\t\t[-p pct] [-r count] [-s seed] [-t trace.vcd] [-u] image ...\n"
+"\n"
+"\t-b pct\tHolds m_vid_ready low (backpressure) pct%% of the time\n"
+"\t-e\tReturns a bus error in place of one acknowledgment, and checks\n"
+"\t\tthat playback halts until restarted\n"
+"\t-k pct\tStalls the memory pct%% of the time\n"
+"\t-l clk\tAcknowledges each request 1 to clk clocks after it's made\n"
+"\t-n cnt\tPlays back the region cnt times (default: 2)\n"
+"\t-p pct\tRuns the pixel clock at pct%% of the bus clock rate\n"
+"\t\t(default: 75)\n"
+"\t-r cnt\tStops and restarts playback cnt times, at random\n"
+"\t-s seed\tSeeds the random number generator\n"
+"\t-t file\tRecords a VCD trace of the simulation\n"
+"\t-u\tChecks that the display never runs dry within a frame.  This\n"
+"\t\trequires -b 0\n");
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	FRAMEBUFFER_TB	*tb = new FRAMEBUFFER_TB;
+	std::vector<IMGFILE>	images;
+	const char	*trace = NULL;
+	unsigned	passes = 2, seed = 1, restarts = 0, pct = 75;
+	int		opt;
+	bool		bus_error = false, underflow = false;
+
+	// Process arguments
+	// {{{
+	while((opt = getopt(argc, argv, "b:ek:l:n:p:r:s:t:uh")) != -1) {
+		switch(opt) {
+		case 'b': tb->m_backpressure = atoi(optarg); break;
+		case 'e': bus_error = true; break;
+		case 'k': tb->m_stall = atoi(optarg); break;
+		case 'l': tb->m_latency = atoi(optarg); break;
+		case 'n': passes = atoi(optarg); break;
+		case 'p': pct = atoi(optarg); break;
+		case 'r': restarts = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 't': trace = optarg; break;
+		case 'u': underflow = true; break;
+		default: usage(); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind >= argc || passes < 1 || tb->m_backpressure >= 100
+			|| tb->m_stall >= 100 || tb->m_latency < 1
+			|| pct < 1 || pct > 1000
+			|| (underflow && tb->m_backpressure > 0)) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+	tb->m_pix_period = BUS_PERIOD * 100 / pct;
+	if (tb->m_pix_period < 4)
+		tb->m_pix_period = 4;
+
+	images.resize(argc - optind);
+	for(int k=optind; k<argc; k++) {
+		IMGFILE	*img = &images[k-optind];
+
+		if (!load_image(argv[k], *img, ALPHA))
+			exit(EXIT_FAILURE);
+		if (img->m_width * img->m_height == 0) {
+			fprintf(stderr, "ERR: %s is empty\n", argv[k]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// }}}
+
+	// Compress each image into our region of memory
+	// {{{
+	qoi::Encoder		encoder;
+	std::vector<uint8_t>	qf, region;
+	uint64_t		npix = 0;
+
+	srand(seed);
+	encoder.alpha(ALPHA);
+	for(unsigned k=0; k<images.size(); k++) {
+		encoder.encode(images[k].m_width, images[k].m_height,
+				images[k].m_pixels.data(), qf);
+		region.insert(region.end(), qf.begin(), qf.end());
+		tb->m_frames.push_back(&images[k]);
+		tb->m_names.push_back(argv[optind+k]);
+		npix += images[k].m_width * images[k].m_height;
+	}
+
+	tb->load(region);
+	// }}}
+
+	if (trace)
+		tb->opentrace(trace);
+	tb->reset();
+	tb->start();
+
+	// Stop and restart at random points of the first pass
+	// {{{
+	for(unsigned r=0; r<restarts && !tb->m_fail; r++) {
+		uint64_t	stop_at = tb->m_npix + 1 + (rand() % npix);
+
+		while(tb->m_npix < stop_at && tb->busy())
+			tb->tick();
+		tb->stop();
+		tb->start();
+	}
+	// }}}
+
+	// Fail a request within the first pass, and then restart
+	// {{{
+	if (bus_error && !tb->m_fail) {
+		uint32_t	stat;
+
+		tb->m_errat = tb->m_nreqs + 1 + (rand() % tb->m_nwords);
+		while(!tb->m_errseen && tb->busy())
+			tb->tick();
+		if (!tb->m_errseen)
+			tb->fail("No bus error was ever returned");
+
+		stat = tb->wb_read(ADDR_CTRL);
+		if ((stat & (STAT_ENABLE | STAT_BUSY | STAT_BUSERR))
+				!= STAT_BUSERR)
+			tb->fail("Bus error not reported, status 0x%08x", stat);
+		tb->hold();
+		tb->m_errat = 0;
+		tb->start();
+	}
+	// }}}
+
+	// Then play back the whole region, as many times as requested
+	// {{{
+	uint64_t	nframes = tb->m_nframes + passes * images.size();
+	uint32_t	stat;
+
+	tb->m_underflows = 0;
+	while(tb->m_nframes < nframes && tb->busy())
+		tb->tick();
+	if (tb->m_nframes < nframes)
+		tb->fail("Frame buffer stopped producing pixels");
+
+	stat = tb->wb_read(ADDR_CTRL);
+	if (stat & (STAT_BUSERR | STAT_SIZEERR))
+		tb->fail("Unexpected error flag, status 0x%08x", stat);
+	if (tb->wb_read(ADDR_ERRS) != 0)
+		tb->fail("Frames counted in error");
+	if (tb->m_errors > 0)
+		tb->fail("%u pixels differ", tb->m_errors);
+	if (!tb->m_syncok)
+		tb->fail("TLAST or TUSER is misplaced");
+	if (underflow && tb->m_underflows > 0)
+		tb->fail("Display ran dry %u times within a frame",
+				tb->m_underflows);
+	// }}}
+
+	printf("%lu bytes, %u frames, %lu pixels, %lu bus requests, %lu bus clocks\n",
+		(unsigned long)region.size(), (unsigned)tb->m_nframes,
+		(unsigned long)tb->m_npix, (unsigned long)tb->m_nreqs,
+		(unsigned long)tb->m_bus_ticks);
+	printf("%u pixel clocks within a frame without a pixel\n",
+		tb->m_underflows);
+
+	bool	fail = tb->m_fail;
+	delete tb;
+
+	if (fail) {
+		printf("FAIL!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("SUCCESS!\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,1144 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/fuzz_tb.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A Verilator based fuzz and stress test bench for the encoder
+//		and decoder.  It has two parts.
+//
+//	The first throws damaged and random streams at the decoder.  Each
+//	stream starts as one or more QOI files, compressed by the software
+//	model in sw/qoi.cpp from a corpus of small images (and from any
+//	images given).  Bits are then flipped, bytes replaced, inserted,
+//	deleted, and duplicated, and header fields overwritten.  Some streams
+//	are pure noise instead.  Whatever the stream holds, the decoder must:
+//
+//	- Keep accepting input.  No stream, no matter how bad, may stall it.
+//	- Hold m_data, m_user, and m_last steady while m_valid is stalled.
+//	- Produce no more pixels than the stream's ops can describe.
+//	- Recover.  Every damaged stream is followed by a trailer, to end any
+//		frame it left open, and then by a clean QOI file.  That last
+//		frame must decode exactly, TUSER and TLAST included, without
+//		o_err.
+//
+//	The second part measures the encoder and decoder on adversarial
+//	images: colors that all share one table index (so INDEX never
+//	matches), yet are too far apart for DIFF, LUMA, or RUN; two colors,
+//	alternating; and noise.  These produce the largest ops, one per pixel,
+//	and so the hardest streams for either core to keep up with.  Each
+//	image is run with no gaps and no backpressure, every byte and pixel
+//	is checked, and then
+//
+//	- The throughput of each, in pixels per clock, must be at least a
+//		fraction (-p) of the most it could be.  This is the smaller of
+//		DW/8 bytes per clock, and one beat of pixels per clock--less,
+//		for the encoder, the extra clock each RGBA op takes.
+//	- The encoder's latency, from the last pixel of a frame in to the
+//		last beat of its QOI file out, and the decoder's, from the
+//		first byte of a QOI file in to its first pixel out, must be
+//		within the given bounds (-L).
+//
+//	Usage: fuzz_tb [-b pct] [-g pct] [-n count] [-s seed] [-p frac]
+//			[-L enc,dec] [-S dir] [-z WxH] [image ...]
+//	       fuzz_tb -f stream ...
+//
+//	-b pct	Holds the decoder's m_ready low pct% of the time, while fuzzing
+//	-g pct	Leaves pct% of the decoder's input cycles idle, while fuzzing
+//	-n cnt	Fuzzes the decoder with cnt streams (default: 400)
+//	-s seed	Seeds the random number generator
+//	-p frac	Sets the minimum throughput, as a fraction (default: 0.9)
+//	-L e,d	Sets the maximum encoder and decoder latencies, in clocks
+//		(default: 32,16)
+//	-S dir	Writes the seed streams into dir, as a starting corpus for an
+//		external fuzzer
+//	-z WxH	Sets the size of the adversarial images (default: 128x32)
+//	-f	Decodes each file given as a raw stream, as above, and aborts if
+//		any check fails.  This is the form AFL expects.
+//
+//	The first stream to fail while fuzzing is written to fuzz_tb.fail, so
+//	that it may be replayed with -f.  Built with -DFUZZER, the test bench
+//	becomes a libFuzzer target instead, decoding one stream per call.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "verilated.h"
+#include "Vqoi_encoder.h"
+#include "Vqoi_decoder.h"
+#include "testb.h"
+#include "imgfile.h"
+#include "qoi.h"
+
+// These must match the parameters the encoder and decoder were Verilated with
+#ifndef	DW
+#define	DW	64
+#endif
+#ifndef	PPC
+#define	PPC	1
+#endif
+#ifndef	ALPHA
+#define	ALPHA	0
+#endif
+
+#define	DB		(DW/8)
+#define	PXMASK		((ALPHA) ? 0xffffffffu : 0x0ffffffu)
+#define	MAX_IDLE	100000
+// The longest any op may take to decode.  A RUN of 62 pixels takes 62.
+#define	OP_CLOCKS	64
+// Enough zeros to carry the decoder through any header it may be in the
+// middle of, and then through the largest op, before the end marker
+#define	NPAD		24
+
+// The (six bit) blue that gives a pixel the table index t.  Since the index
+// is (r*3 + g*5 + b*7 + a*11) mod 64, and 55 is the inverse of 7 mod 64,
+// this is (t - r*3 - g*5 - a*11) * 55.
+static	unsigned	blue(unsigned t, unsigned r, unsigned g, unsigned a) {
+	return ((t - 3*r - 5*g - 11*a) * 55) & 0x3f;
+}
+
+class	DECODER_SIM : public TESTB<Vqoi_decoder> {
+	// {{{
+	unsigned	m_rand;
+	// While m_valid is stalled, what the decoder was last holding
+	bool		m_stalled;
+	uint32_t	m_held_data;
+	bool		m_held_user, m_held_last;
+public:
+	unsigned	m_backpressure, m_gaps;
+	// Partial beats, filled with fewer than DB bytes, are then made at
+	// random
+	bool		m_partial;
+
+	// Input side
+	std::vector<uint8_t>	m_stream;
+	size_t		m_pos;
+	uint64_t	m_first_in;
+	// Output side: every pixel produced, with TUSER, TLAST, and whether
+	// o_err was raised while it was held on the output
+	std::vector<uint32_t>	m_pixels;
+	std::vector<uint8_t>	m_flags;
+	uint64_t	m_first_out, m_last_out;
+	bool		m_unstable;
+
+	enum { F_USER = 1, F_LAST = 2, F_ERR = 4 };
+
+	DECODER_SIM(void) : m_rand(1), m_backpressure(0), m_gaps(0),
+			m_partial(true) {
+		m_core->i_qvalid = 0;
+		m_core->m_ready  = 1;
+	}
+
+	int	rnd(void) { return rand_r(&m_rand); }
+
+	// set_byte
+	// {{{
+	// Place byte k of the current beat into i_qdata, where byte zero is
+	// found in the MSBs
+	void	set_byte(unsigned k, uint8_t v) {
+		unsigned	pos = DW-8-8*k;
+#if	(DW <= 32)
+		m_core->i_qdata &= ~(0x0ffu << pos);
+		m_core->i_qdata |= (uint32_t)v << pos;
+#elif	(DW <= 64)
+		m_core->i_qdata &= ~(0x0ffull << pos);
+		m_core->i_qdata |= (uint64_t)v << pos;
+#else
+		m_core->i_qdata[pos/32] &= ~(0x0ffu << (pos%32));
+		m_core->i_qdata[pos/32] |= (uint32_t)v << (pos%32);
+#endif
+	}
+	// }}}
+
+	// load
+	// {{{
+	// Load the next beat.  The unused bytes of a partial beat are filled
+	// with garbage, which the decoder must ignore.
+	void	load(void) {
+		unsigned	nb = DB;
+
+		if (m_partial && (rnd() & 3) == 0)
+			nb = 1 + (rnd() % DB);
+		if (nb > m_stream.size() - m_pos)
+			nb = m_stream.size() - m_pos;
+
+		for(unsigned k=0; k<DB; k++)
+			set_byte(k, (k < nb) ? m_stream[m_pos+k] : rnd());
+		m_core->i_qbytes = nb % DB;
+		m_core->i_qvalid = 1;
+	}
+	// }}}
+
+	// start
+	// {{{
+	// Reset the core, and get ready to send it stream
+	void	start(const std::vector<uint8_t> &stream, unsigned seed) {
+		m_stream = stream;
+		m_pos    = 0;
+		m_rand   = seed;
+		m_pixels.clear();
+		m_flags.clear();
+		m_first_in = m_first_out = m_last_out = 0;
+		m_stalled = m_unstable = false;
+		m_core->i_qvalid = 0;
+		reset();
+	}
+	// }}}
+
+	// Reset the core, without sending it anything
+	void	reset(void) {
+		m_core->i_reset = 1;
+		TESTB<Vqoi_decoder>::tick();
+		m_core->i_reset = 0;
+	}
+
+	bool	consumed(void) {
+		return m_pos >= m_stream.size() && !m_core->i_qvalid;
+	}
+
+	void	tick(void) {
+		// {{{
+		bool	iaccept, oaccept;
+
+		// Set our inputs for this cycle
+		// {{{
+		if (!m_core->i_qvalid && m_pos < m_stream.size()
+				&& (unsigned)(rnd() % 100) >= m_gaps)
+			load();
+		m_core->m_ready = ((unsigned)(rnd() % 100) >= m_backpressure);
+		eval();
+		// }}}
+
+		iaccept = m_core->i_qvalid && m_core->o_qready;
+		oaccept = m_core->m_valid && m_core->m_ready;
+
+		// Check the outputs
+		// {{{
+		if (m_stalled && (!m_core->m_valid
+				|| m_core->m_data != m_held_data
+				|| (m_core->m_user != 0) != m_held_user
+				|| (m_core->m_last != 0) != m_held_last))
+			m_unstable = true;
+		m_stalled = m_core->m_valid && !m_core->m_ready;
+		m_held_data = m_core->m_data;
+		m_held_user = m_core->m_user;
+		m_held_last = m_core->m_last;
+
+		// o_err belongs to the pixel it was raised with, the one now
+		// waiting on the output
+		if (m_core->o_err) {
+			if (m_flags.size() <= m_pixels.size())
+				m_flags.resize(m_pixels.size()+1, 0);
+			m_flags[m_pixels.size()] |= F_ERR;
+		}
+
+		if (oaccept) {
+			if (m_pixels.empty())
+				m_first_out = m_tickcount;
+			m_last_out = m_tickcount;
+			if (m_flags.size() <= m_pixels.size())
+				m_flags.resize(m_pixels.size()+1, 0);
+			m_flags[m_pixels.size()] |= (m_core->m_user ? F_USER : 0)
+				| (m_core->m_last ? F_LAST : 0);
+			m_pixels.push_back(m_core->m_data & PXMASK);
+		}
+		// }}}
+
+		TESTB<Vqoi_decoder>::tick();
+
+		// Step the input
+		// {{{
+		if (iaccept) {
+			unsigned nb = (m_core->i_qbytes == 0)
+						? DB : m_core->i_qbytes;
+
+			if (m_pos == 0)
+				m_first_in = m_tickcount;
+			m_core->i_qvalid = 0;
+			m_pos += nb;
+		}
+		// }}}
+	}
+	// }}}
+	// }}}
+};
+
+class	ENCODER_SIM : public TESTB<Vqoi_encoder> {
+	// {{{
+	const IMGFILE	*m_img;
+	unsigned	m_frame, m_x, m_y;
+public:
+	// The second frame's QOI file, and its timing
+	std::vector<uint8_t>	m_packet;
+	uint64_t	m_first_in, m_last_in, m_qlast, m_last_activity;
+	bool		m_olast;
+
+	ENCODER_SIM(void) : m_img(NULL) {
+		m_core->s_valid  = 0;
+		m_core->i_qready = 1;
+		m_core->i_restart = 0;
+		m_core->i_line_budget = 0;
+		m_core->i_frame_budget = 0;
+		m_core->i_delta = 0;
+		m_core->i_keyframe = 0;
+		m_core->i_keyint = 0;
+		m_core->i_above = 0;
+		m_core->i_crop_x = 0;
+		m_core->i_crop_y = 0;
+		m_core->i_crop_w = 0;
+		m_core->i_crop_h = 0;
+		m_core->i_skip_x = 0;
+		m_core->i_skip_y = 0;
+		m_core->i_skip_frames = 0;
+	}
+
+	// set_data
+	// {{{
+	// Place pixel k of the current beat into the s_data word.  The first
+	// pixel of each beat goes into the MSBs.
+	void	set_data(unsigned k, uint32_t px) {
+#if	(PPC <= 1)
+		m_core->s_data = px;
+#elif	(PPC <= 2)
+		unsigned	pos = 24*(PPC-1-k);
+
+		m_core->s_data &= ~(0x0ffffffUL << pos);
+		m_core->s_data |= (uint64_t)px << pos;
+#else
+		unsigned	pos = 24*(PPC-1-k);
+
+		for(unsigned b=0; b<24; b++) {
+			unsigned	w = (pos+b) / 32, s = (pos+b) % 32;
+
+			m_core->s_data[w] &= ~(1u << s);
+			m_core->s_data[w] |= ((px >> b) & 1) << s;
+		}
+#endif
+	}
+	// }}}
+
+	// out_byte
+	// {{{
+	// Return byte k of o_qdata, where byte zero is the first byte in the
+	// stream, found in the MSBs
+	uint8_t	out_byte(unsigned k) {
+		unsigned	pos = DW-8-8*k;
+#if	(DW <= 64)
+		return (uint8_t)(m_core->o_qdata >> pos);
+#else
+		return (uint8_t)(m_core->o_qdata[pos/32] >> (pos%32));
+#endif
+	}
+	// }}}
+
+	void	reset(void) {
+		m_core->i_reset = 1;
+		TESTB<Vqoi_encoder>::tick();
+		m_core->i_reset = 0;
+	}
+
+	void	load(void) {
+		// {{{
+		bool	hlast, vlast;
+
+		for(unsigned k=0; k<PPC; k++)
+			set_data(k, m_img->m_pixels[m_y*m_img->m_width+m_x+k]);
+
+		hlast = (m_x + PPC >= m_img->m_width);
+		vlast = (m_y + 1 >= m_img->m_height);
+		m_core->s_user = hlast;
+		m_core->s_last = hlast && vlast;
+		m_core->s_valid = 1;
+	}
+	// }}}
+
+	void	tick(void) {
+		// {{{
+		bool	iaccept, oaccept;
+
+		if (!m_core->s_valid && m_frame < 2)
+			load();
+		eval();
+
+		iaccept = m_core->s_valid && m_core->s_ready;
+		oaccept = m_core->o_qvalid && m_core->i_qready;
+		if (iaccept || oaccept)
+			m_last_activity = m_tickcount;
+		if (oaccept && !m_olast) {
+			unsigned nb = (m_core->o_qbytes == 0)
+						? DB : m_core->o_qbytes;
+
+			for(unsigned k=0; k<nb; k++)
+				m_packet.push_back(out_byte(k));
+			if (m_core->o_qlast) {
+				m_olast = true;
+				m_qlast = m_tickcount;
+			}
+		}
+
+		TESTB<Vqoi_encoder>::tick();
+
+		if (iaccept) {
+			if (m_frame > 0) {
+				if (m_x == 0 && m_y == 0)
+					m_first_in = m_tickcount;
+				m_last_in = m_tickcount;
+			}
+			m_core->s_valid = 0;
+
+			m_x += PPC;
+			if (m_x >= m_img->m_width) {
+				m_x = 0;
+				m_y++;
+				if (m_y >= m_img->m_height) {
+					m_y = 0;
+					m_frame++;
+				}
+			}
+		}
+	}
+	// }}}
+
+	// run
+	// {{{
+	// Encodes img twice.  The first copy synchronizes the encoder, and
+	// produces no output.  Returns false if the encoder stops.
+	bool	run(const IMGFILE &img) {
+		m_img = &img;
+		m_frame = m_x = m_y = 0;
+		m_packet.clear();
+		m_olast = false;
+		m_first_in = m_last_in = m_qlast = 0;
+		reset();
+		m_last_activity = m_tickcount;
+
+		while(!m_olast && m_tickcount - m_last_activity < MAX_IDLE)
+			tick();
+		return m_olast;
+	}
+	// }}}
+	// }}}
+};
+
+// The corpus
+// {{{
+// mkimage
+// {{{
+// Builds one of the images the fuzzed streams start from, or one of the
+// adversarial images
+static	void	mkimage(unsigned kind, unsigned w, unsigned h, unsigned seed,
+		IMGFILE &img) {
+	unsigned	r = 0, g = 0, b = 0, ca = 255, ta, tb;
+	uint32_t	pa, pb;
+
+	// Two colors, too far apart for anything but an RGB op (or INDEX).
+	// For kind 4, both share one table index.
+	ta = rand_r(&seed) & 0x3f;
+	tb = (kind == 4) ? ta : (ta ^ 0x20);
+	pa = 0x102000 | blue(ta, 0x10, 0x20, 255);
+	pb = 0x90a000 | blue(tb, 0x90, 0xa0, 255);
+
+	img.m_width  = w;
+	img.m_height = h;
+	img.m_pixels.resize((size_t)w * h);
+	for(unsigned y=0; y<h; y++)
+	for(unsigned x=0; x<w; x++) {
+		uint32_t	px = 0, a = 255;
+
+		switch(kind) {
+		case 0: // Plot, on a black background
+			if ((rand_r(&seed) % 7) == 0)
+				px = 0x0ffffff;
+			else if ((rand_r(&seed) % 11) == 0)
+				px = 0x0ffa000 + (rand_r(&seed) & 3);
+			else if (y == h/2 || x == w/3)
+				px = 0x00ff00;
+			break;
+		case 1: // Photo-like, a smooth gradient with noise
+			px = (((x * 3 + (rand_r(&seed) % 5)) & 0x0ff) << 16)
+				| (((y * 2 + x + (rand_r(&seed) % 3)) & 0x0ff) << 8)
+				| ((x + y + (rand_r(&seed) % 9)) & 0x0ff);
+			if ((rand_r(&seed) % 5) == 0)
+				a = rand_r(&seed) & 0x0ff;
+			break;
+		case 2: { // Every pixel shares one table index
+			// Green moves by 64 to 191 each pixel, beyond LUMA's
+			// reach, and blue is then chosen to keep the index.
+			// Alpha changes every pixel as well, when used.
+			r = rand_r(&seed) & 0x0ff;
+			g = (g + 64 + (rand_r(&seed) % 128)) & 0x0ff;
+			if (ALPHA)
+				ca = (ca + 1 + (rand_r(&seed) % 255)) & 0x0ff;
+			a = ca;
+			b = blue(ta, r, g, a) | ((rand_r(&seed) & 3) << 6);
+			px = (r << 16) | (g << 8) | b;
+			} break;
+		case 3: // Two colors, alternating: every op an INDEX
+		case 4: // Two colors, alternating, on one index: all RGB
+			px = ((x + y) & 1) ? pb : pa;
+			break;
+		default: // Noise
+			px = rand_r(&seed) & 0x0ffffff;
+			a  = rand_r(&seed) & 0x0ff;
+			break;
+		}
+
+		img.m_pixels[(size_t)y*w+x] = px | ((ALPHA) ? (a << 24) : 0);
+	}
+}
+// }}}
+
+typedef	struct	CORPUS_S {
+	std::string		m_name;
+	IMGFILE			m_img;
+	std::vector<uint8_t>	m_qoi;
+	// The number of RGBA ops in m_qoi
+	uint64_t		m_nrgba;
+} CORPUS;
+
+// }}}
+
+// Decoder fuzzing
+// {{{
+// The frame every damaged stream is followed by, which must always decode
+static	CORPUS		g_clean;
+static	DECODER_SIM	*g_dec = NULL;
+
+// fuzz_one
+// {{{
+// Decodes one damaged stream, and checks that the decoder survives it.
+// Returns NULL on success, or a description of what went wrong.
+static	const char *fuzz_one(DECODER_SIM &dec, const uint8_t *data,
+		size_t len, unsigned seed) {
+	const IMGFILE		&img = g_clean.m_img;
+	std::vector<uint8_t>	stream(data, data+len);
+	uint64_t		start, limit, last;
+	size_t			npix = (size_t)img.m_width * img.m_height,
+				base;
+
+	// End whatever frame the damage left open, with a trailer the
+	// decoder can't miss.  Zeros are one byte INDEX ops, so the end
+	// marker will be found on an op boundary.
+	stream.insert(stream.end(), NPAD, 0);
+	stream.insert(stream.end(), 7, 0);
+	stream.push_back(1);
+	stream.insert(stream.end(), g_clean.m_qoi.begin(), g_clean.m_qoi.end());
+
+	dec.start(stream, seed);
+
+	// Every byte must be accepted.  Even with backpressure, no op may
+	// take more than OP_CLOCKS to leave, on average.
+	start = dec.m_tickcount;
+	limit = 64 + (uint64_t)OP_CLOCKS * stream.size() * 100
+			/ (100 - dec.m_backpressure) * 100 / (100 - dec.m_gaps);
+	while(!dec.consumed() && dec.m_tickcount - start < limit)
+		dec.tick();
+	if (!dec.consumed())
+		return "the decoder stopped accepting input";
+
+	// Then the pixels must stop
+	size_t		nout = dec.m_pixels.size();
+	last = dec.m_tickcount;
+	while(dec.m_tickcount - last < 256
+			&& dec.m_tickcount - start < 2*limit) {
+		dec.tick();
+		if (dec.m_pixels.size() != nout) {
+			nout = dec.m_pixels.size();
+			last = dec.m_tickcount;
+		}
+	}
+	if (dec.m_tickcount - start >= 2*limit)
+		return "the decoder never stopped producing pixels";
+
+	if (dec.m_unstable)
+		return "m_data, m_user, or m_last changed while stalled";
+	if (dec.m_pixels.size() > 62 * stream.size())
+		return "more pixels were produced than the stream describes";
+	if (dec.m_pixels.size() < npix)
+		return "the final, clean, frame was lost";
+
+	// The final frame must be exact
+	base = dec.m_pixels.size() - npix;
+	if (dec.m_flags.size() < dec.m_pixels.size())
+		dec.m_flags.resize(dec.m_pixels.size(), 0);
+	for(size_t k=0; k<npix; k++) {
+		unsigned	x = k % img.m_width;
+		bool		hlast = (x + 1 >= img.m_width),
+				vlast = (k + img.m_width >= npix);
+		uint8_t		flags = dec.m_flags[base+k];
+
+		if (dec.m_pixels[base+k] != img.m_pixels[k])
+			return "the final, clean, frame was decoded wrongly";
+		if ((flags & DECODER_SIM::F_ERR) != 0)
+			return "o_err was raised during the final, clean, frame";
+		if (((flags & DECODER_SIM::F_USER) != 0) != hlast
+				|| ((flags & DECODER_SIM::F_LAST) != 0)
+							!= (hlast && vlast))
+			return "TLAST or TUSER is misplaced in the final frame";
+	}
+
+	return NULL;
+}
+// }}}
+
+static	void	setup(void) {
+	// {{{
+	if (g_dec)
+		return;
+
+	g_clean.m_name = "clean";
+	mkimage(0, 24, 9, 12345, g_clean.m_img);
+	qoi::Encoder	encoder;
+	encoder.alpha(ALPHA);
+	encoder.encode(g_clean.m_img.m_width, g_clean.m_img.m_height,
+		g_clean.m_img.m_pixels.data(), g_clean.m_qoi);
+
+	g_dec = new DECODER_SIM;
+}
+// }}}
+// }}}
+
+#ifdef	FUZZER
+// The libFuzzer entry point.  Each stream is run with partial beats, but
+// without backpressure or gaps, so that the result depends upon the stream
+// alone.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t len) {
+	const char	*err;
+
+	setup();
+	if ((err = fuzz_one(*g_dec, data, len, 1)) != NULL) {
+		fprintf(stderr, "ERR: %s\n", err);
+		abort();
+	}
+
+	return 0;
+}
+#else
+// The seeds, and the adversarial images
+// {{{
+static	const char *const adv_names[] = {
+	"collide", "alternate", "alt-collide", "noise" };
+#define	NADV	(sizeof(adv_names) / sizeof(adv_names[0]))
+
+static	void	add_image(std::vector<CORPUS> &corpus, const char *name,
+		unsigned kind, unsigned w, unsigned h, unsigned seed) {
+	CORPUS	c;
+
+	c.m_name = name;
+	mkimage(kind, w, h, seed, c.m_img);
+	corpus.push_back(c);
+}
+
+static	void	encode_all(std::vector<CORPUS> &corpus) {
+	qoi::Encoder	encoder;
+
+	encoder.alpha(ALPHA);
+	for(unsigned k=0; k<corpus.size(); k++) {
+		encoder.clear_counts();
+		encoder.encode(corpus[k].m_img.m_width,
+			corpus[k].m_img.m_height,
+			corpus[k].m_img.m_pixels.data(), corpus[k].m_qoi);
+		corpus[k].m_nrgba = encoder.m_counts[qoi::T_RGBA];
+	}
+}
+
+// The seeds: small images, a few of odd sizes, and a one pixel image
+static	void	seeds(std::vector<CORPUS> &corpus) {
+	static const unsigned	sizes[][2] = {
+		{ 16, 8 }, { 33, 7 }, { 7, 13 }, { 64, 2 }, { 1, 1 }, { 2, 40 } };
+
+	for(unsigned k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++)
+	for(unsigned kind=0; kind<6; kind++) {
+		char	name[64];
+
+		snprintf(name, sizeof(name), "seed-%d-%dx%d", kind,
+			sizes[k][0], sizes[k][1]);
+		add_image(corpus, name, kind, sizes[k][0], sizes[k][1],
+			k*8+kind+1);
+	}
+}
+// }}}
+
+// Damaged streams
+// {{{
+// mutate
+// {{{
+// Damages a stream, in one of several ways
+static	void	mutate(std::vector<uint8_t> &s, unsigned &seed) {
+	static const uint8_t	special[] = { 0x00, 0x01, 0x3f, 0x40, 0x7f,
+		0x80, 0xbf, 0xc0, 0xfd, 0xfe, 0xff, 'q', 'o', 'i', 'f' };
+	size_t	pos, n;
+
+	if (s.empty()) {
+		s.push_back(rand_r(&seed));
+		return;
+	}
+
+	pos = rand_r(&seed) % s.size();
+	n   = 1 + rand_r(&seed) % 16;
+	if (n > s.size() - pos)
+		n = s.size() - pos;
+
+	switch(rand_r(&seed) % 9) {
+	case 0: // Flip a bit
+		s[pos] ^= 1 << (rand_r(&seed) & 7);
+		break;
+	case 1: // Replace a byte with one an op or header would use
+		s[pos] = special[rand_r(&seed) % sizeof(special)];
+		break;
+	case 2: // Replace a byte with anything at all
+		s[pos] = rand_r(&seed);
+		break;
+	case 3: // Delete a few bytes
+		s.erase(s.begin()+pos, s.begin()+pos+n);
+		break;
+	case 4: { // Duplicate a few bytes
+		std::vector<uint8_t>	dup(s.begin()+pos, s.begin()+pos+n);
+
+		s.insert(s.begin()+pos, dup.begin(), dup.end());
+		} break;
+	case 5: // Insert random bytes
+		for(size_t k=0; k<n; k++)
+			s.insert(s.begin()+pos, (uint8_t)rand_r(&seed));
+		break;
+	case 6: { // Insert a header, claiming a (mostly) small frame
+		static const uint8_t	magic[] = { 'q', 'o', 'i', 'f' };
+		uint8_t		hdr[14];
+		uint32_t	w, h;
+
+		w = (rand_r(&seed) & 7) ? rand_r(&seed) % 40 : rand_r(&seed);
+		h = (rand_r(&seed) & 7) ? rand_r(&seed) % 40 : rand_r(&seed);
+		memcpy(hdr, magic, 4);
+		for(unsigned b=0; b<4; b++) {
+			hdr[4+b] = w >> (24-8*b);
+			hdr[8+b] = h >> (24-8*b);
+		}
+		hdr[12] = 3 + (rand_r(&seed) & 1);
+		hdr[13] = 0;
+		s.insert(s.begin()+pos, hdr, hdr+sizeof(hdr));
+		} break;
+	case 7: { // Overwrite the width or height of a header
+		size_t	k = pos;
+
+		while(k+12 <= s.size() && memcmp(&s[k], "qoif", 4) != 0)
+			k++;
+		if (k+12 <= s.size()) {
+			unsigned	b = 4 + 4*(rand_r(&seed) & 1)
+						+ (rand_r(&seed) & 3);
+
+			s[k+b] = (rand_r(&seed) & 1) ? rand_r(&seed)
+					: s[k+b] + 1 - 2*(rand_r(&seed) & 1);
+		}
+		} break;
+	default: // Damage an end marker
+		for(size_t k=pos; k+8 <= s.size(); k++)
+		if (s[k+7] == 1 && s[k] == 0 && s[k+6] == 0) {
+			s[k + (rand_r(&seed) & 7)] ^= 1 << (rand_r(&seed) & 7);
+			break;
+		}
+		break;
+	}
+}
+// }}}
+
+static	void	mkstream(const std::vector<CORPUS> &corpus,
+		std::vector<uint8_t> &s, unsigned &seed) {
+	// {{{
+	unsigned	nframes, nmut;
+
+	s.clear();
+	switch(rand_r(&seed) % 8) {
+	case 0: { // Pure noise
+		size_t	n = 1 + rand_r(&seed) % 1024;
+
+		for(size_t k=0; k<n; k++)
+			s.push_back(rand_r(&seed));
+		return; }
+	case 1: { // Noise, following a header
+		size_t	n = 10 + rand_r(&seed) % 512;
+
+		s.push_back('q'); s.push_back('o');
+		s.push_back('i'); s.push_back('f');
+		for(size_t k=0; k<n; k++)
+			s.push_back(rand_r(&seed));
+		return; }
+	default:
+		break;
+	}
+
+	// One to three frames from the corpus, with up to eight mutations
+	nframes = 1 + rand_r(&seed) % 3;
+	for(unsigned k=0; k<nframes; k++) {
+		const CORPUS	*c = &corpus[rand_r(&seed) % corpus.size()];
+
+		s.insert(s.end(), c->m_qoi.begin(), c->m_qoi.end());
+	}
+
+	nmut = 1 + rand_r(&seed) % 8;
+	for(unsigned k=0; k<nmut; k++)
+		mutate(s, seed);
+	// }}}
+}
+
+static	bool	write_file(const char *fname, const std::vector<uint8_t> &s) {
+	// {{{
+	FILE	*fp = fopen(fname, "wb");
+	bool	ok;
+
+	if (!fp) {
+		fprintf(stderr, "ERR: Could not open %s\n", fname);
+		return false;
+	}
+
+	ok = fwrite(s.data(), 1, s.size(), fp) == s.size();
+	fclose(fp);
+	return ok;
+}
+// }}}
+// }}}
+
+// Adversarial images
+// {{{
+typedef	struct	ADVSTATS_S {
+	const char	*m_name;
+	unsigned	m_npix;
+	uint64_t	m_bytes, m_enc_cycles, m_dec_cycles,
+			m_enc_latency, m_dec_latency;
+	double		m_enc_max, m_dec_max;
+	bool		m_ok;
+} ADVSTATS;
+
+// Runs one adversarial image through both cores, checking every byte and
+// pixel along the way
+static	void	adversarial(ENCODER_SIM &enc, const CORPUS &c, ADVSTATS &st) {
+	// {{{
+	const IMGFILE	&img = c.m_img;
+	double		enc_clocks, dec_clocks, bus_clocks;
+
+	st.m_name  = c.m_name.c_str();
+	st.m_npix  = img.m_width * img.m_height;
+	st.m_bytes = c.m_qoi.size();
+	st.m_ok    = true;
+	st.m_enc_cycles = st.m_dec_cycles = 0;
+	st.m_enc_latency = st.m_dec_latency = 0;
+
+	// The most either could do: DW/8 bytes, or a beat of pixels, per
+	// clock.  Each RGBA op costs the encoder an extra clock.
+	bus_clocks = st.m_bytes / (double)DB;
+	enc_clocks = st.m_npix / (double)PPC + ((ALPHA) ? c.m_nrgba : 0);
+	dec_clocks = st.m_npix;
+	if (enc_clocks < bus_clocks)
+		enc_clocks = bus_clocks;
+	if (dec_clocks < bus_clocks)
+		dec_clocks = bus_clocks;
+	st.m_enc_max = st.m_npix / enc_clocks;
+	st.m_dec_max = st.m_npix / dec_clocks;
+
+	// The encoder
+	// {{{
+	if (!enc.run(img)) {
+		fprintf(stderr, "ERR: %s, the encoder stopped\n", st.m_name);
+		st.m_ok = false;
+		return;
+	} if (enc.m_packet != c.m_qoi) {
+		fprintf(stderr, "ERR: %s, the encoder differs from the model\n",
+			st.m_name);
+		st.m_ok = false;
+	}
+
+	st.m_enc_cycles  = enc.m_last_in - enc.m_first_in + 1;
+	st.m_enc_latency = enc.m_qlast - enc.m_last_in;
+	// }}}
+
+	// The decoder, given whole beats
+	// {{{
+	DECODER_SIM	&dec = *g_dec;
+	uint64_t	limit;
+
+	dec.m_partial = false;
+	dec.m_backpressure = dec.m_gaps = 0;
+	dec.start(c.m_qoi, 1);
+	limit = dec.m_tickcount + OP_CLOCKS * (c.m_qoi.size() + st.m_npix);
+	while(dec.m_pixels.size() < st.m_npix && dec.m_tickcount < limit)
+		dec.tick();
+	dec.m_partial = true;
+
+	if (dec.m_pixels.size() < st.m_npix) {
+		fprintf(stderr, "ERR: %s, the decoder stopped\n", st.m_name);
+		st.m_ok = false;
+		return;
+	}
+
+	for(unsigned k=0; k<st.m_npix; k++)
+	if (dec.m_pixels[k] != img.m_pixels[k]) {
+		fprintf(stderr, "ERR: %s, pixel %d is 0x%06x, not 0x%06x\n",
+			st.m_name, k, dec.m_pixels[k], img.m_pixels[k]);
+		st.m_ok = false;
+		break;
+	}
+
+	st.m_dec_cycles  = dec.m_last_out - dec.m_first_out + 1;
+	st.m_dec_latency = dec.m_first_out - dec.m_first_in;
+	// }}}
+}
+// }}}
+// }}}
+
+static	void	usage(void) {
+	// {{{
+	fprintf(stderr,
+"USAGE: fuzz_tb [-b pct] [-g pct] [-n count] [-s seed] [-p frac]\n"
+"\t\t[-L enc,dec] [-S dir] [-z WxH] [image ...]\n"
+"       fuzz_tb -f stream ...\n"
+"\n"
+"\t-b pct\tHolds the decoder's m_ready low pct%% of the time, while fuzzing\n"
+"\t-g pct\tLeaves pct%% of the decoder's input cycles idle, while fuzzing\n"
+"\t-n cnt\tFuzzes the decoder with cnt streams (default: 400)\n"
+"\t-s seed\tSeeds the random number generator\n"
+"\t-p frac\tSets the minimum throughput, as a fraction of the most\n"
+"\t\tpossible (default: 0.9)\n"
+"\t-L e,d\tSets the maximum encoder and decoder latencies, in clocks\n"
+"\t\t(default: 32,16)\n"
+"\t-S dir\tWrites the seed streams into dir, for an external fuzzer\n"
+"\t-z WxH\tSets the size of the adversarial images (default: 128x32)\n"
+"\t-f\tDecodes each file as a raw stream, aborting on any failure\n"
+"\n"
+"\tAny images given are added to the seeds the fuzzed streams start from.\n");
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	std::vector<CORPUS>	corpus, adv;
+	const char	*seeddir = NULL;
+	unsigned	ncases = 400, seed = 1, aw = 128, ah = 32,
+			backpressure = 0, gaps = 0, max_enc = 32, max_dec = 16;
+	double		minfrac = 0.9;
+	int		opt;
+	bool		fail = false, files = false;
+
+	// Process arguments
+	// {{{
+	while((opt = getopt(argc, argv, "b:fg:n:s:p:L:S:z:h")) != -1) {
+		switch(opt) {
+		case 'b': backpressure = atoi(optarg); break;
+		case 'f': files = true; break;
+		case 'g': gaps = atoi(optarg); break;
+		case 'n': ncases = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'p': minfrac = atof(optarg); break;
+		case 'L':
+			if (sscanf(optarg, "%u,%u", &max_enc, &max_dec) != 2)
+				minfrac = -1;
+			break;
+		case 'S': seeddir = optarg; break;
+		case 'z':
+			if (sscanf(optarg, "%ux%u", &aw, &ah) != 2)
+				aw = 0;
+			break;
+		default: usage(); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (gaps >= 100 || backpressure >= 100 || minfrac < 0 || minfrac > 1
+			|| aw < 1 || ah < 1 || (aw % PPC) != 0
+			|| (files && optind >= argc)) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+	// }}}
+
+	setup();
+
+	// Replay (or AFL) mode: each file is one stream
+	// {{{
+	if (files) {
+		for(int k=optind; k<argc; k++) {
+			std::vector<uint8_t>	s;
+			FILE		*fp = fopen(argv[k], "rb");
+			const char	*err;
+			int		ch;
+
+			if (!fp) {
+				fprintf(stderr, "ERR: Could not open %s\n", argv[k]);
+				exit(EXIT_FAILURE);
+			}
+			while((ch = fgetc(fp)) != EOF)
+				s.push_back(ch);
+			fclose(fp);
+
+			g_dec->m_backpressure = backpressure;
+			g_dec->m_gaps = gaps;
+			if ((err = fuzz_one(*g_dec, s.data(), s.size(), seed))
+					!= NULL) {
+				fprintf(stderr, "ERR: %s, %s\n", argv[k], err);
+				abort();
+			}
+		}
+
+		printf("SUCCESS!\n");
+		exit(EXIT_SUCCESS);
+	}
+	// }}}
+
+	// Build the corpora
+	// {{{
+	seeds(corpus);
+	for(int k=optind; k<argc; k++) {
+		CORPUS	c;
+
+		c.m_name = argv[k];
+		if (!load_image(argv[k], c.m_img, ALPHA))
+			exit(EXIT_FAILURE);
+		if (c.m_img.m_width * c.m_img.m_height == 0) {
+			fprintf(stderr, "ERR: %s is empty\n", argv[k]);
+			exit(EXIT_FAILURE);
+		}
+		corpus.push_back(c);
+	}
+
+	for(unsigned k=0; k<NADV; k++)
+		add_image(adv, adv_names[k], 2+k, aw, ah, seed+k);
+	// The adversarial images make good seeds as well, if small
+	for(unsigned k=0; k<NADV; k++)
+		add_image(corpus, adv_names[k], 2+k, 16, 4, seed+k);
+
+	encode_all(corpus);
+	encode_all(adv);
+
+	if (seeddir) {
+		for(unsigned k=0; k<corpus.size(); k++) {
+			char	fname[512];
+
+			snprintf(fname, sizeof(fname), "%s/seed%03d.qoi",
+				seeddir, k);
+			if (!write_file(fname, corpus[k].m_qoi))
+				exit(EXIT_FAILURE);
+		}
+	}
+	// }}}
+
+	// Fuzz the decoder
+	// {{{
+	unsigned	nfail = 0;
+	uint64_t	nbytes = 0;
+
+	srand(seed);
+	g_dec->m_backpressure = backpressure;
+	g_dec->m_gaps = gaps;
+	for(unsigned k=0; k<ncases; k++) {
+		std::vector<uint8_t>	s;
+		unsigned	cseed = rand();
+		const char	*err;
+
+		// Each stream follows its own seed, so that any failure can
+		// be reproduced from the stream alone
+		mkstream(corpus, s, cseed);
+		nbytes += s.size();
+		if ((err = fuzz_one(*g_dec, s.data(), s.size(), cseed)) != NULL) {
+			fprintf(stderr, "ERR: Stream %d (%lu bytes, seed %u), %s\n",
+				k, (unsigned long)s.size(), cseed, err);
+			if (nfail++ == 0 && write_file("fuzz_tb.fail", s))
+				fprintf(stderr, "ERR: Written to fuzz_tb.fail\n");
+			fail = true;
+		}
+	}
+
+	printf("Fuzzed the decoder with %u streams, %lu bytes: %u failed\n",
+		ncases, (unsigned long)nbytes, nfail);
+	// }}}
+
+	// Adversarial images, throughput and latency
+	// {{{
+	ENCODER_SIM	*enc = new ENCODER_SIM;
+
+	printf("%-24s %9s %9s %7s %7s %5s %9s %7s %7s %5s\n", "Image", "Bytes",
+		"Enc Cyc", "Px/Clk", "Max", "Lat", "Dec Cyc", "Px/Clk",
+		"Max", "Lat");
+	for(unsigned k=0; k<adv.size(); k++) {
+		ADVSTATS	st;
+		double		erate, drate;
+
+		adversarial(*enc, adv[k], st);
+		erate = st.m_enc_cycles ? st.m_npix/(double)st.m_enc_cycles : 0;
+		drate = st.m_dec_cycles ? st.m_npix/(double)st.m_dec_cycles : 0;
+		printf("%-24s %9lu %9lu %7.3f %7.3f %5lu %9lu %7.3f %7.3f %5lu\n",
+			st.m_name, (unsigned long)st.m_bytes,
+			(unsigned long)st.m_enc_cycles, erate, st.m_enc_max,
+			(unsigned long)st.m_enc_latency,
+			(unsigned long)st.m_dec_cycles, drate, st.m_dec_max,
+			(unsigned long)st.m_dec_latency);
+
+		if (!st.m_ok)
+			fail = true;
+		else {
+			if (erate < minfrac * st.m_enc_max) {
+				fprintf(stderr, "ERR: %s, the encoder only kept up %.3f pixels per clock\n",
+					st.m_name, erate);
+				fail = true;
+			} if (drate < minfrac * st.m_dec_max) {
+				fprintf(stderr, "ERR: %s, the decoder only kept up %.3f pixels per clock\n",
+					st.m_name, drate);
+				fail = true;
+			} if (st.m_enc_latency > max_enc) {
+				fprintf(stderr, "ERR: %s, the encoder took %lu clocks to finish its frame\n",
+					st.m_name,
+					(unsigned long)st.m_enc_latency);
+				fail = true;
+			} if (st.m_dec_latency > max_dec) {
+				fprintf(stderr, "ERR: %s, the decoder took %lu clocks to its first pixel\n",
+					st.m_name,
+					(unsigned long)st.m_dec_latency);
+				fail = true;
+			}
+		}
+	}
+
+	delete enc;
+	// }}}
+
+	delete g_dec;
+
+	if (fail) {
+		printf("FAIL!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("SUCCESS!\n");
+	exit(EXIT_SUCCESS);
+}
+#endif
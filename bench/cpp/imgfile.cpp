@@ -0,0 +1,230 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/imgfile.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	Reads PPM, and optionally PNG, images from disk for the
+//		test benches.  See imgfile.h for details.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef	USE_PNG
+#include <png.h>
+#endif
+
+#include "imgfile.h"
+
+// ppm_token
+// {{{
+// Reads one whitespace separated (decimal) number from a PPM header,
+// skipping any comments along the way.  Returns -1 on any error.
+static int	ppm_token(FILE *fp) {
+	int	ch, v = 0;
+
+	do {
+		ch = fgetc(fp);
+		if (ch == '#') {
+			while((ch != EOF)&&(ch != '\n'))
+				ch = fgetc(fp);
+		}
+	} while((ch != EOF)&&(isspace(ch)));
+
+	if (!isdigit(ch))
+		return -1;
+	while(isdigit(ch)) {
+		v = v * 10 + (ch - '0');
+		ch = fgetc(fp);
+	}
+
+	// The single whitespace character following the last header field
+	// has now been consumed, as the PPM format requires
+	return v;
+}
+// }}}
+
+// load_ppm
+// {{{
+static	bool	load_ppm(const char *fname, FILE *fp, IMGFILE &img,
+		bool alpha) {
+	int	w, h, mx;
+
+	if (fgetc(fp) != 'P' || fgetc(fp) != '6') {
+		fprintf(stderr, "ERR: %s is not a binary (P6) PPM file\n",
+			fname);
+		return false;
+	}
+
+	w  = ppm_token(fp);
+	h  = ppm_token(fp);
+	mx = ppm_token(fp);
+	if (w <= 0 || h <= 0 || mx != 255) {
+		fprintf(stderr, "ERR: %s: Unsupported PPM header\n", fname);
+		return false;
+	}
+
+	img.m_width  = w;
+	img.m_height = h;
+	img.m_pixels.resize((size_t)w * h);
+
+	for(size_t k=0; k<img.m_pixels.size(); k++) {
+		unsigned char	rgb[3];
+
+		if (fread(rgb, 1, 3, fp) != 3) {
+			fprintf(stderr, "ERR: %s: Unexpected end of file\n",
+				fname);
+			return false;
+		}
+
+		img.m_pixels[k] = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+		if (alpha)
+			img.m_pixels[k] |= 0xff000000;
+	}
+
+	return true;
+}
+// }}}
+
+#ifdef	USE_PNG
+// load_png
+// {{{
+static	bool	load_png(const char *fname, FILE *fp, IMGFILE &img,
+		bool alpha) {
+	png_structp	png;
+	png_infop	info;
+	png_bytep	row = NULL;
+	bool		r = false;
+	unsigned	nc = (alpha) ? 4 : 3;
+
+	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!png)
+		return false;
+	info = png_create_info_struct(png);
+	if (!info) {
+		png_destroy_read_struct(&png, NULL, NULL);
+		return false;
+	}
+
+	if (setjmp(png_jmpbuf(png))) {
+		fprintf(stderr, "ERR: %s: Could not decode PNG file\n", fname);
+		goto png_done;
+	}
+
+	png_init_io(png, fp);
+	png_read_info(png, info);
+
+	// Convert everything to 8-bit RGB, or RGBA if alpha is requested
+	// {{{
+	if (png_get_bit_depth(png, info) == 16)
+		png_set_strip_16(png);
+	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY
+			&& png_get_bit_depth(png, info) < 8)
+		png_set_expand_gray_1_2_4_to_8(png);
+	if (png_get_valid(png, info, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(png);
+	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY
+		|| png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA)
+		png_set_gray_to_rgb(png);
+	if (alpha)
+		png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+	else
+		png_set_strip_alpha(png);
+	png_read_update_info(png, info);
+	// }}}
+
+	img.m_width  = png_get_image_width(png, info);
+	img.m_height = png_get_image_height(png, info);
+	img.m_pixels.resize((size_t)img.m_width * img.m_height);
+
+	row = new png_byte[png_get_rowbytes(png, info)];
+	for(unsigned y=0; y<img.m_height; y++) {
+		png_read_row(png, row, NULL);
+		for(unsigned x=0; x<img.m_width; x++) {
+			png_bytep	px = &row[nc*x];
+
+			img.m_pixels[y*img.m_width+x] = (px[0] << 16)
+				| (px[1] << 8) | px[2];
+			if (alpha)
+				img.m_pixels[y*img.m_width+x]
+					|= (uint32_t)px[3] << 24;
+		}
+	}
+
+	r = true;
+png_done:
+	delete[] row;
+	png_destroy_read_struct(&png, &info, NULL);
+	return r;
+}
+// }}}
+#endif
+
+bool	load_image(const char *fname, IMGFILE &img, bool alpha) {
+	// {{{
+	FILE		*fp;
+	unsigned char	magic[8];
+	bool		r;
+
+	fp = fopen(fname, "rb");
+	if (!fp) {
+		fprintf(stderr, "ERR: Could not open %s\n", fname);
+		return false;
+	}
+
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic))
+		magic[0] = 0;
+	rewind(fp);
+
+	if (magic[0] == 'P' && magic[1] == '6')
+		r = load_ppm(fname, fp, img, alpha);
+	else if (0 == memcmp(magic, "\x89PNG\r\n\x1a\n", 8)) {
+#ifdef	USE_PNG
+		r = load_png(fname, fp, img, alpha);
+#else
+		fprintf(stderr, "ERR: %s: PNG support was not built in\n",
+			fname);
+		r = false;
+#endif
+	} else {
+		fprintf(stderr, "ERR: %s: Unknown image format\n", fname);
+		r = false;
+	}
+
+	fclose(fp);
+	return r;
+}
+// }}}
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/imgfile.h
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	Reads test images from disk so that they may be fed to the
+//		QOI simulation test benches.  Binary PPM (P6) files are always
+//	supported.  PNG files are also supported if the bench is built with
+//	USE_PNG defined (and libpng available).  Either way, images are
+//	returned as one 24-bit 0x00RRGGBB word per pixel, in raster order.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#ifndef	IMGFILE_H
+#define	IMGFILE_H
+
+#include <stdint.h>
+#include <vector>
+
+typedef	struct	IMGFILE_S {
+	unsigned		m_width, m_height;
+	std::vector<uint32_t>	m_pixels;
+} IMGFILE;
+
+// Returns false (with a message to stderr) if the file cannot be read.
+// Pixels are 0x00RRGGBB, or 0xAARRGGBB if alpha is requested.  (PPM
+// images, having no alpha channel, are then fully opaque.)
+extern	bool	load_image(const char *fname, IMGFILE &img,
+			bool alpha = false);
+
+#endif
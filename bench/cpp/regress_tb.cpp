@@ -0,0 +1,821 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	bench/cpp/regress_tb.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A Verilator based regression farm for the encoder and decoder
+//		together.  Each image is streamed through the encoder, whose
+//	QOI output is connected directly to the decoder's input--exactly as
+//	a recording played back through the framebuffer would see it, only
+//	without the memory in between.  Random gaps may be placed between the
+//	encoder's input pixels, and random backpressure applied to the
+//	decoder's output, through which it reaches the encoder as well.
+//
+//	Every frame is checked three ways: the encoder's output must match
+//	the software model in sw/qoi.cpp byte for byte, every pixel the
+//	decoder produces must match the original image, and TUSER and TLAST
+//	must mark the ends of each line and frame.
+//
+//	Frames are independent of one another, so they are run in parallel:
+//	each worker thread has its own Verilator context, with its own
+//	encoder and decoder, and takes the next frame from a shared list as
+//	soon as it finishes the last.  Both cores are reset before every
+//	frame, and the encoder (which needs a frame to synchronize) is then
+//	given the image twice.  Only the second is measured.  Each frame is
+//	also given its own random number seed, so the results don't depend
+//	upon the number of threads, or upon which thread runs which frame.
+//
+//	If no images are given, a built-in corpus is used instead: sonar and
+//	other plots on a black background, a photo-like noisy gradient, pure
+//	noise, and several solid colors.  The following are reported for
+//	each frame, and (optionally) written to CSV and JSON files:
+//
+//	- Encoder cycles, from the first pixel accepted to the last, and the
+//		encoder's throughput in pixels per clock
+//	- Decoder cycles, from the first pixel produced to the last, and the
+//		decoder's throughput in pixels per clock
+//	- Frame cycles, from the first pixel into the encoder to the last
+//		pixel out of the decoder
+//	- Bytes, the size of the QOI file, and its size as a percentage of
+//		the 24-bit (32-bit, with ALPHA) uncompressed image size
+//	- Whether or not the frame passed all three checks
+//
+//	Usage: regress_tb [-b pct] [-g pct] [-j threads] [-n count] [-s seed]
+//			[-z WxH] [-c report.csv] [-J report.json] [image ...]
+//
+//	-b pct	Holds m_ready low (backpressure) pct% of the time
+//	-g pct	Leaves pct% of the encoder's input cycles idle (gaps)
+//	-j n	Runs n worker threads (default: one per CPU)
+//	-n cnt	Runs each image cnt times, each with its own seed (default: 1)
+//	-s seed	Seeds the random number generator
+//	-z WxH	Sets the size of the built-in images (default: 320x240)
+//	-c file	Writes a CSV report, one line per frame
+//	-J file	Writes a JSON report, one object per frame
+//
+//	The encoder and decoder must both have been Verilated with the same
+//	DW and ALPHA settings.  Verilator 4.210 or later is required, for its
+//	VerilatedContext.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "verilated.h"
+#include "Vqoi_encoder.h"
+#include "Vqoi_decoder.h"
+#include "imgfile.h"
+#include "qoi.h"
+
+// These must match the parameters the encoder and decoder were Verilated with
+#ifndef	DW
+#define	DW	64
+#endif
+#ifndef	PPC
+#define	PPC	1
+#endif
+#ifndef	ALPHA
+#define	ALPHA	0
+#endif
+
+#if	(ALPHA && PPC > 1)
+#error "OPT_ALPHA is only supported with one pixel per clock"
+#endif
+
+#define	DB		(DW/8)
+#define	NCHAN		((ALPHA) ? 4 : 3)
+#define	PXMASK		((ALPHA) ? 0xffffffffu : 0x0ffffffu)
+#define	OPAQUE		((ALPHA) ? 0xff000000u : 0u)
+#define	MAX_IDLE	100000
+
+// One image of the corpus
+// {{{
+typedef	struct	CORPUS_S {
+	std::string	m_name;
+	IMGFILE		m_img;
+} CORPUS;
+// }}}
+
+// The results of one frame
+// {{{
+typedef	struct	FRAMESTATS_S {
+	const CORPUS	*m_src;
+	unsigned	m_seed;
+	uint64_t	m_enc_start, m_enc_end, m_stalls;
+	uint64_t	m_dec_start, m_dec_end, m_bytes;
+	unsigned	m_errors;
+	bool		m_done, m_model_ok, m_sync_ok;
+
+	bool	pass(void) const {
+		return m_done && m_model_ok && m_sync_ok && m_errors == 0; }
+} FRAMESTATS;
+// }}}
+
+class	COSIM {
+	// {{{
+	// One encoder, wired to one decoder, in a context of their own so
+	// that each thread may simulate its own pair
+	VerilatedContext	*m_ctx;
+	Vqoi_encoder		*m_enc;
+	Vqoi_decoder		*m_dec;
+	unsigned		m_rand;
+
+	// Input side: the pixel the encoder is being offered next
+	const IMGFILE	*m_img;
+	unsigned	m_frame, m_x, m_y;
+	// Output side: the encoded frame, and the next pixel expected
+	std::vector<uint8_t>	m_packet;
+	unsigned	m_oframe, m_pixel;
+	bool		m_olast;
+	uint64_t	m_last_activity;
+public:
+	unsigned	m_backpressure, m_gaps;
+	uint64_t	m_tickcount;
+
+	COSIM(void) : m_rand(1), m_img(NULL), m_backpressure(0), m_gaps(0),
+			m_tickcount(0) {
+		m_ctx = new VerilatedContext;
+		m_enc = new Vqoi_encoder(m_ctx);
+		m_dec = new Vqoi_decoder(m_ctx);
+		m_enc->i_clk = 0;
+		m_dec->i_clk = 0;
+		m_enc->s_valid = 0;
+		m_dec->m_ready = 1;
+		eval();
+	}
+
+	~COSIM(void) {
+		delete m_dec;
+		delete m_enc;
+		delete m_ctx;
+	}
+
+	// A thread safe rand(), following our own seed
+	int	rnd(void) { return rand_r(&m_rand); }
+
+	// set_data
+	// {{{
+	// Place pixel k of the current beat into the s_data word.  The first
+	// pixel of each beat goes into the MSBs.
+	void	set_data(unsigned k, uint32_t px) {
+#if	(PPC <= 1)
+		m_enc->s_data = px;
+#elif	(PPC <= 2)
+		unsigned	pos = 24*(PPC-1-k);
+
+		m_enc->s_data &= ~(0x0ffffffUL << pos);
+		m_enc->s_data |= (uint64_t)px << pos;
+#else
+		unsigned	pos = 24*(PPC-1-k);
+
+		for(unsigned b=0; b<24; b++) {
+			unsigned	w = (pos+b) / 32, s = (pos+b) % 32;
+
+			m_enc->s_data[w] &= ~(1u << s);
+			m_enc->s_data[w] |= ((px >> b) & 1) << s;
+		}
+#endif
+	}
+	// }}}
+
+	// out_byte
+	// {{{
+	// Return byte k of the encoder's o_qdata, where byte zero is the first
+	// byte in the stream, found in the MSBs
+	uint8_t	out_byte(unsigned k) {
+		unsigned	pos = DW-8-8*k;
+#if	(DW <= 64)
+		return (uint8_t)(m_enc->o_qdata >> pos);
+#else
+		return (uint8_t)(m_enc->o_qdata[pos/32] >> (pos%32));
+#endif
+	}
+	// }}}
+
+	// load
+	// {{{
+	// Load the next beat of video into the encoder's input.  TUSER marks
+	// the last pixel in a line and TLAST the last pixel in a frame.
+	void	load(void) {
+		bool	hlast, vlast;
+
+		for(unsigned k=0; k<PPC; k++)
+			set_data(k, m_img->m_pixels[m_y*m_img->m_width+m_x+k]);
+
+		hlast = (m_x + PPC >= m_img->m_width);
+		vlast = (m_y + 1 >= m_img->m_height);
+		m_enc->s_user = hlast;
+		m_enc->s_last = hlast && vlast;
+		m_enc->s_valid = 1;
+	}
+	// }}}
+
+	// connect
+	// {{{
+	// Copy the encoder's QOI stream outputs to the decoder's inputs, and
+	// the decoder's ready back again
+	void	connect(void) {
+		m_dec->i_qvalid = m_enc->o_qvalid;
+#if	(DW <= 64)
+		m_dec->i_qdata  = m_enc->o_qdata;
+#else
+		for(unsigned k=0; k<(DW+31)/32; k++)
+			m_dec->i_qdata[k] = m_enc->o_qdata[k];
+#endif
+		m_dec->i_qbytes = m_enc->o_qbytes;
+		m_dec->eval();
+		m_enc->i_qready = m_dec->o_qready;
+	}
+	// }}}
+
+	void	eval(void) {
+		m_enc->eval();
+		connect();
+		m_enc->eval();
+	}
+
+	void	clock(void) {
+		// {{{
+		// Both cores sample their inputs at the same edge.  Since the
+		// decoder's inputs were copied before it, nothing the
+		// encoder does here can reach the decoder until the next
+		// cycle.
+		m_tickcount++;
+		m_enc->i_clk = 1;
+		m_dec->i_clk = 1;
+		m_enc->eval();
+		m_dec->eval();
+		m_enc->i_clk = 0;
+		m_dec->i_clk = 0;
+		m_enc->eval();
+		m_dec->eval();
+	}
+	// }}}
+
+	void	reset(void) {
+		// {{{
+		m_enc->i_reset = 1;
+		m_dec->i_reset = 1;
+		m_enc->s_valid = 0;
+		eval();
+		clock();
+		m_enc->i_reset = 0;
+		m_dec->i_reset = 0;
+		eval();
+	}
+	// }}}
+
+	void	tick(FRAMESTATS &f) {
+		// {{{
+		bool	iaccept, eaccept, oaccept;
+
+		// Set our inputs for this cycle
+		// {{{
+		if (!m_enc->s_valid && m_frame < 2
+				&& (unsigned)(rnd() % 100) >= m_gaps)
+			load();
+		m_dec->m_ready = ((unsigned)(rnd() % 100) >= m_backpressure);
+		eval();
+		// }}}
+
+		// Sample the handshakes before the clock edge
+		// {{{
+		iaccept = m_enc->s_valid && m_enc->s_ready;
+		if (m_frame > 0 && m_enc->s_valid && !m_enc->s_ready)
+			f.m_stalls++;
+
+		eaccept = m_enc->o_qvalid && m_enc->i_qready;
+		if (eaccept) {
+			unsigned nb = (m_enc->o_qbytes == 0)
+						? DB : m_enc->o_qbytes;
+
+			for(unsigned k=0; k<nb; k++)
+				m_packet.push_back(out_byte(k));
+			if (m_enc->o_qlast)
+				m_olast = true;
+			m_last_activity = m_tickcount;
+		}
+
+		// A frame whose length disagrees with its header is out of
+		// sync, even if every pixel matches
+		if (m_dec->o_err)
+			f.m_sync_ok = false;
+
+		oaccept = m_dec->m_valid && m_dec->m_ready;
+		if (oaccept && m_oframe == 0) {
+			unsigned	npix = m_img->m_width * m_img->m_height;
+			bool		hlast, vlast;
+
+			hlast = ((m_pixel % m_img->m_width) + 1 >= m_img->m_width);
+			vlast = (m_pixel + m_img->m_width >= npix);
+
+			if (m_pixel == 0)
+				f.m_dec_start = m_tickcount;
+			f.m_dec_end = m_tickcount;
+			if ((m_dec->m_data & PXMASK)
+					!= m_img->m_pixels[m_pixel]) {
+				if (f.m_errors == 0)
+					fprintf(stderr, "ERR: %s, pixel %d is 0x%06x, not 0x%06x\n",
+						f.m_src->m_name.c_str(), m_pixel,
+						m_dec->m_data & PXMASK,
+						m_img->m_pixels[m_pixel]);
+				f.m_errors++;
+			}
+
+			if (m_dec->m_user != hlast
+					|| m_dec->m_last != (hlast && vlast))
+				f.m_sync_ok = false;
+
+			m_last_activity = m_tickcount;
+			m_pixel++;
+			if (m_pixel >= npix) {
+				m_pixel = 0;
+				m_oframe++;
+			}
+		} else if (oaccept) {
+			fprintf(stderr, "ERR: %s, the decoder produced extra pixels\n",
+				f.m_src->m_name.c_str());
+			f.m_errors++;
+		}
+		// }}}
+
+		clock();
+
+		// Step the input
+		// {{{
+		if (iaccept) {
+			if (m_frame > 0) {
+				if (m_x == 0 && m_y == 0)
+					f.m_enc_start = m_tickcount;
+				f.m_enc_end = m_tickcount;
+			}
+			m_enc->s_valid = 0;
+			m_last_activity = m_tickcount;
+
+			m_x += PPC;
+			if (m_x >= m_img->m_width) {
+				m_x = 0;
+				m_y++;
+				if (m_y >= m_img->m_height) {
+					m_y = 0;
+					m_frame++;
+				}
+			}
+		}
+		// }}}
+	}
+	// }}}
+
+	// run
+	// {{{
+	// Runs one frame through the encoder and decoder, and checks the
+	// results.  The first copy of the image synchronizes the encoder, and
+	// produces no output.
+	void	run(FRAMESTATS &f) {
+		qoi::Encoder		encoder;
+		std::vector<uint8_t>	golden;
+
+		m_img   = &f.m_src->m_img;
+		m_rand  = f.m_seed;
+		m_frame = m_x = m_y = 0;
+		m_oframe = m_pixel = 0;
+		m_olast = false;
+		m_packet.clear();
+
+		reset();
+		m_last_activity = m_tickcount;
+		while((m_oframe == 0 || !m_olast)
+				&& m_tickcount - m_last_activity < MAX_IDLE)
+			tick(f);
+		f.m_done = (m_oframe > 0 && m_olast);
+		if (!f.m_done)
+			fprintf(stderr, "ERR: %s, the simulation stopped making progress\n",
+				f.m_src->m_name.c_str());
+
+		// Any extra pixels should show up shortly after the last
+		for(unsigned k=0; k<16; k++)
+			tick(f);
+
+		// The encoder must match the software model, byte for byte
+		encoder.alpha(ALPHA);
+		encoder.encode(m_img->m_width, m_img->m_height,
+				m_img->m_pixels.data(), golden);
+		f.m_bytes = m_packet.size();
+		f.m_model_ok = (m_packet == golden);
+		if (f.m_done && !f.m_model_ok)
+			fprintf(stderr, "ERR: %s, the encoder differs from the model\n",
+				f.m_src->m_name.c_str());
+	}
+	// }}}
+	// }}}
+};
+
+// The built-in corpus
+// {{{
+// mkimage
+// {{{
+// Builds one image of the built-in corpus.  The plots are mostly a black
+// background, as the recorder was built for.  The sonar image is a fan of
+// range rings and bearing lines, filled with returns that fade with range.
+static	void	mkimage(unsigned kind, unsigned w, unsigned h, unsigned seed,
+		IMGFILE &img) {
+	img.m_width  = w;
+	img.m_height = h;
+	img.m_pixels.resize((size_t)w * h);
+	for(unsigned y=0; y<h; y++)
+	for(unsigned x=0; x<w; x++) {
+		uint32_t	px = 0;
+
+		switch(kind) {
+		case 0: { // Sonar
+			int	dx = (int)x - (int)w/2, dy = (int)h - 1 - (int)y;
+			unsigned r = (unsigned)sqrt((double)dx*dx + (double)dy*dy);
+			unsigned ring = (h/4 > 0) ? h/4 : 1;
+
+			// A ninety degree fan, from the bottom center
+			if (r >= h || dx > dy || -dx > dy)
+				break;
+			if ((r % ring) == 0 || dx == 0 || dx == dy || -dx == dy)
+				px = 0x00a000;
+			else if ((rand_r(&seed) % 41) == 0) {
+				unsigned v = 255 - 200 * r / h
+						- (rand_r(&seed) & 0x1f);
+				px = (v << 8) | (v >> 2);
+			}
+			} break;
+		case 1: // Plot
+			if ((rand_r(&seed) % 23) == 0)
+				px = 0x0ffffff;
+			else if ((rand_r(&seed) % 37) == 0)
+				px = 0x0ffa000 + (rand_r(&seed) & 3);
+			else if (y == h/2 || x == w/3)
+				px = 0x00ff00;
+			break;
+		case 2: { // Photo-like, a smooth gradient with noise
+			unsigned r, g, b;
+
+			r = (x * 3 + (rand_r(&seed) % 5)) & 0x0ff;
+			g = (y * 2 + x + (rand_r(&seed) % 3)) & 0x0ff;
+			b = (x + y + (rand_r(&seed) % 9)) & 0x0ff;
+			px = (r << 16) | (g << 8) | b;
+			} break;
+		case 3: // Noise
+			px = rand_r(&seed) & 0x0ffffff;
+			break;
+		case 4: // Solid black
+			px = 0;
+			break;
+		case 5: // Solid white
+			px = 0x0ffffff;
+			break;
+		default: // Solid color
+			px = 0x2080c0;
+			break;
+		}
+
+		img.m_pixels[(size_t)y*w+x] = px | OPAQUE;
+	}
+}
+// }}}
+
+static	void	builtin(unsigned w, unsigned h, std::vector<CORPUS> &corpus) {
+	static const char *const names[] = {
+		"sonar", "plot", "photo", "noise", "black", "white", "color" };
+	const unsigned	nkinds = sizeof(names) / sizeof(names[0]);
+
+	corpus.resize(nkinds);
+	for(unsigned k=0; k<nkinds; k++) {
+		char	name[64];
+
+		snprintf(name, sizeof(name), "%s-%dx%d", names[k], w, h);
+		corpus[k].m_name = name;
+		mkimage(k, w, h, k+1, corpus[k].m_img);
+	}
+}
+// }}}
+
+// Reports
+// {{{
+static	unsigned	npixels(const FRAMESTATS &f) {
+	return f.m_src->m_img.m_width * f.m_src->m_img.m_height;
+}
+
+static	uint64_t	enc_cycles(const FRAMESTATS &f) {
+	return f.m_done ? f.m_enc_end - f.m_enc_start + 1 : 0;
+}
+
+static	uint64_t	dec_cycles(const FRAMESTATS &f) {
+	return f.m_done ? f.m_dec_end - f.m_dec_start + 1 : 0;
+}
+
+static	uint64_t	frame_cycles(const FRAMESTATS &f) {
+	return f.m_done ? f.m_dec_end - f.m_enc_start + 1 : 0;
+}
+
+static	double	ratio(const FRAMESTATS &f) {
+	return f.m_bytes / ((double)NCHAN * npixels(f));
+}
+
+static	bool	write_csv(const char *fname, const std::vector<FRAMESTATS> &frames) {
+	// {{{
+	FILE	*fp = fopen(fname, "w");
+
+	if (!fp) {
+		fprintf(stderr, "ERR: Could not open %s\n", fname);
+		return false;
+	}
+
+	fprintf(fp, "image,seed,width,height,encoder_cycles,encoder_stalls,"
+		"decoder_cycles,frame_cycles,bytes,ratio,model_match,"
+		"pixel_errors,sync_ok,pass\n");
+	for(unsigned k=0; k<frames.size(); k++) {
+		const FRAMESTATS &f = frames[k];
+
+		fprintf(fp, "\"%s\",%u,%u,%u,%lu,%lu,%lu,%lu,%lu,%.4f,%d,%u,%d,%d\n",
+			f.m_src->m_name.c_str(), f.m_seed,
+			f.m_src->m_img.m_width, f.m_src->m_img.m_height,
+			(unsigned long)enc_cycles(f),
+			(unsigned long)f.m_stalls,
+			(unsigned long)dec_cycles(f),
+			(unsigned long)frame_cycles(f),
+			(unsigned long)f.m_bytes, ratio(f),
+			f.m_model_ok ? 1:0, f.m_errors,
+			f.m_sync_ok ? 1:0, f.pass() ? 1:0);
+	}
+
+	fclose(fp);
+	return true;
+}
+// }}}
+
+static	bool	write_json(const char *fname, const std::vector<FRAMESTATS> &frames) {
+	// {{{
+	FILE	*fp = fopen(fname, "w");
+
+	if (!fp) {
+		fprintf(stderr, "ERR: Could not open %s\n", fname);
+		return false;
+	}
+
+	fprintf(fp, "{\n\t\"dw\": %d, \"ppc\": %d, \"alpha\": %s,\n"
+		"\t\"frames\": [\n", DW, PPC, (ALPHA) ? "true" : "false");
+	for(unsigned k=0; k<frames.size(); k++) {
+		const FRAMESTATS &f = frames[k];
+		std::string	name;
+
+		// Escape the only characters a file name might hold that
+		// JSON cares about
+		for(const char *s = f.m_src->m_name.c_str(); *s; s++) {
+			if (*s == '\"' || *s == '\\')
+				name += '\\';
+			name += *s;
+		}
+
+		fprintf(fp, "\t\t{ \"image\": \"%s\", \"seed\": %u, "
+			"\"width\": %u, \"height\": %u,\n"
+			"\t\t  \"encoder_cycles\": %lu, \"encoder_stalls\": %lu, "
+			"\"decoder_cycles\": %lu, \"frame_cycles\": %lu,\n"
+			"\t\t  \"bytes\": %lu, \"ratio\": %.4f, "
+			"\"model_match\": %s, \"pixel_errors\": %u, "
+			"\"sync_ok\": %s, \"pass\": %s }%s\n",
+			name.c_str(), f.m_seed,
+			f.m_src->m_img.m_width, f.m_src->m_img.m_height,
+			(unsigned long)enc_cycles(f),
+			(unsigned long)f.m_stalls,
+			(unsigned long)dec_cycles(f),
+			(unsigned long)frame_cycles(f),
+			(unsigned long)f.m_bytes, ratio(f),
+			f.m_model_ok ? "true" : "false", f.m_errors,
+			f.m_sync_ok ? "true" : "false",
+			f.pass() ? "true" : "false",
+			(k+1 < frames.size()) ? "," : "");
+	}
+	fprintf(fp, "\t]\n}\n");
+
+	fclose(fp);
+	return true;
+}
+// }}}
+// }}}
+
+static	void	usage(void) {
+	// {{{
+	fprintf(stderr,
+"USAGE: regress_tb [-b pct] [-g pct] [-j threads] [-n count] [-s seed]\n"
+"\t\t[-z WxH] [-c report.csv] [-J report.json] [image ...]\n"
+"\n"
+"\t-b pct\tHolds m_ready low (backpressure) pct%% of the time\n"
+"\t-g pct\tLeaves pct%% of the encoder's input cycles idle\n"
+"\t-j n\tRuns n worker threads (default: one per CPU)\n"
+"\t-n cnt\tRuns each image cnt times, each with its own seed\n"
+"\t-s seed\tSeeds the random number generator\n"
+"\t-z WxH\tSets the size of the built-in images (default: 320x240)\n"
+"\t-c file\tWrites a CSV report, one line per frame\n"
+"\t-J file\tWrites a JSON report, one object per frame\n"
+"\n"
+"\tWith no images, a built-in corpus of sonar plots, photo-like images,\n"
+"\tnoise, and solid colors is used instead.\n");
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	std::vector<CORPUS>	corpus;
+	std::vector<FRAMESTATS>	frames;
+	const char	*csvname = NULL, *jsonname = NULL;
+	unsigned	repeats = 1, seed = 1, nthreads, bw = 320, bh = 240,
+			backpressure = 0, gaps = 0;
+	int		opt;
+	bool		fail = false;
+
+	nthreads = std::thread::hardware_concurrency();
+
+	// Process arguments
+	// {{{
+	while((opt = getopt(argc, argv, "b:g:j:n:s:z:c:J:h")) != -1) {
+		switch(opt) {
+		case 'b': backpressure = atoi(optarg); break;
+		case 'g': gaps = atoi(optarg); break;
+		case 'j': nthreads = atoi(optarg); break;
+		case 'n': repeats = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case 'z':
+			if (sscanf(optarg, "%ux%u", &bw, &bh) != 2)
+				bw = 0;
+			break;
+		case 'c': csvname = optarg; break;
+		case 'J': jsonname = optarg; break;
+		default: usage(); exit(EXIT_FAILURE);
+		}
+	}
+
+	if (nthreads < 1)
+		nthreads = 1;
+	if (repeats < 1 || gaps >= 100 || backpressure >= 100
+			|| bw < 1 || bh < 1 || (bw % PPC) != 0) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (optind >= argc)
+		builtin(bw, bh, corpus);
+	else {
+		corpus.resize(argc - optind);
+		for(int k=optind; k<argc; k++) {
+			CORPUS	*c = &corpus[k-optind];
+
+			c->m_name = argv[k];
+			if (!load_image(argv[k], c->m_img, ALPHA))
+				exit(EXIT_FAILURE);
+			if (c->m_img.m_width * c->m_img.m_height == 0) {
+				fprintf(stderr, "ERR: %s is empty\n", argv[k]);
+				exit(EXIT_FAILURE);
+			} if (c->m_img.m_width % PPC) {
+				fprintf(stderr, "ERR: %s: Width (%d) is not a multiple of %d pixels per clock\n",
+					argv[k], c->m_img.m_width, PPC);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	// }}}
+
+	// Build our list of frames, each with its own seed
+	// {{{
+	srand(seed);
+	for(unsigned k=0; k<corpus.size(); k++) {
+		for(unsigned r=0; r<repeats; r++) {
+			FRAMESTATS	f;
+
+			memset(&f, 0, sizeof(f));
+			f.m_src  = &corpus[k];
+			f.m_seed = rand();
+			f.m_model_ok = f.m_sync_ok = true;
+			frames.push_back(f);
+		}
+	}
+	// }}}
+
+	// Run the frames, in parallel
+	// {{{
+	std::atomic<unsigned>		next(0);
+	std::vector<std::thread>	workers;
+
+	if (nthreads > frames.size())
+		nthreads = frames.size();
+	for(unsigned t=0; t<nthreads; t++) {
+		workers.push_back(std::thread([&]() {
+			COSIM		sim;
+			unsigned	k;
+
+			sim.m_backpressure = backpressure;
+			sim.m_gaps = gaps;
+			while((k = next++) < frames.size())
+				sim.run(frames[k]);
+		}));
+	}
+
+	for(unsigned t=0; t<workers.size(); t++)
+		workers[t].join();
+	// }}}
+
+	// Report on each frame
+	// {{{
+	uint64_t	tpix = 0, tenc = 0, tdec = 0, tbytes = 0;
+	unsigned	nfail = 0;
+
+	printf("%-24s %9s %9s %7s %9s %7s %9s %6s %s\n", "Image", "Size",
+		"Enc Cyc", "Px/Clk", "Dec Cyc", "Px/Clk", "Bytes", "Ratio",
+		"Result");
+
+	for(unsigned k=0; k<frames.size(); k++) {
+		const FRAMESTATS *f = &frames[k];
+		const IMGFILE	*img = &f->m_src->m_img;
+		uint64_t	npix = npixels(*f);
+		char		sz[32];
+
+		if (f->m_errors > 0)
+			fprintf(stderr, "ERR: %s, %d pixels differ\n",
+				f->m_src->m_name.c_str(), f->m_errors);
+		if (!f->m_sync_ok)
+			fprintf(stderr, "ERR: %s, TLAST or TUSER is misplaced\n",
+				f->m_src->m_name.c_str());
+		if (!f->pass()) {
+			nfail++;
+			fail = true;
+		}
+
+		snprintf(sz, sizeof(sz), "%dx%d", img->m_width, img->m_height);
+		printf("%-24s %9s %9lu %7.3f %9lu %7.3f %9lu %5.1f%% %s\n",
+			f->m_src->m_name.c_str(), sz,
+			(unsigned long)enc_cycles(*f),
+			enc_cycles(*f) ? npix / (double)enc_cycles(*f) : 0.0,
+			(unsigned long)dec_cycles(*f),
+			dec_cycles(*f) ? npix / (double)dec_cycles(*f) : 0.0,
+			(unsigned long)f->m_bytes, 100.0 * ratio(*f),
+			f->pass() ? "PASS" : "FAIL");
+
+		tpix   += npix;
+		tenc   += enc_cycles(*f);
+		tdec   += dec_cycles(*f);
+		tbytes += f->m_bytes;
+	}
+
+	if (tenc > 0 && tdec > 0)
+		printf("%-24s %9s %9lu %7.3f %9lu %7.3f %9lu %5.1f%% %d/%d\n",
+			"Total", "",
+			(unsigned long)tenc, tpix / (double)tenc,
+			(unsigned long)tdec, tpix / (double)tdec,
+			(unsigned long)tbytes,
+			100.0 * tbytes / ((double)NCHAN * tpix),
+			(unsigned)frames.size() - nfail, (unsigned)frames.size());
+
+	if (csvname && !write_csv(csvname, frames))
+		fail = true;
+	if (jsonname && !write_json(jsonname, frames))
+		fail = true;
+	// }}}
+
+	if (fail) {
+		printf("FAIL!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("SUCCESS!\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,348 @@
+#!/usr/bin/env python3
+################################################################################
+##
+## Filename:	bench/synth/sweep.py
+## {{{
+## Project:	Quite OK image compression (QOI) Verilog implementation
+##
+## Purpose:	Synthesizes the encoder, decoder, and recorder across a sweep
+##		of their parameters, and tabulates the cost (LUTs, FFs, block
+##	RAMs, and DSPs) and speed (Fmax) of each configuration, together with
+##	the pixel rate that speed buys.  The pixel rate is Fmax times the
+##	pixels per clock measured by the matching C++ test bench in bench/cpp,
+##	built with the same settings (see BENCH_VARS), and run without
+##	backpressure on the given images.  The recorder's pixel rate uses the
+##	pixel clock's Fmax, and the throughput of the encoder inside it.
+##
+##	Yosys and nextpnr-ecp5 are used by default, placing and routing each
+##	design out of context--so the number of IOs doesn't matter.  With
+##	--vivado, Vivado is used instead (see vivado.tcl).  The recorder
+##	requires the ZipCPU's DMA and FIFO components, and so is only swept
+##	if --zipcpu gives the path to a copy of the ZipCPU's repository.
+##
+##	Results are written to build/<config>/, and the table to a CSV file.
+##	The benches in bench/cpp are rebuilt (and left clean) along the way.
+##	See the Makefile in this directory for the usual way to run this.
+##
+## Creator:	Dan Gisselquist, Ph.D.
+##		Gisselquist Technology, LLC
+##
+################################################################################
+## }}}
+## Copyright (C) 2024, Gisselquist Technology, LLC
+## {{{
+## This program is free software (firmware): you can redistribute it and/or
+## modify it under the terms of the GNU General Public License as published
+## by the Free Software Foundation, either version 3 of the License, or (at
+## your option) any later version.
+##
+## This program is distributed in the hope that it will be useful, but WITHOUT
+## ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+## FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+## for more details.
+##
+## You should have received a copy of the GNU General Public License along
+## with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+## target there if the PDF file isn't present.)  If not, see
+## <http://www.gnu.org/licenses/> for a copy.
+## }}}
+## License:	GPL, v3, as defined and found on www.gnu.org,
+## {{{
+##		http://www.gnu.org/licenses/gpl.html
+##
+################################################################################
+##
+## }}}
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import sys
+
+HERE  = os.path.dirname(os.path.abspath(__file__))
+RTL   = os.path.normpath(os.path.join(HERE, '..', '..', 'rtl'))
+BENCH = os.path.normpath(os.path.join(HERE, '..', 'cpp'))
+
+# Configurations
+# {{{
+# Each configuration overrides only those parameters that differ from the
+# module's defaults.
+CONFIGS = [
+	( 'enc',		'qoi_encoder',	{} ),
+	( 'enc-dw32',		'qoi_encoder',	{ 'DW': 32 } ),
+	( 'enc-dw128',		'qoi_encoder',	{ 'DW': 128 } ),
+	( 'enc-ppc2',		'qoi_encoder',	{ 'PIXELS_PER_CLOCK': 2 } ),
+	( 'enc-lowpower',	'qoi_encoder',	{ 'OPT_LOWPOWER': 1 } ),
+	( 'enc-infifo3',	'qoi_encoder',	{ 'LGINFIFO': 3 } ),
+	( 'enc-overlap',	'qoi_encoder',	{ 'OPT_OVERLAP': 1 } ),
+	( 'enc-alpha',		'qoi_encoder',	{ 'OPT_ALPHA': 1 } ),
+	( 'enc-budget',		'qoi_encoder',	{ 'OPT_BUDGET': 1 } ),
+	( 'enc-above',		'qoi_encoder',	{ 'OPT_ABOVE': 1 } ),
+	( 'dec',		'qoi_decoder',	{} ),
+	( 'dec-dw32',		'qoi_decoder',	{ 'DW': 32 } ),
+	( 'dec-dw128',		'qoi_decoder',	{ 'DW': 128 } ),
+	( 'dec-tblreg',		'qoi_decoder',	{ 'OPT_TBLREG': 1 } ),
+	( 'dec-alpha',		'qoi_decoder',	{ 'OPT_ALPHA': 1 } ),
+	( 'rec',		'qoi_recorder',	{} ),
+	( 'rec-dw32',		'qoi_recorder',	{ 'DW': 32 } ),
+	( 'rec-lgfifo6',	'qoi_recorder',	{ 'LGFIFO': 6 } ),
+	( 'rec-lgfifo10',	'qoi_recorder',	{ 'LGFIFO': 10 } ),
+	( 'rec-ppc2',		'qoi_recorder',	{ 'PIXELS_PER_CLOCK': 2 } ),
+]
+
+SOURCES = {
+	'qoi_encoder':	[ 'qoi_encoder.v', 'qoi_compress.v', 'qoi_wcompress.v',
+				'qoi_skid.v' ],
+	'qoi_decoder':	[ 'qoi_decoder.v', 'qoi_decompress.v' ],
+	'qoi_recorder':	[ 'qoi_recorder.v', 'qoi_encoder.v', 'qoi_compress.v',
+				'qoi_wcompress.v', 'qoi_skid.v' ],
+}
+
+# Found (by name) within the ZipCPU's repository
+ZIPCPU_SOURCES = [ 'zipdma_rxgears.v', 'zipdma_s2mm.v', 'sfifo.v', 'afifo.v' ]
+
+# The clock whose Fmax sets the pixel rate
+PIXEL_CLOCK = {
+	'qoi_encoder':	'i_clk',
+	'qoi_decoder':	'i_clk',
+	'qoi_recorder':	'i_pix_clk',
+}
+
+# Parameters that set the bench's RTL configuration, the make variable that
+# sets each, and the module's default.  Every one is passed, since the bench
+# Makefile's own defaults differ from the modules'.
+BENCH_VARS = [
+	( 'DW',			'DW',		64 ),
+	( 'PIXELS_PER_CLOCK',	'PPC',		1 ),
+	( 'OPT_ALPHA',		'ALPHA',	0 ),
+	( 'OPT_TBLREG',		'TBLREG',	0 ),
+	( 'LGINFIFO',		'INFIFO',	0 ),
+	( 'OPT_OVERLAP',	'OVERLAP',	0 ),
+	( 'OPT_PERFCOUNTERS',	'PERF',		0 ),
+	( 'OPT_FASTSTART',	'FASTSTART',	0 ),
+	( 'OPT_DELTA',		'DELTA',	0 ),
+	( 'OPT_ABOVE',		'ABOVE',	0 ),
+	( 'OPT_CROP',		'CROP',		0 ),
+	( 'OPT_BUDGET',		'BUDGET',	0 ),
+]
+
+# Where a top level's defaults differ from the encoder's, for the encoder
+# within it
+BENCH_DEFAULTS = {
+	'qoi_recorder':	{ 'OPT_BUDGET': 1 },
+}
+# }}}
+
+def	run(cmd, log=None, cwd=None):
+	# {{{
+	if log:
+		with open(log, 'w') as fp:
+			r = subprocess.run(cmd, cwd=cwd, stdout=fp,
+						stderr=subprocess.STDOUT)
+	else:
+		r = subprocess.run(cmd, cwd=cwd, stdout=subprocess.PIPE,
+					stderr=subprocess.STDOUT, text=True)
+	return r
+# }}}
+
+def	find_zipcpu(root):
+	# {{{
+	found = {}
+	for dirpath, _, files in os.walk(root):
+		for f in files:
+			if f in ZIPCPU_SOURCES and f not in found:
+				found[f] = os.path.join(dirpath, f)
+	missing = [ f for f in ZIPCPU_SOURCES if f not in found ]
+	if missing:
+		sys.exit('ERR: %s not found in %s' % (', '.join(missing), root))
+	return [ found[f] for f in ZIPCPU_SOURCES ]
+# }}}
+
+def	clock_fmax(fmax, port):
+	# {{{
+	# nextpnr names clocks by their nets, which may have been promoted
+	# to a global
+	for k, v in fmax.items():
+		if re.search(r'(^|\$)' + port + r'$', k):
+			return v.get('achieved')
+	return None
+# }}}
+
+def	nextpnr_flow(args, name, top, params, files, odir):
+	# {{{
+	js = os.path.join(odir, top + '.json')
+	script = 'read_verilog -DSYNTHESIS %s; ' % ' '.join(files)
+	for k, v in params.items():
+		script += 'chparam -set %s %d %s; ' % (k, v, top)
+	script += 'synth_ecp5 -top %s -json %s' % (top, js)
+
+	r = run([ args.yosys, '-q', '-p', script ],
+			log=os.path.join(odir, 'yosys.log'))
+	if r.returncode != 0:
+		print('ERR: %s, synthesis failed' % name, file=sys.stderr)
+		return None
+
+	rpt = os.path.join(odir, 'report.json')
+	r = run([ args.nextpnr, '--' + args.device, '--package', args.package,
+			'--speed', str(args.speed), '--freq', str(args.freq),
+			'--out-of-context', '--timing-allow-fail',
+			'--json', js, '--report', rpt ],
+			log=os.path.join(odir, 'nextpnr.log'))
+	if r.returncode != 0 or not os.path.exists(rpt):
+		print('ERR: %s, place and route failed' % name,
+							file=sys.stderr)
+		return None
+
+	with open(rpt) as fp:
+		report = json.load(fp)
+	util = report.get('utilization', {})
+	used = lambda k: util.get(k, {}).get('used', 0)
+	fmax = report.get('fmax', {})
+
+	return {
+		'luts':	used('TRELLIS_COMB') or 2 * used('TRELLIS_SLICE'),
+		'ffs':	used('TRELLIS_FF'),
+		'bram':	used('DP16KD'),
+		'dsp':	used('MULT18X18D'),
+		'fmax':	clock_fmax(fmax, 'i_clk'),
+		'fmax_pix': clock_fmax(fmax, PIXEL_CLOCK[top]),
+	}
+# }}}
+
+def	vivado_flow(args, name, top, params, files, odir):
+	# {{{
+	generics = ' '.join('%s=%d' % (k, v) for k, v in params.items())
+	r = run([ args.vivado_bin, '-mode', 'batch', '-nojournal', '-nolog',
+			'-source', os.path.join(HERE, 'vivado.tcl'),
+			'-tclargs', odir, top, args.part,
+			'%.3f' % (1000.0 / args.freq), generics ] + files,
+			log=os.path.join(odir, 'vivado.log'))
+	res = os.path.join(odir, 'results.txt')
+	if r.returncode != 0 or not os.path.exists(res):
+		print('ERR: %s, Vivado failed' % name, file=sys.stderr)
+		return None
+
+	out = {}
+	with open(res) as fp:
+		for line in fp:
+			k, v = line.split()
+			out[k] = float(v)
+	return {
+		'luts':	int(out.get('luts', 0)),
+		'ffs':	int(out.get('ffs', 0)),
+		'bram':	out.get('bram', 0),
+		'dsp':	int(out.get('dsp', 0)),
+		'fmax':	out.get('fmax_i_clk'),
+		'fmax_pix': out.get('fmax_' + PIXEL_CLOCK[top]),
+	}
+# }}}
+
+def	bench_pixels_per_clock(top, params, images, cache):
+	# {{{
+	# Build the matching bench, and read its throughput from the "Total"
+	# line.  The recorder is measured by its encoder.
+	if not images:
+		return None
+	tb = 'decoder_tb' if top == 'qoi_decoder' else 'encoder_tb'
+	dflts = BENCH_DEFAULTS.get(top, {})
+	mkvars = [ '%s=%d' % (var, params.get(p, dflts.get(p, dflt)))
+					for p, var, dflt in BENCH_VARS ]
+	key = (tb, tuple(mkvars))
+	if key in cache:
+		return cache[key]
+
+	cache[key] = None
+	run([ 'make', 'clean' ], cwd=BENCH)
+	r = run([ 'make', tb ] + mkvars, cwd=BENCH)
+	if r.returncode == 0:
+		r = run([ './' + tb ] + images, cwd=BENCH)
+		for line in r.stdout.splitlines():
+			f = line.split()
+			if r.returncode == 0 and len(f) > 2 and f[0] == 'Total':
+				cache[key] = float(f[2])
+	if cache[key] is None:
+		print('ERR: %s with %s failed' % (tb, ' '.join(mkvars)),
+							file=sys.stderr)
+	return cache[key]
+# }}}
+
+def	main():
+	# {{{
+	ap = argparse.ArgumentParser(description='QOI synthesis sweep')
+	ap.add_argument('--vivado', action='store_true',
+				help='Use Vivado, rather than Yosys and nextpnr')
+	ap.add_argument('--vivado-bin', default='vivado')
+	ap.add_argument('--only', default='',
+				help='Only sweep configurations matching this regex')
+	ap.add_argument('--zipcpu', default='',
+				help='Path to the ZipCPU repository, for the recorder')
+	ap.add_argument('--device', default='85k')
+	ap.add_argument('--package', default='CABGA381')
+	ap.add_argument('--speed', type=int, default=6)
+	ap.add_argument('--part', default='xc7a100tcsg324-1')
+	ap.add_argument('--freq', type=float, default=100.0,
+				help='Target clock rate, MHz')
+	ap.add_argument('--csv', default='synth.csv')
+	ap.add_argument('--yosys', default='yosys')
+	ap.add_argument('--nextpnr', default='nextpnr-ecp5')
+	ap.add_argument('images', nargs='*')
+	args = ap.parse_args()
+
+	images = [ os.path.abspath(f) for f in args.images ]
+	zipcpu = find_zipcpu(args.zipcpu) if args.zipcpu else []
+	flow   = vivado_flow if args.vivado else nextpnr_flow
+	cache  = {}
+	rows   = []
+
+	for name, top, params in CONFIGS:
+		if args.only and not re.search(args.only, name):
+			continue
+		if top == 'qoi_recorder' and not zipcpu:
+			print('Skipping %s: no --zipcpu given' % name)
+			continue
+
+		odir = os.path.join(HERE, 'build', name)
+		os.makedirs(odir, exist_ok=True)
+		files = [ os.path.join(RTL, f) for f in SOURCES[top] ]
+		if top == 'qoi_recorder':
+			files += zipcpu
+
+		res = flow(args, name, top, params, files, odir)
+		if res is None:
+			continue
+		res['ppc'] = bench_pixels_per_clock(top, params, images, cache)
+		res['mpix'] = (res['fmax_pix'] * res['ppc']
+			if res['fmax_pix'] and res['ppc'] else None)
+		res['name'], res['top'] = name, top
+		res['params'] = ' '.join('%s=%d' % (k, v)
+						for k, v in params.items())
+		rows.append(res)
+
+	if images:
+		run([ 'make', 'clean' ], cwd=BENCH)
+
+	# Report
+	# {{{
+	fields = [ 'name', 'top', 'params', 'luts', 'ffs', 'bram', 'dsp',
+			'fmax', 'fmax_pix', 'ppc', 'mpix' ]
+	with open(args.csv, 'w', newline='') as fp:
+		w = csv.writer(fp)
+		w.writerow(fields)
+		for r in rows:
+			w.writerow([ '' if r[f] is None else r[f] for f in fields ])
+
+	fmt = lambda v, p: '-' if v is None else '%.*f' % (p, v)
+	print('%-14s %7s %7s %5s %4s %8s %8s %7s %9s' % ('Config', 'LUTs',
+		'FFs', 'BRAM', 'DSP', 'Fmax', 'Fmax(px)', 'Px/Clk', 'Mpixel/s'))
+	for r in rows:
+		print('%-14s %7d %7d %5s %4d %8s %8s %7s %9s' % (r['name'],
+			r['luts'], r['ffs'], fmt(r['bram'], 1), r['dsp'],
+			fmt(r['fmax'], 1), fmt(r['fmax_pix'], 1),
+			fmt(r['ppc'], 3), fmt(r['mpix'], 1)))
+	# }}}
+# }}}
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,98 @@
+################################################################################
+##
+## Filename:	bench/synth/vivado.tcl
+## {{{
+## Project:	Quite OK image compression (QOI) Verilog implementation
+##
+## Purpose:	Synthesizes, places, and routes one configuration out of
+##		context under Vivado, on behalf of sweep.py.  Usage:
+##
+##	vivado -mode batch -source vivado.tcl -tclargs <outdir> <top> <part>
+##		<period (ns)> <"PARAM=value ..."> <files ...>
+##
+##	Writes its utilization and timing reports to <outdir>, together with
+##	a results.txt file of "name value" lines for sweep.py to read: luts,
+##	ffs, bram (in 36kb blocks), dsp, and fmax_<clock> (MHz) for each of
+##	i_clk and i_pix_clk (if present).
+##
+## Creator:	Dan Gisselquist, Ph.D.
+##		Gisselquist Technology, LLC
+##
+################################################################################
+## }}}
+## Copyright (C) 2024, Gisselquist Technology, LLC
+## {{{
+## This program is free software (firmware): you can redistribute it and/or
+## modify it under the terms of the GNU General Public License as published
+## by the Free Software Foundation, either version 3 of the License, or (at
+## your option) any later version.
+##
+## This program is distributed in the hope that it will be useful, but WITHOUT
+## ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+## FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+## for more details.
+##
+## You should have received a copy of the GNU General Public License along
+## with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+## target there if the PDF file isn't present.)  If not, see
+## <http://www.gnu.org/licenses/> for a copy.
+## }}}
+## License:	GPL, v3, as defined and found on www.gnu.org,
+## {{{
+##		http://www.gnu.org/licenses/gpl.html
+##
+################################################################################
+##
+## }}}
+set outdir	[lindex $argv 0]
+set top		[lindex $argv 1]
+set part	[lindex $argv 2]
+set period	[lindex $argv 3]
+set params	[lindex $argv 4]
+set files	[lrange $argv 5 end]
+
+foreach f $files { read_verilog $f }
+
+set generics {}
+foreach p $params { lappend generics -generic $p }
+synth_design -top $top -part $part -mode out_of_context {*}$generics
+
+## Clocks
+## {{{
+set clocks {}
+foreach clk {i_clk i_pix_clk} {
+	if {[llength [get_ports -quiet $clk]] > 0} {
+		create_clock -name $clk -period $period [get_ports $clk]
+		lappend clocks $clk
+	}
+}
+if {[llength $clocks] > 1} {
+	set_clock_groups -asynchronous -group i_clk -group i_pix_clk
+}
+## }}}
+
+opt_design
+place_design
+route_design
+
+report_utilization	-file $outdir/utilization.rpt
+report_timing_summary	-file $outdir/timing.rpt
+
+## Results
+## {{{
+set fp [open $outdir/results.txt w]
+puts $fp "luts [llength [get_cells -hier -filter {PRIMITIVE_GROUP == LUT}]]"
+puts $fp "ffs [llength [get_cells -hier -filter {PRIMITIVE_GROUP == FLOP_LATCH}]]"
+set bram [expr {[llength [get_cells -hier -filter {REF_NAME =~ RAMB36*}]] \
+	+ 0.5 * [llength [get_cells -hier -filter {REF_NAME =~ RAMB18*}]]}]
+puts $fp "bram $bram"
+puts $fp "dsp [llength [get_cells -hier -filter {REF_NAME =~ DSP48*}]]"
+foreach clk $clocks {
+	set path [get_timing_paths -setup -max_paths 1 -group $clk]
+	if {[llength $path] > 0} {
+		set slack [get_property SLACK $path]
+		puts $fp "fmax_$clk [expr {1000.0 / ($period - $slack)}]"
+	}
+}
+close $fp
+## }}}
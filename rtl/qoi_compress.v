@@ -8,7 +8,12 @@
 //		doesn't handle header or trailer insertions.  As such, it
 //	requires an external wrapper (somewhere) to guarantee proper formatting.
 //
-//	This implementation does not handle ALPHA.
+//	ALPHA is only handled if OPT_ALPHA is set.  In that case, pixels are
+//	32 bits wide, { A, R, G, B }, with alpha in the MSBs, and pixels whose
+//	alpha differs from the pixel before them are encoded with QOI_OP_RGBA.
+//	At five bytes, this op doesn't fit in a beat.  It is sent as two,
+//	{ 8'hff, R, G, B } followed by A alone, and so costs one extra clock.
+//	Otherwise, pixels are 24 bits, { R, G, B }, and always fully opaque.
 //
 //	The input is an AXI video stream, save two signals:
 //	HLAST: true on the last pixel of every line.
@@ -24,6 +29,83 @@
 //	LAST: True on the last DATA beat of any image.
 //	Line boundaries are not preserved in this implementation.
 //
+//	Each beat holds exactly one QOI op.  OPS identifies which, one bit
+//	per op type: { RUN, INDEX, DIFF, LUMA, RGB }.  It is provided for
+//	gathering statistics, and may be ignored otherwise.  RGBA ops are
+//	counted as RGB ops, on the first of their two beats.
+//
+//	OPT_DELTA, together with I_DELTA, prepares the stream for delta
+//	frames (see qoi_encoder).  Runs then end at the end of every line,
+//	so each line's ops may be replaced as a whole, and are never longer
+//	than 61 pixels, leaving the op a run of 62 would've used (0xfd) free
+//	to mean "this line is unchanged."  M_HLAST then marks the op holding
+//	the last pixel of each line.  I_DELTA should only change between
+//	frames.  It is ignored without OPT_DELTA, and isn't supported with
+//	OPT_ALPHA.
+//
+//	OPT_ABOVE, together with I_ABOVE, predicts pixels from the line
+//	before.  The op 0xfc, which would otherwise be a run of 61, then
+//	stands for a pixel equal to the one directly above it.  A line buffer
+//	of 2^LGABOVE pixels, read alongside the hash table, holds the line
+//	before.  Pixels on the first line of each frame, and those past the
+//	first 2^LGABOVE of any line, are never predicted.  Runs still come
+//	first, followed by INDEX ops, and then this op ahead of any other.
+//	To keep 0xfc free, runs are no longer than 60 pixels.  Such ops are
+//	counted as INDEX ops on M_OPS.  Streams using them are no longer
+//	standard QOI: qoi_encoder marks them with the magic number "qoiv".
+//	I_ABOVE should only change between frames, and is ignored while
+//	I_DELTA is set.
+//
+//	OPT_PERFCOUNTERS adds a set of pipeline occupancy counters.  Six
+//	stages are watched: the input (skidbuffer), steps one through four,
+//	and the output.  For each, two 32-bit counters are kept: the number
+//	of clocks the stage was valid and moving (valid && ready), and the
+//	number it was valid but stalled (valid && !ready).  Any remaining
+//	clocks the stage was idle.  A count of all clocks is kept as well.
+//	At the end of every frame, as its last beat leaves the output, the
+//	counters are copied to O_PERF and then restarted, so O_PERF always
+//	describes the last complete frame (including any idle time before
+//	it):
+//
+//	    { CLOCKS, INPUT_MOVING, INPUT_STALLED, S1_MOVING, S1_STALLED,
+//		S2_MOVING, S2_STALLED, S3_MOVING, S3_STALLED,
+//		S4_MOVING, S4_STALLED, OUTPUT_MOVING, OUTPUT_STALLED }
+//
+//	Since the pipeline steps as one, with a single ready signal, a stall
+//	anywhere is a stall everywhere.  Output stalls are due to m_ready,
+//	and so to whatever is downstream.  Stalls within the pipeline while
+//	the output is moving (or idle) are due instead to a lack of input
+//	pixels to push the pipeline forward.  Idle input clocks are clocks
+//	where no pixel was offered at all.  Steps four and five are idle
+//	during runs, since repeated pixels produce no ops.  Without
+//	OPT_PERFCOUNTERS, O_PERF is zero.
+//
+//	OPT_OVERLAP allows the first pixel of a frame to enter the pipeline on
+//	the clock following the last pixel of the frame before, rather than
+//	waiting for that frame to drain from the pipeline and leave the
+//	output.  The hash table is already cleared in a single clock, as the
+//	last pixel leaves step two, so only the pixel differences and runs
+//	need to know where the frame starts: each step treats the pixel
+//	before the first of a frame as opaque black, whether or not the last
+//	pixel of the frame before is still in the step behind it.  A frame's
+//	last pixel is pushed through the pipeline by any pixels of the next
+//	frame, or otherwise on its own.  Its formal properties follow frames
+//	back to back: every frame end that enters the pipeline leaves it, and
+//	each step's differences are checked against black at a frame's
+//	start.  Until its proof (prfoverlap) passes, OPT_OVERLAP is off in
+//	the test benches by default.
+//
+//	The formal properties below also model OPT_ALPHA, in both the hash
+//	and the second beat of each RGBA op, the line ends of I_DELTA, and,
+//	for OPT_ABOVE, one column of the line buffer, against which every
+//	0xfc op is checked.  Beyond the default configuration,
+//	bench/formal/qoi_compress.sby has a task for each of these options:
+//	prfalpha, prfdelta, prfabove, and prfoverlap.
+//
+//	LGINFIFO, if non-zero, replaces the input skid buffer with a FIFO of
+//	2^LGINFIFO pixels (see qoi_skid), so that a burst of stalls at the output
+//	needn't be felt at once by the video source.
+//
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
 //
@@ -54,59 +136,95 @@
 //
 `default_nettype none
 // }}}
-module	qoi_compress (
+module	qoi_compress #(
+		// {{{
+		parameter	[0:0]	OPT_ALPHA = 1'b0,
+		parameter	[0:0]	OPT_PERFCOUNTERS = 1'b0,
+		parameter	[0:0]	OPT_DELTA = 1'b0,
+		parameter	[0:0]	OPT_OVERLAP = 1'b0,
+		parameter	[0:0]	OPT_ABOVE = 1'b0,
+		// LGABOVE: log_2 of the longest line that may be predicted
+		// from the line above, if OPT_ABOVE is set
+		parameter		LGABOVE = 11,
+		parameter		LGINFIFO = 0,
+		localparam		PXW = (OPT_ALPHA) ? 32 : 24,
+		localparam		PERFW = 13*32
+		// }}}
+	) (
 		input	wire	i_clk, i_reset,
 		// Video stream input
 		// {{{
 		input	wire		s_vid_valid,
 		output	wire		s_vid_ready,
-		input	wire	[23:0]	s_vid_data,
+		input	wire [PXW-1:0]	s_vid_data,
 		input	wire		s_vid_hlast,
 		input	wire		s_vid_vlast,
 		// }}}
+		// End runs at line ends, if OPT_DELTA is set
+		input	wire		i_delta,
+		// Predict from the line above, if OPT_ABOVE is set
+		input	wire		i_above,
 		// QOI compressed output stream
 		// {{{
 		output	reg		m_valid,
 		input	wire		m_ready,
 		output	reg	[31:0]	m_data,
 		output	reg	[1:0]	m_bytes,
-		output	reg		m_last
+		output	reg		m_last,
+		output	reg		m_hlast,
+		output	reg	[4:0]	m_ops,
 		// }}}
+		output	wire [PERFW-1:0] o_perf
 	);
 
 	// Local declarations
 	// {{{
+	// Every frame starts from opaque black
+	localparam [31:0]	BLACK32 = (OPT_ALPHA) ? 32'hff00_0000 : 32'h0;
+	localparam [PXW-1:0]	BLACK = BLACK32[PXW-1:0];
+
 	wire		skd_valid, skd_ready, skd_hlast, skd_vlast;
-	wire	[23:0]	skd_data;
+	wire	[PXW-1:0]	skd_data;
 
-	reg		s1_valid, s1_last;
-	reg	[5:0]	s1_rhash, s1_ghash, s1_bhash;
-	reg	[23:0]	s1_pixel;
+	reg		s1_valid, s1_last, s1_hlast;
+	reg	[5:0]	s1_rhash, s1_ghash, s1_bhash, s1_ahash;
+	reg	[PXW-1:0]	s1_pixel;
 	wire		s1_ready;
 
-	reg		s2_valid, s2_last;
+	reg		s2_valid, s2_last, s2_hlast;
 	reg	[5:0]	s2_tbl_index;
-	reg	[23:0]	s2_pixel;
+	reg	[PXW-1:0]	s2_pixel;
 	reg	[7:0]	s2_gdiff;
 	wire		s2_ready;
 
-	reg		s3_valid, s3_last, s3_tbl_valid, s3_rptvalid;
-	reg	[23:0]	s3_pixel, s3_tbl_pixel;
+	reg		s3_valid, s3_last, s3_tbl_valid, s3_rptvalid,
+			s3_anew, s3_hlast;
+	reg	[PXW-1:0]	s3_pixel, s3_tbl_pixel;
 	reg	[5:0]	s3_repeats, s3_tblidx;
 	reg	[7:0]	s3_rdiff, s3_gdiff, s3_bdiff, s3_rgdiff, s3_bgdiff;
-	wire		s3_continue, s3_ready;
+	wire		s3_continue, s3_ready, s3_eol, s3_step;
+	// The pixels before those in steps one and two, in their frames
+	wire	[PXW-1:0]	s2_prior, s3_prior;
+	// The pixel above the one in step three, if s3_abvok
+	wire		abv_en, s3_abvok;
+	wire	[PXW-1:0]	s3_above;
 
 	reg	[63:0]	tbl_valid;
-	reg	[23:0]	tbl_pixel	[0:63];
+	reg	[PXW-1:0]	tbl_pixel	[0:63];
 
-	reg		s4_valid, s4_tblset, s4_rptset, s4_last,
-			s4_small, s4_bigdf;
+	reg		s4_valid, s4_tblset, s4_rptset, s4_abvset, s4_last,
+			s4_hlast, s4_small, s4_bigdf, s4_rgba;
 	reg	[5:0]	s4_tblidx, s4_repeats, s4_gdiff;
-	reg	[23:0]	s4_pixel;
+	reg	[PXW-1:0]	s4_pixel;
 	reg	[3:0]	s4_rgdiff, s4_bgdiff;
 	reg	[1:0]	s4_rdiff, s4_bdiff;
 	wire		s4_ready;
 
+	wire		s4_twobeat;
+
+	reg		m_apend, m_alast;
+	reg	[7:0]	m_alpha;
+
 	wire		gbl_ready;
 	reg		gbl_last;
 	// }}}
@@ -122,7 +240,7 @@ module	qoi_compress (
 `ifdef	FORMAL
 		.OPT_PASSTHROUGH(1'b1),
 `endif
-		.OPT_OUTREG(1'b0), .DW(2+24)
+		.OPT_OUTREG(1'b0), .LGDEPTH(LGINFIFO), .DW(2+PXW)
 	) u_skid (
 		// {{{
 		.i_clk(i_clk), .i_reset(i_reset),
@@ -160,21 +278,27 @@ module	qoi_compress (
 	else if (s1_ready)
 		s1_last <= 0;
 
-	initial	s1_pixel = 0;
+	initial	s1_pixel = BLACK;
 	always @(posedge i_clk)
 	if (i_reset)
-		s1_pixel <= 0;
+		s1_pixel <= BLACK;
 	else if (skd_valid && skd_ready)
 		s1_pixel <= skd_data;
 	else if (s1_ready && s1_last)
-		s1_pixel <= 0;
+		s1_pixel <= BLACK;
 
 	always @(posedge i_clk)
 	if (skd_valid && skd_ready)
 	begin
+		s1_hlast <= skd_hlast;
 		s1_rhash <= skd_data[21:16] + { skd_data[20:16], 1'b0 };
 		s1_ghash <= skd_data[13: 8] + { skd_data[11: 8], 2'b0 };
 		s1_bhash <= { skd_data[2:0], 3'h0} - skd_data[ 5: 0];
+		// A * 11 = (A << 3) + (A << 1) + A.  Without OPT_ALPHA, this
+		// is a constant, and is added in step #2 instead.
+		s1_ahash <= { skd_data[PXW-6:PXW-8], 3'h0 }
+				+ { skd_data[PXW-4:PXW-8], 1'b0 }
+				+ skd_data[PXW-3:PXW-8];
 	end
 	// }}}
 	////////////////////////////////////////////////////////////////////////
@@ -194,14 +318,14 @@ module	qoi_compress (
 	else if (s2_ready)
 		s2_valid <= 1'b0;
 
-	initial	s2_pixel = 0;
+	initial	s2_pixel = BLACK;
 	always @(posedge i_clk)
 	if (i_reset)
-		s2_pixel <= 0;
+		s2_pixel <= BLACK;
 	else if (s1_valid && s1_ready)
 		s2_pixel <= s1_pixel;
 	else if (s2_ready && s2_last)
-		s2_pixel <= 0;
+		s2_pixel <= BLACK;
 
 	always @(posedge i_clk)
 	if (i_reset)
@@ -211,12 +335,19 @@ module	qoi_compress (
 	else if (s2_ready)
 		s2_last <= 1'b0;
 
+	// With OPT_OVERLAP, the last pixel of one frame may be followed
+	// directly by the first of the next
+	assign	s2_prior = (OPT_OVERLAP && s2_last) ? BLACK : s2_pixel;
+
 	always @(posedge i_clk)
 	if (s1_valid && s1_ready)
 	begin
-		s2_tbl_index <= s1_rhash + s1_ghash + s1_bhash + 6'h35;
+		// 255 * 11 = 2805 = 6'h35 (mod 64), the hash of opaque alpha
+		s2_tbl_index <= s1_rhash + s1_ghash + s1_bhash
+				+ ((OPT_ALPHA) ? s1_ahash : 6'h35);
 
-		s2_gdiff <= s1_pixel[15: 8] - s2_pixel[15: 8];
+		s2_gdiff <= s1_pixel[15: 8] - s2_prior[15: 8];
+		s2_hlast <= s1_hlast;
 	end
 
 	// }}}
@@ -248,7 +379,11 @@ module	qoi_compress (
 	begin
 		if (!s3_continue)
 		begin
-			s3_rptvalid <= s3_rptvalid && (s3_pixel == s2_pixel);
+			// At a line end, a new line may start with a run.
+			// So may a new frame, if it follows directly.
+			s3_rptvalid <= (s3_rptvalid || s3_eol
+					|| (OPT_OVERLAP && s3_last))
+						&& (s3_prior == s2_pixel);
 			s3_repeats <= 0;
 		end else if (!s3_rptvalid)
 		begin
@@ -258,8 +393,12 @@ module	qoi_compress (
 			s3_rptvalid  <= 1;
 			s3_repeats <= s3_repeats + 1;
 		end
-	end else if (s3_valid && s3_ready && s3_last)
+	end else if (s3_step && (s3_last || !s3_continue))
 	begin
+		// Nothing followed, yet this run has still been handed on:
+		// at the end of a frame, a line (with I_DELTA), or its
+		// longest length.  It mustn't be held, or it would be handed
+		// on again once the next pixel shows up.
 		s3_repeats   <= 0;
 		s3_rptvalid  <= 0;
 	end
@@ -291,16 +430,202 @@ module	qoi_compress (
 		tbl_pixel[s2_tbl_index] <= s2_pixel;
 	// }}}
 
+	// Line buffer lookup, for OPT_ABOVE
+	// {{{
+	// Each pixel is looked up by its column, and then replaces the pixel
+	// above it.  The column follows each pixel from the input, as does
+	// whether or not it may be predicted.
+	assign	abv_en = OPT_ABOVE && i_above && !(OPT_DELTA && i_delta);
+
+	generate if (OPT_ABOVE)
+	begin : GEN_ABOVE
+		reg	[LGABOVE-1:0]	ab_col, s1_col, s2_col;
+		reg			ab_row0, ab_over, s1_abvok, s2_abvok,
+					s1_abvwr, s2_abvwr, r_abvok;
+		reg	[PXW-1:0]	r_above;
+		reg	[PXW-1:0]	line_pixel	[0:(1<<LGABOVE)-1];
+
+		initial	ab_col  = 0;
+		initial	ab_over = 1'b0;
+		initial	ab_row0 = 1'b1;
+		always @(posedge i_clk)
+		if (i_reset)
+		begin
+			ab_col  <= 0;
+			ab_over <= 1'b0;
+			ab_row0 <= 1'b1;
+		end else if (skd_valid && skd_ready)
+		begin
+			if (skd_hlast)
+			begin
+				ab_col  <= 0;
+				ab_over <= 1'b0;
+				ab_row0 <= skd_vlast;
+			end else if (!ab_over)
+				{ ab_over, ab_col } <= { 1'b0, ab_col } + 1'b1;
+		end
+
+		always @(posedge i_clk)
+		if (skd_valid && skd_ready)
+		begin
+			s1_col   <= ab_col;
+			s1_abvok <= !ab_row0 && !ab_over;
+			s1_abvwr <= !ab_over;
+		end
+
+		always @(posedge i_clk)
+		if (s1_valid && s1_ready)
+		begin
+			s2_col   <= s1_col;
+			s2_abvok <= s1_abvok;
+			s2_abvwr <= s1_abvwr;
+		end
+
+		always @(posedge i_clk)
+		if (s2_valid && s2_ready)
+		begin
+			r_above <= line_pixel[s2_col];
+			r_abvok <= s2_abvok;
+		end
+
+		always @(posedge i_clk)
+		if (s2_valid && s2_ready && s2_abvwr)
+			line_pixel[s2_col] <= s2_pixel;
+
+		assign	s3_above = r_above;
+		assign	s3_abvok = r_abvok;
+`ifdef	FORMAL
+		// {{{
+		// Follow one column, fa_col, of the line buffer.  Each pixel
+		// in it is predicted from the last pixel written to it: for
+		// frames whose lines are all the same width, the pixel above.
+		// The columns, and which pixels may be predicted, are counted
+		// afresh as pixels enter step two.
+		(* anyconst *)	reg	[LGABOVE-1:0]	fa_col;
+		reg	[LGABOVE:0]	fa_ncol, fa2_col;
+		reg			fa_nrow0, fa2_row0, fa_valid,
+					fa3_mine, fa4_mine, fa4_ok, fam_mine,
+					fam_ok;
+		reg	[PXW-1:0]	fa_pixel, fa3_above, fa4_above,
+					fam_above, fam_pixel;
+
+		// The column and row of the next pixel into step two
+		initial	fa_ncol  = 0;
+		initial	fa_nrow0 = 1'b1;
+		always @(posedge i_clk)
+		if (i_reset)
+		begin
+			fa_ncol  <= 0;
+			fa_nrow0 <= 1'b1;
+		end else if (s1_valid && s1_ready)
+		begin
+			if (s1_hlast)
+			begin
+				fa_ncol  <= 0;
+				fa_nrow0 <= s1_last;
+			end else if (!fa_ncol[LGABOVE])
+				fa_ncol <= fa_ncol + 1;
+		end
+
+		always @(posedge i_clk)
+		if (s1_valid && s1_ready)
+		begin
+			fa2_col  <= fa_ncol;
+			fa2_row0 <= fa_nrow0;
+		end
+
+		always @(*)
+		if (s2_valid)
+		begin
+			assert(s2_abvwr == !fa2_col[LGABOVE]);
+			if (!fa2_col[LGABOVE])
+				assert(s2_col == fa2_col[LGABOVE-1:0]);
+			assert(s2_abvok == (!fa2_row0 && !fa2_col[LGABOVE]));
+		end
+
+		// The line buffer, at fa_col
+		initial	fa_valid = 1'b0;
+		always @(posedge i_clk)
+		if (s2_valid && s2_ready && s2_abvwr && s2_col == fa_col)
+		begin
+			fa_valid <= 1'b1;
+			fa_pixel <= s2_pixel;
+		end
+
+		always @(*)
+		if (fa_valid)
+			assert(line_pixel[fa_col] == fa_pixel);
+
+		// Step three: the pixel above, as read
+		always @(posedge i_clk)
+		if (s2_valid && s2_ready)
+		begin
+			fa3_mine  <= s2_abvok && s2_col == fa_col && fa_valid;
+			fa3_above <= fa_pixel;
+		end
+
+		always @(*)
+		if (s3_valid && fa3_mine)
+			assert(s3_abvok && s3_above == fa3_above);
+
+		// Step four: the pixel is only ever predicted from the pixel
+		// above, and never on the first line of a frame
+		always @(posedge i_clk)
+		if (s3_step && (!s3_rptvalid || !s3_continue))
+		begin
+			fa4_ok    <= s3_abvok;
+			fa4_mine  <= fa3_mine;
+			fa4_above <= fa3_above;
+		end
+
+		always @(*)
+		if (s4_valid && s4_abvset)
+		begin
+			assert(abv_en && fa4_ok);
+			if (fa4_mine)
+				assert(s4_pixel == fa4_above);
+		end
+
+		// The output
+		always @(posedge i_clk)
+		if (s4_valid && s4_ready)
+		begin
+			fam_ok    <= fa4_ok;
+			fam_mine  <= fa4_mine;
+			fam_above <= fa4_above;
+			fam_pixel <= s4_pixel;
+		end
+
+		always @(*)
+		if (m_valid && m_ops == 5'b01000 && m_data[31:24] == 8'hfc)
+		begin
+			assert(abv_en && fam_ok);
+			if (fam_mine)
+				assert(fam_pixel == fam_above);
+		end
+
+		// Runs are no longer than 60 pixels, keeping 8'hfc free
+		always @(*)
+		if (m_valid && abv_en && m_ops == 5'b10000)
+			assert(m_data[31:24] < 8'hfc);
+		// }}}
+`endif
+	end else begin : NO_ABOVE
+		assign	s3_above = BLACK;
+		assign	s3_abvok = 1'b0;
+	end endgenerate
+	// }}}
+
 	// s3_(everything else): tblidx, xdiff, xgdiff, xlast, && pixel
 	// {{{
-	initial	s3_pixel = 0;
+	initial	s3_pixel = BLACK;
 	always @(posedge i_clk)
 	if (i_reset)
-		s3_pixel <= 0;
+		s3_pixel <= BLACK;
 	else if (s2_valid && s2_ready)
 		s3_pixel <= s2_pixel;
 	else if (s3_ready && s3_last)
-		s3_pixel <= 0;
+		s3_pixel <= BLACK;
 
 	always @(posedge i_clk)
 	if (i_reset)
@@ -314,19 +639,38 @@ module	qoi_compress (
 	if (s2_valid && s2_ready)
 	begin
 		s3_tblidx <= s2_tbl_index;
+		s3_hlast  <= s2_hlast;
 
-		s3_rdiff <= s2_pixel[23:16] - s3_pixel[23:16];
-		// s3_gdiff <= s2_pixel[15: 8] - s3_pixel[15: 8];
+		s3_rdiff <= s2_pixel[23:16] - s3_prior[23:16];
+		// s3_gdiff <= s2_pixel[15: 8] - s3_prior[15: 8];
 		s3_gdiff <= s2_gdiff;
-		s3_bdiff <= s2_pixel[ 7: 0] - s3_pixel[ 7: 0];
+		s3_bdiff <= s2_pixel[ 7: 0] - s3_prior[ 7: 0];
 
-		s3_rgdiff <= (s2_pixel[23:16] - s3_pixel[23:16]) - s2_gdiff;
-		s3_bgdiff <= (s2_pixel[ 7: 0] - s3_pixel[ 7: 0]) - s2_gdiff;
+		s3_rgdiff <= (s2_pixel[23:16] - s3_prior[23:16]) - s2_gdiff;
+		s3_bgdiff <= (s2_pixel[ 7: 0] - s3_prior[ 7: 0]) - s2_gdiff;
+
+		s3_anew <= OPT_ALPHA
+			&& (s2_pixel[PXW-1:PXW-8] != s3_prior[PXW-1:PXW-8]);
 	end
 	// }}}
 
-	assign	s3_continue = (s3_pixel == s2_pixel) &&(s3_repeats < 6'd61)
-					&& !s3_last;
+	assign	s3_prior = (OPT_OVERLAP && s3_last) ? BLACK : s3_pixel;
+
+	// For delta frames, runs are cut one pixel shorter, and at every line
+	// end.  When predicting from the line above, they're cut two shorter.
+	assign	s3_eol = OPT_DELTA && i_delta && s3_hlast;
+	assign	s3_continue = (s3_pixel == s2_pixel)
+			&& (s3_repeats < ((OPT_DELTA && i_delta) ? 6'd60
+					: (abv_en) ? 6'd59 : 6'd61))
+			&& !s3_last && !s3_eol;
+
+	// Step three normally moves on when it's valid.  With OPT_OVERLAP,
+	// pushing the last pixel of one frame out of the pipeline may leave a
+	// gap behind the first pixel of the next.  If that pixel started a
+	// run, step three holds the run while no longer valid, and must still
+	// hand it to step four once the next pixel shows up.
+	assign	s3_step = s3_ready && (s3_valid
+				|| (OPT_OVERLAP && s3_rptvalid && s2_valid));
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -340,41 +684,51 @@ module	qoi_compress (
 	always @(posedge i_clk)
 	if (i_reset)
 		s4_valid <= 0;
-	else if (s3_valid && s3_ready)
+	else if (s3_step)
 		s4_valid <= (!s3_rptvalid || !s3_continue);
 	else if (s4_ready)
 		s4_valid <= 1'b0;
 
-	initial	s4_pixel = 0;
+	initial	s4_pixel = BLACK;
 	always @(posedge i_clk)
 	if (i_reset)
-		s4_pixel <= 0;
-	else if (s3_valid && s3_ready && (!s3_rptvalid || !s3_continue))
+		s4_pixel <= BLACK;
+	else if (s3_step && (!s3_rptvalid || !s3_continue))
 		s4_pixel <= s3_pixel;
 	else if (s4_ready && s4_last)
-		s4_pixel <= 0;
+		s4_pixel <= BLACK;
 
 	always @(posedge i_clk)
 	if (i_reset)
 		s4_last <= 1'b0;
-	else if (s3_valid && s3_ready)
+	else if (s3_step)
 		s4_last <= s3_last;
 	else if (s4_ready)
 		s4_last <= 1'b0;
 
+	// Without I_DELTA, a run may cover the ends of many lines
+	always @(posedge i_clk)
+	if (s3_step)
+		s4_hlast <= s3_eol || s3_last;
+
 	initial	s4_rptset  = 0;
 	initial	s4_repeats = 0;
 	initial	s4_repeats = 0;
 	always @(posedge i_clk)
-	if (s3_valid && s3_ready)
+	if (s3_step)
 	begin
 		s4_tblset <= (s3_pixel == s3_tbl_pixel) && s3_tbl_valid
 						&& (s3_tblidx != s4_tblidx);
 		s4_tblidx <= s3_tblidx;
 
+		s4_abvset <= abv_en && s3_abvok && (s3_pixel == s3_above);
+
 		s4_rptset  <= s3_rptvalid && !s3_continue;
 		s4_repeats <= s3_repeats;
 
+		// DIFF and LUMA ops can only be used if alpha is unchanged
+		s4_rgba <= s3_anew;
+
 		s4_small <= ((&s3_rdiff[7:1]) || (s3_rdiff <= 1))
 			&&  ((&s3_gdiff[7:1]) || (s3_gdiff <= 1))
 			&&  ((&s3_bdiff[7:1]) || (s3_bdiff <= 1));
@@ -399,21 +753,53 @@ module	qoi_compress (
 	//
 	//
 
+	// An RGBA op takes two beats.  The second, holding alpha alone, is
+	// pending (m_apend) while the first is on the output.
+	assign	s4_twobeat = OPT_ALPHA && s4_rgba && !s4_rptset && !s4_tblset
+					&& !s4_abvset;
+
 	initial	m_valid = 1'b0;
 	always @(posedge i_clk)
 	if (i_reset)
 		m_valid <= 1'b0;
 	else if (!m_valid || m_ready)
-		m_valid <= s4_valid && s4_ready;
+		m_valid <= (s4_valid && s4_ready) || m_apend;
 
 	always @(posedge i_clk)
 	if (i_reset)
 		m_last <= 1'b0;
 	else if (s4_valid && s4_ready)
-		m_last <= s4_last;
+		m_last <= s4_last && !s4_twobeat;
+	else if (m_apend && m_ready)
+		m_last <= m_alast;
 	else if (m_ready)
 		m_last <= 1'b0;
 
+	initial	m_hlast = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		m_hlast <= 1'b0;
+	else if (s4_valid && s4_ready)
+		m_hlast <= s4_hlast && !s4_twobeat;
+	else if (m_ready)
+		m_hlast <= 1'b0;
+
+	initial	m_apend = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		m_apend <= 1'b0;
+	else if (s4_valid && s4_ready)
+		m_apend <= s4_twobeat;
+	else if (m_ready)
+		m_apend <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s4_valid && s4_ready)
+	begin
+		m_alpha <= s4_pixel[PXW-1:PXW-8];
+		m_alast <= s4_last;
+	end
+
 	always @(posedge i_clk)
 	if (s4_valid && s4_ready)
 	begin
@@ -421,10 +807,23 @@ module	qoi_compress (
 		begin
 			m_data <= { 2'b11, s4_repeats, 24'h0 };
 			m_bytes <= 2'd1;
+			m_ops   <= 5'b10000;
 		end else if (s4_tblset)
 		begin
 			m_data <= { 2'b00, s4_tblidx, 24'h0 };
 			m_bytes <= 2'd1;
+			m_ops   <= 5'b01000;
+		end else if (s4_abvset)
+		begin
+			// The pixel above, counted as an INDEX op
+			m_data <= { 8'hfc, 24'h0 };
+			m_bytes <= 2'd1;
+			m_ops   <= 5'b01000;
+		end else if (s4_twobeat)
+		begin
+			m_data <= { 8'hff, s4_pixel[23:0] };
+			m_bytes <= 2'd0;
+			m_ops   <= 5'b00001;
 		end else if (s4_small)
 		begin
 			m_data <= { 2'b01, s4_rdiff[1:0], s4_gdiff[1:0],
@@ -433,6 +832,7 @@ module	qoi_compress (
 			m_data[27:26] <= s4_gdiff[1:0] + 2'b10;
 			m_data[25:24] <= s4_bdiff[1:0] + 2'b10;
 			m_bytes <= 2'd1;
+			m_ops   <= 5'b00100;
 		end else if (s4_bigdf)
 		begin
 			m_data <= { 2'b10, s4_gdiff[5:0],
@@ -442,10 +842,17 @@ module	qoi_compress (
 			m_data[23:20] <= s4_rgdiff[3:0] + 4'h8;
 			m_data[19:16] <= s4_bgdiff[3:0] + 4'h8;
 			m_bytes <= 2'd2;
+			m_ops   <= 5'b00010;
 		end else begin
-			m_data <= { 8'hfe, s4_pixel };
+			m_data <= { 8'hfe, s4_pixel[23:0] };
 			m_bytes <= 2'd0;
+			m_ops   <= 5'b00001;
 		end
+	end else if (m_apend && m_ready)
+	begin
+		m_data  <= { m_alpha, 24'h0 };
+		m_bytes <= 2'd1;
+		m_ops   <= 5'b00000;
 	end
 	// }}}
 	////////////////////////////////////////////////////////////////////////
@@ -453,23 +860,109 @@ module	qoi_compress (
 	// Pipeline control (i.e. ready signals)
 	// {{{
 
-	assign	skd_ready = skd_valid && (!m_valid || m_ready) && !gbl_last;
+	assign	skd_ready = skd_valid && (!m_valid || m_ready)
+				&& (OPT_OVERLAP || !gbl_last) && !m_apend;
 	assign	s1_ready = gbl_ready;
 	assign	s2_ready = gbl_ready;
 	assign	s3_ready = gbl_ready;
 	assign	s4_ready = gbl_ready;
 	// assign	s4_ready = (!s4_valid || m_ready)
 	//			&& (s2_valid || s3_last) && s3_valid;
-	assign	gbl_ready = (skd_valid || gbl_last) && (!m_valid || m_ready);
+	assign	gbl_ready = (skd_valid || gbl_last) && (!m_valid || m_ready)
+				&& !m_apend;
+
+	// gbl_last is set while the last pixel of a frame needs to be pushed
+	// through the pipeline.  With OPT_OVERLAP, any step may hold the last
+	// pixel of a frame, and more than one may, so it's set while any does.
+	// Once that pixel reaches the output, nothing more needs pushing.
+	generate if (OPT_OVERLAP)
+	begin : GEN_OVERLAP
+		always @(*)
+			gbl_last = s1_last || s2_last || s3_last || s4_last;
+	end else begin : NO_OVERLAP
+		initial	gbl_last = 1'b0;
+		always @(posedge i_clk)
+		if (i_reset)
+			gbl_last <= 1'b0;
+		else if (skd_valid && skd_ready)
+			gbl_last <= skd_hlast && skd_vlast;
+		else if (m_valid && m_ready && m_last)
+			gbl_last <= 1'b0;
+	end endgenerate
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// (Optional) pipeline occupancy counters
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
 
-	initial	gbl_last = 1'b0;
-	always @(posedge i_clk)
-	if (i_reset)
-		gbl_last <= 1'b0;
-	else if (skd_valid && skd_ready)
-		gbl_last <= skd_hlast && skd_vlast;
-	else if (m_valid && m_ready && m_last)
-		gbl_last <= 1'b0;
+	generate if (OPT_PERFCOUNTERS)
+	begin : GEN_PERFCOUNTERS
+		// {{{
+		localparam	NSTAGES = 6;
+		integer		ik;
+
+		wire			pf_end;
+		wire	[NSTAGES-1:0]	pf_valid, pf_ready;
+		reg	[31:0]		pf_clocks, nx_clocks;
+		reg	[32*NSTAGES-1:0]	pf_moving, pf_stalled,
+					nx_moving, nx_stalled;
+		reg	[PERFW-1:0]	nx_perf, r_perf;
+
+		// Stage NSTAGES-1 is the input, and stage zero the output
+		assign	pf_valid = { skd_valid, s1_valid, s2_valid,
+					s3_valid, s4_valid, m_valid };
+		assign	pf_ready = { skd_ready, s1_ready, s2_ready,
+					s3_ready, s4_ready, m_ready };
+		assign	pf_end = m_valid && m_ready && m_last;
+
+		always @(*)
+		begin
+			nx_clocks = pf_clocks + 1;
+			for(ik=0; ik<NSTAGES; ik=ik+1)
+			begin
+				nx_moving[32*ik +: 32] = pf_moving[32*ik +: 32]
+					+ ((pf_valid[ik] && pf_ready[ik])
+							? 32'h1 : 32'h0);
+				nx_stalled[32*ik +: 32] = pf_stalled[32*ik +: 32]
+					+ ((pf_valid[ik] && !pf_ready[ik])
+							? 32'h1 : 32'h0);
+
+				nx_perf[64*ik +: 64] = { nx_moving[32*ik +: 32],
+						nx_stalled[32*ik +: 32] };
+			end
+			nx_perf[PERFW-1:PERFW-32] = nx_clocks;
+		end
+
+		initial	pf_clocks  = 0;
+		initial	pf_moving  = 0;
+		initial	pf_stalled = 0;
+		always @(posedge i_clk)
+		if (i_reset || pf_end)
+		begin
+			pf_clocks  <= 0;
+			pf_moving  <= 0;
+			pf_stalled <= 0;
+		end else begin
+			pf_clocks  <= nx_clocks;
+			pf_moving  <= nx_moving;
+			pf_stalled <= nx_stalled;
+		end
+
+		initial	r_perf = 0;
+		always @(posedge i_clk)
+		if (i_reset)
+			r_perf <= 0;
+		else if (pf_end)
+			r_perf <= nx_perf;
+
+		assign	o_perf = r_perf;
+		// }}}
+	end else begin : NO_PERFCOUNTERS
+		assign	o_perf = 0;
+	end endgenerate
 	// }}}
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -482,31 +975,41 @@ module	qoi_compress (
 ////////////////////////////////////////////////////////////////////////////////
 `ifdef	FORMAL
 	reg	f_past_valid;
-	(* anyconst *)	reg	[23:0]	fnvr_pixel;
+	(* anyconst *)	reg	[PXW-1:0]	fnvr_pixel;
 	(* anyconst *)	reg	[5:0]	fc_index;
+	(* anyconst *)	reg		f_delta, f_above;
 	reg		fc_valid;
-	reg	[23:0]	fc_pixel;
+	reg	[PXW-1:0]	fc_pixel;
 
-	reg	[5:0]	f1_rhash, f1_ghash, f1_bhash;
+	reg	[5:0]	f1_rhash, f1_ghash, f1_bhash, f1_ahash;
 	reg	[31:0]	f1_pcount;
 
-	reg	[5:0]	f2_rhash, f2_ghash, f2_bhash, f2_index;
+	reg	[5:0]	f2_rhash, f2_ghash, f2_bhash, f2_ahash, f2_index;
 	reg	[7:0]	f2_gdiff;
 	reg	[31:0]	f2_pcount;
 
-	reg	[5:0]	f3_rhash, f3_ghash, f3_bhash, f3_index;
+	reg	[5:0]	f3_rhash, f3_ghash, f3_bhash, f3_ahash, f3_index;
 	reg	[7:0]	f3_gdiff, f3_rdiff, f3_bdiff;;
 	reg	[7:0]	f3_rgdiff, f3_bgdiff;
 	reg	[31:0]	f3_pcount;
 
-	reg	[5:0]	f4_rhash, f4_ghash, f4_bhash, f4_index;
+	reg	[5:0]	f4_rhash, f4_ghash, f4_bhash, f4_ahash, f4_index;
 	reg	[7:0]	f4_gdiff, f4_rdiff, f4_bdiff;;
 	reg	[7:0]	f4_rgdiff, f4_bgdiff;
 	reg	[31:0]	f4_pcount;
 
-	reg	[23:0]	fm_pixel, flst_pixel, fm_luna, fm_delta;
+	reg	[PXW-1:0]	fm_pixel, flst_pixel, fm_luna, fm_delta;
 	reg	[31:0]	fm_pcount;
 	reg	[ 7:0]	fm_vg;
+	// The output holds the last pixel of a frame, in either beat of an
+	// RGBA op
+	wire		fm_last;
+	// The pixel before the one in each step, within its frame.  With
+	// OPT_OVERLAP, the step ahead may hold the last pixel of the frame
+	// before, and so the first pixel of a frame follows opaque black.
+	wire	[PXW-1:0]	f2_prior, f3_prior, f4_prior;
+	// Frame ends within the compressor
+	reg	[2:0]		f_frames;
 
 	(* anyconst *)	reg	fnvr_last;
 
@@ -515,6 +1018,12 @@ module	qoi_compress (
 	always @(posedge i_clk)
 		f_past_valid <= 1'b1;
 
+	assign	fm_last = m_valid && (m_last || (m_apend && m_alast));
+
+	assign	f2_prior = (OPT_OVERLAP && s3_valid && s3_last) ? BLACK : s3_pixel;
+	assign	f3_prior = (OPT_OVERLAP && s4_valid && s4_last) ? BLACK : s4_pixel;
+	assign	f4_prior = (OPT_OVERLAP && fm_last) ? BLACK : fm_pixel;
+
 	always @(*)
 	if (!f_past_valid)
 		assume(i_reset);
@@ -522,8 +1031,9 @@ module	qoi_compress (
 	//
 	// Global Pipeline handling assertions
 	// {{{
+	// Without OPT_OVERLAP, only one frame is ever in the pipeline
 	always @(*)
-	if (f_past_valid)
+	if (f_past_valid && !OPT_OVERLAP)
 	case({ s1_valid, s2_valid, s3_valid, s4_valid })
 	4'b0000: assert(f1_pcount == 0);
 	4'b1000: begin
@@ -605,11 +1115,12 @@ module	qoi_compress (
 
 	always @(*)
 	if (f_past_valid && !s1_valid && !s2_valid && !s3_valid && !s4_valid
-			&& (!m_valid || !m_last))
+			&& !fm_last)
 		assert(!gbl_last);
 
 	always @(*)
-	if(f_past_valid && (s1_last || s2_last || s3_last || s4_last || m_last))
+	if(f_past_valid && (s1_last || s2_last || s3_last || s4_last
+					|| (!OPT_OVERLAP && fm_last)))
 		assert(gbl_last);
 
 	always @(*)
@@ -623,7 +1134,37 @@ module	qoi_compress (
 	end
 
 	always @(*)
-	if (!s3_valid) assume(!skd_valid || !skd_hlast || !skd_vlast);
+	if (!OPT_OVERLAP && !s3_valid)
+		assume(!skd_valid || !skd_hlast || !skd_vlast);
+
+	// Count the frame ends within the compressor.  Every step holds at
+	// most one.  With OPT_OVERLAP, each may hold the end of a different
+	// frame, and none may be lost along the way.
+	initial	f_frames = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		f_frames <= 0;
+	else case({ skd_valid && skd_ready && skd_hlast && skd_vlast,
+				m_valid && m_ready && m_last })
+	2'b10: f_frames <= f_frames + 1;
+	2'b01: f_frames <= f_frames - 1;
+	default: begin end
+	endcase
+
+	always @(*)
+	if (f_past_valid)
+	begin
+		assert(f_frames == s1_last + s2_last + s3_last + s4_last
+					+ fm_last);
+		if (!OPT_OVERLAP)
+			assert(f_frames <= 1);
+	end
+
+	// Back to back frames: the next frame is already on its way as the
+	// last beat of a frame leaves
+	always @(*)
+	if (OPT_OVERLAP)
+		cover(m_valid && m_ready && m_last && s4_valid && s3_valid);
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -644,6 +1185,14 @@ module	qoi_compress (
 	if (s_vid_valid)
 		assume(s_vid_data != fnvr_pixel);
 
+	// I_DELTA and I_ABOVE should only change between frames.  Here, they
+	// never change.
+	always @(*)
+	begin
+		assume(i_delta == f_delta);
+		assume(i_above == f_above);
+	end
+
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -658,6 +1207,7 @@ module	qoi_compress (
 		assert($stable(s1_rhash));
 		assert($stable(s1_ghash));
 		assert($stable(s1_bhash));
+		assert($stable(s1_ahash));
 		assert($stable(s1_last));
 		assert($stable(s1_pixel));
 	end
@@ -671,6 +1221,9 @@ module	qoi_compress (
 		f1_rhash = (s1_pixel[23:16] << 1) + s1_pixel[23:16];
 		f1_ghash = (s1_pixel[15: 8] << 2) + s1_pixel[15: 8];
 		f1_bhash = (s1_pixel[ 7: 0] << 3) - s1_pixel[ 7: 0];
+		f1_ahash = (s1_pixel[PXW-1:PXW-8] << 3)
+				+ (s1_pixel[PXW-1:PXW-8] << 1)
+				+ s1_pixel[PXW-1:PXW-8];
 	end
 
 	always @(*)
@@ -679,6 +1232,8 @@ module	qoi_compress (
 		assert(f1_rhash == s1_rhash);
 		assert(f1_ghash == s1_ghash);
 		assert(f1_bhash == s1_bhash);
+		if (OPT_ALPHA)
+			assert(f1_ahash == s1_ahash);
 	end
 
 	initial	f1_pcount = 0;
@@ -692,7 +1247,7 @@ module	qoi_compress (
 
 	always @(*)
 	if (f1_pcount == 0)
-		assert(s1_pixel == 0);
+		assert(s1_pixel == BLACK);
 
 	always @(*)
 	if (&f1_pcount)
@@ -706,7 +1261,7 @@ module	qoi_compress (
 	if (!f_past_valid || $past(i_reset))
 	begin
 		assert(!s2_valid);
-		assert(s2_pixel == 0);
+		assert(s2_pixel == BLACK);
 	end else if ($past(s2_valid && !s2_ready))
 	begin
 		assert(s2_valid);
@@ -725,9 +1280,13 @@ module	qoi_compress (
 		f2_rhash = (s2_pixel[23:16] << 1) + s2_pixel[23:16];
 		f2_ghash = (s2_pixel[15: 8] << 2) + s2_pixel[15: 8];
 		f2_bhash = (s2_pixel[ 7: 0] << 3) - s2_pixel[ 7: 0];
+		f2_ahash = (s2_pixel[PXW-1:PXW-8] << 3)
+				+ (s2_pixel[PXW-1:PXW-8] << 1)
+				+ s2_pixel[PXW-1:PXW-8];
 
-		f2_index = f2_rhash + f2_ghash + f2_bhash + 6'h35;
-		f2_gdiff = s2_pixel[15: 8] - s3_pixel[15: 8];
+		f2_index = f2_rhash + f2_ghash + f2_bhash
+				+ ((OPT_ALPHA) ? f2_ahash : 6'h35);
+		f2_gdiff = s2_pixel[15: 8] - f2_prior[15: 8];
 	end
 
 
@@ -754,11 +1313,11 @@ module	qoi_compress (
 
 	always @(*)
 	if (f2_pcount == 0)
-		assert(s2_pixel == 0);
+		assert(s2_pixel == BLACK);
 
 	always @(*)
 	if (s2_valid && s2_last)
-		assert(f1_pcount == 0);
+		assert(f1_pcount == ((OPT_OVERLAP && s1_valid) ? 1:0));
 
 	always @(*)
 	if (!s2_valid || !s2_last)
@@ -773,7 +1332,7 @@ module	qoi_compress (
 	if (!f_past_valid || $past(i_reset))
 	begin
 		assert(!s3_valid);
-		assert(s3_pixel == 0);
+		assert(s3_pixel == BLACK);
 	end else if ($past(s3_valid && !s3_ready))
 	begin
 		assert(s3_valid);
@@ -793,6 +1352,7 @@ module	qoi_compress (
 		assert($stable(s3_bdiff));
 		assert($stable(s3_rgdiff));
 		assert($stable(s3_bgdiff));
+		assert($stable(s3_anew));
 	end
 
 	always @(*)
@@ -802,6 +1362,10 @@ module	qoi_compress (
 	always @(*)
 	if (!s3_rptvalid)
 		assert(s3_repeats == 0);
+	else if (OPT_DELTA && f_delta)
+		assert(s3_repeats <= 6'd60);
+	else if (abv_en)
+		assert(s3_repeats <= 6'd59);
 	else
 		assert(s3_repeats <= 6'h3d);
 
@@ -810,15 +1374,19 @@ module	qoi_compress (
 		f3_rhash = (s3_pixel[23:16] << 1) + s3_pixel[23:16];
 		f3_ghash = (s3_pixel[15: 8] << 2) + s3_pixel[15: 8];
 		f3_bhash = (s3_pixel[ 7: 0] << 3) - s3_pixel[ 7: 0];
+		f3_ahash = (s3_pixel[PXW-1:PXW-8] << 3)
+				+ (s3_pixel[PXW-1:PXW-8] << 1)
+				+ s3_pixel[PXW-1:PXW-8];
 
-		f3_index = f3_rhash + f3_ghash + f3_bhash + 6'h35;
-		f3_gdiff = s3_pixel[15: 8] - s4_pixel[15: 8];
+		f3_index = f3_rhash + f3_ghash + f3_bhash
+				+ ((OPT_ALPHA) ? f3_ahash : 6'h35);
+		f3_gdiff = s3_pixel[15: 8] - f3_prior[15: 8];
 
-		f3_rdiff = s3_pixel[23:16] - s4_pixel[23:16];
-		f3_bdiff = s3_pixel[ 7: 0] - s4_pixel[ 7: 0];
+		f3_rdiff = s3_pixel[23:16] - f3_prior[23:16];
+		f3_bdiff = s3_pixel[ 7: 0] - f3_prior[ 7: 0];
 
-		f3_rgdiff = (s3_pixel[23:16] - s4_pixel[23:16]) - s3_gdiff;
-		f3_bgdiff = (s3_pixel[ 7: 0] - s4_pixel[ 7: 0]) - s3_gdiff;
+		f3_rgdiff = (s3_pixel[23:16] - f3_prior[23:16]) - s3_gdiff;
+		f3_bgdiff = (s3_pixel[ 7: 0] - f3_prior[ 7: 0]) - s3_gdiff;
 	end
 
 	always @(*)
@@ -834,13 +1402,16 @@ module	qoi_compress (
 			assert(s3_rgdiff  == f3_rgdiff);
 			assert(s3_bgdiff  == f3_bgdiff);
 
-			assert(s3_pixel != s4_pixel);
+			assert(s3_anew == (OPT_ALPHA && (s3_pixel[PXW-1:PXW-8]
+						!= f3_prior[PXW-1:PXW-8])));
+
+			assert(s3_pixel != f3_prior);
 		end else
-			assert(s3_pixel == s4_pixel);
+			assert(s3_pixel == f3_prior);
 	end else if (f3_pcount == 0)
-		assert(s3_pixel == 0);
+		assert(s3_pixel == BLACK);
 	else
-		assert(s3_pixel == s4_pixel);
+		assert(s3_pixel == f3_prior);
 
 	initial	f3_pcount = 0;
 	always @(posedge i_clk)
@@ -857,11 +1428,11 @@ module	qoi_compress (
 
 	always @(*)
 	if (f3_pcount == 0)
-		assert(s3_pixel == 0);
+		assert(s3_pixel == BLACK);
 
 	always @(*)
 	if (s3_valid && s3_last)
-		assert(f2_pcount == 0);
+		assert(f2_pcount == ((OPT_OVERLAP && s2_valid) ? 1:0));
 
 	always @(*)
 	if (!s3_valid || !s3_last)
@@ -880,7 +1451,7 @@ module	qoi_compress (
 	if (!f_past_valid || $past(i_reset))
 	begin
 		assert(!s4_valid);
-		assert(s4_pixel == 0);
+		assert(s4_pixel == BLACK);
 	end else if ($past(s4_valid && !s4_ready))
 	begin
 		assert(s4_valid);
@@ -897,6 +1468,7 @@ module	qoi_compress (
 		assert($stable(s4_rdiff));
 		assert($stable(s4_gdiff));
 		assert($stable(s4_bdiff));
+		assert($stable(s4_rgba));
 	end
 
 	always @(*)
@@ -908,24 +1480,28 @@ module	qoi_compress (
 	begin
 		assert(s4_repeats <= 6'h3d);
 		if (s4_valid)
-			assert(s4_pixel == fm_pixel);
+			assert(s4_pixel == f4_prior);
 	end else if (s4_valid)
-		assert(s4_pixel != fm_pixel);
+		assert(s4_pixel != f4_prior);
 
 	always @(*)
 	begin
 		f4_rhash = (s4_pixel[23:16] << 1) + s4_pixel[23:16];
 		f4_ghash = (s4_pixel[15: 8] << 2) + s4_pixel[15: 8];
 		f4_bhash = (s4_pixel[ 7: 0] << 3) - s4_pixel[ 7: 0];
+		f4_ahash = (s4_pixel[PXW-1:PXW-8] << 3)
+				+ (s4_pixel[PXW-1:PXW-8] << 1)
+				+ s4_pixel[PXW-1:PXW-8];
 
-		f4_index = f4_rhash + f4_ghash + f4_bhash + 6'h35;
-		f4_gdiff = s4_pixel[15: 8] - fm_pixel[15: 8];
+		f4_index = f4_rhash + f4_ghash + f4_bhash
+				+ ((OPT_ALPHA) ? f4_ahash : 6'h35);
+		f4_gdiff = s4_pixel[15: 8] - f4_prior[15: 8];
 
-		f4_rdiff = s4_pixel[23:16] - fm_pixel[23:16];
-		f4_bdiff = s4_pixel[ 7: 0] - fm_pixel[ 7: 0];
+		f4_rdiff = s4_pixel[23:16] - f4_prior[23:16];
+		f4_bdiff = s4_pixel[ 7: 0] - f4_prior[ 7: 0];
 
-		f4_rgdiff = (s4_pixel[23:16] - fm_pixel[23:16]) - f4_gdiff;
-		f4_bgdiff = (s4_pixel[ 7: 0] - fm_pixel[ 7: 0]) - f4_gdiff;
+		f4_rgdiff = (s4_pixel[23:16] - f4_prior[23:16]) - f4_gdiff;
+		f4_bgdiff = (s4_pixel[ 7: 0] - f4_prior[ 7: 0]) - f4_gdiff;
 	end
 
 	always @(*)
@@ -944,6 +1520,10 @@ module	qoi_compress (
 			assert(f4_gdiff  == { {(2){s4_gdiff[5] }}, s4_gdiff });
 			assert(f4_bgdiff == { {(4){s4_bgdiff[3]}}, s4_bgdiff });
 		end
+
+		if (!s4_rptset)
+			assert(s4_rgba == (OPT_ALPHA && (s4_pixel[PXW-1:PXW-8]
+						!= f4_prior[PXW-1:PXW-8])));
 	end
 
 	initial	f4_pcount = 0;
@@ -951,12 +1531,14 @@ module	qoi_compress (
 	if (i_reset)
 		f4_pcount <= 0;
 	else if (s4_valid && s4_ready && s4_last)
-		f4_pcount <= 0;
-	else if (s3_valid && s3_ready && (!s3_rptvalid || !s3_continue))
+		// With OPT_OVERLAP, the next frame may follow at once
+		f4_pcount <= (s3_step && (!s3_rptvalid || !s3_continue))
+						? 1 + s3_repeats : 0;
+	else if (s3_step && (!s3_rptvalid || !s3_continue))
 		f4_pcount <= f4_pcount + 1 + s3_repeats;
 
 	always @(*)
-	if (!s4_valid && (!m_valid || !m_last))
+	if (!s4_valid && !fm_last)
 		assert(s4_pixel == fm_pixel);
 
 	always @(*)
@@ -969,12 +1551,13 @@ module	qoi_compress (
 
 	always @(*)
 	if (f4_pcount == 0)
-		assert(s4_pixel == 0);
+		assert(s4_pixel == BLACK);
 
 	always @(*)
 	if (s4_valid && s4_last)
 	begin
-		assert(f3_pcount == 0);
+		assert(f3_pcount == ((!OPT_OVERLAP) ? 0
+			: ((s3_valid || s3_rptvalid) ? 1:0) + s3_repeats));
 	end else
 		assert(f4_pcount <= f3_pcount);
 
@@ -1016,44 +1599,82 @@ module	qoi_compress (
 		assert($stable(m_data));
 		assert($stable(m_bytes));
 		assert($stable(m_last));
+		assert($stable(m_ops));
 	end
 
-	initial	fm_pixel = 0;
+	initial	fm_pixel = BLACK;
 	always @(posedge i_clk)
 	if (i_reset)
-		fm_pixel <= 0;
+		fm_pixel <= BLACK;
 	else begin
 		if (m_valid && m_ready && m_last)
-			fm_pixel <= 0;
+			fm_pixel <= BLACK;
 		if (s4_valid && s4_ready)
 			fm_pixel <= s4_pixel;
 	end
 
+	// With OPT_ALPHA, an RGBA op's second beat, alpha alone, is the only
+	// beat that counts no op.  Its first beat uses 8'hff, and carries the
+	// color.  By the second beat, the first has been counted, so alpha
+	// is checked against the pixel both beats describe.  With OPT_ABOVE,
+	// 8'hfc may also be the pixel above--counted as an INDEX op, not as
+	// the RUN of 61 it would otherwise be.
 	always @(*)
-	if (m_valid)
+	if (m_valid && OPT_ALPHA && m_ops == 5'b00000)
+	begin
+		assert(m_bytes == 2'd1);
+		assert(!m_apend);
+		assert(m_data[31:24] == fm_pixel[PXW-1:PXW-8]);
+		assert(flst_pixel == fm_pixel);
+	end else if (m_valid)
 	case(m_data[31:30])
 	2'b11: begin
-		assert(m_data[31:24] != 8'hff);
-		if (m_data[31:24] == 8'hfe)
+		if (!OPT_ALPHA)
+			assert(m_data[31:24] != 8'hff);
+		if (m_data[31:24] == 8'hff)
 		begin
+			assert(m_ops == 5'b00001);
 			assert(m_bytes == 2'd0);
-			assert(m_data[23:0] != fnvr_pixel);
-			assert(m_data[23:0] == fm_pixel);
-			assert(m_data[23:0] != flst_pixel);
+			assert(m_apend);
+			assert(m_data[23:0] == fm_pixel[23:0]);
+			assert(m_alpha == fm_pixel[PXW-1:PXW-8]);
+			assert(fm_pixel[PXW-1:PXW-8]
+					!= flst_pixel[PXW-1:PXW-8]);
+		end else if (m_data[31:24] == 8'hfe)
+		begin
+			assert(m_ops == 5'b00001);
+			assert(m_bytes == 2'd0);
+			assert(m_data[23:0] == fm_pixel[23:0]);
+			assert(fm_pixel != flst_pixel);
+			if (OPT_ALPHA)
+				assert(fm_pixel[PXW-1:PXW-8]
+					== flst_pixel[PXW-1:PXW-8]);
+		end else if (OPT_ABOVE && m_data[31:24] == 8'hfc
+					&& m_ops == 5'b01000)
+		begin
+			// The pixel above
+			assert(m_bytes == 2'd1);
 		end else begin
 			// Repeated pixel
+			assert(m_ops == 5'b10000);
 			assert(m_bytes == 2'd1);
 			assert(fm_pixel == flst_pixel);
+			// With I_DELTA, 8'hfd is left free
+			if (OPT_DELTA && f_delta)
+				assert(m_data[31:24] != 8'hfd);
 		end end
 	2'b00: begin
+		assert(m_ops == 5'b01000);
 		assert(m_bytes == 2'd1);
 		// if (m_data[29:24] == fc_index) assert(fc_valid);
 		end
 	2'b01: begin
+		assert(m_ops == 5'b00100);
 		assert(m_bytes == 2'd1);
 		assert(fm_delta == fm_pixel);
 		end
 	2'b10: begin
+		assert(m_ops == 5'b00010);
 		assert(m_bytes == 2'd2);
 		assert(fm_luna == fm_pixel);
 		end
@@ -1077,7 +1698,8 @@ module	qoi_compress (
 	if (i_reset)
 		fm_pcount <= 0;
 	else if (m_valid && m_ready && m_last)
-		fm_pcount <= 0;
+		fm_pcount <= (!s4_valid || !s4_ready) ? 0
+				: (s4_rptset) ? s4_repeats + 1 : 1;
 	else if (s4_valid && s4_ready)
 	begin
 		if (s4_rptset)
@@ -1087,14 +1709,14 @@ module	qoi_compress (
 	end
 
 	always @(*)
-	if (!m_valid || !m_last)
+	if (!fm_last)
 		assert(f4_pcount == fm_pcount + (s4_valid ? 1:0)
 				+ ((s4_valid && s4_rptset) ? s4_repeats : 0));
 
-	initial	flst_pixel = 0;
+	initial	flst_pixel = BLACK;
 	always @(posedge i_clk)
 	if (i_reset || (m_valid && m_ready && m_last))
-		flst_pixel <= 0;
+		flst_pixel <= BLACK;
 	else if (m_valid && m_ready)
 		flst_pixel <= fm_pixel;
 
@@ -1102,13 +1724,16 @@ module	qoi_compress (
 	if (!m_valid)
 		assert(flst_pixel == fm_pixel);
 
+	// DIFF and LUMA ops leave alpha as it was
 	always @(*)
 	begin
+		fm_delta = flst_pixel;
 		fm_delta[23:16] = flst_pixel[23:16] + m_data[29:28] - 2;
 		fm_delta[15: 8] = flst_pixel[15: 8] + m_data[27:26] - 2;
 		fm_delta[ 7: 0] = flst_pixel[ 7: 0] + m_data[25:24] - 2;
 
 		fm_vg = m_data[29:24] - 32;
+		fm_luna = flst_pixel;
 		fm_luna[23:16] = flst_pixel[23:16] + fm_vg - 8 + m_data[23:20];
 		fm_luna[15: 8] = flst_pixel[15: 8] + fm_vg;
 		fm_luna[ 7: 0] = flst_pixel[ 7: 0] + fm_vg - 8 + m_data[19:16];
@@ -1117,8 +1742,8 @@ module	qoi_compress (
 	always @(*)
 	if (fm_pcount == 0)
 	begin
-		assert(fm_pixel == 0);
-		assert(flst_pixel == 0);
+		assert(fm_pixel == BLACK);
+		assert(flst_pixel == BLACK);
 	end
 
 	always @(*)
@@ -1137,9 +1762,56 @@ module	qoi_compress (
 		assert(!s2_last);
 		assert(!s3_last);
 		assert(!s4_last);
+		assert(!fm_last);
+	end
+
+	// The second beat of an RGBA op is pending while the first is on the
+	// output, and holds the pixel's alpha
+	always @(*)
+	if (!OPT_ALPHA)
+		assert(!m_apend);
+	else if (m_apend)
+	begin
+		assert(m_valid);
 		assert(!m_last);
+		assert(!m_hlast);
+		assert(m_data[31:24] == 8'hff);
 	end
 
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Delta frames
+	// {{{
+	// With I_DELTA, each line ends with an op of its own, marked by
+	// M_HLAST.  No run may then cover a line end, save as its last pixel.
+	// Count the line ends within the pipeline: each step may hold one, and
+	// none are lost.
+	reg	[31:0]	f_lines;
+
+	initial	f_lines = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		f_lines <= 0;
+	else case({ skd_valid && skd_ready && skd_hlast,
+				m_valid && m_ready && m_hlast })
+	2'b10: f_lines <= f_lines + 1;
+	2'b01: f_lines <= f_lines - 1;
+	default: begin end
+	endcase
+
+	always @(*)
+	if (f_past_valid && OPT_DELTA && f_delta)
+	begin
+		assert(f_lines == (s1_valid && s1_hlast) + (s2_valid && s2_hlast)
+			+ (s3_valid && s3_hlast) + (s4_valid && s4_hlast)
+			+ (m_valid && m_hlast));
+
+		if (s4_valid && s4_last)
+			assert(s4_hlast);
+		if (m_valid && m_last)
+			assert(m_hlast);
+	end
 
 	// }}}
 	////////////////////////////////////////////////////////////////////////
@@ -1147,7 +1819,7 @@ module	qoi_compress (
 	// Table checking
 	// {{{
 	reg		f3_tbl_valid;
-	reg	[23:0]	f3_tbl_pixel;
+	reg	[PXW-1:0]	f3_tbl_pixel;
 
 	initial	fc_valid = 0;
 	always @(posedge i_clk)
@@ -1205,8 +1877,9 @@ module	qoi_compress (
 		end
 	end
 
+	// (An RGBA op's second beat, counted as no op, may also begin 2'b00)
 	always @(*)
-	if (m_valid && m_data[31:30] == 2'b00)
+	if (m_valid && m_data[31:30] == 2'b00 && m_ops == 5'b01000)
 	begin
 		// Can't have two TBL code words to the same table entry on
 		// two consecutive code words--should do repeats instead
@@ -1225,12 +1898,16 @@ module	qoi_compress (
 	if (s3_valid && s3_last)
 		assert(tbl_valid == 0);
 
+	// With OPT_OVERLAP, the next frame may already be using the table,
+	// once any of its pixels have left step two
 	always @(*)
-	if (s4_valid && s4_last)
+	if (s4_valid && s4_last && (!OPT_OVERLAP
+			|| (!s3_valid && !s3_rptvalid)))
 		assert(tbl_valid == 0);
 
 	always @(*)
-	if (m_valid && m_last)
+	if (fm_last && (!OPT_OVERLAP
+			|| (!s4_valid && !s3_valid && !s3_rptvalid)))
 		assert(tbl_valid == 0);
 
 	//	assert($stable(s3_tbl_pixel));
@@ -15,6 +15,41 @@
 //	4. Adds TLAST and TUSER based on the given width and height information
 //	5. Recognizes the video trailer, and ends decoding when seen.
 //
+//	Frames may follow each other back to back, or be separated by any
+//	amount of (non-"qoif") filler.  Between frames, the decoder waits for
+//	the last pixel of the prior frame to leave the decompressor before it
+//	looks at the next header, so that every frame is given the width and
+//	height found in its own header.  Frames of differing sizes may
+//	therefore be mixed freely, with no need for a reset between them.
+//
+//	TLAST and TUSER follow the header's width and height, of up to
+//	2^LGFRAME-1 pixels each.  A lost or corrupted byte is caught when the
+//	number of pixels in a frame's stream no longer matches its header,
+//	and o_err is then raised for one clock.
+//
+//	- If the stream ends early, o_err is raised as its last pixel enters
+//	  the output.  The search for the next "qoif" then continues after the
+//	  frame's trailer, as it would have anyway.
+//
+//	- If the stream carries on past the header's last pixel, o_err is
+//	  raised as that last pixel enters the output.  The frame ends there,
+//	  with TLAST where its header says it should be.  The decompressor is
+//	  then flushed, and the rest of the frame is searched for the next
+//	  "qoif".
+//
+//	Either way, the damage is limited to the frame it's in--and, should
+//	the frame's own trailer have been damaged, whatever of the next
+//	header was read before the damage was noticed.  Since the counters
+//	restart with every frame, no damage carries forward to the frames
+//	after.
+//
+//	i_qbytes is the number of valid bytes in i_qdata, first byte in the
+//	MSBs, with zero meaning all DW/8 of them.
+//
+//	With OPT_ALPHA, pixels are output as { A, R, G, B }.  Otherwise alpha
+//	is dropped, and only { R, G, B } is output.  Either way, both three
+//	and four channel images may be decoded.
+//
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
 //
@@ -48,10 +83,17 @@
 module	qoi_decoder #(
 		// {{{
 		parameter	[0:0]	OPT_TUSER_IS_SOF = 1'b0,
+		parameter	[0:0]	OPT_ALPHA = 1'b0,
+		// OPT_TBLREG: Registers the decompressor's table output, as
+		// in qoi_decompress
+		parameter	[0:0]	OPT_TBLREG = 1'b0,
 		parameter		DW = 64,
+		localparam		PXW = (OPT_ALPHA) ? 32 : 24,
 		localparam		DB = DW/8,
 		localparam		LGDB = $clog2(DB),
-		localparam		LGFRAME = 32,
+		// LGFRAME: The number of bits kept of the width and height
+		// from each header.  The QOI header allows up to 32.
+		parameter		LGFRAME = 32,
 		localparam	[LGFRAME-1:0]	DEF_WIDTH = 800,
 		localparam	[LGFRAME-1:0]	DEF_HEIGHT = 600
 		// }}}
@@ -59,19 +101,22 @@ module	qoi_decoder #(
 		// {{{
 		input	wire			i_clk, i_reset,
 		//
-		input	reg			i_qvalid,
+		input	wire			i_qvalid,
 		output	wire			o_qready,
-		input	reg	[DW-1:0]	i_qdata,
-		input	reg	[LGDB-1:0]	i_qbytes,
+		input	wire	[DW-1:0]	i_qdata,
+		input	wire	[LGDB-1:0]	i_qbytes,
 		// qlast is a nice idea, but ... it's redundant.  How should
 		// qlast be handled when there's already a last indicator within
 		// the data stream as it is?
-		// input reg			i_qlast
+		// input wire			i_qlast
 		//
-		output	wire			m_valid,
+		output	reg			m_valid,
 		input	wire			m_ready,
-		output	wire	[23:0]		m_data,
-		output	wire			m_last, m_user
+		output	reg	[PXW-1:0]	m_data,
+		output	wire			m_last, m_user,
+		// o_err: A frame held more or fewer pixels than its header
+		// claimed
+		output	reg			o_err
 		// }}}
 	);
 
@@ -83,30 +128,37 @@ module	qoi_decoder #(
 				DC_FORMAT = 3,
 				DC_DATA   = 4,
 				DC_TAIL   = 5;
-	localparam	SRW = 56 + DW;
+	// The shift register needs room for the longest look ahead we ever
+	// need, the 8-byte trailer, plus a full incoming word on top of
+	// whatever is left over from the last one.  With that much room, a
+	// new word can be accepted on the same cycle a code word is consumed.
+	localparam	NB = 2*DB + 8;
+	localparam	SRW = 8*NB;
+	localparam	LGNB = $clog2(NB+1);
 
 	reg	[2:0]		state;
 	reg	[LGFRAME-1:0]	r_width, r_height;
 
 	reg	[SRW-1:0]	sreg;
-	reg	[$clog2(SRW/8+1)-1:0]	sr_nvalid, nxt_step, nxt_nvalid;
+	reg	[LGNB-1:0]	sr_nvalid, nxt_step, nxt_nvalid;
+	reg			sr_step;
 	wire	[LGDB:0]	wide_qbytes;
-	reg			eoi_marker, sr_last;
-	wire			sr_valid, sr_ready;
+	wire	[DW-1:0]	masked_qdata;
+	wire			eoi_marker, op_ready, qaccept;
 
 	reg		pre_valid;
 	reg	[39:0]	pre_data;
-	wire		pre_ready, pre_last;
 
 	reg		in_valid, in_last;
 	reg	[39:0]	in_data;
 	wire		in_ready;
 
 	wire		d_valid, d_ready, d_last;
-	wire	[23:0]	d_pixel;
+	wire	[PXW-1:0]	d_pixel;
 
 	reg	[LGFRAME-1:0]	ypos, xpos;
-	reg			m_hlast, m_vlast, m_eof, midframe, lcl_reset;
+	reg			m_hlast, m_vlast, m_first;
+	wire			m_eof, d_hlast, d_vlast, dc_flush;
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -114,81 +166,73 @@ module	qoi_decoder #(
 	// {{{
 	////////////////////////////////////////////////////////////////////////
 	//
-	// 1. Reset the decompression algorithm.  Hold it in reset.
-	// 2. Search for the SYNC, "qoif".
-	//	Insist that this SYNC be aligned with a 32b word.
-	//	If the image doesn't have it, wait until it shows up.
-	// 3. Grab the header data (height/width) next.
-	// 4. Ignore the next two bytes.
-	//	Unpacking only 2 bytes will necessitate gearbox integration here
-	// 5. For each code word, grab an appropriately sized word
-	//	Count pixels--horizontal and vertical--going into the decoder.
-	// 6. After HEIGHT * WIDTH - 1 pixels, mark decoder word as *LAST*.
-	//	Ignore everything that might follow.
-	// 7. Once HLAST+VLAST take place, reset the qoi_decompress module
-	// 8. Go back to step 2, to search for the SYNC again
+	// 1. Search for the SYNC, "qoif", one byte at a time.
+	// 2. Grab the header data (width/height) next.
+	// 3. Ignore the next two bytes (channels and colorspace).
+	// 4. For each code word, grab an appropriately sized word.  Hold
+	//	each word back until we know whether or not the trailer
+	//	follows it, so the last one can be marked as *LAST*.
+	// 5. Once the trailer is found, wait for the decompressor to produce
+	//	the last pixel of the frame.
+	// 6. Go back to step 1, to search for the SYNC again
 	//
 
-	// nxt_step
+	assign	eoi_marker = (sreg[SRW-1:SRW-64] == 64'h01);
+	assign	op_ready = !in_valid || in_ready;
+
+	// nxt_step, sr_step: How many bytes to consume from sreg, and whether
+	// to consume them at all
 	// {{{
 	always @(*)
 	begin
+		sr_step  = 1'b0;
 		nxt_step = 4;
-		if (state == DC_SYNC)
-		begin
-			// if (sreg[DW+32-1:DW] == "qoif")
-			//	step = 4;
-			nxt_step = 4;
-			if (sreg[SRW-8-1:SRW-32] == "qoi")
-				nxt_step = 1;
-			else if (sreg[SRW-16-1:SRW-32] == "qo")
-				nxt_step = 2;
-			else if (sreg[SRW-24-1:SRW-32] == "q")
-				nxt_step = 3;
-			else
-				nxt_step = 4;
-		end // else if (state == DC_SIZE)
-		//	nxt_step = 4;
-		else if (state == DC_FORMAT)
+		case(state)
+		DC_SYNC: begin
+			sr_step  = (sr_nvalid >= 4);
+			nxt_step = (sreg[SRW-1:SRW-32] == "qoif") ? 4 : 1;
+			end
+		DC_WIDTH:  sr_step = (sr_nvalid >= 4);
+		DC_HEIGHT: sr_step = (sr_nvalid >= 4);
+		DC_FORMAT: begin
+			sr_step  = (sr_nvalid >= 2);
 			nxt_step = 2;
-		else if (state == DC_DATA)
-		begin
-			casez(sreg[SRW-1:SRW-8])
+			end
+		DC_DATA: begin
+			sr_step = (sr_nvalid >= 8) && op_ready;
+			if (eoi_marker)
+				nxt_step = 8;
+			else casez(sreg[SRW-1:SRW-8])
 			8'b1111_1110: nxt_step = 4;
 			8'b1111_1111: nxt_step = 5;
 			8'b10??_????: nxt_step = 2;
 			default:	nxt_step = 1;
 			endcase
-		end else
-			nxt_step = 4;
+			end
+		default: begin end
+		endcase
 	end
 	// }}}
 
-	always @(*)
-		eoi_marker = (sreg[SRW-1:SRW-64] == 64'h01);
-
 	// state
 	// {{{
+	initial	state = DC_SYNC;
 	always @(posedge i_clk)
-	if (i_reset)
+	if (i_reset || dc_flush)
 		state <= DC_SYNC;
-	else if (sr_valid && sr_ready)
-	case(state)
-	DC_SYNC: if ((sr_nvalid >= 4) && (sreg[SRW-1:SRW-32] == "qoif"))
+	else case(state)
+	DC_SYNC: if (sr_step && sreg[SRW-1:SRW-32] == "qoif")
 		state <= DC_WIDTH;
-	DC_WIDTH: if (sr_nvalid >= 4)
+	DC_WIDTH: if (sr_step)
 		state <= DC_HEIGHT;
-	DC_HEIGHT: if (sr_nvalid >= 4)
+	DC_HEIGHT: if (sr_step)
 		state <= DC_FORMAT;
-	DC_FORMAT: if (sr_nvalid >= 2)
+	DC_FORMAT: if (sr_step)
 		state <= DC_DATA;
-	DC_DATA: begin
-		if(sr_nvalid >= 8 && eoi_marker && (!pre_valid || pre_ready))
-			state <= DC_TAIL;
-		// if (i_qvalid && o_qready && i_qlast)
-		//	state <= DC_TAIL;
-		end
-	DC_TAIL: if (m_valid && m_ready && m_eof)
+	DC_DATA: if (sr_step && eoi_marker)
+		// An empty image has no pixels to wait for
+		state <= (pre_valid) ? DC_TAIL : DC_SYNC;
+	DC_TAIL: if (d_valid && d_ready && d_last)
 		state <= DC_SYNC;
 	default: state <= DC_SYNC;
 	endcase
@@ -203,27 +247,30 @@ module	qoi_decoder #(
 	begin
 		r_width  <= DEF_WIDTH;
 		r_height <= DEF_HEIGHT;
-	end else if (sr_nvalid >= 4)
+	end else if (sr_step)
 	begin
 		if (state == DC_WIDTH)
-			r_width <= sreg[SRW-32 +: LGFRAME];
+			r_width <= sreg[SRW-1 -: LGFRAME];
 		if (state == DC_HEIGHT)
-			r_height <= sreg[SRW-32 +: LGFRAME];
+			r_height <= sreg[SRW-1 -: LGFRAME];
 	end
 	// }}}
 
 	// sr_nvalid
 	// {{{
 	assign	wide_qbytes = (i_qbytes == 0) ? DB[LGDB:0] : { 1'b0, i_qbytes };
+	assign	qaccept = i_qvalid && o_qready;
 
 	always @(*)
-	case({ (i_qvalid && o_qready), (sr_valid && sr_ready) })
-	2'b00: nxt_nvalid = sr_nvalid;
-	2'b10: nxt_nvalid = sr_nvalid + wide_qbytes;
-	2'b01: nxt_nvalid = sr_nvalid - nxt_step;
-	2'b11: nxt_nvalid = sr_nvalid + wide_qbytes - nxt_step;
-	endcase
+	begin
+		nxt_nvalid = sr_nvalid;
+		if (sr_step)
+			nxt_nvalid = nxt_nvalid - nxt_step;
+		if (qaccept)
+			nxt_nvalid = nxt_nvalid + { {(LGNB-LGDB-1){1'b0}}, wide_qbytes };
+	end
 
+	initial	sr_nvalid = 0;
 	always @(posedge i_clk)
 	if (i_reset)
 		sr_nvalid <= 0;
@@ -231,83 +278,69 @@ module	qoi_decoder #(
 		sr_nvalid <= nxt_nvalid;
 	// }}}
 
-	// sr_last
-	// {{{
-	always @(posedge i_clk)
-	if (i_reset || (m_valid && m_ready && m_eof))
-		sr_last <= 0;
-	else begin
-		// if (i_qvalid && i_qready && i_qlast)
-		//	sr_last <= 1'b1;
-		if (sr_valid && sr_ready && sr_nvalid >= 8 && eoi_marker)
-			sr_last <= 1'b1;
-		// if (state != DC_DATA)
-		//	sr_last <= 1'b0;
-	end
-	// }}}
-
 	// sreg
 	// {{{
+	// Everything below the sr_nvalid bytes at the top of sreg is kept at
+	// zero, so new words may simply be OR'd into place.  This requires
+	// that any unused bytes at the bottom of i_qdata be cleared first.
+	assign	masked_qdata = (i_qbytes == 0) ? i_qdata
+			: (i_qdata & ~({(DW){1'b1}} >> (8*i_qbytes)));
+
 	always @(posedge i_clk)
-	if (i_reset || sr_last)
+	if (i_reset)
 		sreg <= 0;
-	else case({ (i_qvalid && o_qready), (sr_valid && sr_ready) })
+	else case({ qaccept, sr_step })
 	2'b00: begin end
-	2'b10: sreg <= sreg
-		| ({ {(SRW-DW){1'b0}}, i_qdata } << ((SRW-DW) - sr_nvalid*8));
 	2'b01: sreg <= sreg << (8*nxt_step);
+	2'b10: sreg <= sreg | ({ masked_qdata, {(SRW-DW){1'b0}} }
+					>> (8*sr_nvalid));
 	2'b11: sreg <= (sreg << (8*nxt_step))
-		| ({ {(SRW-DW){1'b0}}, i_qdata } << (SRW-(8*nxt_nvalid)));
+			| ({ masked_qdata, {(SRW-DW){1'b0}} }
+					>> (8*(sr_nvalid - nxt_step)));
 	endcase
 	// }}}
 
-	assign	sr_valid = (sr_nvalid >= 8);
-	assign	sr_ready = !pre_valid || pre_ready || (state != DC_DATA);
 	// Verilator lint_off WIDTH
-	assign	o_qready = (state != DC_TAIL && state != DC_DATA) || (sr_nvalid <= SRW/8-DB);
+	assign	o_qready = (sr_nvalid <= NB-DB);
 	// Verilator lint_on  WIDTH
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
 	// The *PRE*-pipeline stage -- used for recognizing EOI
 	// {{{
+	// Each code word waits here until the next is known, so we can tell
+	// if it's the last of its frame.
+
+	initial	pre_valid = 1'b0;
 	always @(posedge i_clk)
-	if (i_reset)
-		pre_valid <= 1'b0;
-	else if (sr_valid && sr_ready)
-		pre_valid <= (sr_nvalid >= 8)&& (state == DC_DATA);
-	else if (pre_ready)
+	if (i_reset || dc_flush)
 		pre_valid <= 1'b0;
+	else if (state == DC_DATA && sr_step)
+		pre_valid <= !eoi_marker;
 
 	always @(posedge i_clk)
-	if (sr_valid && sr_ready)
+	if (state == DC_DATA && sr_step)
 		pre_data <= sreg[SRW-1:SRW-40];
-
-	assign	pre_last = sr_last;
-
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
 	// The feed stage
 	// {{{
+	initial	in_valid = 1'b0;
 	always @(posedge i_clk)
-	if (i_reset)
+	if (i_reset || dc_flush)
 		in_valid <= 1'b0;
-	else if (pre_valid && pre_ready)
-		in_valid <= pre_valid && (state != DC_TAIL);
+	else if (state == DC_DATA && sr_step && pre_valid)
+		in_valid <= 1'b1;
 	else if (in_ready)
 		in_valid <= 1'b0;
 
 	always @(posedge i_clk)
-	if (pre_valid && pre_ready)
+	if (state == DC_DATA && sr_step && pre_valid)
+	begin
 		in_data <= pre_data;
-
-	always @(posedge i_clk)
-	if (pre_valid && pre_ready)
-		in_last <= pre_last;
-
-	assign	pre_ready = (!in_valid || in_ready)&&(sr_nvalid >= 8);
-
+		in_last <= eoi_marker;
+	end
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -316,11 +349,13 @@ module	qoi_decoder #(
 	////////////////////////////////////////////////////////////////////////
 	//
 
-	qoi_decompress
-	u_decompress (
+	qoi_decompress #(
+		.OPT_ALPHA(OPT_ALPHA),
+		.OPT_TBLREG(OPT_TBLREG)
+	) u_decompress (
 		// {{{
 		.i_clk(i_clk),
-		.i_reset(i_reset || lcl_reset || (m_valid && m_eof)),
+		.i_reset(i_reset || dc_flush),
 		//
 		.s_valid(in_valid),
 		.s_ready(in_ready),
@@ -339,68 +374,80 @@ module	qoi_decoder #(
 	//
 	// Add TLAST + TUSER (Either HLAST+VLAST, or HLAST+SOF)
 	// {{{
+	initial	m_valid = 1'b0;
 	always @(posedge i_clk)
 	if (i_reset)
 		m_valid <= 1'b0;
 	else if (!m_valid || m_ready)
-		m_valid <= d_valid || (lcl_reset && midframe);
-
-	always @(posedge i_clk)
-	if (i_reset)
-		lcl_reset <= 1'b0;
-	else if (m_valid && m_ready && m_eof)
-		lcl_reset <= 1'b0;
-	else if (d_valid && d_ready && d_last)
-		lcl_reset <= 1'b1;
+		m_valid <= d_valid;
 
 	always @(posedge i_clk)
 	if (d_valid && d_ready)
 		m_data <= d_pixel;
 
+	// xpos, ypos: The position of the next pixel to come from the
+	// decompressor.  Both return to zero at the end of every frame.
 	always @(posedge i_clk)
 	if (i_reset)
 	begin
 		xpos <= 0;
 		ypos <= 0;
-		midframe <= 1'b0;
+		m_first <= 1'b1;
 		m_hlast <= 0;
 		m_vlast <= 0;
-	end else if (m_valid && m_ready)
+	end else if (d_valid && d_ready)
 	begin
+		m_first <= (xpos == 0) && (ypos == 0);
+		m_hlast <= d_hlast;
+		m_vlast <= d_vlast;
+
 		xpos <= xpos + 1;
-		midframe <= 1'b1;
-		m_hlast <= (xpos + 2 >= r_width);
-		if (xpos + 1 >= r_width)
+		if (d_hlast)
 		begin
-			m_hlast <= 1'b0;
 			xpos <= 0;
-			m_vlast <= (ypos + 2 >= r_height);
 			ypos <= ypos + 1;
-			if (ypos + 1 >= r_height)
-			begin
-				m_vlast <= 1'b0;
+			if (d_vlast)
 				ypos <= 0;
-				midframe <= 1'b0;
-			end
+		end
+
+		if (d_last)
+		begin
+			xpos <= 0;
+			ypos <= 0;
 		end
 	end
 
+	assign	d_hlast = (xpos + 1 >= r_width);
+	assign	d_vlast = (ypos + 1 >= r_height);
+
+	// dc_flush: The header's last pixel has been reached, yet the stream
+	// carries on.  Throw away whatever's left of it in the decompressor,
+	// and go look for the next frame.
+	assign	dc_flush = d_valid && d_ready && d_hlast && d_vlast && !d_last;
+
+	// o_err: The decompressor's last pixel should be the last of the
+	// header's frame, and vice versa
+	initial	o_err = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		o_err <= 1'b0;
+	else
+		o_err <= d_valid && d_ready && (d_last != (d_hlast && d_vlast));
+
 	assign	m_eof = m_hlast && m_vlast;
 
 	generate if (OPT_TUSER_IS_SOF)
 	begin : GEN_SOF
-		reg	m_sof;
-		always @(posedge i_clk)
-		if (i_reset)
-			m_sof <= 1'b1;
-		else if (m_valid && m_ready)
-			m_sof <= m_eof;
-
 		assign	m_last = m_hlast;
-		assign	m_user = m_sof;
+		assign	m_user = m_first;
 	end else begin : GEN_EOF
 		assign	m_last = m_eof;
 		assign	m_user = m_hlast;
+
+		// Verilator lint_off UNUSED
+		wire	unused_sof;
+		assign	unused_sof = &{ 1'b0, m_first };
+		// Verilator lint_on  UNUSED
 	end endgenerate
 
 	assign	d_ready = !m_valid || m_ready;
@@ -12,69 +12,65 @@
 //
 //	The challenge here is the pipeline--particularly because we have to
 //	take only a single clock cycle to read from memory (unlike software),
-//	and we won't immediately know what address to read from.  Sure, if this
-//	is a memory pixel, we'll read from the right address-but how will we
-//	write pixel values to the right address if we haven't already
-//	calculated their indexes first?  Hence, pipeline scheduling is our
-//	most complex task.
+//	and we won't immediately know what address to write to.  The table
+//	index of a DIFF or LUMA pixel depends upon the pixel before it, and
+//	that pixel might itself have come from the table.  Doing this in one
+//	step costs a clock per pixel.  Instead, we note that the hash is
+//	linear (mod 64) in R, G, and B, and so we keep a running hash
+//	alongside the running pixel: the hash of a DIFF or LUMA pixel is the
+//	hash of the pixel before it plus the hash of its difference.  The
+//	result is a pipeline that produces one pixel per clock, and holds
+//	m_valid high throughout any run, with no bubbles--no matter what the
+//	colors do.
 //
-//	1. Start calculating table index: R*3 + G*5 + B*7 + A*11
-//		8'hfe: If pixel is known ...
-//			Code = 0
-//			Pre-R = R*3
-//			Pre-G = G*5
-//			Pre-B = R*7
-//			Pre-A = (Prior value of A)
-//			Mark as non-offset
-//		8'hff: Same, except ...
-//			Code = 1
-//			Pre-A = A*11 = A * 16 - A * 4 - A * 1
-//		2'b00: (Keep as index)
-//			Code = 2
-//		2'b01: Mark as offset
-//			Pre-R = dR*3
-//			Pre-G = dG*5
-//			Pre-B = dB*7
-//			Pre-A = 0
-//			Code = 3
-//		2'b10: Mark as offset
-//			Pre-R = (dR + dG)*3
-//			Pre-G = dG*5
-//			Pre-B = (dB + dG)*7
-//			Pre-A = 0
-//			Code = 3
-//		2'b11: (Keep as run and length)
-//			Code = 4
-//	2. Calculate the table entry
-//		If run
-//			Tbl-Idx = last_index
-//		else if index
-//			Tbl-Idx = index
-//		else if offset
-//			Tbl-IDX = pre-R + pre-G + pre-B + last_index
-//		else
-//			Tbl-IDX = pre-R + pre-G + pre-B
-//	3. Table write / lookup
-//		If run
-//			(skip)
-//			(pixel is already valid)
-//		else if index
-//			pixel = tbl[index]
-//		else if offset
-//			pixel <= pixel + offset
-//			tbl[index] <= pixel + offset
-//		else
-//			tbl[index] <= pipeline_pixel
-//	4. Run
-//		if (run_count > 0)
-//			run_count <= run_count - 1;
-//		else if (run)
-//			run_pixel <= run_pixel;
-//			run_count <= run_count;
-//		else
-//			run_pixel <= pixel;
-//			run_count <= 0;
-//			
+//	1. Decode the code word
+//		8'hfe: RGB.  Pix = { R, G, B, x }
+//		8'hff: RGBA.  Pix = { R, G, B, A }
+//		2'b00: INDEX.  Keep the index
+//		2'b01: DIFF.  Pix = { dR, dG, dB, 0 }
+//		2'b10: LUMA.  Pix = { dG + dR-dG, dG, dG + dB-dG, 0 }
+//		2'b11: RUN.  Keep the run length, less one
+//		All of these, save INDEX and RUN, are then marked as DELTAs.
+//	2. Start calculating the table index: R*3 + G*5 + B*7 + A*11
+//		RGB:   Hash = R*3 + G*5 + B*7.  (A*11 comes from the prior
+//				pixel in step 3)
+//		RGBA:  Hash = R*3 + G*5 + B*7 + A*11
+//		DELTA: Hash = dR*3 + dG*5 + dB*7
+//		Also, read the table for any INDEX word.  The read is
+//		registered, and so it will be ready by step 3.  (With
+//		OPT_TBLREG, the read is started in step 1 instead, and the
+//		block RAM's output is registered again in step 2.)
+//	3. Produce the pixel, and write it to the table
+//		RGB:   pixel = { RGB, prior alpha },
+//			index = hash + prior alpha * 11
+//		RGBA:  pixel = RGBA, index = hash
+//		DELTA: pixel = prior pixel + the delta,
+//			index = prior index + hash
+//		INDEX: pixel = tbl[index], index = index
+//		RUN:   pixel = prior pixel, index = prior index
+//	   The table lookup for an INDEX word was made (in step 2) at the same
+//	   clock the pixel before it was written (in step 3), and so it can't
+//	   see that write.  It can see every write before it.  The prior
+//	   pixel is therefore forwarded to an INDEX word whenever the two
+//	   indexes match.  No other hazard exists.
+//
+//	   OPT_TBLREG trades this for a table read two clocks long, as from
+//	   a block RAM with its output register enabled, so the RAM's clock
+//	   to out time need not fit within the same clock as the pixel
+//	   math in step 3.  Such a read, made from step 1, also misses the
+//	   write of the pixel two words back.  That write is kept as well,
+//	   giving a two entry forwarding table of the last two writes--the
+//	   most recent taking priority--and so even INDEX words back to back
+//	   with the DIFF or LUMA words before them still cost no bubbles.
+//
+//	   Every pixel is written to the table, run pixels included, just as
+//	   the reference decoder does it.  An (all zero) empty table is
+//	   kept via a valid bit per entry, so it can be cleared in a single
+//	   clock once the last word of a frame passes through this step.
+//	4. Repeat for runs.  The pixel from step 3 is held, and repeated,
+//		for as many clocks as the run requires.  Step 3 waits until
+//		the run is complete.  (Code words that aren't runs have a
+//		length of one.)
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -106,7 +102,18 @@
 //
 `default_nettype none
 // }}}
-module	qoi_decompress (
+module	qoi_decompress #(
+		// {{{
+		// OPT_ALPHA: Set to output the alpha channel, as { A, R, G, B }.
+		// Alpha is always decoded, but otherwise only RGB is output.
+		parameter	[0:0]	OPT_ALPHA = 1'b0,
+		// OPT_TBLREG: Set to register the table's block RAM output,
+		// reading it over two clocks rather than one.  The last two
+		// table writes are then forwarded, rather than just the last.
+		parameter	[0:0]	OPT_TBLREG = 1'b0,
+		localparam		PXW = (OPT_ALPHA) ? 32 : 24
+		// }}}
+	) (
 		input	wire		i_clk, i_reset,
 		// QOI compressed input stream
 		// {{{
@@ -119,7 +126,7 @@ module	qoi_decompress (
 		// {{{
 		output	wire		m_valid,
 		input	wire		m_ready,
-		output	wire	[23:0]	m_data,
+		output	wire [PXW-1:0]	m_data,
 		// We have no knowledge of height or width here.  Hence the
 		// video last signal only indicates the last pixel in the
 		// frame, not the last pixel in a line or any other such thing.
@@ -136,42 +143,57 @@ module	qoi_decompress (
 				C_TABLE = 2,
 				C_DELTA = 3,
 				C_REPEAT= 4;
+	// The hash of opaque black, 255 * 11 = 2805 = 53 (mod 64).  This is
+	// both the index, and the alpha portion of the index, of the pixel
+	// preceding every frame.
+	localparam	[5:0]	BLACK_HASH = 6'h35;
 
 	reg		s1_valid, s1_last;
 	wire		s1_ready;
-	wire	[7:0]	dr_sum, db_sum;	// Red and blue differentials
+	wire	[7:0]	luma_dg, luma_dr, luma_db;
 	reg	[2:0]	s1_code;
 	reg	[31:0]	s1_pix;
-	reg	[5:0]	s1_prer, s1_preg, s1_preb, s1_prea;
+	reg	[5:0]	s1_index;
 
 	reg		s2_valid, s2_last;
 	wire		s2_ready;
+	wire	[5:0]	s2_prer, s2_preg, s2_preb, s2_prea;
 	reg	[2:0]	s2_code;
 	reg	[31:0]	s2_pix;
-	reg	[5:0]	s2_index, s2_alpha, s2_run;
+	reg	[5:0]	s2_index;
 
-	reg		s3_valid, s3_last;
+	reg		s3_valid, s3_last, s3_first;
 	wire		s3_ready;
 	reg	[2:0]	s3_code;
-	reg	[31:0]	s3_lookup, s3_write_value, s3_raw;
-	wire	[31:0]	s3_pixel;
-	wire	[5:0]	s3_write_index;
-	reg	[5:0]	s3_run;
-	reg	[5:0]	s3_index;
+	reg	[31:0]	s3_pix, s3_lookup;
+	reg	[5:0]	s3_hash, s3_ahash, s3_index;
+	reg		s3_lvalid;
+	wire	[31:0]	prior_pixel;
+	wire	[5:0]	prior_hash, prior_ahash;
+	reg	[31:0]	lkup_pixel, nxt_pixel;
+	reg		lkup_valid;
+	reg	[5:0]	nxt_hash, nxt_ahash;
 
 	reg	[31:0]	tbl	[0:63];
+	reg	[63:0]	tbl_valid;
 
 	reg		s4_valid, s4_last;
-	wire		s4_ready;
 	reg	[5:0]	s4_count;
-	reg	[31:0]	s4_pixel;
+	reg	[31:0]	r_pixel;
+	reg	[5:0]	r_hash, r_ahash;
+	// The write before r_pixel's, for OPT_TBLREG
+	reg		p_valid;
+	reg	[31:0]	p_pixel;
+	reg	[5:0]	p_hash;
+	// Verilator lint_off UNUSED
+	wire	[31:0]	argb_pixel;	// (Alpha is unused without OPT_ALPHA)
+	// Verilator lint_on  UNUSED
 
 	assign	s_ready = (!s1_valid || s1_ready);
-
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
-	// s1
+	// Step #1: Decode the code word
 	// {{{
 
 	initial	s1_valid = 1'b0;
@@ -181,60 +203,35 @@ module	qoi_decompress (
 	else if (!s1_valid || s1_ready)
 		{ s1_valid, s1_last } <= { s_valid, s_last };
 
-	// Red - green
-	assign	dr_sum = { {(4){s_data[31]}}, s_data[31:28] }
-					+ { {(2){s_data[37]}}, s_data[37:32] };
-	// Blue - green
-	assign	db_sum = { {(4){s_data[27]}}, s_data[27:24] }
-					+ { {(2){s_data[37]}}, s_data[37:32] };
+	// LUMA: dG is biased by 32, dR-dG and dB-dG by 8 each
+	assign	luma_dg = { 2'b00, s_data[37:32] } - 8'd32;
+	assign	luma_dr = luma_dg + { 4'h0, s_data[31:28] } - 8'd8;
+	assign	luma_db = luma_dg + { 4'h0, s_data[27:24] } - 8'd8;
 
 	always @(posedge i_clk)
 	if (s_valid && s_ready)
 	begin
+		s1_index <= s_data[37:32];
 		case(s_data[39:38])
 		2'b00: begin	// Table lookup
 			// {{{
 			s1_code <= C_TABLE;
-			s1_pix  <= { s_data[39:32], 24'h0 };
-			//
-			s1_prer <= 6'h0;
-			s1_preg <= 6'h0;
-			s1_preb <= 6'h0;
-			s1_prea <= 6'h0;
+			s1_pix  <= 32'h0;
 			end
 			// }}}
-		2'b01: begin
+		2'b01: begin	// DIFF, each difference is biased by 2
+			// {{{
 			s1_code <= C_DELTA;
-			s1_pix[31:24] <= { {(6){s_data[37]}}, s_data[37:36]}+2;
-			s1_pix[23:16] <= { {(6){s_data[35]}}, s_data[35:34]}+2;
-			s1_pix[15: 8] <= { {(6){s_data[33]}}, s_data[33:32]}+2;
-			// dR * 3
-			s1_prer <= { {(3){s_data[37]}}, s_data[37:36], 1'b0 }
-				+ { {(4){s_data[37]}}, s_data[37:36] } + 6'h6;
-			// dG * 5
-			s1_preg <= { {(2){s_data[35]}}, s_data[35:34], 2'b00 }
-				+ { {(4){s_data[35]}}, s_data[35:34] } + 6'ha;
-			// dR * 7
-			s1_preb <= { {(1){s_data[33]}}, s_data[33:32], 3'b000 }
-				- { {(4){s_data[33]}}, s_data[33:32] } + 6'he;
-			// Alpha stays the same
-			s1_prea <= 0;
+			s1_pix[31:24] <= { 6'h0, s_data[37:36] } - 8'd2;
+			s1_pix[23:16] <= { 6'h0, s_data[35:34] } - 8'd2;
+			s1_pix[15: 8] <= { 6'h0, s_data[33:32] } - 8'd2;
+			s1_pix[ 7: 0] <= 8'h0;
 			end
-		2'b10: begin	// LUNA
+			// }}}
+		2'b10: begin	// LUMA
 			// {{{
 			s1_code <= C_DELTA;
-			//
-			s1_pix[31:24] <= dr_sum + 8;
-			s1_pix[23:16] <= { {(2){s_data[37]}}, s_data[37:32]}+32;
-			s1_pix[15: 8] <= db_sum + 8;
-			s1_pix[ 7: 0] <= 0;
-			// dR * 3
-			s1_prer <= { dr_sum[4:0], 1'b0 } + dr_sum[5:0] + 6'd10;
-			// dG * 5
-			s1_preg <= { s_data[37:32] }
-				+ { s_data[35:32], 2'b00 } + 6'd32;
-			s1_preb <= { db_sum[2:0], 3'b0 } - db_sum[5:0] + 6'd24;
-			s1_prea <= 0;
+			s1_pix  <= { luma_dr, luma_dg, luma_db, 8'h0 };
 			end
 			// }}}
 		2'b11: if (s_data[39:32] == 8'hfe)
@@ -242,41 +239,16 @@ module	qoi_decompress (
 				// {{{
 				s1_code <= C_RGB;
 				s1_pix  <= { s_data[31: 8], 8'h0 };
-				// R * 3
-				s1_prer <= { s_data[28:24], 1'b0 } + s_data[29:24];
-				// G * 5
-				s1_preg <= { s_data[19:16], 2'b0 } + s_data[21:16];
-				// B * 7
-				s1_preb <= { s_data[10: 8], 3'b0 } - s_data[13: 8];
-				// A * 11 = (255 * 11), but only on the first case
-				//	1011 0000 0000
-				//	1111 1111 0101
-				//	--------------
-				//	1010 1111 0101 -> 11 0101 -> 48+5 = 53
-				// s1_prea <= 55; // This is an offset
 				// }}}
 			end else if (s_data[39:32] == 8'hff)
 			begin // RGB + Alpha
 				// {{{
 				s1_code<= C_RGBA;
 				s1_pix <=  s_data[31: 0];
-				// R *  3
-				s1_prer<={ s_data[28:24], 1'b0 }+ s_data[29:24];
-				// G *  5
-				s1_preg<={ s_data[19:16], 2'b0 }+ s_data[21:16];
-				// B *  7
-				s1_preb<={ s_data[10: 8], 3'b0 }- s_data[13: 8];
-				// A * 11 = (A << 3) + (A << 1) + A // 1011
-				s1_prea<={ s_data[ 2: 0], 3'b0 }
-					+{ s_data[ 4: 0], 1'b0 }+ s_data[ 5: 0];
 				// }}}
 			end else begin // (Keep as run and length)
 				s1_code <= C_REPEAT;
-				s1_pix <= { s_data[39:32], 24'h0 };
-				s1_prer <= 0;
-				s1_preg <= 0;
-				s1_preb <= 0;
-				s1_prea <= 0;
+				s1_pix  <= 32'h0;
 			end
 		endcase
 	end
@@ -285,7 +257,7 @@ module	qoi_decompress (
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
-	// s2
+	// Step #2: Start the table index, and read from the table
 	// {{{
 
 	initial	s2_valid = 1'b0;
@@ -296,45 +268,69 @@ module	qoi_decompress (
 		{ s2_valid, s2_last } <= { s1_valid, s1_last };
 
 	always @(posedge i_clk)
-	if (i_reset)
-		s2_alpha <= 6'h35;
-	else if (s1_valid && s1_ready && s1_code == C_RGBA)
-		s2_alpha <= s1_prea;
-	// else if (s3_valid && s3_code == C_TABLE)
-	//	s2_alpha <= s3_lookup[7:0] + (s3_lookup[7:0] << 1)
-	//			+ (s3_lookup[7:0] << 3);
-
-	always @(posedge i_clk)
-	if (i_reset)
-		s2_pix <= 0;
-	else if (s1_valid && s1_ready)
+	if (s1_valid && s1_ready)
 	begin
-		if (s1_code == C_TABLE)
-			s2_pix  <= 0;
-		else if (s1_code != C_REPEAT)
-			s2_pix  <= s1_pix;
+		s2_code  <= s1_code;
+		s2_pix   <= s1_pix;
+		s2_index <= s1_index;
 	end
 
+	// Only the bottom six bits of each channel matter to the index
+	// R * 3
+	assign	s2_prer = { s2_pix[28:24], 1'b0 } + s2_pix[29:24];
+	// G * 5
+	assign	s2_preg = { s2_pix[19:16], 2'b0 } + s2_pix[21:16];
+	// B * 7
+	assign	s2_preb = { s2_pix[10: 8], 3'b0 } - s2_pix[13: 8];
+	// A * 11 = (A << 3) + (A << 1) + A // 1011
+	assign	s2_prea = { s2_pix[ 2: 0], 3'b0 } + { s2_pix[ 4: 0], 1'b0 }
+						+ s2_pix[ 5: 0];
+
+	// The table read.  The read needs to be the registered output of a
+	// block RAM, so that the lookup is ready for step #3.
+	// {{{
+	generate if (OPT_TBLREG)
+	begin : GEN_TBLREG
+		// The read is started as the word enters step #2, and then
+		// registered again as it enters step #3.  Both registers
+		// share their clock enables with the pipeline, as the
+		// block RAM's enable and output register enable would.
+		reg	[31:0]	tbl_rd;
+
+		always @(posedge i_clk)
+		if (s1_valid && s1_ready)
+			tbl_rd <= tbl[s1_index];
+
+		always @(posedge i_clk)
+		if (s2_valid && s2_ready)
+			s3_lookup <= tbl_rd;
+
+	end else begin : GEN_TBLREAD
+
+		always @(posedge i_clk)
+		if (s2_valid && s2_ready)
+			s3_lookup <= tbl[s2_index];
+
+	end endgenerate
+	// }}}
+
+	// The valid bits, together with the (partial) index
 	always @(posedge i_clk)
-	if (s1_valid && s1_ready)
+	if (s2_valid && s2_ready)
 	begin
-		s2_code <= s1_code;
-		s2_run  <= (s1_code == C_REPEAT) ? s1_pix[29:24] : 6'h0;
-		case(s1_code)
-		C_RGB:    s2_index <= s1_prer + s1_preg + s1_preb;// + s2_alpha;
-		C_RGBA:   s2_index <= s1_prer + s1_preg + s1_preb + s1_prea;
-		C_TABLE:  s2_index <= s1_pix[29:24];
-		C_DELTA:  s2_index <= s1_prer + s1_preg + s1_preb;// + s2_index;
-		C_REPEAT: s2_index <= s2_index;
-		default: begin end
-		endcase
+		s3_lvalid <= tbl_valid[s2_index];
+
+		s3_ahash <= s2_prea;
+		// For RGB and DELTA words, s2_pix[7:0] is zero, so adding the
+		// alpha's contribution in costs nothing
+		s3_hash  <= s2_prer + s2_preg + s2_preb + s2_prea;
 	end
 
 	assign	s2_ready = !s3_valid || s3_ready;
-	// }}}	
+	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
-	// s3: Table lookup
+	// Step #3: Produce the pixel and write it to the table
 	// {{{
 
 	initial	s3_valid = 1'b0;
@@ -345,114 +341,178 @@ module	qoi_decompress (
 		{ s3_last, s3_valid } <= { s2_last, s2_valid };
 
 	always @(posedge i_clk)
-	if (s2_valid && s2_ready && s2_code == C_TABLE)
-		s3_lookup <= tbl[s2_index];
+	if (s2_valid && s2_ready)
+	begin
+		s3_code  <= s2_code;
+		s3_pix   <= s2_pix;
+		s3_index <= s2_index;
+	end
+
+	// s3_first: True if the word in step #3 is the first of its frame
+	// {{{
+	initial	s3_first = 1'b1;
+	always @(posedge i_clk)
+	if (i_reset)
+		s3_first <= 1'b1;
+	else if (s3_valid && s3_ready)
+		s3_first <= s3_last;
+	// }}}
+
+	// Every frame starts from opaque black
+	assign	prior_pixel = (s3_first) ? 32'h0ff : r_pixel;
+	assign	prior_hash  = (s3_first) ? BLACK_HASH : r_hash;
+	assign	prior_ahash = (s3_first) ? BLACK_HASH : r_ahash;
+
+	// Table lookup, and forwarding
+	// {{{
+	// On the first word of a frame, the table is empty--regardless of
+	// whatever might have been read from it.  Otherwise, the only write
+	// the lookup might have missed is that of the prior pixel--or, with
+	// OPT_TBLREG, also that of the pixel before it.  The valid bits are
+	// still read in step #2, so only the prior pixel's can be missed.
+	always @(*)
+	if (s3_first)
+		{ lkup_valid, lkup_pixel } = 33'h0;
+	else if (s3_index == r_hash)
+		{ lkup_valid, lkup_pixel } = { 1'b1, r_pixel };
+	else if (OPT_TBLREG && p_valid && s3_index == p_hash)
+		{ lkup_valid, lkup_pixel } = { 1'b1, p_pixel };
+	else if (s3_lvalid)
+		{ lkup_valid, lkup_pixel } = { 1'b1, s3_lookup };
+	else
+		{ lkup_valid, lkup_pixel } = 33'h0;
+	// }}}
 
-	assign	s3_write_index = (s2_code == C_RGB) ? (s2_index + s2_alpha)
-			:(s2_code < C_TABLE) ? s2_index : (s3_index + s2_index);
 	always @(*)
 	begin
-		s3_write_value = s3_raw;
-		case(s2_code)
-		C_RGB:   s3_write_value[31:8] = s2_pix[31:8];
-		C_RGBA:  s3_write_value = s2_pix[31:0];
-		C_TABLE: s3_write_value = s3_pixel;	// Could be anything ...
+		nxt_pixel = prior_pixel;
+		nxt_hash  = prior_hash;
+		nxt_ahash = prior_ahash;
+
+		case(s3_code)
+		C_RGB: begin
+			// {{{
+			nxt_pixel = { s3_pix[31:8], prior_pixel[7:0] };
+			nxt_hash  = s3_hash + prior_ahash;
+			end
+			// }}}
+		C_RGBA: begin
+			// {{{
+			nxt_pixel = s3_pix;
+			nxt_hash  = s3_hash;
+			nxt_ahash = s3_ahash;
+			end
+			// }}}
+		C_TABLE: begin
+			// {{{
+			// An empty table entry is all zeros, and so it hashes
+			// to zero as well
+			nxt_pixel = lkup_pixel;
+			nxt_hash  = (lkup_valid) ? s3_index : 6'h0;
+			nxt_ahash = { lkup_pixel[ 2: 0], 3'b0 }
+				+ { lkup_pixel[ 4: 0], 1'b0 } + lkup_pixel[ 5: 0];
+			end
+			// }}}
 		C_DELTA: begin
-			s3_write_value[31:24]= s2_pix[31:24]+ s3_pixel[31:24];
-			s3_write_value[23:16]= s2_pix[23:16]+ s3_pixel[23:16];
-			s3_write_value[15: 8]= s2_pix[15: 8]+ s3_pixel[15: 8];
-			s3_write_value[ 7: 0]= s3_pixel[7:0];
+			// {{{
+			nxt_pixel[31:24] = prior_pixel[31:24] + s3_pix[31:24];
+			nxt_pixel[23:16] = prior_pixel[23:16] + s3_pix[23:16];
+			nxt_pixel[15: 8] = prior_pixel[15: 8] + s3_pix[15: 8];
+			nxt_hash  = prior_hash + s3_hash;
 			end
-		default: begin end // s3_write_value = s2_pix;
+			// }}}
+		default: begin end	// C_REPEAT, nothing changes
 		endcase
 	end
 
+	// Table write
+	// {{{
 	always @(posedge i_clk)
-	if (s2_valid && s2_ready && (s2_code != C_TABLE && !s2_code[2]))
-		tbl[s3_write_index] <= s3_write_value;
+	if (s3_valid && s3_ready)
+		tbl[nxt_hash] <= nxt_pixel;
 
+	initial	tbl_valid = 0;
 	always @(posedge i_clk)
+	if (i_reset)
+		tbl_valid <= 0;
+	else if (s3_valid && s3_ready)
 	begin
-		if (s2_valid && s2_ready)
-		begin
-			s3_code <= s2_code;
-			if (s2_code == C_TABLE)
-				s3_index <= s2_index;
-			else if (s2_code != C_REPEAT)
-				s3_index <= s3_write_index;
-
-
-			if (s2_code == C_REPEAT)
-			begin
-				s3_run <= s2_run;
-				if (s3_code == C_TABLE)
-					s3_raw <= s3_lookup;
-			end else begin
-				s3_run <= 0;
-				s3_raw  <= s3_write_value;
-			end
-		end
+		if (s3_last)
+			tbl_valid <= 0;
+		else
+			tbl_valid[nxt_hash] <= 1'b1;
+	end
+	// }}}
 
-		if (i_reset)
-		begin
-			s3_raw   <= 32'h00ff;
-			s3_code  <= C_RGBA;
-			s3_index <= 6'h35;
-		end
+	// The prior pixel, also the output pixel
+	// {{{
+	always @(posedge i_clk)
+	if (s3_valid && s3_ready)
+	begin
+		r_pixel <= nxt_pixel;
+		r_hash  <= nxt_hash;
+		r_ahash <= nxt_ahash;
 	end
+	// }}}
 
-	assign	s3_pixel = (s3_code == C_TABLE) ? s3_lookup : s3_raw;
-	assign	s3_ready = !s4_valid || (s4_ready && s4_count == 0);
+	// The pixel before that, to be forwarded with OPT_TBLREG
+	// {{{
+	// p_valid is only set if this pixel came from the same frame as the
+	// one now being written
+	initial	p_valid = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		p_valid <= 1'b0;
+	else if (s3_valid && s3_ready)
+		p_valid <= OPT_TBLREG && !s3_first;
+
+	always @(posedge i_clk)
+	if (s3_valid && s3_ready)
+	begin
+		p_pixel <= r_pixel;
+		p_hash  <= r_hash;
+	end
+	// }}}
+
+	assign	s3_ready = !s4_valid || (m_ready && s4_count == 0);
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
-	// s4: Repeats
+	// Step #4: Repeats
 	// {{{
 
 	initial	s4_valid = 1'b0;
 	always @(posedge i_clk)
 	if (i_reset)
-		{ s4_last, s4_valid } <= 0;
-	else if (!s4_valid || s4_ready)
-	begin
-		{ s4_last, s4_valid } <= { s3_last, s3_valid };
-		// s4_last <= (s3_valid && s3_last && s3_run == 0);
-	end else if (s4_count > 0)
-	begin
-		s4_valid <= !s4_last;
-		// s4_last <= (s4_count <= 1) && s4_lcl_last;
-	end
+		s4_valid <= 1'b0;
+	else if (s3_valid && s3_ready)
+		s4_valid <= 1'b1;
+	else if (m_ready && s4_count == 0)
+		s4_valid <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s3_valid && s3_ready)
+		s4_last <= s3_last;
 
+	// s4_count is the number of pixels remaining to be repeated, after
+	// the current one
+	initial	s4_count = 0;
 	always @(posedge i_clk)
 	if (i_reset)
 		s4_count <= 0;
 	else if (s3_valid && s3_ready)
-	begin
-		if (s3_code != C_REPEAT)
-			s4_count <= 0;
-		else
-			s4_count <= s3_run;
-	end else if ((!m_valid || m_ready) && s4_count > 0)
+		s4_count <= (s3_code == C_REPEAT) ? s3_index : 6'h0;
+	else if (m_valid && m_ready && s4_count > 0)
 		s4_count <= s4_count - 1;
-
-	always @(posedge i_clk)
-	if (s3_valid && s3_ready && s3_code != C_REPEAT)
-		s4_pixel <= s3_pixel;
-
-	assign	s4_ready = (!m_valid || m_ready)&&(s4_count == 0);
 	// }}}
 
 	assign	m_valid = s4_valid;
-	assign	m_data  = s4_pixel[31:8];
+	// Internally, pixels are { R, G, B, A }, but they are output with
+	// alpha (if at all) in the MSBs
+	assign	argb_pixel = { r_pixel[7:0], r_pixel[31:8] };
+	assign	m_data  = argb_pixel[PXW-1:0];
 	assign	m_last  = s4_last && (s4_count == 0);
 
-	// Keep Verilator happy
-	// {{{
-	// Verilator lint_off UNUSED
-	wire	unused;
-	assign	unused = &{ 1'b0, s4_pixel[7:0] };
-	// Verilator lint_on  UNUSED
-	// }}}
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -485,9 +545,6 @@ module	qoi_decompress (
 		assume($stable(s_data));
 		assume($stable(s_last));
 	end
-
-	// No two table look ups to the same element in a row
-
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -504,10 +561,7 @@ module	qoi_decompress (
 		assert($stable(s1_code));
 		assert($stable(s1_last));
 		assert($stable(s1_pix));
-		assert($stable(s1_prer));
-		assert($stable(s1_preg));
-		assert($stable(s1_preb));
-		assert($stable(s1_prea));
+		assert($stable(s1_index));
 
 		assert($stable(f1_raw));
 	end
@@ -515,6 +569,26 @@ module	qoi_decompress (
 	always @(posedge i_clk)
 	if (s_valid && s_ready)
 		f1_raw <= s_data;
+
+	always @(*)
+	if (s1_valid)
+	begin
+		assert(s1_index == f1_raw[37:32]);
+		case(f1_raw[39:38])
+		2'b00: assert(s1_code == C_TABLE);
+		2'b01: assert(s1_code == C_DELTA);
+		2'b10: assert(s1_code == C_DELTA);
+		2'b11: if (f1_raw[39:32] == 8'hfe)
+				assert(s1_code == C_RGB);
+			else if (f1_raw[39:32] == 8'hff)
+				assert(s1_code == C_RGBA);
+			else
+				assert(s1_code == C_REPEAT);
+		endcase
+
+		if (s1_code != C_RGBA)
+			assert(s1_pix[7:0] == 8'h0);
+	end
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -532,8 +606,6 @@ module	qoi_decompress (
 		assert($stable(s2_last));
 		assert($stable(s2_pix));
 		assert($stable(s2_index));
-		assert($stable(s2_alpha));
-		assert($stable(s2_run));
 
 		assert($stable(f2_raw));
 	end
@@ -541,12 +613,24 @@ module	qoi_decompress (
 	always @(posedge i_clk)
 	if (s1_valid && s1_ready)
 		f2_raw <= f1_raw;
+
+	always @(*)
+	if (s2_valid)
+	begin
+		assert(s2_code == ((f2_raw[39:38] == 2'b00) ? C_TABLE
+			: (f2_raw[39:38] != 2'b11) ? C_DELTA
+			: (f2_raw[39:32] == 8'hfe) ? C_RGB
+			: (f2_raw[39:32] == 8'hff) ? C_RGBA : C_REPEAT));
+		if (s2_code != C_RGBA)
+			assert(s2_pix[7:0] == 8'h0);
+	end
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
 	// S3
 	// {{{
 	reg	[39:0]	f3_raw;
+	reg	[5:0]	f3_phash, f3_hash, f3_prior, f3_ahash, f3_pahash, f3_lhash;
 
 	always @(posedge i_clk)
 	if (!f_past_valid || $past(i_reset))
@@ -556,11 +640,12 @@ module	qoi_decompress (
 		assert(s3_valid);
 		assert($stable(s3_code));
 		assert($stable(s3_last));
-		assert($stable(s3_pixel));
-		assert($stable(s3_raw));
-		assert($stable(s3_run));
+		assert($stable(s3_pix));
 		assert($stable(s3_index));
 		assert($stable(s3_lookup));
+		assert($stable(s3_lvalid));
+		assert($stable(s3_hash));
+		assert($stable(s3_ahash));
 
 		assert($stable(f3_raw));
 	end
@@ -569,102 +654,97 @@ module	qoi_decompress (
 	if (s2_valid && s2_ready)
 		f3_raw <= f2_raw;
 
-	reg	[5:0]	f2_index, f3_index;
-
+	// Whatever pixel we write, it must be written to its own hash--as
+	// the reference decoder would calculate it
 	always @(*)
 	begin
-		f2_index = s3_write_value[31:24] + (s3_write_value[31:24]<<1)
-			+ s3_write_value[23:16] + (s3_write_value[23:16]<<2)
-			- s3_write_value[15: 8] + (s3_write_value[15: 8]<<3);
-		// + ALPHA * 11
-		f2_index = f2_index + s3_write_value[7:0]
-			+ (s3_write_value[7:0] << 1)
-			+ (s3_write_value[7:0] << 3);
-
-		f3_index = s3_lookup[31:24] + (s3_lookup[31:24]<<1)
-			+ s3_lookup[23:16] + (s3_lookup[23:16]<<2)
-			- s3_lookup[15: 8] + (s3_lookup[15: 8]<<3);
-		// + ALPHA * 11
-		f3_index = f3_index + s3_lookup[7:0]
-			+ (s3_lookup[7:0] << 1)
-			+ (s3_lookup[7:0] << 3);
+		f3_phash = s3_pix[31:24] * 3 + s3_pix[23:16] * 5
+			+ s3_pix[15:8] * 7 + s3_pix[7:0] * 11;
+		f3_hash = nxt_pixel[31:24] * 3 + nxt_pixel[23:16] * 5
+			+ nxt_pixel[15:8] * 7 + nxt_pixel[7:0] * 11;
+		f3_prior = prior_pixel[31:24] * 3 + prior_pixel[23:16] * 5
+			+ prior_pixel[15:8] * 7 + prior_pixel[7:0] * 11;
+		f3_lhash = s3_lookup[31:24] * 3 + s3_lookup[23:16] * 5
+			+ s3_lookup[15:8] * 7 + s3_lookup[7:0] * 11;
+		f3_ahash  = nxt_pixel[7:0] * 11;
+		f3_pahash = prior_pixel[7:0] * 11;
 	end
 
 	always @(*)
-	if (!i_reset && s2_valid && (s2_code != C_TABLE && s2_code != C_REPEAT))
+	if (s3_valid)
 	begin
-		assert(f2_index == s3_write_index);
+		assert(s3_hash == f3_phash);
+		if (s3_code != C_RGBA)
+			assert(s3_pix[7:0] == 8'h0);
 	end
 
 	always @(*)
-	if (s3_code == C_TABLE)
+	if (!i_reset)
 	begin
-		assume(f3_index == s3_index);
+		assert(prior_hash == f3_prior);
+		assert(prior_ahash == f3_pahash);
+		if (s3_valid)
+		begin
+			assert(nxt_hash == f3_hash);
+			assert(nxt_ahash == f3_ahash);
+		end
 	end
-	// }}}
-	////////////////////////////////////////////////////////////////////////
-	//
-	// Never Alpha
-	// {{{
-	(* anyconst *)	reg	fnvr_alpha;
-
-	always @(*)
-		assume(fnvr_alpha);
-
-	always @(*)
-	if (!i_reset && fnvr_alpha && s_valid)
-		assume(s_data[39:32] != 8'hff);
-
-	always @(*)
-	if (!i_reset && fnvr_alpha && s1_valid)
-		assert(s1_code != C_RGBA);
 
-	always @(*)
-	if (!i_reset && fnvr_alpha && s2_valid)
-		assert(s2_code != C_RGBA);
+	// Every valid table entry is found at its own hash
+	(* anyconst *)	reg	[5:0]	f_addr;
+	reg	[31:0]	f_tblv;
+	reg	[5:0]	f_tblh;
+	reg	[5:0]	f_phash;
 
 	always @(*)
-	if (!i_reset && fnvr_alpha && s2_valid && (s2_code != C_TABLE && s2_code != C_REPEAT))
 	begin
-		assert(s3_write_value[7:0] == 8'hff);
+		f_tblv = tbl[f_addr];
+		f_tblh = f_tblv[31:24] * 3 + f_tblv[23:16] * 5
+				+ f_tblv[15:8] * 7 + f_tblv[7:0] * 11;
+		if (!i_reset && tbl_valid[f_addr])
+			assert(f_addr == f_tblh);
 	end
 
+	// So is the forwarded write before the prior pixel's
 	always @(*)
-	if (!i_reset && fnvr_alpha && s3_valid)
 	begin
-		assert(s3_code != C_RGBA);
-		assume(s3_lookup[7:0] == 8'hff);
+		f_phash = p_pixel[31:24] * 3 + p_pixel[23:16] * 5
+				+ p_pixel[15:8] * 7 + p_pixel[7:0] * 11;
+		if (!i_reset && p_valid)
+		begin
+			assert(OPT_TBLREG);
+			assert(p_hash == f_phash);
+		end
 	end
 
+	always @(*)
+	if (!i_reset && s3_valid && s3_lvalid && !s3_first
+			&& s3_index != r_hash
+			&& (!OPT_TBLREG || !p_valid || s3_index != p_hash))
+		assert(s3_index == f3_lhash);
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
-	// "Careless" assumptions
+	// S4 and the M_* outputs
 	// {{{
-	always @(*)
-	if(s_valid)
-		assume(s_data[39:38] != 2'b10);
-	// always @(*)
-	// if(s_valid)
-	//	assume(s_data[39:38] != 2'b01);
-	always @(*)
-	if(!i_reset && s1_valid)
-		assert(f1_raw[39:38] != 2'b10);
-	always @(*)
-	if(!i_reset && s2_valid)
-		assert(f2_raw[39:38] != 2'b10);
-	always @(*)
-	if(!i_reset && s3_valid)
-		assert(f3_raw[39:38] != 2'b10);
+	always @(posedge i_clk)
+	if (!f_past_valid || $past(i_reset))
+		assert(!m_valid);
+	else if ($past(m_valid && !m_ready))
+	begin
+		assert(m_valid);
+		assert($stable(m_data));
+		assert($stable(m_last));
+	end
 
 	always @(*)
-		assume(m_ready);
-
-	always @(posedge i_clk)
-	if (!f_past_valid && !$past(i_reset) && $past(s_valid && s_last))
-		assume(s_valid);
+	if (!i_reset)
+	begin
+		assert(s4_count < 6'd62);
+		if (!s4_valid)
+			assert(s4_count == 0);
+	end
 	// }}}
-
 `endif	// FORMAL
 // }}}
 endmodule
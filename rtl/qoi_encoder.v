@@ -13,6 +13,150 @@
 //	end of the image data.  The third purpose is then to add the required
 //	QOI trailer to the image stream.
 //
+//	When PIXELS_PER_CLOCK > 1, each beat of the incoming video stream
+//	carries PIXELS_PER_CLOCK pixels, first pixel in the MSBs, and the
+//	image width must be a multiple of PIXELS_PER_CLOCK.  In this case,
+//	compression is handled by qoi_wcompress rather than qoi_compress.  The
+//	compressed stream may then contain as many as 4*PIXELS_PER_CLOCK bytes
+//	per clock, so DW should be at least 32*PIXELS_PER_CLOCK if the encoder
+//	is to keep up with its input.
+//
+//	The output packer accepts one compressed word every clock, at any DW,
+//	no matter how those words straddle the bus words leaving o_qdata.  It
+//	only ever holds off the compressor when i_qready is (or has been) low.
+//
+//	OPT_ALPHA adds an alpha channel.  Pixels are then 32 bits wide,
+//	{ A, R, G, B }, alpha in the MSBs, and the header claims four
+//	channels.  This option is (currently) only supported with one pixel
+//	per clock.  See qoi_compress for details.
+//
+//	O_OPS reports the QOI ops as they are generated, for anyone wishing
+//	to gather statistics.  It holds a count of each op type sent in the
+//	current clock, in fields of OCW bits each: { RUN, INDEX, DIFF, LUMA,
+//	RGB }, and is zero otherwise.  These counts lead the compressed data
+//	on o_qdata by a few clocks.
+//
+//	OPT_PERFCOUNTERS adds pipeline occupancy counters to the compressor,
+//	for finding out where any throughput is lost.  O_PERF holds the
+//	counts for the last complete frame, in the format described in
+//	qoi_compress, and is updated a few clocks before that frame's trailer
+//	leaves o_qdata.  This option is only supported with one pixel per
+//	clock.  Otherwise, or without OPT_PERFCOUNTERS, O_PERF is zero.
+//
+//	OPT_OVERLAP lets the compressor accept the first pixel of each frame
+//	on the clock after the last pixel of the frame before, rather than
+//	only once that frame has left the compressor (see qoi_compress).
+//	Incoming video is then only held up between frames while the trailer
+//	and next header are sent.  It's ignored with more than one pixel per
+//	clock.
+//
+//	OPT_FASTSTART allows a new frame to be started part way through the
+//	incoming one, for captures that need to start now rather than at the
+//	next frame.  Once the encoder is synchronized, a pulse on I_RESTART
+//	cuts the frame in progress short at the end of the next line, and
+//	starts a new frame with the line after it.  The new frame's header
+//	carries the true number of lines remaining, so it is a valid QOI image
+//	of the bottom of the incoming frame.  Following frames are full
+//	height again.  The frame that was cut short is a partial frame: its
+//	header claims its full height, but it ends early.  It should be
+//	discarded.  O_RESTARTED is set as the last pixel before the new frame
+//	is accepted, so whatever follows the encoder can tell that the next
+//	frame end is that of the (possibly partial) frame to discard.  No cut
+//	is needed if that line was the last of its frame anyway.  I_RESTART
+//	is ignored without OPT_FASTSTART.
+//
+//	OPT_BUDGET enables a bandwidth budget.  Two budgets may be given,
+//	i_line_budget in bytes per line, and i_frame_budget in bytes per
+//	frame.  Either may be set to zero to disable it.  These inputs are
+//	treated as quasi-static, and should only be changed when the video
+//	is idle--or else the frame in progress may be affected.
+//
+//	  - The line budget controls a quantizer, ahead of the compressor.
+//	    At the end of every line, if the frame has used more than its
+//	    share of the line budget so far, the quantization level is raised
+//	    by one, up to three.  Once the frame is back under budget by a
+//	    full line, it is lowered by one.  At level q, any pixel whose
+//	    colors are all within 2^(q+1)-1 of the pixel before it is replaced
+//	    by that pixel.  (Simply clearing low order bits would break up
+//	    the small differences QOI_OP_DIFF and QOI_OP_LUMA depend upon, and
+//	    so make most images larger, not smaller.)  Noise below the
+//	    threshold then compresses into runs, at the cost of fine detail.
+//	    The current quantization level is given by o_quant.
+//
+//	  - The frame budget caps the size of any frame.  Once the budget is
+//	    used up, every remaining pixel of the frame is replaced by the
+//	    last pixel before it.  The rest of the frame then compresses into
+//	    (nearly) nothing but QOI_OP_RUN ops, and the frame remains a valid
+//	    QOI image of the right size.  o_overrun is set for the rest of
+//	    such a frame.  Since the compressor is pipelined, a frame can
+//	    still exceed its budget by the ops of any pixels within the
+//	    compressor once it's used up: up to 2^LGINFIFO+7 beats of them,
+//	    at no more than five bytes a pixel.  The rest of the frame may
+//	    then cost another QOI_OP_RUN for every 62 pixels, and the header
+//	    and trailer come on top of all of this.  For the same reason,
+//	    o_overrun is only sure to be set for a frame that runs over its
+//	    budget by more than the ops within the compressor.
+//
+//	OPT_DELTA adds delta frames, for video that changes little from one
+//	frame to the next.  While I_DELTA is set, a CRC is kept of every
+//	line, and compared against that of the same line of the frame before,
+//	from a table of 2^LGLINES CRCs.  Each line's ops are held back, in a
+//	FIFO of 2^(LGLBUF+1) ops, until the line ends.  A frame the same size
+//	as the one before it may then be sent as a delta frame, with the magic
+//	number "qoid" in place of "qoif".  Any line of a delta frame whose CRC
+//	matches, and which took no more than 2^LGLBUF-1 ops, is replaced by
+//	the single (otherwise unused) op 0xfd: this line is unchanged.  Lines
+//	past the first 2^LGLINES are always sent in full.  So that a decoder
+//	can rebuild its table from the line it copies, runs end at the end of
+//	every line while I_DELTA is set, and are no longer than 61 pixels--in
+//	key frames as well.  See sw/qoi.h for the format.
+//
+//	  - A key frame, an ordinary QOI image, is sent whenever the frame
+//	    size changes, following any pulse on I_KEYFRAME, and at least
+//	    once every I_KEYINT frames, unless I_KEYINT is zero.  The first
+//	    frame after I_DELTA is set is always a key frame.  A pulse on
+//	    I_KEYFRAME applies to the next header to be sent.  Since each
+//	    header is sent once the frame before it has left, this may be
+//	    before its frame has even started to arrive.
+//
+//	  - Delta frames can only be decoded, in order, from the key frame
+//	    before them, and (so far) only in software.  qoi_decoder doesn't
+//	    support them.
+//
+//	  - Any bandwidth budget counts the bytes of every line, including
+//	    those later replaced, and so is conservative.
+//
+//	I_DELTA and I_KEYINT are quasi-static, as are the budgets.  OPT_DELTA
+//	requires one pixel per clock, and is ignored with OPT_ALPHA.
+//
+//	OPT_ABOVE, while I_ABOVE is set, lets the compressor predict pixels
+//	from the line above them, using the (otherwise unused) op 0xfc.  The
+//	stream is then no longer standard QOI, and so carries the magic number
+//	"qoiv" in place of "qoif".  Only lines of up to 2^LGABOVE pixels are
+//	fully predicted.  See qoi_compress for details, and sw/qoi.h for the
+//	format.  As with delta frames, only software can (so far) decode
+//	these frames.  I_ABOVE is quasi-static, and is ignored while I_DELTA
+//	is set.  OPT_ABOVE requires one pixel per clock.
+//
+//	OPT_CROP selects a part of the incoming video to compress, dropping
+//	everything else before it reaches the compressor.  Only the rectangle
+//	I_CROP_W by I_CROP_H pixels, with its top left corner at I_CROP_X,
+//	I_CROP_Y, is kept.  A width or height of zero extends the rectangle
+//	to the right or bottom edge of the incoming frame.  Within it, one
+//	of every I_SKIP_X+1 pixels, starting with the first, and one of every
+//	I_SKIP_Y+1 lines is kept.  Finally, only one of every I_SKIP_FRAMES+1
+//	frames is kept at all.  All zeros keeps every pixel of every frame.
+//	The header then gives the size of what was kept, and any fast start
+//	counts the lines kept as well.  The settings take effect from the
+//	next frame, but since the header's size is always taken from the frame
+//	before, the first frame following a change to the rectangle or to
+//	I_SKIP_X or I_SKIP_Y will have the wrong size in its header, exactly
+//	as it would if the incoming video had changed size.  Since the last
+//	pixel kept from a line isn't known until the next is kept, or the
+//	incoming line ends, each kept pixel is held back by one until then.
+//	The rectangle must hold at least one pixel of the incoming frame.
+//	OPT_CROP requires one pixel per clock.
+//
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
 //
@@ -47,10 +191,36 @@ module	qoi_encoder #(
 		// {{{
 		parameter	[0:0]	OPT_TUSER_IS_SOF = 1'b0,
 		parameter	[0:0]	OPT_LOWPOWER = 1'b0,
+		parameter	[0:0]	OPT_BUDGET = 1'b0,
+		parameter	[0:0]	OPT_ALPHA = 1'b0,
+		parameter	[0:0]	OPT_PERFCOUNTERS = 1'b0,
+		parameter	[0:0]	OPT_FASTSTART = 1'b0,
+		parameter	[0:0]	OPT_DELTA = 1'b0,
+		parameter	[0:0]	OPT_CROP = 1'b0,
+		parameter	[0:0]	OPT_OVERLAP = 1'b0,
+		parameter	[0:0]	OPT_ABOVE = 1'b0,
+		// LGABOVE: log_2 of the line buffer size, in pixels, if
+		// OPT_ABOVE is set
+		parameter		LGABOVE = 11,
+		// LGLBUF: log_2 of the most ops a line may take and still be
+		// replaced, plus one, in a delta frame
+		parameter		LGLBUF = 6,
+		// LGLINES: log_2 of the number of line CRCs kept
+		parameter		LGLINES = 11,
+		// LGINFIFO: log_2 of the compressor's input FIFO size, in
+		// beats, or zero for a simple skid buffer
+		parameter		LGINFIFO = 0,
 		parameter	[15:0]	LGFRAME=16,
 		parameter		DW = 64,
+		parameter		PIXELS_PER_CLOCK = 1,
 		localparam		DB = DW/8,
-		localparam		LGDB = $clog2(DB)
+		localparam		LGDB = $clog2(DB),
+		localparam		PXW = (OPT_ALPHA) ? 32 : 24,
+		localparam		PW = PXW*PIXELS_PER_CLOCK,
+		localparam		FW = 32*PIXELS_PER_CLOCK,
+		localparam		LGFB = $clog2(FW/8),
+		localparam		OCW = $clog2(PIXELS_PER_CLOCK+1),
+		localparam		PERFW = 13*32
 		// }}}
 	) (
 		// {{{
@@ -58,14 +228,37 @@ module	qoi_encoder #(
 		//
 		input	wire			s_valid,
 		output	wire			s_ready,
-		input	wire	[23:0]		s_data,
+		input	wire	[PW-1:0]	s_data,
 		input	wire			s_last, s_user,
+		// Start a new frame at the next line, if OPT_FASTSTART is set
+		input	wire			i_restart,
+		output	wire			o_restarted,
 		//
 		output	reg			o_qvalid,
 		input	wire			i_qready,
 		output	reg	[DW-1:0]	o_qdata,
 		output	reg	[LGDB-1:0]	o_qbytes,
-		output	reg			o_qlast
+		output	reg			o_qlast,
+		//
+		output	wire	[5*OCW-1:0]	o_ops,
+		// Bandwidth budget, if OPT_BUDGET is set
+		input	wire	[15:0]		i_line_budget,
+		input	wire	[31:0]		i_frame_budget,
+		output	wire	[1:0]		o_quant,
+		output	wire			o_overrun,
+		// Delta frames, if OPT_DELTA is set
+		input	wire			i_delta,
+		input	wire			i_keyframe,
+		input	wire	[7:0]		i_keyint,
+		// Prediction from the line above, if OPT_ABOVE is set
+		input	wire			i_above,
+		// Cropping and decimation, if OPT_CROP is set
+		input	wire	[LGFRAME-1:0]	i_crop_x, i_crop_y,
+		input	wire	[LGFRAME-1:0]	i_crop_w, i_crop_h,
+		input	wire	[7:0]		i_skip_x, i_skip_y,
+		input	wire	[7:0]		i_skip_frames,
+		// Pipeline occupancy, if OPT_PERFCOUNTERS is set
+		output	wire	[PERFW-1:0]	o_perf
 		// }}}
 	);
 
@@ -87,18 +280,34 @@ module	qoi_encoder #(
 	reg	[1:0]	v_state;
 	reg	[LGFRAME-1:0]	v_count, v_height;
 
-	wire		e_valid, e_ready;
+	wire		c_valid, c_vlast;
+	wire	[PW-1:0]	c_data;
+	wire	[LGFRAME-1:0]	c_vcount, c_width, c_height;
+
+	wire		e_hlast, e_vlast;
+	wire	[LGFRAME-1:0]	hdr_height;
 
-	wire		enc_valid, enc_ready, enc_last;
-	wire	[31:0]	enc_data;
-	wire	[1:0]	enc_bytes;
+	wire		e_valid, e_ready, cmp_valid, cmp_ready;
+	wire	[PW-1:0]	e_data;
+
+	wire		enc_valid, enc_ready, enc_last, enc_hlast;
+	wire	[FW-1:0]	enc_data;
+	wire	[LGFB-1:0]	enc_bytes;
+	wire	[5*OCW-1:0]	enc_ops;
 
 	reg	[3:0]	frm_state;
 	reg		frm_valid, frm_last;
-	reg	[31:0]	frm_data;
-	reg	[1:0]	frm_bytes;
+	reg	[FW-1:0]	frm_data;
+	reg	[LGFB-1:0]	frm_bytes;
 	wire		frm_ready;
 
+	wire		pk_valid, pk_ready, pk_last;
+	wire	[FW-1:0]	pk_data;
+	wire	[LGFB-1:0]	pk_bytes;
+	wire	[5*OCW-1:0]	pk_ops;
+	wire		hdr_start, above_en;
+	wire	[31:0]	hdr_magic;
+
 
 	// }}}
 	////////////////////////////////////////////////////////////////////////
@@ -130,7 +339,9 @@ module	qoi_encoder #(
 		if (s_hlast)
 		begin
 			h_count <= 0;
-			h_width <= h_count + 1;
+			// Verilator lint_off WIDTH
+			h_width <= (h_count + 1) * PIXELS_PER_CLOCK;
+			// Verilator lint_on  WIDTH
 		end else
 			h_count <= h_count + 1;
 	end
@@ -235,6 +446,190 @@ module	qoi_encoder #(
 		// }}}
 	end endgenerate
 
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step 2b: Cropping and decimation
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// The kept pixels, c_data, are handed on to the compressor with
+	// c_valid.  e_hlast and c_vlast mark the last kept pixel of each line,
+	// and of each frame.  c_vcount counts the kept lines of the frame that
+	// have been handed on so far.  The kept size is counted at the end of
+	// every incoming line and frame, whether synchronized or not, just like
+	// h_width and v_height, so the first frame can be given a header.
+	generate if (OPT_CROP && PIXELS_PER_CLOCK == 1)
+	begin : GEN_CROP
+		// {{{
+		reg	[LGFRAME-1:0]	r_x, r_y, r_w, r_h;
+		reg	[7:0]		r_skipx, r_skipy, r_skipf;
+		reg	[7:0]		x_phase, y_phase, f_phase;
+		reg	[LGFRAME-1:0]	x_kept, y_kept, r_width, r_height,
+					r_lines;
+		wire	[LGFRAME:0]	x_end, y_end;
+		wire			s_frame, keep_x, keep_y, keep;
+		reg			b_valid, b_hlast, b_final;
+		reg	[PW-1:0]	b_data;
+
+		assign	s_frame = s_valid && s_ready && s_hlast && s_vlast;
+
+		// The settings only change between frames
+		always @(posedge i_clk)
+		if (i_reset || !syncd || s_frame)
+		begin
+			r_x <= i_crop_x;
+			r_y <= i_crop_y;
+			r_w <= i_crop_w;
+			r_h <= i_crop_h;
+			r_skipx <= i_skip_x;
+			r_skipy <= i_skip_y;
+			r_skipf <= i_skip_frames;
+		end
+
+		// Where the rectangle ends
+		// Verilator lint_off WIDTH
+		assign	x_end = r_x + r_w;
+		assign	y_end = r_y + r_h;
+		// Verilator lint_on  WIDTH
+
+		// Count off the pixels, lines, and frames to be skipped
+		// {{{
+		always @(posedge i_clk)
+		if (i_reset)
+			x_phase <= 0;
+		else if (s_valid && s_ready)
+		begin
+			if (s_hlast)
+				x_phase <= 0;
+			else if (h_count >= r_x)
+				x_phase <= (x_phase >= r_skipx) ? 0 : x_phase + 1;
+		end
+
+		always @(posedge i_clk)
+		if (i_reset)
+			y_phase <= 0;
+		else if (s_valid && s_ready && s_hlast)
+		begin
+			if (s_vlast)
+				y_phase <= 0;
+			else if (v_count >= r_y)
+				y_phase <= (y_phase >= r_skipy) ? 0 : y_phase + 1;
+		end
+
+		always @(posedge i_clk)
+		if (i_reset)
+			f_phase <= 0;
+		else if (s_frame)
+			f_phase <= (f_phase >= r_skipf) ? 0 : f_phase + 1;
+		// }}}
+
+		// Verilator lint_off WIDTH
+		assign	keep_x = (h_count >= r_x) && (r_w == 0
+					|| h_count < x_end) && (x_phase == 0);
+		assign	keep_y = (v_count >= r_y) && (r_h == 0
+					|| v_count < y_end) && (y_phase == 0)
+					&& (f_phase == 0);
+		// Verilator lint_on  WIDTH
+		assign	keep = keep_x && keep_y;
+
+		// Whether a kept pixel is the last of its line, or of its frame,
+		// isn't known until either the next pixel is kept or its line
+		// (frame) ends.  Each is therefore held in b_data until then.
+		// b_final is set once the frame ends, and so once nothing more
+		// will be kept before the next frame.
+		// {{{
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			b_valid <= 1'b0;
+		else if (s_valid && s_ready && keep)
+			b_valid <= 1'b1;
+		else if (c_valid && e_ready)
+			b_valid <= 1'b0;
+
+		always @(posedge i_clk)
+		if (s_valid && s_ready && keep)
+			b_data <= s_data;
+
+		always @(posedge i_clk)
+		if (s_valid && s_ready && (keep || s_hlast))
+			b_hlast <= s_hlast || !keep;
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			b_final <= 1'b0;
+		else if (s_valid && s_ready && (keep || s_frame))
+			b_final <= s_frame;
+
+		assign	c_valid = b_valid && (b_final || (s_valid && keep));
+		assign	c_data  = b_data;
+		assign	e_hlast = b_hlast;
+		assign	c_vlast = b_final;
+		assign	s_ready = !syncd || !keep || !b_valid || e_ready;
+		// }}}
+
+		// Count the size of what's kept
+		// {{{
+		always @(posedge i_clk)
+		if (i_reset)
+			{ x_kept, r_width } <= 0;
+		else if (s_valid && s_ready && keep_y)
+		begin
+			if (s_hlast)
+			begin
+				x_kept  <= 0;
+				r_width <= x_kept + (keep_x ? 1:0);
+			end else if (keep_x)
+				x_kept <= x_kept + 1;
+		end
+
+		// Kept lines handed on, for any fast start
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			r_lines <= 0;
+		else if (c_valid && e_ready && b_hlast)
+			r_lines <= (b_final) ? 0 : r_lines + 1;
+
+		always @(posedge i_clk)
+		if (i_reset)
+			{ y_kept, r_height } <= 0;
+		else if (s_valid && s_ready && s_hlast)
+		begin
+			if (s_vlast)
+			begin
+				y_kept <= 0;
+				if (f_phase == 0)
+					r_height <= y_kept + (keep_y ? 1:0);
+			end else if (keep_y)
+				y_kept <= y_kept + 1;
+		end
+		// }}}
+
+		assign	c_vcount = r_lines;
+		assign	c_width  = r_width;
+		assign	c_height = r_height;
+		// }}}
+	end else begin : NO_CROP
+		// {{{
+		assign	c_valid  = syncd && s_valid;
+		assign	c_data   = s_data;
+		assign	s_ready  = !syncd || e_ready;
+		assign	e_hlast  = s_hlast;
+		assign	c_vlast  = s_vlast;
+		assign	c_vcount = v_count;
+		assign	c_width  = h_width;
+		assign	c_height = v_height;
+
+		// Verilator coverage_off
+		// Verilator lint_off UNUSED
+		wire	unused_crop;
+		assign	unused_crop = &{ 1'b0, i_crop_x, i_crop_y, i_crop_w,
+				i_crop_h, i_skip_x, i_skip_y, i_skip_frames };
+		// Verilator lint_on  UNUSED
+		// Verilator coverage_on
+		// }}}
+	end endgenerate
+
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -244,35 +639,504 @@ module	qoi_encoder #(
 	//
 	//
 
-	assign	e_valid = syncd && s_valid;
-	assign	s_ready = !syncd || e_ready;
+	assign	e_valid = c_valid;
+
+	// Bandwidth budget
+	// {{{
+	generate if (OPT_BUDGET)
+	begin : GEN_BUDGET
+		// {{{
+		localparam	NP = PIXELS_PER_CLOCK;
+		localparam [31:0] BLACK32 = (OPT_ALPHA) ? 32'hff00_0000 : 32'h0;
+
+		reg	[1:0]		r_quant;
+		reg			r_overrun, r_tail;
+		reg	[31:0]		fr_bytes;
+		reg	[32:0]		credit, nxt_credit;
+		reg	[PXW-1:0]	last_pixel, q_prev, q_pix;
+		reg	[7:0]		q_thresh, q_dr, q_dg, q_db;
+		reg	[PW-1:0]	q_data;
+		wire	[$clog2(FW/8):0]	enc_nbytes;
+		integer			qk;
+
+		assign	enc_nbytes = (enc_bytes == 0) ? FW/8 : { 1'b0, enc_bytes };
+
+		// Frame boundaries.  With OPT_OVERLAP, the compressor may
+		// accept the first pixels of the next frame before it has
+		// emitted the last op of this one.  The input's frame
+		// boundary, e_hlast && e_vlast, and the output's, enc_last,
+		// are then different clocks.  r_tail marks the time between
+		// the two, where the ops leaving the compressor still belong
+		// to the last frame.  Only one frame boundary may be within
+		// the compressor at a time, so if the next frame ends on the
+		// same clock enc_last ends this one, r_tail stays set.
+		always @(posedge i_clk)
+		if (i_reset)
+			r_tail <= 1'b0;
+		else if (e_valid && e_ready && e_hlast && e_vlast)
+			r_tail <= 1'b1;
+		else if (enc_valid && enc_ready && enc_last)
+			r_tail <= 1'b0;
+
+		// Count the bytes in this frame.  These are counted as they
+		// leave, so the output's boundary, enc_last, starts the count
+		// for the next frame.
+		always @(posedge i_clk)
+		if (i_reset || (enc_valid && enc_ready && enc_last))
+			fr_bytes <= 0;
+		else if (enc_valid && enc_ready)
+			// Verilator lint_off WIDTH
+			fr_bytes <= fr_bytes + enc_nbytes;
+			// Verilator lint_on  WIDTH
+
+		// Line budget: the running credit is the number of bytes
+		// allowed so far, less the number used.  It's kept in two's
+		// complement, so credit[32] is set when over budget.  Credit
+		// is granted as lines enter the compressor, so it starts over
+		// at the input's frame boundary.  Bytes leaving during the
+		// tail of the last frame are then not charged to this one.
+		always @(*)
+		begin
+			nxt_credit = credit;
+			if (e_valid && e_ready && e_hlast)
+				nxt_credit = nxt_credit + { 17'h0, i_line_budget };
+			if (enc_valid && enc_ready && !r_tail)
+				nxt_credit = nxt_credit
+				  - { {(33-$clog2(FW/8)-1){1'b0}}, enc_nbytes };
+		end
+
+		always @(posedge i_clk)
+		if (i_reset || i_line_budget == 0
+				|| (e_valid && e_ready && e_hlast && e_vlast))
+			credit <= 0;
+		else
+			credit <= nxt_credit;
+
+		always @(posedge i_clk)
+		if (i_reset || i_line_budget == 0)
+			r_quant <= 0;
+		else if (e_valid && e_ready && e_hlast)
+		begin
+			if (nxt_credit[32])
+			begin
+				if (r_quant != 2'b11)
+					r_quant <= r_quant + 1;
+			end else if (nxt_credit[31:0] >= { 16'h0, i_line_budget }
+					&& r_quant != 0)
+				r_quant <= r_quant - 1;
+		end
+
+		// Frame budget.  During r_tail, fr_bytes still belongs to
+		// the last frame, so it mustn't overrun this one.
+		always @(posedge i_clk)
+		if (i_reset || (e_valid && e_ready && e_hlast && e_vlast))
+			r_overrun <= 1'b0;
+		else if (!r_tail && i_frame_budget != 0
+					&& fr_bytes >= i_frame_budget)
+			r_overrun <= 1'b1;
+
+		// Like the compressor, start every frame from opaque black
+		always @(posedge i_clk)
+		if (i_reset || (e_valid && e_ready && e_hlast && e_vlast))
+			last_pixel <= BLACK32[PXW-1:0];
+		else if (e_valid && e_ready)
+			last_pixel <= e_data[PXW-1:0];
+
+		// Quantizer: replace pixels near the one before them with the
+		// pixel before them.  The first pixel is in the MSBs.
+		always @(*)
+		begin
+			q_thresh = (8'h2 << r_quant) - 1;
+			q_prev = last_pixel;
+			for(qk=NP-1; qk>=0; qk=qk-1)
+			begin
+				q_pix = c_data[qk*PXW +: PXW];
+				q_dr = q_pix[23:16] - q_prev[23:16];
+				q_dg = q_pix[15: 8] - q_prev[15: 8];
+				q_db = q_pix[ 7: 0] - q_prev[ 7: 0];
+				// Alpha, if present, must match exactly
+				if (r_quant != 0 && (!OPT_ALPHA
+					|| q_pix[PXW-1:PXW-8]==q_prev[PXW-1:PXW-8])
+					&& (q_dr <= q_thresh || -q_dr <= q_thresh)
+					&& (q_dg <= q_thresh || -q_dg <= q_thresh)
+					&& (q_db <= q_thresh || -q_db <= q_thresh))
+					q_pix = q_prev;
+				q_data[qk*PXW +: PXW] = q_pix;
+				q_prev = q_pix;
+			end
+		end
+
+		assign	e_data = (r_overrun) ? {(NP){ last_pixel }} : q_data;
+
+		assign	o_quant   = r_quant;
+		assign	o_overrun = r_overrun;
+		// }}}
+	end else begin : NO_BUDGET
+		// {{{
+		assign	e_data    = c_data;
+		assign	o_quant   = 2'b00;
+		assign	o_overrun = 1'b0;
+
+		// Verilator coverage_off
+		// Verilator lint_off UNUSED
+		wire	unused_budget;
+		assign	unused_budget = &{ 1'b0, i_line_budget, i_frame_budget };
+		// Verilator lint_on  UNUSED
+		// Verilator coverage_on
+		// }}}
+	end endgenerate
+	// }}}
 
 `ifdef	FORMAL
 	(* anyseq *)	reg	f_ready, f_last, f_valid;
-	(* anyseq *)	reg	[31:0]	f_data;
-	(* anyseq *)	reg	[1:0]	f_bytes;
+	(* anyseq *)	reg	[FW-1:0]	f_data;
+	(* anyseq *)	reg	[LGFB-1:0]	f_bytes;
 
-	assign	e_ready   = f_ready;
+	assign	cmp_ready = f_ready;
 	assign	enc_valid = f_valid;
 	assign	enc_data  = f_data;
 	assign	enc_bytes = f_bytes;
 	assign	enc_last  = f_last;
+	assign	enc_hlast = f_last;
+	assign	enc_ops   = 0;
+	assign	o_perf    = 0;
+	assign	above_en  = 1'b0;
 `else
-	qoi_compress
-	u_compress (
-		.i_clk(i_clk), .i_reset(i_reset),
-		//
-		.s_vid_valid(e_valid), .s_vid_ready(e_ready),
-		.s_vid_data(s_data),
-		.s_vid_hlast(s_hlast), .s_vid_vlast(s_vlast),
-		//
-		.m_valid(enc_valid), .m_ready(enc_ready),
-		.m_data( enc_data), .m_bytes(enc_bytes),
-		.m_last( enc_last)
-	);
+	generate if (PIXELS_PER_CLOCK > 1)
+	begin : GEN_WIDE
+		qoi_wcompress #(
+			.PIXELS_PER_CLOCK(PIXELS_PER_CLOCK),
+			.LGINFIFO(LGINFIFO)
+		) u_compress (
+			.i_clk(i_clk), .i_reset(i_reset),
+			//
+			.s_vid_valid(cmp_valid), .s_vid_ready(cmp_ready),
+			.s_vid_data(e_data),
+			.s_vid_hlast(e_hlast), .s_vid_vlast(e_vlast),
+			//
+			.m_valid(enc_valid), .m_ready(enc_ready),
+			.m_data( enc_data), .m_bytes(enc_bytes),
+			.m_last( enc_last), .m_ops(enc_ops)
+		);
+
+		// Occupancy counters aren't (yet) supported by qoi_wcompress
+		assign	o_perf = 0;
+		// Nor are delta frames, or prediction from the line above
+		assign	enc_hlast = enc_last;
+		assign	above_en  = 1'b0;
+	end else begin : GEN_COMPRESS
+		qoi_compress #(
+			.OPT_ALPHA(OPT_ALPHA),
+			.OPT_PERFCOUNTERS(OPT_PERFCOUNTERS),
+			.OPT_DELTA(OPT_DELTA && !OPT_ALPHA),
+			.OPT_OVERLAP(OPT_OVERLAP),
+			.OPT_ABOVE(OPT_ABOVE),
+			.LGABOVE(LGABOVE),
+			.LGINFIFO(LGINFIFO)
+		) u_compress (
+			.i_clk(i_clk), .i_reset(i_reset),
+			//
+			.s_vid_valid(cmp_valid), .s_vid_ready(cmp_ready),
+			.s_vid_data(e_data),
+			.s_vid_hlast(e_hlast), .s_vid_vlast(e_vlast),
+			.i_delta(i_delta), .i_above(i_above),
+			//
+			.m_valid(enc_valid), .m_ready(enc_ready),
+			.m_data( enc_data), .m_bytes(enc_bytes),
+			.m_last( enc_last), .m_hlast(enc_hlast),
+			.m_ops(enc_ops),
+			//
+			.o_perf(o_perf)
+		);
+
+		// As in the compressor, delta frames take precedence
+		assign	above_en = OPT_ABOVE && i_above
+					&& !(OPT_DELTA && !OPT_ALPHA && i_delta);
+	end endgenerate
 `endif
 
-	assign	enc_ready = (frm_state == FRM_DATA)&&(!frm_valid || frm_ready);
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step 3b: Delta frames
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Lines are compared by CRC: the CRC-32 polynomial, MSB first, over
+	// the 24 bits { R, G, B } of every pixel, starting from all ones.
+	// Each line's CRC is read from (and then replaced in) the table once
+	// the line has been accepted, and the result pushed into a small queue
+	// for when the line's last op leaves the compressor.  Since that op
+	// can't leave until the next few pixels have pushed it through the
+	// compressor's pipeline, the result is always there first.  The
+	// queue must then hold a result for every line (as short as one pixel
+	// each) that may be inside the compressor at once: the 2^LGINFIFO+1
+	// beats of its input FIFO, its four stages, and its output register.
+	//
+	// The ops then go into the line FIFO.  pk_* is the FIFO's output,
+	// from which the frame state machine takes the compressed data.  Ops
+	// are committed as soon as they arrive, unless this is a delta frame,
+	// where they're committed at the end of their line (d_cm), or once the
+	// line has taken too many ops to be replaced.  If the line is
+	// replaced, anything uncommitted is discarded, and a single 0xfd op
+	// takes its place.  The end of each line is found by counting the
+	// pixels in each op.
+	assign	pk_ready  = (frm_state == FRM_DATA) && (!frm_valid || frm_ready);
+	assign	hdr_start = syncd && (frm_state == FRM_HDRMAGIC)
+				&& (!frm_valid || frm_ready)
+				&& !o_qvalid && !sr_last;
+
+	generate if (OPT_DELTA && PIXELS_PER_CLOCK == 1 && !OPT_ALPHA)
+	begin : GEN_DELTA
+		// {{{
+		localparam	DEPTH  = (1<<(LGLBUF+1));
+		localparam	MAXOPS = (1<<LGLBUF) - 1;
+		localparam	QW = 5*OCW + 1 + LGFB + FW;
+		// Room for every line the compressor may hold, with margin
+		localparam	LGQ = $clog2((1<<LGINFIFO) + 8);
+		// A skipped line is counted as a run
+		localparam [5*OCW-1:0]	SAME_OPS = 1 << (4*OCW);
+
+		reg	[31:0]		ln_crc, c_crc, c_prev, c_rd, nxt_crc;
+		reg	[LGFRAME-1:0]	ln_count, c_line;
+		reg			c_valid, c_fwd, c_inrange;
+		reg	[31:0]		ref_crc	[0:(1<<LGLINES)-1];
+		wire			ln_end, c_match;
+
+		reg	[(1<<LGQ)-1:0]	q_match;
+		reg	[LGQ:0]		q_wr, q_rd;
+		wire			q_empty;
+
+		reg	[QW-1:0]	d_mem	[0:DEPTH-1];
+		reg	[LGLBUF+1:0]	d_wr, d_cm, d_rd;
+		wire	[LGLBUF+1:0]	d_pending, d_fill;
+		reg			d_spill, r_gotlast;
+		wire			d_accept, d_eol, d_skip, d_commit, d_room;
+
+		reg			r_refok, r_keyreq, r_frmdelta;
+		reg	[7:0]		r_since;
+		reg	[LGFRAME-1:0]	r_refw, r_refh;
+		wire			isdelta;
+		integer			ck;
+
+		// Line CRCs
+		// {{{
+		assign	ln_end  = e_valid && e_ready && e_hlast;
+
+		// One pixel's worth of CRC, a bit at a time
+		always @(*)
+		begin
+			nxt_crc = ln_crc;
+			for(ck=23; ck>=0; ck=ck-1)
+				nxt_crc = { nxt_crc[30:0], 1'b0 }
+					^ ((nxt_crc[31] ^ e_data[ck])
+						? 32'h04c1_1db7 : 32'h0);
+		end
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd || ln_end)
+			ln_crc <= 32'hffff_ffff;
+		else if (e_valid && e_ready)
+			ln_crc <= nxt_crc;
+
+		// Lines are counted from the top of each frame
+		always @(posedge i_clk)
+		if (i_reset || !syncd || (ln_end && e_vlast))
+			ln_count <= 0;
+		else if (ln_end)
+			ln_count <= ln_count + 1;
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd || !i_delta)
+			c_valid <= 1'b0;
+		else
+			c_valid <= ln_end;
+
+		// If the line before was the same line (of a one line frame),
+		// its CRC is only now being written, so c_fwd forwards it
+		always @(posedge i_clk)
+		if (ln_end)
+		begin
+			c_crc  <= nxt_crc;
+			c_line <= ln_count;
+			c_prev <= c_crc;
+			c_fwd  <= c_valid && (c_line == ln_count);
+			// Verilator lint_off WIDTH
+			c_inrange <= (ln_count < (1<<LGLINES));
+			// Verilator lint_on  WIDTH
+			c_rd   <= ref_crc[ln_count[LGLINES-1:0]];
+		end
+
+		always @(posedge i_clk)
+		if (c_valid && c_inrange)
+			ref_crc[c_line[LGLINES-1:0]] <= c_crc;
+
+		assign	c_match = c_inrange && (c_crc == ((c_fwd) ? c_prev : c_rd));
+		// }}}
+
+		// Queue of compare results, one per line
+		// {{{
+		always @(posedge i_clk)
+		if (i_reset || !syncd || !i_delta)
+			q_wr <= 0;
+		else if (c_valid)
+			q_wr <= q_wr + 1;
+
+		always @(posedge i_clk)
+		if (c_valid)
+			q_match[q_wr[LGQ-1:0]] <= c_match;
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd || !i_delta)
+			q_rd <= 0;
+		else if (d_accept && d_eol)
+			q_rd <= q_rd + 1;
+
+		assign	q_empty = (q_wr == q_rd);
+		// }}}
+
+		// Line FIFO, write side
+		// {{{
+		// The compressor marks the op ending each line, rather than
+		// counting pixels against the header's width--which, in the
+		// first frame after a size change, would be wrong
+		assign	d_eol  = i_delta && enc_hlast;
+		assign	d_skip = r_frmdelta && d_eol && !d_spill
+						&& q_match[q_rd[LGQ-1:0]];
+		assign	d_pending = d_wr - d_cm;
+		// Verilator lint_off WIDTH
+		assign	d_commit = !r_frmdelta || d_eol || d_spill
+						|| (d_pending + 1 >= MAXOPS);
+		assign	d_fill = d_wr - d_rd;
+		assign	d_room = (d_fill < DEPTH);
+		// Verilator lint_on  WIDTH
+
+		// Nothing from the next frame is accepted until its header
+		// has been sent
+		assign	enc_ready = (frm_state == FRM_DATA) && !r_gotlast
+					&& d_room && (!d_eol || !q_empty);
+		assign	d_accept  = enc_valid && enc_ready;
+
+		always @(posedge i_clk)
+		if (d_accept)
+		begin
+			if (d_skip)
+				d_mem[d_cm[LGLBUF:0]] <= { SAME_OPS, enc_last,
+					{ {(LGFB-1){1'b0}}, 1'b1 },
+					8'hfd, {(FW-8){1'b0}} };
+			else
+				d_mem[d_wr[LGLBUF:0]] <= { enc_ops, enc_last,
+					enc_bytes, enc_data };
+		end
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+		begin
+			d_wr <= 0;
+			d_cm <= 0;
+		end else if (d_accept)
+		begin
+			if (d_skip)
+			begin
+				d_wr <= d_cm + 1;
+				d_cm <= d_cm + 1;
+			end else begin
+				d_wr <= d_wr + 1;
+				if (d_commit)
+					d_cm <= d_wr + 1;
+			end
+		end
+
+		// Once a line has taken too many ops, the rest are committed
+		// as they arrive
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			d_spill <= 1'b0;
+		else if (d_accept)
+			d_spill <= r_frmdelta && !d_eol && !d_skip
+					&& (d_spill || d_commit);
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd || frm_state != FRM_DATA)
+			r_gotlast <= 1'b0;
+		else if (d_accept && enc_last)
+			r_gotlast <= 1'b1;
+		// }}}
+
+		// Line FIFO, read side
+		// {{{
+		assign	pk_valid = (d_rd != d_cm);
+		assign	{ pk_ops, pk_last, pk_bytes, pk_data }
+						= d_mem[d_rd[LGLBUF:0]];
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			d_rd <= 0;
+		else if (pk_valid && pk_ready)
+			d_rd <= d_rd + 1;
+		// }}}
+
+		// Key or delta frame?
+		// {{{
+		// Decided as the header starts, once the frame before has
+		// left--and so become this frame's reference
+		// Verilator lint_off WIDTH
+		assign	isdelta = i_delta && r_refok && !r_keyreq && !i_keyframe
+				&& c_width == r_refw && hdr_height == r_refh
+				&& (i_keyint == 0 || r_since + 1 < i_keyint);
+		// Verilator lint_on  WIDTH
+
+		always @(posedge i_clk)
+		if (i_reset || hdr_start)
+			r_keyreq <= 1'b0;
+		else if (i_keyframe)
+			r_keyreq <= 1'b1;
+
+		always @(posedge i_clk)
+		if (i_reset || !syncd || !i_delta)
+		begin
+			r_refok    <= 1'b0;
+			r_frmdelta <= 1'b0;
+			r_since    <= 0;
+		end else if (hdr_start)
+		begin
+			r_refok    <= 1'b1;
+			r_frmdelta <= isdelta;
+			r_since    <= (isdelta) ? r_since + 1 : 0;
+		end
+
+		always @(posedge i_clk)
+		if (hdr_start)
+		begin
+			r_refw <= c_width;
+			r_refh <= hdr_height;
+		end
+
+		assign	hdr_magic = (isdelta) ? "qoid"
+					: (above_en) ? "qoiv" : "qoif";
+		// }}}
+		// }}}
+	end else begin : NO_DELTA
+		// {{{
+		assign	enc_ready = pk_ready;
+		assign	pk_valid  = enc_valid;
+		assign	pk_data   = enc_data;
+		assign	pk_bytes  = enc_bytes;
+		assign	pk_last   = enc_last;
+		assign	pk_ops    = enc_ops;
+		assign	hdr_magic = (above_en) ? "qoiv" : "qoif";
+
+		// Verilator coverage_off
+		// Verilator lint_off UNUSED
+		wire	unused_delta;
+		assign	unused_delta = &{ 1'b0, i_delta, i_keyframe, i_keyint,
+						hdr_start, enc_hlast };
+		// Verilator lint_on  UNUSED
+		// Verilator coverage_on
+		// }}}
+	end endgenerate
+
+	assign	o_ops = (pk_valid && pk_ready) ? pk_ops : 0;
 
 	// }}}
 	////////////////////////////////////////////////////////////////////////
@@ -290,29 +1154,144 @@ module	qoi_encoder #(
 				FRM_TRAILER   = 4'h7,
 				FRM_LAST      = 4'h8;
 
+	// Header and trailer words are always 32-bits, and so always 4-bytes.
+	// They are placed into the MSBs of frm_data.  When frm_data is only
+	// 32-bits wide, these are full words and so FRM_WORD is zero.
+	localparam		HDR_SHIFT = FW-32;
+	// Verilator lint_off WIDTH
+	localparam [LGFB-1:0]	FRM_WORD = (FW == 32) ? 0 : 4;
+	// Verilator lint_on  WIDTH
+
+	// Frames ahead of their headers
+	// {{{
+	// The header's size is taken once the header is sent.  With
+	// OPT_OVERLAP, or an input FIFO, the compressor may take in the whole
+	// of a small frame before its header is sent, and so start on the
+	// next.  That next frame is held back until the header before it has
+	// been sent, lest the header take its size from the wrong frame.
+	generate if (OPT_OVERLAP || LGINFIFO > 0)
+	begin : GEN_HDRHOLD
+		reg	r_hdrsent, r_hold;
+		wire	hdr_sent, e_frame;
+
+		assign	hdr_sent = (frm_state == FRM_HDRFORMAT)
+					&& (!frm_valid || frm_ready);
+		assign	e_frame = e_valid && e_ready && e_hlast && e_vlast;
+
+		// r_hdrsent: the frame now entering the compressor has had its
+		// header's size taken.  r_hold: it hasn't, and has ended too.
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			{ r_hdrsent, r_hold } <= 2'b00;
+		else if (e_frame)
+		begin
+			r_hdrsent <= 1'b0;
+			r_hold    <= !r_hdrsent && !hdr_sent;
+		end else if (hdr_sent)
+		begin
+			if (r_hold)
+				r_hold <= 1'b0;
+			else
+				r_hdrsent <= 1'b1;
+		end
+
+		assign	cmp_valid = e_valid && !r_hold;
+		assign	e_ready   = cmp_ready && !r_hold;
+	end else begin : NO_HDRHOLD
+		assign	cmp_valid = e_valid;
+		assign	e_ready   = cmp_ready;
+	end endgenerate
+	// }}}
+
+	// Fast start
+	// {{{
+	// Once i_restart has been seen, the frame in progress is cut short at
+	// the end of the next line, by telling the compressor that line was
+	// the last of the frame.  The next frame then starts with the line
+	// after it, and its header carries the number of lines remaining in
+	// the incoming frame, as counted by c_vcount.  Frames after that return
+	// to the full height.  No cut is made if the next line is the last of
+	// its frame anyway.  Either way, o_restarted marks the end of that
+	// line, and so the end of the last frame before the new one.  If the
+	// encoder isn't yet synchronized, the restart waits until it is.
+	generate if (OPT_FASTSTART)
+	begin : GEN_FASTSTART
+		reg			r_armed, r_next;
+		reg	[LGFRAME-1:0]	r_height;
+		wire			fst_cut;
+
+		always @(posedge i_clk)
+		if (i_reset)
+			r_armed <= 1'b0;
+		else if (i_restart)
+			r_armed <= 1'b1;
+		else if (e_valid && e_ready && e_hlast)
+			r_armed <= 1'b0;
+
+		// Verilator lint_off WIDTH
+		assign	fst_cut = r_armed && !c_vlast
+					&& (c_vcount + 1 < c_height);
+		// Verilator lint_on  WIDTH
+
+		// r_next marks the frame following a cut, until its header has
+		// been sent
+		always @(posedge i_clk)
+		if (i_reset || !syncd)
+			r_next <= 1'b0;
+		else if (e_valid && e_ready && e_hlast && fst_cut)
+			r_next <= 1'b1;
+		else if (frm_state == FRM_HDRHEIGHT && (!frm_valid || frm_ready))
+			r_next <= 1'b0;
+
+		always @(posedge i_clk)
+		if (e_valid && e_ready && e_hlast && fst_cut)
+			// Verilator lint_off WIDTH
+			r_height <= c_height - c_vcount - 1;
+			// Verilator lint_on  WIDTH
+
+		assign	e_vlast    = c_vlast || fst_cut;
+		assign	hdr_height = (r_next) ? r_height : c_height;
+		assign	o_restarted = r_armed && e_valid && e_ready && e_hlast;
+	end else begin : NO_FASTSTART
+		assign	e_vlast    = c_vlast;
+		assign	hdr_height = c_height;
+		assign	o_restarted = 1'b0;
+
+		// Verilator coverage_off
+		// Verilator lint_off UNUSED
+		wire	unused_faststart;
+		assign	unused_faststart = &{ 1'b0, i_restart };
+		// Verilator lint_on  UNUSED
+		// Verilator coverage_on
+	end endgenerate
+	// }}}
+
+	// Verilator lint_off WIDTH
 	always @(posedge i_clk)
 	if (i_reset || !syncd)
 	begin
 		frm_state <= FRM_IDLE;
 		frm_valid <= 1'b0;
-		frm_data  <= "qoif";
-		frm_bytes <= 2'b00;
+		frm_data  <= "qoif" << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 	end else if (!frm_valid || frm_ready)
 	case(frm_state)
 	FRM_IDLE: begin
-		if (syncd && s_valid)
+		// With OPT_OVERLAP, a small frame may already be inside the
+		// compressor by now
+		if (syncd && (s_valid || enc_valid))
 			frm_state <= FRM_START;
 		frm_valid <= 1'b0;
-		frm_data  <= "qoif";
-		frm_bytes <= 2'b00;
+		frm_data  <= "qoif" << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 		end
 	FRM_START: begin
 		frm_state <= FRM_HDRMAGIC;
 		frm_valid <= 1'b0;
-		frm_data  <= "qoif";
-		frm_bytes <= 2'b00;
+		frm_data  <= "qoif" << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 		end
 	FRM_HDRMAGIC: begin
@@ -320,70 +1299,67 @@ module	qoi_encoder #(
 		begin
 		frm_state <= FRM_HDRWIDTH;
 		frm_valid <= 1'b1;
-		frm_data  <= "qoif";
-		frm_bytes <= 2'b00;
+		frm_data  <= hdr_magic << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 		end end
 	FRM_HDRWIDTH: begin
 		frm_state <= FRM_HDRHEIGHT;
 		frm_valid <= 1'b1;
-		frm_data  <= { {(32-LGFRAME){1'b0}}, h_width };
-		frm_bytes <= 2'b00;
+		frm_data  <= { {(32-LGFRAME){1'b0}}, c_width } << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 		end
 	FRM_HDRHEIGHT: begin
 		frm_state <= FRM_HDRFORMAT;
 		frm_valid <= 1'b1;
-		frm_data  <= { {(32-LGFRAME){1'b0}}, v_height };
-		frm_bytes <= 2'b00;
+		frm_data  <= { {(32-LGFRAME){1'b0}}, hdr_height } << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 		end
 	FRM_HDRFORMAT: begin
 		frm_state <= FRM_DATA;
 		frm_valid <= 1'b1;
-		frm_data  <= { 8'd3, 8'd1, 16'h0 };
-		frm_bytes <= 2'b10;
+		frm_data  <= { (OPT_ALPHA) ? 8'd4 : 8'd3, 8'd1, 16'h0 }
+							<< HDR_SHIFT;
+		frm_bytes <= 2;
 		frm_last  <= 1'b0;
 		end
 	FRM_DATA: begin
-		if (enc_valid && enc_last)
+		if (pk_valid && pk_last)
 			frm_state <= FRM_TRAILER;
-		frm_valid <= enc_valid;
-		case(enc_bytes)
-		2'b00: frm_data  <= enc_data;
-		2'b01: frm_data  <= { enc_data[31:24], 24'h0 };
-		2'b10: frm_data  <= { enc_data[31:16], 16'h0 };
-		2'b11: frm_data  <= { enc_data[31: 8],  8'h0 };
-		endcase
-		frm_bytes <= enc_bytes;
+		frm_valid <= pk_valid;
+		// Clear any bytes beyond the end of the valid data
+		frm_data  <= pk_data;
+		if (pk_bytes != 0)
+			frm_data <= pk_data & ~({(FW){1'b1}} >> (8*pk_bytes));
+		frm_bytes <= pk_bytes;
 		frm_last  <= 1'b0;
 		end
 	FRM_TRAILER: begin
 		frm_state <= FRM_LAST;
 		frm_valid <= 1'b1;
-		frm_data  <= 32'h0;
-		frm_bytes <= 2'b00;
+		frm_data  <= 0;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b0;
 		end
 	FRM_LAST: begin
 		frm_state <= FRM_IDLE;
 		frm_valid <= 1'b1;
-		frm_data  <= 32'h01;
-		frm_bytes <= 2'b00;
+		frm_data  <= 32'h01 << HDR_SHIFT;
+		frm_bytes <= FRM_WORD;
 		frm_last  <= 1'b1;
 		end
 	default: begin
 		frm_state <= FRM_IDLE;
 		frm_valid <= 1'b0;
-		frm_data  <= 32'b0;
-		frm_bytes <= 2'b0;
+		frm_data  <= 0;
+		frm_bytes <= 0;
 		frm_last  <= 1'b0;
 		end
 	endcase
-
-	// Verilator lint_off WIDTH
-	assign	frm_ready = ((!o_qvalid || i_qready)&&sr_fill <= DB)||(sr_fill < DB && !sr_last);
 	// Verilator lint_on  WIDTH
+
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -391,37 +1367,62 @@ module	qoi_encoder #(
 	// {{{
 	////////////////////////////////////////////////////////////////////////
 	//
+	// Words of up to FW/8 bytes are packed into DW bit bus words.  The
+	// shift register, sreg, holds sr_fill bytes, MSB first, and is wide
+	// enough to hold a (nearly) full bus word plus two more incoming words.
+	// As long as the output is free, a word is accepted every clock,
+	// whether or not it straddles two bus words: any bytes beyond the bus
+	// word leaving on this clock simply wait in sreg for the next.  While
+	// the output is stalled, words may still be accepted until sreg holds
+	// a full bus word, so none are lost once the stall ends.
 	//
+	// Once the last (trailer) word has been accepted, nothing more is
+	// accepted until the frame has left.  If the rest of the frame doesn't
+	// fit in one bus word, sr_last is set, and full bus words are sent
+	// until it does.  The final word of the frame is then sent with
+	// o_qlast set.
+
+	localparam	SRW = DW + 2*FW;
 
-	reg	[DW+32-1:0]		sreg, new_data;
-	reg	[$clog2(DW+32)-3:0]	sr_fill, new_fill;
+	reg	[SRW-1:0]		sreg, new_data;
+	reg	[$clog2(SRW/8+1)-1:0]	sr_fill, new_fill;
 	reg				sr_last, fl_last, flush;
+	wire				sr_free, sr_accept;
+
+	assign	sr_free = !o_qvalid || i_qready;
+
+	// When FW <= DW, sr_fill < 2*DB whenever the output is free, so
+	// frm_ready only ever drops when the output is stalled.
+	// Verilator lint_off WIDTH
+	assign	frm_ready = !sr_last && (sr_fill < DB
+				|| (sr_free && sr_fill < 2*DB));
+	// Verilator lint_on  WIDTH
+
+	assign	sr_accept = frm_valid && frm_ready;
 
 	always @(*)
 	begin
 		new_fill = sr_fill;
+		new_data = sreg;
 		// Verilator lint_off WIDTH
-		if (frm_valid && frm_ready)
+		if (sr_accept)
 		begin
 			if (frm_bytes == 0)
-				new_fill = new_fill + 4;
+				new_fill = new_fill + FW/8;
 			else
 				new_fill = new_fill + frm_bytes;
-		end
 
-		fl_last = sr_last;
-		if (frm_valid && frm_ready && !sr_last
-					&& (new_fill <= DB))
-			fl_last = frm_last;
+			new_data = sreg | ({ frm_data, {(SRW-FW){1'b0}} }
+							>> (sr_fill*8));
+		end
 
-		flush = sr_last || frm_last;
-		if (sr_fill >= DW/8)
-			flush = 1'b1;
-		if (frm_valid && frm_ready && (new_fill >= DB))
-			flush = 1'b1;
+		// fl_last is true if this bus word will end the frame
+		if (sr_last)
+			fl_last = (sr_fill <= DB);
+		else
+			fl_last = sr_accept && frm_last && (new_fill <= DB);
 
-		new_data = sreg| ({{(DW){1'b0}}, frm_data}
-							<< (DW - (sr_fill*8)));
+		flush = sr_last || fl_last || (new_fill >= DB);
 		// Verilator lint_on  WIDTH
 	end
 
@@ -432,66 +1433,56 @@ module	qoi_encoder #(
 	begin
 		sr_fill <= 0;
 		o_qvalid <= 1'b0;
-	end else if ((!o_qvalid || i_qready) && flush)
+	end else if (sr_free && flush)
 	begin
 		o_qvalid <= 1'b1;
 		// Verilator lint_off WIDTH
-		sr_fill <= new_fill - DB;
-		// Verilator lint_on  WIDTH
-		if (sr_last)
-			sr_fill <= (frm_valid) ? new_fill : 0;
-		else if (fl_last)
+		if (fl_last)
 			sr_fill <= 0;
+		else
+			sr_fill <= new_fill - DB;
+		// Verilator lint_on  WIDTH
 	end else begin
 		if (i_qready)
 			o_qvalid <= 1'b0;
-		if (frm_valid && frm_ready)
-			sr_fill <= new_fill;
+		sr_fill <= new_fill;
 	end
 
 	always @(posedge i_clk)
 	if (i_reset)
 		sreg <= 0;
-	else if ((!o_qvalid || i_qready) && flush)
+	else if (sr_free && flush)
 	begin
-		if (sr_last)
-			sreg <= (frm_valid) ? { frm_data, {(DW){1'b0}} } : {(DW+32){1'b0}};
-		else if (fl_last)
+		if (fl_last)
 			sreg <= 0;
-		else if (frm_valid)
-			sreg <= { new_data[31:0], {(DW){1'b0}} };
 		else
-			sreg <= { sreg[31:0], {(DW){1'b0}} };
-	end else if (frm_valid && frm_ready)
+			sreg <= new_data << DW;
+	end else
 		sreg <= new_data;
 
 	always @(posedge i_clk)
-	if ((!o_qvalid || i_qready)&&(!OPT_LOWPOWER || flush))
-		o_qdata <= new_data[DW+31:32];
+	if (sr_free && (!OPT_LOWPOWER || flush))
+		o_qdata <= new_data[SRW-1:SRW-DW];
 
 	always @(posedge i_clk)
-	if ((!o_qvalid || i_qready)&&(!OPT_LOWPOWER || flush))
+	if (sr_free && (!OPT_LOWPOWER || flush))
 	begin
-		// Verilator lint_off WIDTH
-		if (sr_last)
-			o_qbytes <= sr_fill[LGDB-1:0];
-		else if (new_fill >= DB)
-			o_qbytes <= 0;
+		if (fl_last)
+			o_qbytes <= new_fill[LGDB-1:0];
 		else
-			o_qbytes <= new_fill;
-		// Verilator lint_on  WIDTH
+			o_qbytes <= 0;
 	end
 
 	always @(posedge i_clk)
 	if (i_reset || !syncd)
 		sr_last <= 1'b0;
-	else if ((!o_qvalid || i_qready) && flush)
-		sr_last <= frm_valid && frm_ready && frm_last && !fl_last;
-	else if (frm_valid && frm_ready)
-		sr_last <= frm_last;
+	else if (sr_free && flush)
+		sr_last <= (sr_last || (sr_accept && frm_last)) && !fl_last;
+	else if (sr_accept && frm_last)
+		sr_last <= 1'b1;
 
 	always @(posedge i_clk)
-	if (!o_qvalid || i_qready)
+	if (sr_free)
 		o_qlast <= fl_last;
 
 	// }}}
@@ -822,7 +1813,7 @@ module	qoi_encoder #(
 	reg	[7:0]	fenc_byte;
 	reg	[31:0]	enc_wide, frm_wide;
 	reg	[DW-1:0]	fq_wide;
-	reg	[DW+32-1:0]	fsr_empty, fsr_wide;
+	reg	[SRW-1:0]	fsr_empty, fsr_wide;
 
 	always @(*)
 		assume(fc_index >= 12+2);
@@ -888,7 +1879,7 @@ module	qoi_encoder #(
 	if (!i_reset && !sr_last && sr_fill > 0 && (fsr_count <= fc_index)
 					&&(fc_index < fsr_count + sr_fill))
 	begin
-		assert(fsr_wide[DW+32-1:DW+24] == fc_byte);
+		assert(fsr_wide[SRW-1:SRW-8] == fc_byte);
 	end
 
 	always @(*)
@@ -905,7 +1896,7 @@ module	qoi_encoder #(
 	always @(*)
 	if(!i_reset)
 	begin
-		assert(sr_fill <= (DW+32)/8);
+		assert(sr_fill < DB + FW/8);
 		assert(fsr_empty == 0);
 	end
 	// }}}
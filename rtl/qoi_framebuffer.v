@@ -0,0 +1,534 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	rtl/qoi_framebuffer.v
+// {{{
+// Project:	Quite OK image compression (QOI)
+//
+// Purpose:	To play back one (or more) QOI compressed images from memory,
+//		producing a continuous AXI video stream.  Since the images
+//	are read compressed, the memory bandwidth required is cut by the
+//	compression ratio--as compared with scanning an uncompressed frame
+//	buffer.  The images are read over Wishbone, using the same DMA
+//	interface as the QOI recorder.  Hence, a region of memory written by
+//	the recorder, whether holding one frame or several back to back, may
+//	be played back by this component.
+//
+//	Compressed data is read into a prefetch FIFO, of 2^LGFIFO bus words,
+//	in bursts of 2^LGBURST words, starting a new burst any time there's
+//	room for a full one.  The FIFO should be deep enough to cover the
+//	longest memory latency expected.  From there, data crosses into the
+//	pixel clock domain (while still compressed), and then goes to the QOI
+//	decoder.  Once the end of the region is read, reading starts over
+//	again from its beginning, so the region plays back continuously.
+//
+// Registers:
+//	0: Status/Control
+//		Writing a 1 to bit 0 starts playback, if a non-zero length
+//		has been given.  Writing a 0 to bit 0 stops playback at the end
+//		of the current bus burst.
+//		On read:
+//		Bit 31: Playback enabled
+//		Bit 30: Bus busy (o_dma_cyc)
+//		Bit 29: Bus error.  Playback has been halted due to a bus
+//			error.  Cleared on the next start.
+//		Bit 28: Size error.  A frame has been played back that held
+//			more or fewer pixels than its header claimed.  Playback
+//			continues, with the decoder searching for the next
+//			frame header.  Set whenever the error count (below) is
+//			non-zero.
+//		Bits [LGFIFO:0]: Prefetch FIFO fill, in words
+//	4: Address (MSB when not LITTLE ENDIAN)
+//	8: Address (LSB when not LITTLE ENDIAN)
+//		The (byte) address of the first QOI image.  Must be aligned to
+//		the bus width.
+//	C: Length
+//		The number of bytes in the region to be played back, including
+//		all headers and trailers.
+//	10: Errors (Read only)
+//		The number of frames found in error since playback was last
+//		started, saturating at 2^16-1.  Counts are crossed from the
+//		pixel clock domain, and so may lag by a few clocks.
+//
+//	Each frame is played back at the width and height given in its own
+//	header, so a recording may mix frames of differing sizes.
+//
+//	The address and length may only be changed while playback is stopped
+//	and the bus is idle.  Between stopping and starting, the FIFOs and
+//	the decoder are held in reset, so playback always (re)starts cleanly
+//	from the first image.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+`default_nettype none
+module	qoi_framebuffer #(
+		// {{{
+		parameter [0:0]	OPT_TUSER_IS_SOF = 1'b0,
+		// OPT_ALPHA: Set to output { A, R, G, B } pixels, rather than
+		// dropping the alpha channel
+		parameter [0:0]	OPT_ALPHA = 1'b0,
+		parameter	ADDRESS_WIDTH = 32,
+		parameter	DW = 64,
+		parameter	AW = ADDRESS_WIDTH-$clog2(DW/8),
+		parameter	LGFIFO = 9,
+		parameter	LGBURST = 5,
+		localparam	PXW = (OPT_ALPHA) ? 32 : 24
+		// }}}
+	) (
+		// {{{
+		input	wire		i_clk, i_reset,
+		input	wire		i_pix_clk,
+		// Control inputs
+		// {{{
+		input	wire		i_wb_cyc, i_wb_stb, i_wb_we,
+		input	wire	[2:0]	i_wb_addr,
+		input	wire	[31:0]	i_wb_data,
+		input	wire	[3:0]	i_wb_sel,
+		output	wire		o_wb_stall,
+		output	reg		o_wb_ack,
+		output	reg	[31:0]	o_wb_data,
+		// }}}
+		// Outgoing WB/DMA interface
+		// {{{
+		output	reg			o_dma_cyc, o_dma_stb,
+		output	wire			o_dma_we,
+		output	reg	[AW-1:0]	o_dma_addr,
+		output	wire	[DW-1:0]	o_dma_data,
+		output	wire	[DW/8-1:0]	o_dma_sel,
+		input	wire			i_dma_stall,
+		input	wire			i_dma_ack,
+		input	wire	[DW-1:0]	i_dma_data,
+		input	wire			i_dma_err,
+		// }}}
+		// Video output interface
+		// {{{
+		output	wire		m_vid_valid,
+		input	wire		m_vid_ready,
+		output	wire [PXW-1:0]	m_vid_data,
+		output	wire		m_vid_user, m_vid_last
+		// }}}
+		// }}}
+	);
+
+	// Local declarations
+	// {{{
+	localparam	ADDR_CTRL= 0,
+			ADDR_MSW = 1,
+			ADDR_LSW = 2,
+			ADDR_LEN = 3,
+			ADDR_ERRS= 4;
+	localparam	LGDB = $clog2(DW/8);
+	localparam	WW = 32-LGDB+1;	// Bits required to count words
+	localparam [LGFIFO:0]	BURST = (1<<LGBURST);
+	localparam [LGFIFO:0]	FIFO_SIZE = (1<<LGFIFO);
+
+	reg		r_enable, r_err;
+	reg	[63:0]	wide_base;
+	reg	[AW+LGDB-1:0]	r_base;
+	reg	[31:0]	r_len;
+	wire	[WW-1:0]	nwords;
+	wire		fb_reset;
+
+	reg	[WW-1:0]	rd_left, ack_left;
+	reg	[LGBURST:0]	burst_left;
+	reg	[LGFIFO:0]	outstanding;
+
+	wire			fifo_full, fifo_empty, fifo_read;
+	wire	[LGFIFO:0]	fifo_fill;
+	wire	[LGDB-1:0]	wr_bytes, fifo_bytes;
+	wire	[DW-1:0]	fifo_data;
+
+	wire			afifo_full, afifo_empty;
+	wire			pxq_valid, pxq_ready;
+	wire	[LGDB-1:0]	pxq_bytes;
+	wire	[DW-1:0]	pxq_data;
+
+	reg	pix_reset, pix_reset_pipe;
+
+	wire		dec_err;
+	reg	[15:0]	px_errs, px_gerrs, gerr_pipe, gerr_sync, gerr_bin,
+			r_nerrs;
+	integer		ik;
+
+	// The FIFOs and decoder are held in reset whenever playback is stopped
+	assign	fb_reset = !r_enable && !o_dma_cyc;
+
+	always @(posedge i_pix_clk)
+	if (i_reset || fb_reset)
+		{ pix_reset, pix_reset_pipe } <= -1;
+	else
+		{ pix_reset, pix_reset_pipe } <= { pix_reset_pipe, 1'b0 };
+
+	// Round the length up to a whole number of bus words
+	// Verilator lint_off WIDTH
+	assign	nwords = (r_len + (DW/8) - 1) >> LGDB;
+	// Verilator lint_on  WIDTH
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Read compressed data from memory
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// A new bus cycle is started any time a full burst will fit into the
+	// prefetch FIFO, counting what's already there.  Since nothing else
+	// is written to the FIFO, the burst can then be issued without any
+	// further checks.
+
+	assign	o_dma_we   = 1'b0;
+	assign	o_dma_data = {(DW){1'b0}};
+	assign	o_dma_sel  = {(DW/8){1'b1}};
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		o_dma_cyc <= 1'b0;
+		o_dma_stb <= 1'b0;
+	end else if (o_dma_cyc && i_dma_err)
+	begin
+		o_dma_cyc <= 1'b0;
+		o_dma_stb <= 1'b0;
+	end else if (!o_dma_cyc)
+	begin
+		if (r_enable && fifo_fill <= FIFO_SIZE - BURST)
+		begin
+			o_dma_cyc <= 1'b1;
+			o_dma_stb <= 1'b1;
+		end
+	end else begin
+		if (o_dma_stb && !i_dma_stall && burst_left <= 1)
+			o_dma_stb <= 1'b0;
+		if (!r_enable && (!o_dma_stb || !i_dma_stall))
+			o_dma_stb <= 1'b0;
+
+		// Once all requests have been made, end the cycle with the
+		// last acknowledgment
+		if (!o_dma_stb && outstanding == (i_dma_ack ? 1:0))
+			o_dma_cyc <= 1'b0;
+	end
+
+	// burst_left: The number of requests left in this burst
+	// {{{
+	always @(posedge i_clk)
+	if (!o_dma_cyc)
+		burst_left <= BURST[LGBURST:0];
+	else if (o_dma_stb && !i_dma_stall)
+		burst_left <= burst_left - 1;
+	// }}}
+
+	// outstanding: The number of requests awaiting acknowledgment
+	// {{{
+	always @(posedge i_clk)
+	if (i_reset || !o_dma_cyc || i_dma_err)
+		outstanding <= 0;
+	else case({ (o_dma_stb && !i_dma_stall), i_dma_ack })
+	2'b10: outstanding <= outstanding + 1;
+	2'b01: outstanding <= outstanding - 1;
+	default: begin end
+	endcase
+	// }}}
+
+	// o_dma_addr, rd_left: Where to read from next
+	// {{{
+	// Once the end of the region has been requested, start over again
+	// from its beginning.
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		o_dma_addr <= 0;
+		rd_left <= 0;
+	end else if (fb_reset)
+	begin
+		o_dma_addr <= r_base[AW+LGDB-1:LGDB];
+		rd_left <= nwords;
+	end else if (o_dma_stb && !i_dma_stall)
+	begin
+		o_dma_addr <= o_dma_addr + 1;
+		rd_left <= rd_left - 1;
+		if (rd_left <= 1)
+		begin
+			o_dma_addr <= r_base[AW+LGDB-1:LGDB];
+			rd_left <= nwords;
+		end
+	end
+	// }}}
+
+	// ack_left: Used to find the last word of the region, and so how
+	// many of its bytes are valid
+	// {{{
+	always @(posedge i_clk)
+	if (i_reset || fb_reset)
+		ack_left <= nwords;
+	else if (o_dma_cyc && i_dma_ack)
+	begin
+		ack_left <= ack_left - 1;
+		if (ack_left <= 1)
+			ack_left <= nwords;
+	end
+
+	assign	wr_bytes = (ack_left <= 1) ? r_len[LGDB-1:0] : 0;
+	// }}}
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Prefetch FIFO
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	sfifo #(
+		.BW(DW+LGDB), .LGFLEN(LGFIFO)
+	) u_fifo (
+		.i_clk(i_clk), .i_reset(i_reset || fb_reset),
+		//
+		.i_wr(o_dma_cyc && i_dma_ack && !i_dma_err),
+		.i_data({ wr_bytes, i_dma_data }),
+		.o_full(fifo_full),
+		.o_fill(fifo_fill),
+		//
+		.i_rd(fifo_read),
+		.o_data({ fifo_bytes, fifo_data }),
+		.o_empty(fifo_empty)
+	);
+
+	assign	fifo_read = !fifo_empty && !afifo_full;
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Cross to the pixel clock domain
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// As with the recorder, the depth of this FIFO is only enough to keep
+	// up with the data rate.  The depth is found in the FIFO above.
+	// Crossing compressed data keeps this FIFO narrow.
+	//
+
+	afifo #(
+		.LGFIFO(3), .WIDTH(LGDB+DW)
+	) u_afifo (
+		.i_wclk(i_clk), .i_wr_reset_n(!i_reset && !fb_reset),
+		.i_wr(fifo_read),
+			.i_wr_data({ fifo_bytes, fifo_data }),
+			.o_wr_full(afifo_full),
+		.i_rclk(i_pix_clk), .i_rd_reset_n(!pix_reset),
+		.i_rd(pxq_ready),
+			.o_rd_data({ pxq_bytes, pxq_data }),
+			.o_rd_empty(afifo_empty)
+	);
+
+	assign	pxq_valid = !afifo_empty;
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Decode
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	qoi_decoder #(
+		.OPT_TUSER_IS_SOF(OPT_TUSER_IS_SOF),
+		.OPT_ALPHA(OPT_ALPHA),
+		.DW(DW)
+	) u_decoder (
+		// {{{
+		.i_clk(i_pix_clk), .i_reset(pix_reset),
+		//
+		.i_qvalid(pxq_valid),
+		.o_qready(pxq_ready),
+		.i_qdata(pxq_data),
+		.i_qbytes(pxq_bytes),
+		//
+		.m_valid(m_vid_valid),
+		.m_ready(m_vid_ready),
+		.m_data(m_vid_data),
+		.m_last(m_vid_last),
+		.m_user(m_vid_user),
+		.o_err(dec_err)
+		// }}}
+	);
+
+	// Decoding errors are counted in the pixel clock domain, and the count
+	// is sent to the bus clock domain as a Gray code.  Since the count
+	// only ever steps by one, just one bit changes at a time, and the
+	// count can be synchronized as though it were a single bit.  (It does
+	// jump back to zero on a reset, but only while playback is stopped.)
+	initial	px_errs = 0;
+	always @(posedge i_pix_clk)
+	if (pix_reset)
+		px_errs <= 0;
+	else if (dec_err && !(&px_errs))
+		px_errs <= px_errs + 1;
+
+	initial	px_gerrs = 0;
+	always @(posedge i_pix_clk)
+		px_gerrs <= px_errs ^ (px_errs >> 1);
+
+	initial	{ gerr_sync, gerr_pipe } = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		{ gerr_sync, gerr_pipe } <= 0;
+	else
+		{ gerr_sync, gerr_pipe } <= { gerr_pipe, px_gerrs };
+
+	always @(*)
+	begin
+		gerr_bin[15] = gerr_sync[15];
+		for(ik=14; ik>=0; ik=ik-1)
+			gerr_bin[ik] = gerr_bin[ik+1] ^ gerr_sync[ik];
+	end
+
+	// The count is held while playback is stopped, and cleared again on
+	// the next start
+	initial	r_nerrs = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		r_nerrs <= 0;
+	else if (i_wb_stb && !o_wb_stall && i_wb_we && i_wb_addr == ADDR_CTRL
+			&& i_wb_sel[0] && i_wb_data[0] && fb_reset && r_len != 0)
+		r_nerrs <= 0;
+	else if (r_enable)
+		r_nerrs <= gerr_bin;
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Control bus handling
+	// {{{
+	assign	o_wb_stall = 1'b0;
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_enable <= 1'b0;
+		r_err    <= 1'b0;
+	end else if (o_dma_cyc && i_dma_err)
+	begin
+		r_enable <= 1'b0;
+		r_err    <= 1'b1;
+	end else if (i_wb_stb && !o_wb_stall && i_wb_we
+				&& i_wb_addr == ADDR_CTRL && i_wb_sel[0])
+	begin
+		if (!i_wb_data[0])
+			r_enable <= 1'b0;
+		else if (fb_reset && r_len != 0)
+		begin
+			r_enable <= 1'b1;
+			r_err    <= 1'b0;
+		end
+	end
+
+	always @(*)
+	begin
+		wide_base = { {(64-AW-LGDB){1'b0}}, r_base };
+		if (i_wb_stb && !o_wb_stall && i_wb_we && i_wb_addr == ADDR_LSW)
+		begin
+			if (i_wb_sel[0])
+				wide_base[ 7: 0] = i_wb_data[ 7: 0];
+			if (i_wb_sel[1])
+				wide_base[15: 8] = i_wb_data[15: 8];
+			if (i_wb_sel[2])
+				wide_base[23:16] = i_wb_data[23:16];
+			if (i_wb_sel[3])
+				wide_base[31:24] = i_wb_data[31:24];
+		end
+
+		if (i_wb_stb && !o_wb_stall && i_wb_we && i_wb_addr == ADDR_MSW)
+		begin
+			if (i_wb_sel[0])
+				wide_base[39:32] = i_wb_data[ 7: 0];
+			if (i_wb_sel[1])
+				wide_base[47:40] = i_wb_data[15: 8];
+			if (i_wb_sel[2])
+				wide_base[55:48] = i_wb_data[23:16];
+			if (i_wb_sel[3])
+				wide_base[63:56] = i_wb_data[31:24];
+		end
+
+		wide_base[63:AW+LGDB] = 0;
+		// Images must be word aligned
+		wide_base[LGDB-1:0] = 0;
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_base <= 0;
+		r_len  <= 0;
+	end else if (i_wb_stb && !o_wb_stall && i_wb_we && fb_reset)
+	begin
+		if (i_wb_addr == ADDR_MSW || i_wb_addr == ADDR_LSW)
+			r_base <= wide_base[AW+LGDB-1:0];
+
+		if (i_wb_addr == ADDR_LEN)
+		begin
+			if (i_wb_sel[0])
+				r_len[ 7: 0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1])
+				r_len[15: 8] <= i_wb_data[15: 8];
+			if (i_wb_sel[2])
+				r_len[23:16] <= i_wb_data[23:16];
+			if (i_wb_sel[3])
+				r_len[31:24] <= i_wb_data[31:24];
+		end
+	end
+
+	initial	o_wb_data = 0;
+	always @(posedge i_clk)
+	if (i_wb_stb)
+	begin
+		case(i_wb_addr)
+		ADDR_CTRL: o_wb_data <= { r_enable, o_dma_cyc, r_err,
+				(r_nerrs != 0), {(28-LGFIFO-1){1'b0}},
+				fifo_fill };
+		ADDR_MSW: o_wb_data <= wide_base[63:32];
+		ADDR_LSW: o_wb_data <= wide_base[31:0];
+		ADDR_LEN: o_wb_data <= r_len;
+		ADDR_ERRS: o_wb_data <= { 16'h0, r_nerrs };
+		default: o_wb_data <= 0;
+		endcase
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+		o_wb_ack <= 1'b0;
+	else
+		o_wb_ack <= i_wb_stb && !o_wb_stall;
+
+	// }}}
+
+	// Keep Verilator happy
+	// {{{
+	// Verilator coverage_off
+	// Verilator lint_off UNUSED
+	wire	unused = &{ 1'b0, i_wb_cyc, fifo_full };
+	// Verilator lint_on  UNUSED
+	// Verilator coverage_on
+	// }}}
+endmodule
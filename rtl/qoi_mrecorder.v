@@ -0,0 +1,655 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	rtl/qoi_mrecorder.v
+// {{{
+// Project:	Quite OK image compression (QOI)
+//
+// Purpose:	A multi-channel version of the recorder.  NCHAN video streams,
+//		each in its own pixel clock domain, are each compressed by
+//	their own QOI encoder, and written to their own region of memory--all
+//	through a single (shared) DMA.  The cost of one bus master, and the
+//	interconnect that goes with it, is thus paid once rather than once
+//	per video source.
+//
+//	Each channel has its own FIFO.  Once a channel's FIFO holds a full
+//	(aligned) burst, or the end of a frame, that burst may be granted the
+//	DMA.  Grants are made round robin among all channels with such a burst
+//	ready, and each burst is written as its own DMA transfer, to that
+//	channel's current address.  Since a burst is only granted once all of
+//	it is in the FIFO, no channel can ever hold the DMA while waiting on
+//	its video.  The few clocks between transfers are the price of
+//	switching channels.  The DMA must, of course, be able to keep up with
+//	the sum of all of the compressed streams.  Channels that fall behind
+//	will backpressure their video--or drop it, if nothing is recording.
+//
+//	Frames are captured in the same fashion as in the qoi_recorder's
+//	linear mode: a fixed number of frames, one after another, starting
+//	from the given address.  Each frame starts on a bus word boundary.
+//	(For ring buffers, frame indexes, statistics, or bandwidth budgets,
+//	use one qoi_recorder per channel.)
+//
+// Registers:
+//	Each channel has four registers, starting at word address 4*channel.
+//	0x00: Status/Control
+//		On write, bits [15:0] set the number of frames to capture, and
+//		start a capture if none is in progress.  When a capture is in
+//		progress, writing zero to bits [15:0] stops the capture once
+//		the current frame completes.
+//		On read:
+//		Bit 31: Capture requested
+//		Bit 30: DMA busy (with this channel)
+//		Bit 29: DMA error
+//		Bit 28: Capture active
+//		Bit 27: Synchronized to the incoming video
+//		Bit 25: Stop pending
+//		Bits [15:0]: Number of frames remaining
+//	0x04: Address (MSB when not LITTLE ENDIAN)
+//	0x08: Address (LSB when not LITTLE ENDIAN)
+//		The byte address of the next frame to be written, rounded down
+//		to a whole bus word.  When read back after a capture, this
+//		gives the end of the capture.  The address may only be changed
+//		when the channel isn't capturing.
+//	0x0C: Frame count
+//		The number of frames written since the capture began.
+//
+//	A DMA error stops the captures on all channels.
+//
+//	PIXELS_PER_CLOCK and OPT_ALPHA apply to all channels, and have the
+//	same meaning as in the qoi_recorder.  Pixels arrive on s_vid_data,
+//	channel zero in the LSBs.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+`default_nettype none
+// }}}
+module	qoi_mrecorder #(
+		// {{{
+		// NCHAN: The number of video channels
+		parameter	NCHAN = 2,
+		parameter [0:0]	OPT_TUSER_IS_SOF = 1'b0,
+		parameter	ADDRESS_WIDTH = 32,
+		parameter	DW = 64,
+		parameter	AW = ADDRESS_WIDTH-$clog2(DW/8),
+		// LGFIFO: log_2 of the (per channel) FIFO size, in bus words
+		parameter	LGFIFO = 8,
+		// LGBURST: log_2 of the memory burst length, in bus words.
+		// Must be no larger than LGFIFO.
+		parameter	LGBURST = 3,
+		parameter	PIXELS_PER_CLOCK = 1,
+		parameter [0:0]	OPT_ALPHA = 1'b0,
+		localparam	PW = ((OPT_ALPHA) ? 32 : 24) * PIXELS_PER_CLOCK,
+		localparam	LGNCH = (NCHAN > 1) ? $clog2(NCHAN) : 1
+		// }}}
+	) (
+		// {{{
+		input	wire		i_clk, i_reset,
+		input	wire	[NCHAN-1:0]	i_pix_clk,
+		// Control inputs
+		// {{{
+		input	wire		i_wb_cyc, i_wb_stb, i_wb_we,
+		input	wire [LGNCH+1:0]	i_wb_addr,
+		input	wire	[31:0]	i_wb_data,
+		input	wire	[3:0]	i_wb_sel,
+		output	wire		o_wb_stall,
+		output	reg		o_wb_ack,
+		output	reg	[31:0]	o_wb_data,
+		// }}}
+		// Video input interfaces, one per channel
+		// {{{
+		input	wire	[NCHAN-1:0]	s_vid_valid,
+		output	wire	[NCHAN-1:0]	s_vid_ready,
+		input	wire	[NCHAN*PW-1:0]	s_vid_data,
+		input	wire	[NCHAN-1:0]	s_vid_user, s_vid_last,
+		// }}}
+		// Outgoing WB/DMA interface
+		// {{{
+		output	wire			o_dma_cyc, o_dma_stb, o_dma_we,
+		output	wire	[AW-1:0]	o_dma_addr,
+		output	wire	[DW-1:0]	o_dma_data,
+		output	wire	[DW/8-1:0]	o_dma_sel,
+		input	wire			i_dma_stall,
+		input	wire			i_dma_ack,
+		input	wire	[DW-1:0]	i_dma_data,
+		input	wire			i_dma_err
+		// }}}
+		// }}}
+	);
+
+	// Local declarations
+	// {{{
+	localparam	ADDR_CTRL  = 0,
+			ADDR_MSW   = 1,
+			ADDR_LSW   = 2,
+			ADDR_FRAMES= 3;
+	localparam	DB = DW/8;
+	localparam	LGDB = $clog2(DW/8);
+	localparam	BAW = AW+LGDB;
+
+	wire	soft_dma_reset;
+
+	// Per channel FIFO outputs, and status
+	wire	[NCHAN-1:0]		ch_valid, ch_last, ch_avail, ch_read;
+	wire	[NCHAN*DW-1:0]		ch_data;
+	wire	[NCHAN*(LGDB+1)-1:0]	ch_bytes;
+	wire	[NCHAN*BAW-1:0]		ch_addr;
+	wire	[NCHAN*(LGBURST+1)-1:0]	ch_blen;
+	wire	[NCHAN*32-1:0]		ch_ctrl, ch_frames;
+
+	// The shared DMA
+	reg				dma_request;
+	reg	[LGNCH-1:0]		r_grant, nxt_grant;
+	reg				nxt_found;
+	reg	[LGBURST:0]		burst_left;
+	wire				dma_valid, dma_ready, dma_last, dma_beat;
+	wire				dma_busy, dma_err, dma_fault;
+	wire	[DW-1:0]		dma_data;
+	wire	[LGDB:0]		dma_bytes;
+	wire	[BAW-1:0]		dma_addr;
+
+	wire	[LGNCH-1:0]		wb_chan;
+	wire	[1:0]			wb_reg;
+	wire	[63:0]			wb_addr;
+	integer				ik;
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Per channel compression, clock crossing, FIFO, and control
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Each channel is a copy of the qoi_recorder's datapath, up to (but
+	// not including) its DMA.
+	//
+
+	assign	wb_chan = i_wb_addr[LGNCH+1:2];
+	assign	wb_reg  = i_wb_addr[1:0];
+
+	genvar	gk;
+	generate for(gk=0; gk<NCHAN; gk=gk+1)
+	begin : GEN_CHANNEL
+		// Local declarations
+		// {{{
+		wire	pix_clk;
+		reg	pix_reset, pix_reset_pipe;
+
+		wire				sel_valid, sel_ready, sel_last;
+		wire	[DW-1:0]		sel_data;
+		wire	[LGDB-1:0]		sel_bytes;
+
+		wire				pix_valid, pix_ready, pix_last;
+		wire	[DW-1:0]		pix_data;
+		wire	[LGDB:0]		pix_bytes;
+
+		wire				pxm_valid, pxm_ready, pxm_last;
+		wire	[DW-1:0]		pxm_data;
+		wire	[LGDB:0]		pxm_bytes;
+
+		wire				fifo_last;
+		wire	[DW-1:0]		fifo_data;
+		wire	[LGDB:0]		fifo_bytes;
+		wire	[LGFIFO:0]		fifo_fill;
+		reg	[LGFIFO:0]		fifo_lasts;
+		wire	afifo_full, afifo_empty;
+		wire	fifo_full,  fifo_empty, fifo_read;
+
+		wire			my_beat, my_sel, start_request,
+					stop_request, final_frame;
+		reg			vid_sync, dma_active, r_request, r_stop;
+		reg	[15:0]		nframes;
+		reg	[31:0]		frame_count;
+		reg	[63:0]		wide_address;
+		reg	[BAW-1:0]	r_address;
+		wire	[BAW-1:0]	next_addr;
+		// }}}
+
+		assign	pix_clk = i_pix_clk[gk];
+
+		always @(posedge pix_clk)
+		if (i_reset)
+			{ pix_reset, pix_reset_pipe } <= -1;
+		else
+			{ pix_reset, pix_reset_pipe } <= { pix_reset_pipe, 1'b0 };
+
+		// Compress the video
+		// {{{
+		qoi_encoder #(
+			.OPT_TUSER_IS_SOF(OPT_TUSER_IS_SOF),
+			.OPT_ALPHA(OPT_ALPHA),
+			.DW(DW),
+			.PIXELS_PER_CLOCK(PIXELS_PER_CLOCK)
+		) u_compress_video (
+			// {{{
+			.i_clk(pix_clk),
+			.i_reset(pix_reset),
+			//
+			.s_valid(s_vid_valid[gk]),
+			.s_ready(s_vid_ready[gk]),
+			.s_data(s_vid_data[gk*PW +: PW]),
+			.s_last(s_vid_last[gk]),
+			.s_user(s_vid_user[gk]),
+			.i_restart(1'b0),
+			//
+			.o_qvalid(sel_valid),
+			.i_qready(sel_ready),
+			.o_qdata(sel_data),
+			.o_qbytes(sel_bytes),
+			.o_qlast(sel_last),
+			//
+			// Verilator lint_off PINCONNECTEMPTY
+			.o_ops(),
+			// Verilator lint_on  PINCONNECTEMPTY
+			//
+			.i_line_budget(16'h0),
+			.i_frame_budget(32'h0),
+			// Verilator lint_off PINCONNECTEMPTY
+			.o_quant(), .o_overrun(),
+			// Verilator lint_on  PINCONNECTEMPTY
+			.i_delta(1'b0), .i_keyframe(1'b0), .i_keyint(8'h0),
+			.i_above(1'b0),
+			.i_crop_x(16'h0), .i_crop_y(16'h0),
+			.i_crop_w(16'h0), .i_crop_h(16'h0),
+			.i_skip_x(8'h0), .i_skip_y(8'h0), .i_skip_frames(8'h0),
+			// Verilator lint_off PINCONNECTEMPTY
+			.o_perf()
+			// Verilator lint_on  PINCONNECTEMPTY
+			// }}}
+		);
+		// }}}
+
+		// Reshape to the bus width, and cross to the bus clock
+		// {{{
+		zipdma_rxgears #(
+			.BUS_WIDTH(DW),
+			.OPT_LITTLE_ENDIAN(1'b0)
+		) u_rxgears (
+			.i_clk(pix_clk), .i_reset(pix_reset),
+			.i_soft_reset(soft_dma_reset),
+			.S_VALID(sel_valid),
+			.S_READY(sel_ready),
+			.S_DATA( sel_data),
+			.S_BYTES({ (sel_bytes == 0 ? 1'b1:1'b0), sel_bytes }),
+			.S_LAST( sel_last),
+			//
+			.M_VALID(pix_valid),
+			.M_READY(pix_ready),
+			.M_DATA( pix_data),
+			.M_BYTES(pix_bytes),
+			.M_LAST( pix_last)
+		);
+
+		afifo #(
+			.LGFIFO(3), .WIDTH(2+LGDB+DW)
+		) u_afifo (
+			.i_wclk(pix_clk), .i_wr_reset_n(!pix_reset),
+			.i_wr(pix_valid),
+				.i_wr_data({ pix_last, pix_bytes, pix_data }),
+				.o_wr_full(afifo_full),
+			.i_rclk(i_clk), .i_rd_reset_n(!i_reset),
+			.i_rd(pxm_ready),
+				.o_rd_data({ pxm_last, pxm_bytes, pxm_data }),
+				.o_rd_empty(afifo_empty)
+		);
+
+		assign	pxm_valid = !afifo_empty;
+		assign	pix_ready = !afifo_full;
+		// }}}
+
+		// The channel's FIFO
+		// {{{
+		sfifo #(
+			.BW(DW+LGDB+2), .LGFLEN(LGFIFO)
+		) u_fifo (
+			.i_clk(i_clk), .i_reset(i_reset),
+			//
+			.i_wr(pxm_valid),
+			.i_data({ pxm_last, pxm_bytes, pxm_data }),
+			.o_full(fifo_full),
+			.o_fill(fifo_fill),
+			//
+			.i_rd(fifo_read),
+			.o_data({ fifo_last, fifo_bytes, fifo_data }),
+			.o_empty(fifo_empty)
+		);
+
+		assign	pxm_ready = !fifo_full;
+		assign	fifo_read = ch_read[gk];
+		// This channel's data is being written to memory
+		assign	my_beat   = dma_beat && r_grant == gk;
+
+		// Count the number of frame ends waiting in the FIFO
+		always @(posedge i_clk)
+		if (i_reset)
+			fifo_lasts <= 0;
+		else case({ pxm_valid && pxm_ready && pxm_last,
+				fifo_read && !fifo_empty && fifo_last })
+		2'b10: fifo_lasts <= fifo_lasts + 1;
+		2'b01: fifo_lasts <= fifo_lasts - 1;
+		default: begin end
+		endcase
+
+		assign	ch_valid[gk] = !fifo_empty;
+		assign	ch_last[gk]  = fifo_last;
+		assign	ch_data[gk*DW +: DW] = fifo_data;
+		assign	ch_bytes[gk*(LGDB+1) +: (LGDB+1)] = fifo_bytes;
+		// Data is thrown away whenever the channel isn't capturing
+		assign	ch_read[gk] = my_beat || !dma_active;
+
+		// A burst runs from the current address to the next burst
+		// boundary, or to the end of the frame.  It's ready once the
+		// FIFO holds all of it.
+		// Verilator lint_off WIDTH
+		assign	ch_blen[gk*(LGBURST+1) +: (LGBURST+1)]
+			= (1<<LGBURST) - (r_address[BAW-1:LGDB]
+						& ((1<<LGBURST)-1));
+		assign	ch_avail[gk] = dma_active && !fifo_empty
+			&& (fifo_lasts != 0 || fifo_fill
+				>= ch_blen[gk*(LGBURST+1) +: (LGBURST+1)]);
+		// Verilator lint_on  WIDTH
+		// }}}
+
+		// Synchronize
+		// {{{
+		always @(posedge i_clk)
+		if (i_reset)
+			vid_sync <= 1'b1;
+		else if (fifo_read && !fifo_empty && fifo_last)
+			vid_sync <= 1'b1;
+		else if (fifo_read && !fifo_empty && !dma_active)
+			vid_sync <= 1'b0;
+
+		always @(posedge i_clk)
+		if (i_reset)
+			dma_active <= 1'b0;
+		else if (!dma_active)
+		begin
+			if (r_request && vid_sync)
+				dma_active <= !fifo_read || fifo_empty;
+		end else if (fifo_read && !fifo_empty && fifo_last
+					&& (!r_request || final_frame))
+			dma_active <= 1'b0;
+		// }}}
+
+		// Capture control
+		// {{{
+		assign	my_sel = i_wb_stb && !o_wb_stall && i_wb_we
+					&& wb_chan == gk;
+
+		assign	start_request = my_sel && !r_request
+				&& wb_reg == ADDR_CTRL && i_wb_sel[1:0] == 2'b11
+				&& r_address != 0 && i_wb_data[15:0] != 0;
+
+		assign	stop_request = my_sel && r_request
+				&& wb_reg == ADDR_CTRL && i_wb_sel[1:0] == 2'b11
+				&& i_wb_data[15:0] == 0;
+
+		assign	final_frame = r_stop || nframes <= 1;
+
+		always @(posedge i_clk)
+		if (i_reset)
+		begin
+			nframes <= 0;
+			r_request <= 0;
+			r_stop <= 0;
+		end else if (dma_fault)
+		begin
+			r_request <= 0;
+			nframes <= 0;
+			r_stop <= 0;
+		end else begin
+			if (dma_active && fifo_read && !fifo_empty && fifo_last)
+			begin
+				if (nframes > 0)
+					nframes <= nframes - 1;
+				if (final_frame)
+				begin
+					r_request <= 0;
+					r_stop <= 0;
+				end
+			end
+
+			if (stop_request)
+			begin
+				if (!dma_active)
+					r_request <= 0;
+				else
+					r_stop <= 1'b1;
+			end
+
+			if (start_request)
+			begin
+				nframes <= i_wb_data[15:0];
+				r_stop  <= 1'b0;
+				r_request <= 1'b1;
+			end
+		end
+
+		always @(posedge i_clk)
+		if (i_reset || start_request)
+			frame_count <= 0;
+		else if (my_beat && fifo_last)
+			frame_count <= frame_count + 1;
+		// }}}
+
+		// Address handling
+		// {{{
+		always @(*)
+		begin
+			wide_address = { {(64-BAW){1'b0}}, r_address };
+			if (my_sel && wb_reg == ADDR_LSW)
+			begin
+				if (i_wb_sel[0])
+					wide_address[ 7: 0] = i_wb_data[ 7: 0];
+				if (i_wb_sel[1])
+					wide_address[15: 8] = i_wb_data[15: 8];
+				if (i_wb_sel[2])
+					wide_address[23:16] = i_wb_data[23:16];
+				if (i_wb_sel[3])
+					wide_address[31:24] = i_wb_data[31:24];
+			end
+
+			if (my_sel && wb_reg == ADDR_MSW)
+			begin
+				if (i_wb_sel[0])
+					wide_address[39:32] = i_wb_data[ 7: 0];
+				if (i_wb_sel[1])
+					wide_address[47:40] = i_wb_data[15: 8];
+				if (i_wb_sel[2])
+					wide_address[55:48] = i_wb_data[23:16];
+				if (i_wb_sel[3])
+					wide_address[63:56] = i_wb_data[31:24];
+			end
+
+			wide_address[63:BAW] = 0;
+		end
+
+		// The next frame starts at the next whole bus word
+		// Verilator lint_off WIDTH
+		assign	next_addr = (r_address + fifo_bytes + DB-1)
+					& ~((1<<LGDB)-1);
+		// Verilator lint_on  WIDTH
+
+		always @(posedge i_clk)
+		if (i_reset)
+			r_address <= 0;
+		else if (my_beat)
+		begin
+			if (fifo_last)
+				r_address <= next_addr;
+			else
+				// Verilator lint_off WIDTH
+				r_address <= r_address + fifo_bytes;
+				// Verilator lint_on  WIDTH
+		end else if (my_sel && !r_request && !dma_active
+				&& (wb_reg == ADDR_MSW || wb_reg == ADDR_LSW))
+			r_address <= { wide_address[BAW-1:LGDB],
+						{(LGDB){1'b0}} };
+
+		assign	ch_addr[gk*BAW +: BAW] = r_address;
+		// }}}
+
+		// Register read back
+		// {{{
+		assign	ch_ctrl[gk*32 +: 32] = { r_request,
+				dma_busy && r_grant == gk, dma_err, dma_active,
+				vid_sync, 1'b0, r_stop, 9'h0, nframes };
+		assign	ch_frames[gk*32 +: 32] = frame_count;
+		// }}}
+	end endgenerate
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Arbitrate among the channels for the DMA
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Once the DMA is idle, the next channel (after the last one granted)
+	// with a burst ready is granted the DMA for one burst.  The DMA is
+	// then requested, to start at that channel's address, and the burst
+	// ends the transfer.
+	//
+
+	always @(*)
+	begin
+		nxt_grant = r_grant;
+		nxt_found = 1'b0;
+		for(ik=NCHAN-1; ik>=0; ik=ik-1)
+		if (ch_avail[ik] && ik > r_grant)
+		begin
+			nxt_grant = ik[LGNCH-1:0];
+			nxt_found = 1'b1;
+		end
+
+		if (!nxt_found)
+		for(ik=NCHAN-1; ik>=0; ik=ik-1)
+		if (ch_avail[ik] && ik <= r_grant)
+		begin
+			nxt_grant = ik[LGNCH-1:0];
+			nxt_found = 1'b1;
+		end
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_grant     <= 0;
+		burst_left  <= 0;
+		dma_request <= 1'b0;
+	end else if (dma_fault)
+	begin
+		burst_left  <= 0;
+		dma_request <= 1'b0;
+	end else if (burst_left != 0)
+	begin
+		if (dma_beat)
+			burst_left <= (dma_last) ? 0 : burst_left - 1;
+		dma_request <= !dma_beat || !dma_last;
+	end else if (!dma_busy && !dma_request && nxt_found)
+	begin
+		r_grant     <= nxt_grant;
+		burst_left  <= ch_blen[nxt_grant*(LGBURST+1) +: (LGBURST+1)];
+		dma_request <= 1'b1;
+	end
+
+	assign	dma_valid = (burst_left != 0) && ch_valid[r_grant];
+	assign	dma_data  = ch_data[r_grant*DW +: DW];
+	assign	dma_bytes = ch_bytes[r_grant*(LGDB+1) +: (LGDB+1)];
+	assign	dma_last  = ch_last[r_grant] || burst_left == 1;
+	assign	dma_addr  = ch_addr[r_grant*BAW +: BAW];
+	assign	dma_beat  = dma_valid && dma_ready;
+
+	assign	dma_fault = dma_err || (o_dma_cyc && i_dma_err);
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Write the final results to memory
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	zipdma_s2mm #(
+		.ADDRESS_WIDTH(ADDRESS_WIDTH), .BUS_WIDTH(DW)
+	) u_dma (
+		.i_clk(i_clk), .i_reset(i_reset),
+		//
+		.i_request(dma_request), .o_busy(dma_busy), .o_err(dma_err),
+		// Always increment.  Size is always the full bus size.
+		.i_inc(1'b1), .i_size(2'b00), .i_addr(dma_addr),
+		//
+		.S_VALID(dma_valid), .S_READY(dma_ready),
+		.S_DATA(dma_data), .S_BYTES(dma_bytes), .S_LAST(dma_last),
+		//
+		.o_wr_cyc(o_dma_cyc), .o_wr_stb(o_dma_stb), .o_wr_we(o_dma_we),
+		.o_wr_addr(o_dma_addr), .o_wr_data(o_dma_data),
+			.o_wr_sel(o_dma_sel),
+		.i_wr_stall(i_dma_stall), .i_wr_ack(i_dma_ack),
+			.i_wr_data(i_dma_data),
+		.i_wr_err(i_dma_err)
+	);
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Control bus handling
+	// {{{
+	assign	o_wb_stall = 1'b0;
+	assign	soft_dma_reset = 1'b0;
+
+	assign	wb_addr = { {(64-BAW){1'b0}}, ch_addr[wb_chan*BAW +: BAW] };
+
+	initial	o_wb_data = 0;
+	always @(posedge i_clk)
+	if (i_wb_stb && wb_chan >= NCHAN)
+		o_wb_data <= 0;
+	else if (i_wb_stb)
+	begin
+		case(wb_reg)
+		ADDR_CTRL:   o_wb_data <= ch_ctrl[wb_chan*32 +: 32];
+		ADDR_MSW:    o_wb_data <= wb_addr[63:32];
+		ADDR_LSW:    o_wb_data <= wb_addr[31:0];
+		ADDR_FRAMES: o_wb_data <= ch_frames[wb_chan*32 +: 32];
+		endcase
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+		o_wb_ack <= 1'b0;
+	else
+		o_wb_ack <= i_wb_stb && !o_wb_stall;
+
+	// }}}
+
+	// Keep Verilator happy
+	// {{{
+	// Verilator coverage_off
+	// Verilator lint_off UNUSED
+	wire	unused = &{ 1'b0, i_wb_cyc };
+	// Verilator lint_on  UNUSED
+	// Verilator coverage_on
+	// }}}
+endmodule
@@ -10,13 +10,210 @@
 //	capture.  Design generates no backpressure when not in use--allowing
 //	raw video data to stream through.
 //
+//	Two capture modes are supported.  In the first, a fixed number of
+//	frames are written, one after another, starting from the given
+//	address.  In the second, a "flight recorder" mode, frames are written
+//	continuously into a ring buffer until the capture is stopped, so the
+//	most recent frames are always available at a fixed memory cost.
+//
+//	In either mode, the start and length of each frame is recorded in an
+//	index table of 2^LGINDEX entries, so software can find the most
+//	recent frames without scanning the compressed data.
+//
 // Registers:
-//	0: Status/Control
-//		Busy
-//		Number of frames desired / number of frames remaining
-//	4: Address (MSB when not LITTLE ENDIAN)
-//	8: Address (LSB when not LITTLE ENDIAN)
-//	C: Data length allowed
+//	0x00: Status/Control
+//		On write, bits [15:0] set the number of frames to capture, and
+//		bit 16 selects ring buffer mode (in which case the frame count
+//		is ignored).  Either starts a capture, if none is in progress.
+//		Bit 17 requests a fast start (if OPT_FASTSTART is set): rather
+//		than waiting for the next frame, the capture starts with the
+//		next line.  Its first frame then holds only the rest of the
+//		incoming frame.  Without a fast start, only whole frames are
+//		ever captured: any partial frame is discarded.
+//		When a capture is in progress, writing zero to bits [15:0] stops
+//		the capture once the current frame completes.  This is how a
+//		ring buffer capture is frozen.
+//		On read:
+//		Bit 31: Capture requested
+//		Bit 30: DMA busy
+//		Bit 29: DMA error
+//		Bit 28: Capture active
+//		Bit 27: Synchronized to the incoming video
+//		Bit 26: Ring buffer mode
+//		Bit 25: Stop pending
+//		Bit 24: Waiting on a fast start
+//		Bits [15:0]: Number of frames remaining
+//	0x04: Address (MSB when not LITTLE ENDIAN)
+//	0x08: Address (LSB when not LITTLE ENDIAN)
+//		The byte address of the next frame to be written, rounded down
+//		to a whole bus word.  When read back after a (non-ring)
+//		capture, this gives the end of the capture.  In ring buffer
+//		mode, it is the start of the ring.
+//	0x0C: Data length allowed (ring buffer only)
+//		The size of the ring buffer, in bytes.
+//	0x10: Maximum frame length (ring buffer only)
+//		A new frame is only started at the current address if this much
+//		room remains before the end of the ring.  Otherwise, it starts
+//		over at the beginning of the ring.  Frames any longer than this
+//		are truncated at the last whole bus word that fits, and marked
+//		as truncated in the index.  This should be a multiple of the bus
+//		width, and may be no larger than the ring itself.
+//	0x14: Frame count
+//		The number of frames written to the index since the capture
+//		began.  The most recent frame is found at index entry
+//		(count-1) mod 2^LGINDEX.
+//	0x18-0x30: Compression statistics (if OPT_STATS is set)
+//		These describe the most recent frame to leave the encoder,
+//		whether or not it was captured.
+//		0x18: Compressed bytes, including header and trailer
+//		0x1C: Number of QOI_OP_RUN ops
+//		0x20: Number of QOI_OP_INDEX ops
+//		0x24: Number of QOI_OP_DIFF ops
+//		0x28: Number of QOI_OP_LUMA ops
+//		0x2C: Number of QOI_OP_RGB ops
+//		0x30: Backpressure: the number of (pixel) clock cycles where
+//			s_vid_valid && !s_vid_ready, since the frame before
+//	0x34: Statistics count
+//		Incremented each time the statistics are updated, once per
+//		frame.  The statistics are consistent if the same value is
+//		read both before and after them.
+//	0x38: Line budget (if OPT_BUDGET is set)
+//		The number of compressed bytes allowed per line, on average.
+//		Frames that exceed this are progressively quantized, to drop
+//		up to three bits per color, until they fall back under budget.
+//		Zero disables the line budget.
+//	0x3C: Frame budget (if OPT_BUDGET is set)
+//		The maximum number of compressed bytes allowed per frame.  Once
+//		a frame has used up its budget, the rest of it is filled with
+//		the last pixel before the budget ran out.  Zero disables the
+//		frame budget.  See qoi_encoder for details on both budgets.
+//	0x40: Budget status (statistic)
+//		Bit 31: The frame used up its frame budget
+//		Bits [1:0]: The largest quantization level used in the frame
+//	0x44-0x74: Pipeline occupancy (if OPT_PERFCOUNTERS is set)
+//		Statistics, gathered from within the compressor, for finding
+//		where any loss of throughput comes from.  Each is a count of
+//		(pixel) clock cycles during the frame (and any idle time
+//		before it).
+//		0x44: Total clock cycles
+//		0x48: Input (skidbuffer) moving, valid && ready
+//		0x4C: Input stalled, valid && !ready
+//		0x50, 0x54: Step 1 (hash) moving, stalled
+//		0x58, 0x5C: Step 2 (table index) moving, stalled
+//		0x60, 0x64: Step 3 (table lookup) moving, stalled
+//		0x68, 0x6C: Step 4 (compare) moving, stalled
+//		0x70: Output moving.  This is the number of QOI ops produced.
+//		0x74: Output stalled.  These clocks were lost downstream of
+//			the compressor: to the FIFO, and so to the DMA.
+//		Clocks where a stage was neither moving nor stalled, it was
+//		idle.  An idle input didn't have a pixel to accept, while a
+//		stall within the compressor with !(output stalled) means it
+//		was waiting on the next pixel.  See qoi_compress for details.
+//		These require OPT_STATS, and are not available with
+//		PIXELS_PER_CLOCK > 1.
+//	0x78: Delta frames (if OPT_DELTA or OPT_ABOVE is set)
+//		Bit 31 enables delta frames, in which lines unchanged from the
+//		frame before are replaced by a single byte.  Bits [7:0] give
+//		the key frame interval: at least one of every this many frames
+//		is a key (ordinary QOI) frame.  Zero requests no key frames
+//		beyond those required.  See qoi_encoder for details.  With
+//		delta frames enabled, every capture starts with a key frame:
+//		one is requested as the capture starts, and any delta frames
+//		before it are discarded.  In ring buffer mode, the oldest
+//		frames in the ring may be delta frames whose key frame has
+//		since been overwritten, and so can no longer be decoded.
+//		Bit 30 (OPT_ABOVE) instead lets pixels be predicted from the
+//		line above them, in "qoiv" frames.  It's ignored while bit 31
+//		is set.
+//	0x7C: Decimation (if OPT_CROP is set)
+//		Bits [23:16]: Keep one of every this many plus one frames
+//		Bits [15: 8]: Keep one of every this many plus one lines
+//		Bits [ 7: 0]: Keep one of every this many plus one pixels
+//		Zero keeps everything.  Skipped frames never leave the
+//		encoder, so they are neither captured nor counted.
+//	0x80: Crop origin (if OPT_CROP is set, and LGINDEX >= 5)
+//		Bits [31:16] give the left column, and bits [15:0] the top
+//		line, of the rectangle to be captured.
+//	0x84: Crop size (if OPT_CROP is set, and LGINDEX >= 5)
+//		Bits [31:16] give the width, and bits [15:0] the height, of
+//		the rectangle to be captured.  Zero extends the rectangle to
+//		the right (bottom) edge of the incoming video.  Captured
+//		frames are only of the pixels kept, and their headers give
+//		the size of what was kept.  See qoi_encoder for details.
+//
+//	Registers 0x0C and 0x10 may only be changed when no capture is
+//	in progress.  The encoder's settings, the budgets and registers 0x78
+//	through 0x84, may be written at any time.  They're carried across into
+//	the pixel clock domain, and take effect with the frame after the next
+//	to leave the encoder (or at once, if the video is idle).  Crop and
+//	decimation settings may take one frame more, and as qoi_encoder
+//	describes, the first frame after a change to the kept size has the
+//	wrong size in its header.  Reading any of these back returns what was
+//	written.  The index table
+//	follows the registers, starting at word address 2^(LGINDEX+1), with
+//	two words per entry:
+//		Word 0: Byte offset of the frame from the capture start address
+//		Word 1: Bit 31 is set if the frame was truncated
+//			Bits [30:0] give its length in bytes
+//	In ring buffer mode, older frames are overwritten as the ring wraps.
+//	Software should walk backwards from the most recent entry, and stop
+//	at the first entry overlapping the space occupied by the frames that
+//	followed it.
+//
+//	o_int pulses for one clock once a capture has ended--whether it ran
+//	out of frames, was stopped, or was halted by a bus error--and once
+//	the DMA has finished writing it to memory.  Software can then sleep
+//	until the capture is complete, rather than polling the status
+//	register.  See sw/qoirec.h for a driver.
+//
+//	Memory is written in aligned bursts of 2^LGBURST bus words.  Data is
+//	held in the FIFO until either a full burst (up to the next burst
+//	boundary) is available, or until the end of the frame has arrived.
+//	Each frame starts on a bus word boundary, so only the last word of
+//	any frame is ever a partial write.  For the best memory efficiency,
+//	the capture address (and so the ring) should be burst aligned.  Bus
+//	widths of 32 to 256 bits are supported.
+//
+//	PIXELS_PER_CLOCK sets the number of pixels per beat of the incoming
+//	video stream, first pixel in the MSBs.  When PIXELS_PER_CLOCK > 1,
+//	DW should be at least 32*PIXELS_PER_CLOCK for the compressed stream to
+//	keep up with the video.  Without compression, DW must be wider than
+//	24*PIXELS_PER_CLOCK.
+//
+//	OPT_ALPHA captures an alpha channel as well.  Pixels are then
+//	{ A, R, G, B }, 32 bits each, and PIXELS_PER_CLOCK must be one.
+//	Without compression, DW must then be wider than 32.
+//
+//	Clock domains: the encoder runs entirely on i_pix_clk, as does the
+//	packing of its output into DW bit bus words.  Only the compressed,
+//	packed stream crosses into the bus clock (i_clk) domain, through a
+//	small asynchronous FIFO of 2^LGAFIFO words.  Everything after that,
+//	including the main FIFO of 2^LGFIFO words, runs on i_clk.  Compared to
+//	crossing the raw video, this cuts the bandwidth through the clock
+//	crossing by the compression ratio.  The asynchronous FIFO only needs
+//	to be deep enough to cover the latency of its own synchronizers, for
+//	which the default of eight words is plenty.  Any further buffering
+//	belongs in the main FIFO, where it can be block RAM.
+//
+//	FIFO sizing: LGFIFO must be at least LGBURST, since a burst is only
+//	started once the FIFO holds all of it.  Beyond that, the FIFO must
+//	absorb anything the encoder produces while the DMA's bus is busy
+//	elsewhere.  QOI's worst case is an RGB op of four bytes for every
+//	three byte pixel (five bytes for every four with RGBA), so in the
+//	worst case the encoder produces 4*PIXELS_PER_CLOCK bytes (with
+//	OPT_ALPHA, 5) every pixel clock, plus 22 bytes of header and trailer
+//	per frame.  For a bus that may be held off for up to N bus clocks,
+//	the FIFO should then hold
+//
+//		2^LGBURST + N * (f_pix / f_bus) * 4 * PIXELS_PER_CLOCK / (DW/8)
+//
+//	words, or more.  A FIFO that is too small doesn't corrupt the capture,
+//	but it does push back on the video, as counted by the backpressure
+//	statistic (0x30).  Likewise, the bus itself can only keep up with such
+//	worst case images if f_bus * DW/8 >= f_pix * 4 * PIXELS_PER_CLOCK.
+//	Typical images need only a fraction (the compression ratio) of this.
+//	Without compression, every beat of video takes one bus word, so
+//	f_bus >= f_pix is required no matter how the FIFO is sized.
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -55,7 +252,52 @@ module	qoi_recorder #(
 		parameter	ADDRESS_WIDTH = 32,
 		parameter	DW = 64,
 		parameter	AW = ADDRESS_WIDTH-$clog2(DW/8),
-		parameter	LGFIFO = 8
+		// LGFIFO: log_2 of the size of the (bus clock) FIFO, in bus
+		// words.  See the sizing notes above.
+		parameter	LGFIFO = 8,
+		// LGAFIFO: log_2 of the size of the asynchronous FIFO, in
+		// bus words, that carries the compressed stream across the
+		// clock crossing
+		parameter	LGAFIFO = 3,
+		// LGINFIFO: log_2 of the size of the FIFO ahead of the
+		// compressor, in pixel clock beats, so that a stall from the
+		// bus needn't reach the video source at once.  Zero leaves only
+		// a skid buffer there.  See qoi_skid.
+		parameter	LGINFIFO = 0,
+		// LGBURST: log_2 of the memory burst length, in bus words.
+		// Must be no larger than LGFIFO.
+		parameter	LGBURST = 3,
+		parameter	PIXELS_PER_CLOCK = 1,
+		// OPT_ALPHA: Set to capture { A, R, G, B } pixels, and to
+		// record them as four channel QOI images
+		parameter [0:0]	OPT_ALPHA = 1'b0,
+		// OPT_STATS: Set to keep per-frame compression statistics
+		parameter [0:0]	OPT_STATS = 1'b1,
+		// OPT_BUDGET: Set to enforce a (programmable) bandwidth budget
+		parameter [0:0]	OPT_BUDGET = 1'b1,
+		// OPT_PERFCOUNTERS: Set to report pipeline occupancy, as part
+		// of the statistics
+		parameter [0:0]	OPT_PERFCOUNTERS = 1'b0,
+		// OPT_FASTSTART: Set to allow captures to start at the next
+		// line, rather than the next frame.  Requires OPT_COMPRESS.
+		parameter [0:0]	OPT_FASTSTART = 1'b0,
+		// OPT_DELTA: Set to allow delta frames.  Requires
+		// OPT_COMPRESS, PIXELS_PER_CLOCK == 1, and !OPT_ALPHA.
+		parameter [0:0]	OPT_DELTA = 1'b0,
+		// OPT_ABOVE: Set to allow pixels to be predicted from the line
+		// above.  Requires OPT_COMPRESS and PIXELS_PER_CLOCK == 1.
+		parameter [0:0]	OPT_ABOVE = 1'b0,
+		// OPT_CROP: Set to allow capturing only part of the video, or
+		// only some of its frames.  Requires OPT_COMPRESS and
+		// PIXELS_PER_CLOCK == 1.  The crop rectangle also requires
+		// LGINDEX >= 5, the default.
+		parameter [0:0]	OPT_CROP = 1'b0,
+		// LGINDEX: log_2 of the number of frame index table entries.
+		// Must be at least four, to leave room for the registers, or
+		// five to leave room for them all.
+		parameter	LGINDEX = 5,
+		localparam	PW = ((OPT_ALPHA) ? 32 : 24) * PIXELS_PER_CLOCK,
+		localparam	PERFW = 13*32
 		// }}}
 	) (
 		// {{{
@@ -64,7 +306,7 @@ module	qoi_recorder #(
 		// Control inputs
 		// {{{
 		input	wire		i_wb_cyc, i_wb_stb, i_wb_we,
-		input	wire	[1:0]	i_wb_addr,
+		input	wire [LGINDEX+1:0]	i_wb_addr,
 		input	wire	[31:0]	i_wb_data,
 		input	wire	[3:0]	i_wb_sel,
 		output	wire		o_wb_stall,
@@ -75,7 +317,7 @@ module	qoi_recorder #(
 		// {{{
 		input	wire		s_vid_valid,
 		output	wire		s_vid_ready,
-		input	wire	[23:0]	s_vid_data,
+		input	wire	[PW-1:0]	s_vid_data,
 		input	wire		s_vid_user, s_vid_last,
 		// }}}
 		// Outgoing WB/DMA interface
@@ -87,22 +329,56 @@ module	qoi_recorder #(
 		input	wire			i_dma_stall,
 		input	wire			i_dma_ack,
 		input	wire	[DW-1:0]	i_dma_data,
-		input	wire			i_dma_err
+		input	wire			i_dma_err,
 		// }}}
+		output	reg			o_int
 		// }}}
 	);
 
 	// Local declarations
 	// {{{
-	localparam	ADDR_CTRL= 0,
-			ADDR_MSW = 1,
-			ADDR_LSW = 2;
+	localparam	ADDR_CTRL  = 0,
+			ADDR_MSW   = 1,
+			ADDR_LSW   = 2,
+			ADDR_LEN   = 3,
+			ADDR_FRMLEN= 4,
+			ADDR_FRAMES= 5,
+			ADDR_STBYTES=6,
+			ADDR_STRUN = 7,
+			ADDR_STINDEX=8,
+			ADDR_STDIFF= 9,
+			ADDR_STLUMA=10,
+			ADDR_STRGB =11,
+			ADDR_STSTALL=12,
+			ADDR_STCOUNT=13,
+			ADDR_LBUDGET=14,
+			ADDR_FBUDGET=15,
+			ADDR_STBUDGET=16,
+			ADDR_PERF  =17,
+			ADDR_PERFLAST=29,
+			ADDR_DELTA = 30,
+			ADDR_DECIMATE = 31,
+			ADDR_CROPXY = 32,
+			ADDR_CROPWH = 33;
+	localparam	DB = DW/8;
+	localparam	OCW = $clog2(PIXELS_PER_CLOCK+1);
 
 	wire	soft_dma_reset;
 
 	wire	sel_valid, sel_ready, sel_last;
 	wire	[DW-1:0]		sel_data;
 	wire	[$clog2(DW/8)-1:0]	sel_bytes;
+	wire	[5*OCW-1:0]		sel_ops;
+
+	wire	[31:0]	stat_bytes, stat_run, stat_index, stat_diff,
+			stat_luma, stat_rgb, stat_stalls, stat_count,
+			stat_budget;
+	wire	[PERFW-1:0]	sel_perf, stat_perf;
+
+	reg	[15:0]	r_line_budget;
+	reg	[31:0]	r_frame_budget;
+	wire	[1:0]	enc_quant;
+	wire		enc_overrun;
 
 	wire				pix_valid, pix_ready, pix_last;
 	wire	[DW-1:0]		pix_data;
@@ -115,7 +391,10 @@ module	qoi_recorder #(
 	wire				fifo_valid, fifo_ready, fifo_last;
 	wire	[DW-1:0]		fifo_data;
 	wire	[$clog2(DW/8):0]	fifo_bytes;
-	reg				fifo_flush;
+	wire				fifo_flush;
+	reg	[LGFIFO:0]		fifo_lasts;
+	reg	[LGBURST:0]		burst_left;
+	wire	[LGBURST:0]		burst_len;
 
 	wire	afifo_full, afifo_empty;
 	wire	fifo_full,  fifo_empty, fifo_read;
@@ -125,9 +404,34 @@ module	qoi_recorder #(
 	reg	[AW+$clog2(DW/8)-1:0]	dma_address;
 	wire	[AW+$clog2(DW/8)-1:0]	base_addr;
 
-	reg	dma_request, vid_sync, dma_active;
+	reg	dma_request, vid_sync, dma_active, r_capture;
 	wire	dma_busy, dma_err;
 
+	wire			start_request, stop_request, final_frame;
+	reg			r_ring, r_stop, r_skip;
+	reg	[31:0]		r_ringlen, r_maxframe;
+	reg	[AW+$clog2(DW/8)-1:0]	r_base;
+	reg	[31:0]		frame_start, frame_bytes, frame_count;
+	wire			frame_beat, frame_end, frame_trunc, frame_wrap;
+	wire	[31:0]		frame_len;
+	wire	[32:0]		next_start;
+	wire	[AW+$clog2(DW/8)-1:0]	next_addr;
+	reg	[63:0]		frame_index	[0:(1<<LGINDEX)-1];
+	wire	[63:0]		index_data;
+
+	wire	fast_start, fast_ack;
+	reg	r_fast;
+
+	reg		r_delta, r_needkey, r_above;
+	reg	[7:0]	r_keyint;
+	wire		key_start;
+
+	// The crop rectangle needs registers beyond 0x7C, which only exist
+	// once there's room for them ahead of the index table
+	localparam [0:0] OPT_RECT = OPT_CROP && (LGINDEX >= 5);
+	reg	[15:0]	r_crop_x, r_crop_y, r_crop_w, r_crop_h;
+	reg	[7:0]	r_skip_x, r_skip_y, r_skip_frames;
+
 	reg	pix_reset, pix_reset_pipe;
 
 	always @(posedge i_pix_clk)
@@ -149,10 +453,29 @@ module	qoi_recorder #(
 	begin : GEN_QOI_COMPRESSION
 		wire	[DW-1:0]		lcl_data;
 		wire	[$clog2(DW/8)-1:0]	lcl_bytes;
+		wire				enc_restart, enc_restarted,
+						enc_keyframe;
+		wire				enc_delta, enc_above;
+		wire	[7:0]			enc_keyint;
+		wire	[15:0]			enc_line_budget;
+		wire	[31:0]			enc_frame_budget;
+		wire	[15:0]			enc_crop_x, enc_crop_y,
+						enc_crop_w, enc_crop_h;
+		wire	[7:0]			enc_skip_x, enc_skip_y,
+						enc_skip_frames;
 
 		qoi_encoder #(
 			.OPT_TUSER_IS_SOF(OPT_TUSER_IS_SOF),
-			.DW(DW)
+			.OPT_BUDGET(OPT_BUDGET),
+			.OPT_ALPHA(OPT_ALPHA),
+			.OPT_PERFCOUNTERS(OPT_PERFCOUNTERS && OPT_STATS),
+			.OPT_FASTSTART(OPT_FASTSTART),
+			.OPT_DELTA(OPT_DELTA),
+			.OPT_ABOVE(OPT_ABOVE),
+			.OPT_CROP(OPT_CROP),
+			.LGINFIFO(LGINFIFO),
+			.DW(DW),
+			.PIXELS_PER_CLOCK(PIXELS_PER_CLOCK)
 		) u_compress_video (
 			// {{{
 			.i_clk(i_pix_clk),
@@ -163,18 +486,231 @@ module	qoi_recorder #(
 			.s_data(s_vid_data),
 			.s_last(s_vid_last),
 			.s_user(s_vid_user),
+			.i_restart(enc_restart),
+			.o_restarted(enc_restarted),
 			//
 			.o_qvalid(sel_valid),
 			.i_qready(sel_ready),
 			.o_qdata(lcl_data),
 			.o_qbytes(lcl_bytes),
-			.o_qlast(sel_last)
+			.o_qlast(sel_last),
+			//
+			.o_ops(sel_ops),
+			//
+			.i_line_budget(enc_line_budget),
+			.i_frame_budget(enc_frame_budget),
+			.o_quant(enc_quant), .o_overrun(enc_overrun),
+			//
+			.i_delta(enc_delta), .i_keyframe(enc_keyframe),
+			.i_keyint(enc_keyint),
+			.i_above(enc_above),
+			//
+			.i_crop_x(enc_crop_x), .i_crop_y(enc_crop_y),
+			.i_crop_w(enc_crop_w), .i_crop_h(enc_crop_h),
+			.i_skip_x(enc_skip_x), .i_skip_y(enc_skip_y),
+			.i_skip_frames(enc_skip_frames),
+			//
+			.o_perf(sel_perf)
 			// }}}
 		);
 
 		assign	sel_data  = lcl_data;
 		assign	sel_bytes = lcl_bytes;
 
+		// Fast start
+		// {{{
+		// A fast start request is sent to the encoder with a toggle,
+		// and answered with another once the encoder has restarted.
+		// The answer always crosses back before the data from the end
+		// of the frame that preceded the restart, since that data
+		// must still make its way through the encoder's pipeline
+		// first, and through the same style of synchronizer.
+		if (OPT_FASTSTART)
+		begin : GEN_FASTSTART
+			reg		rq_toggle, ak_toggle;
+			reg	[2:0]	rq_pipe, ak_pipe;
+
+			always @(posedge i_clk)
+			if (i_reset)
+				rq_toggle <= 1'b0;
+			else if (start_request && fast_start)
+				rq_toggle <= !rq_toggle;
+
+			always @(posedge i_pix_clk)
+			if (pix_reset)
+				rq_pipe <= 0;
+			else
+				rq_pipe <= { rq_pipe[1:0], rq_toggle };
+
+			assign	enc_restart = (rq_pipe[2] != rq_pipe[1]);
+
+			always @(posedge i_pix_clk)
+			if (pix_reset)
+				ak_toggle <= 1'b0;
+			else if (enc_restarted)
+				ak_toggle <= !ak_toggle;
+
+			always @(posedge i_clk)
+			if (i_reset)
+				ak_pipe <= 0;
+			else
+				ak_pipe <= { ak_pipe[1:0], ak_toggle };
+
+			assign	fast_ack = (ak_pipe[2] != ak_pipe[1]);
+		end else begin : NO_FASTSTART
+			assign	enc_restart = 1'b0;
+			assign	fast_ack = 1'b0;
+
+			// Verilator coverage_off
+			// Verilator lint_off UNUSED
+			wire	unused_faststart;
+			assign	unused_faststart = &{ 1'b0, enc_restarted };
+			// Verilator lint_on  UNUSED
+			// Verilator coverage_on
+		end
+		// }}}
+
+		// Key frame requests
+		// {{{
+		// Every capture with delta frames starts by asking the encoder
+		// for a key frame, using a toggle as with the fast start.  No
+		// answer is needed, since key frames are recognized by their
+		// magic number.
+		if (OPT_DELTA)
+		begin : GEN_KEYFRAME
+			reg		kf_toggle;
+			reg	[2:0]	kf_pipe;
+
+			always @(posedge i_clk)
+			if (i_reset)
+				kf_toggle <= 1'b0;
+			else if (start_request && r_delta)
+				kf_toggle <= !kf_toggle;
+
+			always @(posedge i_pix_clk)
+			if (pix_reset)
+				kf_pipe <= 0;
+			else
+				kf_pipe <= { kf_pipe[1:0], kf_toggle };
+
+			assign	enc_keyframe = (kf_pipe[2] != kf_pipe[1]);
+		end else begin : NO_KEYFRAME
+			assign	enc_keyframe = 1'b0;
+		end
+		// }}}
+
+		// Settings
+		// {{{
+		// The encoder's settings are written on the bus clock, but used
+		// on the pixel clock.  They cross much as the statistics do, only
+		// in the other direction.  Following any write, they are copied
+		// into a set of holding registers, and a toggle is sent to the
+		// pixel clock domain.  The holding registers don't change again
+		// until the toggle has been answered, so the pixel side can copy
+		// them without any further synchronization.  Once across, they're
+		// only handed to the encoder as a frame leaves it, or while it's
+		// idle, so that no frame is ever encoded with a mix of old and
+		// new settings.  This is the frame boundary at the encoder's
+		// output, not at its input.  The encoder uses these settings
+		// all the way from its input to its output, and picks each
+		// frame's header (key or delta) once the frame before has left.
+		// Were delta frames enabled while the end of the last frame
+		// was still within it, it would then wait on line compares
+		// that were never made.  Likewise, a frame's "qoiv" header
+		// must match how every one of its pixels was predicted.
+		localparam	SETW = 16 + 32 + 10 + 4*16 + 3*8;
+
+		wire			set_write, set_load;
+		reg			set_pending, set_busy, set_toggle,
+					sa_toggle, px_busy;
+		reg	[2:0]		set_pipe, sa_pipe;
+		reg	[SETW-1:0]	bh_set, px_set, enc_set;
+
+		assign	set_write = i_wb_stb && !o_wb_stall && i_wb_we
+				&& (i_wb_addr == ADDR_LBUDGET
+					|| i_wb_addr == ADDR_FBUDGET
+					|| i_wb_addr == ADDR_DELTA
+					|| i_wb_addr == ADDR_DECIMATE
+					|| i_wb_addr == ADDR_CROPXY
+					|| i_wb_addr == ADDR_CROPWH);
+
+		always @(posedge i_clk)
+		if (i_reset)
+			set_pending <= 1'b0;
+		else if (set_write)
+			set_pending <= 1'b1;
+		else if (!set_busy)
+			set_pending <= 1'b0;
+
+		always @(posedge i_clk)
+		if (i_reset)
+		begin
+			set_toggle <= 1'b0;
+			set_busy   <= 1'b0;
+		end else if (!set_busy && set_pending)
+		begin
+			set_toggle <= !set_toggle;
+			set_busy   <= 1'b1;
+		end else if (sa_pipe[2] != sa_pipe[1])
+			set_busy   <= 1'b0;
+
+		always @(posedge i_clk)
+		if (i_reset)
+			bh_set <= 0;
+		else if (!set_busy && set_pending)
+			bh_set <= { r_line_budget, r_frame_budget,
+					r_delta, r_keyint, r_above,
+					r_crop_x, r_crop_y, r_crop_w, r_crop_h,
+					r_skip_x, r_skip_y, r_skip_frames };
+
+		// Cross into the pixel clock domain, and answer
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+			set_pipe <= 0;
+		else
+			set_pipe <= { set_pipe[1:0], set_toggle };
+
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+		begin
+			px_set    <= 0;
+			sa_toggle <= 1'b0;
+		end else if (set_pipe[2] != set_pipe[1])
+		begin
+			px_set    <= bh_set;
+			sa_toggle <= !sa_toggle;
+		end
+
+		always @(posedge i_clk)
+		if (i_reset)
+			sa_pipe <= 0;
+		else
+			sa_pipe <= { sa_pipe[1:0], sa_toggle };
+
+		// The encoder is idle once its last frame has left, and no more
+		// video has arrived since
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+			px_busy <= 1'b0;
+		else if (s_vid_valid)
+			px_busy <= 1'b1;
+		else if (sel_valid && sel_ready && sel_last)
+			px_busy <= 1'b0;
+
+		assign	set_load = (!px_busy && !s_vid_valid)
+				|| (sel_valid && sel_ready && sel_last);
+
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+			enc_set <= 0;
+		else if (set_load)
+			enc_set <= px_set;
+
+		assign	{ enc_line_budget, enc_frame_budget,
+				enc_delta, enc_keyint, enc_above,
+				enc_crop_x, enc_crop_y, enc_crop_w, enc_crop_h,
+				enc_skip_x, enc_skip_y, enc_skip_frames } = enc_set;
+		// }}}
 	end else begin : NO_COMPRESSION
 		wire	s_vid_hlast, s_vid_vlast;
 
@@ -183,10 +719,164 @@ module	qoi_recorder #(
 
 		assign	sel_valid = s_vid_valid;
 		assign	s_vid_ready = sel_ready;
-		assign	sel_data = { s_vid_data, {(DW-24){1'b0}} };
-		assign	sel_bytes = 3;
+		assign	sel_data = { s_vid_data, {(DW-PW){1'b0}} };
+		assign	sel_bytes = PW/8;
 		assign	sel_last = s_vid_hlast && s_vid_vlast;
+		assign	sel_ops  = 0;
+		assign	sel_perf = 0;
+		assign	enc_quant   = 2'b00;
+		assign	enc_overrun = 1'b0;
+		assign	fast_ack    = 1'b0;
+
+	end endgenerate
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Compression statistics
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Statistics are accumulated in the pixel clock domain.  At the end of
+	// every frame, they are copied into a set of holding registers, and
+	// a toggle is sent to the bus clock domain.  Since these holding
+	// registers then remain constant for (roughly) a frame time, the bus
+	// side, once it sees the toggle, can copy them without any further
+	// synchronization.
+	//
+
+	generate if (OPT_STATS)
+	begin : GEN_STATS
+		// {{{
+		wire		pc_end;
+		wire	[$clog2(DW/8):0]	pc_nbytes;
+		reg	[31:0]	pc_bytes, pc_run, pc_index, pc_diff, pc_luma,
+				pc_rgb, pc_stalls;
+		reg	[31:0]	nx_bytes, nx_run, nx_index, nx_diff, nx_luma,
+				nx_rgb, nx_stalls;
+		reg	[1:0]	pc_quant, nx_quant;
+		reg		pc_overrun, nx_overrun;
+		reg	[7*32+3-1:0]	ph_stats;
+		reg		pc_toggle;
+
+		reg	[2:0]		st_pipe;
+		reg	[7*32+3-1:0]	st_stats;
+		reg	[31:0]		st_count;
+
+		reg	[PERFW-1:0]	ph_perf, st_perf;
+
+		assign	pc_end = sel_valid && sel_ready && sel_last;
+		assign	pc_nbytes = (sel_bytes == 0) ? DB : { 1'b0, sel_bytes };
+
+		always @(*)
+		begin
+			nx_bytes  = pc_bytes;
+			if (sel_valid && sel_ready)
+				// Verilator lint_off WIDTH
+				nx_bytes  = pc_bytes + pc_nbytes;
+				// Verilator lint_on  WIDTH
+
+			nx_run    = pc_run   + { {(32-OCW){1'b0}}, sel_ops[4*OCW +: OCW] };
+			nx_index  = pc_index + { {(32-OCW){1'b0}}, sel_ops[3*OCW +: OCW] };
+			nx_diff   = pc_diff  + { {(32-OCW){1'b0}}, sel_ops[2*OCW +: OCW] };
+			nx_luma   = pc_luma  + { {(32-OCW){1'b0}}, sel_ops[1*OCW +: OCW] };
+			nx_rgb    = pc_rgb   + { {(32-OCW){1'b0}}, sel_ops[0*OCW +: OCW] };
+			nx_stalls = pc_stalls
+				+ ((s_vid_valid && !s_vid_ready) ? 32'h1 : 32'h0);
+
+			nx_quant  = (enc_quant > pc_quant) ? enc_quant : pc_quant;
+			nx_overrun= pc_overrun || enc_overrun;
+		end
+
+		always @(posedge i_pix_clk)
+		if (pix_reset || pc_end)
+		begin
+			pc_bytes  <= 0;
+			pc_run    <= 0;
+			pc_index  <= 0;
+			pc_diff   <= 0;
+			pc_luma   <= 0;
+			pc_rgb    <= 0;
+			pc_stalls <= 0;
+			pc_quant  <= 0;
+			pc_overrun<= 0;
+		end else begin
+			pc_bytes  <= nx_bytes;
+			pc_run    <= nx_run;
+			pc_index  <= nx_index;
+			pc_diff   <= nx_diff;
+			pc_luma   <= nx_luma;
+			pc_rgb    <= nx_rgb;
+			pc_stalls <= nx_stalls;
+			pc_quant  <= nx_quant;
+			pc_overrun<= nx_overrun;
+		end
+
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+			ph_stats <= 0;
+		else if (pc_end)
+			ph_stats <= { nx_bytes, nx_run, nx_index, nx_diff,
+					nx_luma, nx_rgb, nx_stalls,
+					nx_overrun, nx_quant };
+
+		// The encoder updates sel_perf a few clocks before the end of
+		// the frame it describes, so it can be captured along with
+		// everything else.  It is zero without OPT_PERFCOUNTERS.
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+			ph_perf <= 0;
+		else if (pc_end)
+			ph_perf <= sel_perf;
+
+		always @(posedge i_pix_clk)
+		if (pix_reset)
+			pc_toggle <= 1'b0;
+		else if (pc_end)
+			pc_toggle <= !pc_toggle;
+
+		// Cross into the bus clock domain
+		always @(posedge i_clk)
+		if (i_reset)
+			st_pipe <= 0;
+		else
+			st_pipe <= { st_pipe[1:0], pc_toggle };
+
+		always @(posedge i_clk)
+		if (i_reset)
+		begin
+			st_stats <= 0;
+			st_perf  <= 0;
+			st_count <= 0;
+		end else if (st_pipe[2] != st_pipe[1])
+		begin
+			st_stats <= ph_stats;
+			st_perf  <= ph_perf;
+			st_count <= st_count + 1;
+		end
+
+		assign	{ stat_bytes, stat_run, stat_index, stat_diff,
+				stat_luma, stat_rgb, stat_stalls,
+				stat_budget[31], stat_budget[1:0] } = st_stats;
+		assign	stat_budget[30:2] = 0;
+		assign	stat_count = st_count;
+		assign	stat_perf  = st_perf;
+		// }}}
+	end else begin : NO_STATS
+		// {{{
+		assign	{ stat_bytes, stat_run, stat_index, stat_diff,
+				stat_luma, stat_rgb, stat_stalls } = 0;
+		assign	stat_count  = 0;
+		assign	stat_budget = 0;
+		assign	stat_perf   = 0;
 
+		// Verilator coverage_off
+		// Verilator lint_off UNUSED
+		wire	unused_stats;
+		assign	unused_stats = &{ 1'b0, sel_ops, enc_quant, enc_overrun,
+						sel_perf };
+		// Verilator lint_on  UNUSED
+		// Verilator coverage_on
+		// }}}
 	end endgenerate
 	// }}}
 	////////////////////////////////////////////////////////////////////////
@@ -223,6 +913,8 @@ module	qoi_recorder #(
 	////////////////////////////////////////////////////////////////////////
 	//
 	// Need to cross here from the pixel clock to the memory clock domain.
+	// By now, the video has been compressed and packed into full bus
+	// words, so this crossing only carries the compressed stream.
 	//
 	// No particular FIFO depth is required here, since we're just going
 	// straight to another FIFO.  That second FIFO will have the depth.
@@ -231,7 +923,7 @@ module	qoi_recorder #(
 	//
 
 	afifo #(
-		.LGFIFO(3), .WIDTH(2+$clog2(DW/8)+DW)
+		.LGFIFO(LGAFIFO), .WIDTH(2+$clog2(DW/8)+DW)
 	) u_afifo (
 		.i_wclk(i_pix_clk), .i_wr_reset_n(!pix_reset),
 		.i_wr(pix_valid),
@@ -273,7 +965,8 @@ module	qoi_recorder #(
 
 	assign	pxm_ready  = !fifo_full;
 	assign	fifo_valid = !fifo_empty;
-	assign	fifo_read  = (fifo_ready && fifo_flush) || !dma_active;
+	assign	fifo_read  = (fifo_ready && fifo_flush) || (!dma_active && !key_start)
+				|| r_skip;
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -283,34 +976,152 @@ module	qoi_recorder #(
 	//
 	//
 
+	// For a fast start, the capture waits until the encoder has
+	// restarted.  The next frame end is then that of the frame that was
+	// cut short, and the capture begins with the frame after it.
 	always @(posedge i_clk)
 	if (i_reset)
 		vid_sync <= 1'b1;
+	else if (r_fast && fast_ack)
+		vid_sync <= 1'b0;
 	else if (fifo_read && !fifo_empty && fifo_last)
 		vid_sync <= 1'b1;
 	else if (fifo_read && !fifo_empty && !dma_active)
 		vid_sync <= 1'b0;
 
+	// With delta frames, the capture instead waits for a key frame.  Since
+	// vid_sync is only set between frames, the word at the head of the
+	// FIFO is then the start of a frame, and it is kept there once it is
+	// seen to be the start of a key frame.
+	assign	key_start = OPT_COMPRESS && OPT_DELTA && r_needkey
+			&& !dma_active && dma_request && vid_sync && !r_fast
+			&& !fifo_empty && fifo_data[DW-1 -: 32] == "qoif";
+
 	always @(posedge i_clk)
 	if (i_reset)
 		dma_active <= 1'b0;
 	else if (!dma_active)
 	begin
-		if ((dma_request || dma_busy) && vid_sync)
+		if (OPT_COMPRESS && OPT_DELTA && r_needkey)
+			dma_active <= key_start;
+		else if (dma_request && vid_sync && !r_fast)
 			dma_active <= !fifo_read || fifo_empty;
-	end else if (fifo_read && !fifo_empty && fifo_last && !dma_request)
+	end else if (fifo_read && !fifo_empty && fifo_last
+				&& (!dma_request || final_frame))
 		dma_active <= 1'b0;
 
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Group the outgoing data into aligned bursts
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// A burst runs from the current address to the next burst boundary.
+	// It's only released to the DMA once the FIFO holds all of it, or once
+	// the FIFO holds the end of a frame, so that every burst is written
+	// back to back.  Since each frame starts on a word boundary, only the
+	// first burst of a frame, and its last, can be short.
+	//
+
+	// Count the number of frame ends waiting in the FIFO
 	always @(posedge i_clk)
 	if (i_reset)
-		fifo_flush <= 1'b0;
-	else if (fifo_read && fifo_empty)
-		fifo_flush <= 1'b0;
-	else if (pxm_valid && pxm_last)
-		fifo_flush <= 1'b1;
-	else if (fifo_fill[LGFIFO:LGFIFO-1] != 2'b00)
-		fifo_flush <= 1'b1;
+		fifo_lasts <= 0;
+	else case({ pxm_valid && pxm_ready && pxm_last,
+			fifo_read && !fifo_empty && fifo_last })
+	2'b10: fifo_lasts <= fifo_lasts + 1;
+	2'b01: fifo_lasts <= fifo_lasts - 1;
+	default: begin end
+	endcase
+
+	// Verilator lint_off WIDTH
+	assign	burst_len = (1<<LGBURST) - (dma_address[AW+$clog2(DW/8)-1:$clog2(DW/8)]
+						& ((1<<LGBURST)-1));
 
+	always @(posedge i_clk)
+	if (i_reset)
+		burst_left <= 0;
+	else if (burst_left != 0)
+	begin
+		// Any frame end cuts the burst short, since the next frame
+		// will start at a new (word aligned) address
+		if (frame_end)
+			burst_left <= 0;
+		else if (frame_beat)
+			burst_left <= burst_left - 1;
+	end else if (dma_active && !r_skip && !fifo_empty
+			&& (fifo_lasts != 0 || fifo_fill >= burst_len))
+		burst_left <= burst_len;
+	// Verilator lint_on  WIDTH
+
+	assign	fifo_flush = (burst_left != 0);
+
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Frame boundaries, ring buffer wrapping, and the frame index
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	// frame_beat is true for every beat written to memory.  A frame ends
+	// either at its last beat, or (in ring buffer mode) once another full
+	// bus word would no longer fit within the maximum frame length.  In
+	// that case, the DMA is told this is the last beat of the frame, and
+	// the rest of the frame is skipped.  At the end of every frame, we
+	// decide where the next one will start, so the address is ready before
+	// the DMA starts its next transfer.
+	//
+
+	assign	frame_beat = dma_active && fifo_read && !fifo_empty && !r_skip;
+
+	// Verilator lint_off WIDTH
+	assign	frame_len  = frame_bytes + fifo_bytes;
+	assign	frame_trunc= r_ring && !fifo_last
+				&& ({ 1'b0, frame_len } + DB > { 1'b0, r_maxframe });
+	// The next frame starts at the next whole bus word
+	assign	next_start = (frame_start + frame_len + DB-1)
+				& ~((1<<$clog2(DW/8))-1);
+	assign	next_addr = (dma_address + fifo_bytes + DB-1)
+				& ~((1<<$clog2(DW/8))-1);
+	assign	frame_wrap = r_ring
+				&& ({ 1'b0, next_start } + r_maxframe > r_ringlen);
+	// Verilator lint_on  WIDTH
+	assign	frame_end  = frame_beat && (fifo_last || frame_trunc);
+
+	always @(posedge i_clk)
+	if (i_reset)
+		r_skip <= 1'b0;
+	else if (fifo_read && !fifo_empty && fifo_last)
+		r_skip <= 1'b0;
+	else if (frame_beat && frame_trunc)
+		r_skip <= 1'b1;
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		frame_start <= 0;
+		frame_bytes <= 0;
+		frame_count <= 0;
+	end else if (start_request)
+	begin
+		frame_start <= 0;
+		frame_bytes <= 0;
+		frame_count <= 0;
+	end else if (frame_end)
+	begin
+		frame_start <= (frame_wrap) ? 0 : next_start[31:0];
+		frame_bytes <= 0;
+		frame_count <= frame_count + 1;
+	end else if (frame_beat)
+		frame_bytes <= frame_len;
+
+	always @(posedge i_clk)
+	if (frame_end)
+		frame_index[frame_count[LGINDEX-1:0]]
+				<= { frame_start, frame_trunc, frame_len[30:0] };
+
+	assign	index_data = frame_index[i_wb_addr[LGINDEX:1]];
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -329,9 +1140,10 @@ module	qoi_recorder #(
 		// Always increment.  Size is always the full bus size.
 		.i_inc(1'b1), .i_size(2'b00), .i_addr(base_addr),
 		//
-		.S_VALID(fifo_valid && dma_active && fifo_flush),
+		.S_VALID(fifo_valid && dma_active && fifo_flush && !r_skip),
 				.S_READY(fifo_ready),
-		.S_DATA(fifo_data), .S_BYTES(fifo_bytes), .S_LAST(fifo_last),
+		.S_DATA(fifo_data), .S_BYTES(fifo_bytes),
+				.S_LAST(fifo_last || frame_trunc),
 		//
 		.o_wr_cyc(o_dma_cyc), .o_wr_stb(o_dma_stb), .o_wr_we(o_dma_we),
 		.o_wr_addr(o_dma_addr), .o_wr_data(o_dma_data),
@@ -348,33 +1160,186 @@ module	qoi_recorder #(
 	assign	o_wb_stall = 1'b0;
 	assign	soft_dma_reset = 1'b0;
 
+	// A capture may start if the address has been set, and either a
+	// frame count is given or ring buffer mode is requested.  Ring buffer
+	// mode also requires a valid ring and frame length.
+	assign	start_request = i_wb_stb && !o_wb_stall && i_wb_we
+			&& !dma_request && i_wb_addr == ADDR_CTRL
+			&& i_wb_sel[1:0] == 2'b11 && dma_address != 0
+			&& ((!i_wb_sel[2] || !i_wb_data[16])
+				? (i_wb_data[15:0] != 0)
+				: (r_maxframe != 0 && r_maxframe <= r_ringlen));
+
+	assign	stop_request = i_wb_stb && !o_wb_stall && i_wb_we
+			&& dma_request && i_wb_addr == ADDR_CTRL
+			&& i_wb_sel[1:0] == 2'b11 && i_wb_data[15:0] == 0;
+
+	assign	fast_start = OPT_COMPRESS && OPT_FASTSTART
+				&& i_wb_sel[2] && i_wb_data[17];
+
+	// True if the frame being written is the last one of the capture
+	assign	final_frame = r_stop || (!r_ring && nframes <= 1);
+
 	always @(posedge i_clk)
 	if (i_reset)
 	begin
 		nframes <= 0;
 		dma_request <= 0;
+		r_ring <= 0;
+		r_stop <= 0;
 	end else if (dma_err || (o_dma_cyc && i_dma_err))
 	begin
 		dma_request <= 0;
 		nframes <= 0;
+		r_stop <= 0;
 	end else begin
 		if (dma_active && fifo_read && !fifo_empty && fifo_last)
 		begin
-			if (nframes > 0)
+			if (!r_ring && nframes > 0)
 				nframes <= nframes - 1;
-			if (nframes <= 1)
+			if (final_frame)
+			begin
 				dma_request <= 0;
+				r_stop <= 0;
+			end
 		end
 
-		if (i_wb_stb && !o_wb_stall && !dma_request && i_wb_addr == 0
-				&& i_wb_sel[1:0] == 2'b11
-				&& i_wb_data[15:0] != 0 && dma_address != 0)
+		if (stop_request)
+		begin
+			// Stop immediately if we are between frames, otherwise
+			// once the current frame has been written
+			if (!dma_active)
+				dma_request <= 0;
+			else
+				r_stop <= 1'b1;
+		end
+
+		if (start_request)
 		begin
 			nframes <= i_wb_data[15:0];
+			r_ring  <= i_wb_sel[2] && i_wb_data[16];
+			r_stop  <= 1'b0;
 			dma_request <= 1'b1;
 		end
 	end
 
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_line_budget  <= 0;
+		r_frame_budget <= 0;
+	end else if (OPT_BUDGET && i_wb_stb && !o_wb_stall && i_wb_we)
+	begin
+		if (i_wb_addr == ADDR_LBUDGET)
+		begin
+			if (i_wb_sel[0]) r_line_budget[ 7: 0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1]) r_line_budget[15: 8] <= i_wb_data[15: 8];
+		end
+
+		if (i_wb_addr == ADDR_FBUDGET)
+		begin
+			if (i_wb_sel[0]) r_frame_budget[ 7: 0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1]) r_frame_budget[15: 8] <= i_wb_data[15: 8];
+			if (i_wb_sel[2]) r_frame_budget[23:16] <= i_wb_data[23:16];
+			if (i_wb_sel[3]) r_frame_budget[31:24] <= i_wb_data[31:24];
+		end
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_delta  <= 1'b0;
+		r_keyint <= 0;
+	end else if (OPT_COMPRESS && OPT_DELTA && i_wb_stb && !o_wb_stall
+				&& i_wb_we && i_wb_addr == ADDR_DELTA)
+	begin
+		if (i_wb_sel[0]) r_keyint <= i_wb_data[7:0];
+		if (i_wb_sel[3]) r_delta  <= i_wb_data[31];
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+		r_above <= 1'b0;
+	else if (OPT_COMPRESS && OPT_ABOVE && i_wb_stb && !o_wb_stall
+				&& i_wb_we && i_wb_addr == ADDR_DELTA
+				&& i_wb_sel[3])
+		r_above <= i_wb_data[30];
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_skip_x      <= 0;
+		r_skip_y      <= 0;
+		r_skip_frames <= 0;
+	end else if (OPT_COMPRESS && OPT_CROP && i_wb_stb && !o_wb_stall
+				&& i_wb_we && i_wb_addr == ADDR_DECIMATE)
+	begin
+		if (i_wb_sel[0]) r_skip_x      <= i_wb_data[ 7: 0];
+		if (i_wb_sel[1]) r_skip_y      <= i_wb_data[15: 8];
+		if (i_wb_sel[2]) r_skip_frames <= i_wb_data[23:16];
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_crop_x <= 0;
+		r_crop_y <= 0;
+		r_crop_w <= 0;
+		r_crop_h <= 0;
+	end else if (OPT_COMPRESS && OPT_RECT && i_wb_stb && !o_wb_stall
+				&& i_wb_we)
+	begin
+		// Verilator lint_off WIDTH
+		if (i_wb_addr == ADDR_CROPXY)
+		begin
+			if (i_wb_sel[0]) r_crop_y[ 7:0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1]) r_crop_y[15:8] <= i_wb_data[15: 8];
+			if (i_wb_sel[2]) r_crop_x[ 7:0] <= i_wb_data[23:16];
+			if (i_wb_sel[3]) r_crop_x[15:8] <= i_wb_data[31:24];
+		end
+
+		if (i_wb_addr == ADDR_CROPWH)
+		begin
+			if (i_wb_sel[0]) r_crop_h[ 7:0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1]) r_crop_h[15:8] <= i_wb_data[15: 8];
+			if (i_wb_sel[2]) r_crop_w[ 7:0] <= i_wb_data[23:16];
+			if (i_wb_sel[3]) r_crop_w[15:8] <= i_wb_data[31:24];
+		end
+		// Verilator lint_on  WIDTH
+	end
+
+	always @(posedge i_clk)
+	if (i_reset)
+		r_needkey <= 1'b0;
+	else if (start_request)
+		r_needkey <= r_delta;
+	else if (key_start || !dma_request)
+		r_needkey <= 1'b0;
+
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		r_ringlen  <= 0;
+		r_maxframe <= 0;
+	end else if (i_wb_stb && !o_wb_stall && i_wb_we && !dma_request)
+	begin
+		if (i_wb_addr == ADDR_LEN)
+		begin
+			if (i_wb_sel[0]) r_ringlen[ 7: 0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1]) r_ringlen[15: 8] <= i_wb_data[15: 8];
+			if (i_wb_sel[2]) r_ringlen[23:16] <= i_wb_data[23:16];
+			if (i_wb_sel[3]) r_ringlen[31:24] <= i_wb_data[31:24];
+		end
+
+		if (i_wb_addr == ADDR_FRMLEN)
+		begin
+			if (i_wb_sel[0]) r_maxframe[ 7: 0] <= i_wb_data[ 7: 0];
+			if (i_wb_sel[1]) r_maxframe[15: 8] <= i_wb_data[15: 8];
+			if (i_wb_sel[2]) r_maxframe[23:16] <= i_wb_data[23:16];
+			if (i_wb_sel[3]) r_maxframe[31:24] <= i_wb_data[31:24];
+		end
+	end
+
 	always @(*)
 	begin
 		wide_dma_address = { {(64-AW-$clog2(DW/8)){1'b0}}, dma_address };
@@ -410,7 +1375,9 @@ module	qoi_recorder #(
 	begin
 		dma_address <= 0;
 	end else begin
-		if (dma_active && fifo_read && !fifo_empty)
+		if (frame_end)
+			dma_address <= (frame_wrap) ? r_base : next_addr;
+		else if (frame_beat)
 		begin
 			// Verilator lint_off WIDTH
 			dma_address <= dma_address + fifo_bytes;
@@ -420,23 +1387,67 @@ module	qoi_recorder #(
 		if (i_wb_stb && !o_wb_stall && !dma_busy && !dma_request
 				&& (i_wb_addr == 1 || i_wb_addr == 2))
 		begin
-			dma_address[AW+$clog2(DW/8)-1:0] <= wide_dma_address[AW+$clog2(DW/8)-1:0];
+			dma_address <= { wide_dma_address[AW+$clog2(DW/8)-1:$clog2(DW/8)],
+						{($clog2(DW/8)){1'b0}} };
 		end
 	end
 
 	assign	base_addr = dma_address;
 
+	always @(posedge i_clk)
+	if (i_reset)
+		r_base <= 0;
+	else if (start_request)
+		r_base <= dma_address;
+
+	always @(posedge i_clk)
+	if (i_reset)
+		r_fast <= 1'b0;
+	else if (start_request)
+		r_fast <= fast_start;
+	else if (!dma_request || fast_ack)
+		r_fast <= 1'b0;
+
 	initial	o_wb_data = 0;
 	always @(posedge i_clk)
-	if (i_wb_stb)
+	if (i_wb_stb && i_wb_addr[LGINDEX+1])
+		o_wb_data <= (i_wb_addr[0]) ? index_data[31:0] : index_data[63:32];
+	else if (i_wb_stb)
 	begin
 		case(i_wb_addr)
 		ADDR_CTRL: o_wb_data
 			<= { dma_request, dma_busy, dma_err, dma_active,
-				vid_sync, 11'h0, nframes };
+				vid_sync, r_ring, r_stop, r_fast, 8'h0, nframes };
 		ADDR_LSW: o_wb_data <= wide_dma_address[31:0];
 		ADDR_MSW: o_wb_data <= wide_dma_address[63:32];
-		default: o_wb_data <= 0;
+		ADDR_LEN: o_wb_data <= r_ringlen;
+		ADDR_FRMLEN: o_wb_data <= r_maxframe;
+		ADDR_FRAMES: o_wb_data <= frame_count;
+		ADDR_STBYTES: o_wb_data <= stat_bytes;
+		ADDR_STRUN:   o_wb_data <= stat_run;
+		ADDR_STINDEX: o_wb_data <= stat_index;
+		ADDR_STDIFF:  o_wb_data <= stat_diff;
+		ADDR_STLUMA:  o_wb_data <= stat_luma;
+		ADDR_STRGB:   o_wb_data <= stat_rgb;
+		ADDR_STSTALL: o_wb_data <= stat_stalls;
+		ADDR_STCOUNT: o_wb_data <= stat_count;
+		ADDR_LBUDGET: o_wb_data <= { 16'h0, r_line_budget };
+		ADDR_FBUDGET: o_wb_data <= r_frame_budget;
+		ADDR_STBUDGET: o_wb_data <= stat_budget;
+		ADDR_DELTA: o_wb_data <= { r_delta, r_above, 22'h0, r_keyint };
+		ADDR_DECIMATE: o_wb_data <= { 8'h0, r_skip_frames, r_skip_y,
+							r_skip_x };
+		default: begin
+			o_wb_data <= 0;
+			// Verilator lint_off WIDTH
+			if (i_wb_addr >= ADDR_PERF && i_wb_addr <= ADDR_PERFLAST)
+				o_wb_data <= stat_perf[PERFW-1-32*(i_wb_addr-ADDR_PERF) -: 32];
+			if (OPT_RECT && i_wb_addr == ADDR_CROPXY)
+				o_wb_data <= { r_crop_x, r_crop_y };
+			if (OPT_RECT && i_wb_addr == ADDR_CROPWH)
+				o_wb_data <= { r_crop_w, r_crop_h };
+			// Verilator lint_on  WIDTH
+			end
 		endcase
 	end
 
@@ -447,12 +1458,29 @@ module	qoi_recorder #(
 		o_wb_ack <= i_wb_stb && !o_wb_stall;
 
 	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Interrupt
+	// {{{
+	// Pulses once a capture has ended, and the DMA has finished writing it
+	always @(posedge i_clk)
+	if (i_reset)
+		r_capture <= 1'b0;
+	else
+		r_capture <= dma_request || dma_busy;
+
+	always @(posedge i_clk)
+	if (i_reset)
+		o_int <= 1'b0;
+	else
+		o_int <= r_capture && !dma_request && !dma_busy;
+	// }}}
 
 	// Keep Verilator happy
 	// {{{
 	// Verilator coverage_off
 	// Verilator lint_off UNUSED
-	wire	unused = &{ 1'b0, i_wb_cyc, fifo_fill };
+	wire	unused = &{ 1'b0, i_wb_cyc, next_start[32] };
 	// Verilator lint_on  UNUSED
 	// Verilator coverage_on
 	// }}}
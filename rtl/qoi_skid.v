@@ -51,6 +51,20 @@
 //	OPT_PASSTHROUGH
 //		Turns the skid buffer into a passthrough.  Used for formal
 //		verification only.
+//
+//	LGDEPTH
+//		If zero, the default, this is the two entry skid buffer above.
+//		Otherwise, the skid buffer is replaced by a FIFO of 2^LGDEPTH
+//		words, followed by a registered output, so that up to
+//		2^LGDEPTH+1 words may be held before o_ready drops.  This
+//		allows a burst of stalls downstream to be absorbed, rather
+//		than passed back upstream.  The FIFO is read asynchronously,
+//		so it may be placed in distributed (LUT) RAM.  When the FIFO
+//		is empty, incoming data goes straight to the output register,
+//		so the latency is still a single clock.  o_ready depends only
+//		on registers.  The outputs are always registered, so
+//		OPT_OUTREG is ignored, and OPT_LOWPOWER applies to o_data
+//		only.
 // }}}
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -91,7 +105,8 @@ module qoi_skid #(
 		//
 		parameter	[0:0]	OPT_PASSTHROUGH = 0,
 		parameter		DW = 8,
-		parameter	[0:0]	OPT_INITIAL = 1'b1
+		parameter	[0:0]	OPT_INITIAL = 1'b1,
+		parameter		LGDEPTH = 0
 		// }}}
 	) (
 		// {{{
@@ -128,6 +143,126 @@ module qoi_skid #(
 		// }}}
 		// Verilator lint_on  UNUSED
 		// }}}
+	end else if (LGDEPTH > 0)
+	begin : FIFO
+		// {{{
+		localparam	DEPTH = (1<<LGDEPTH);
+
+		reg	[DW-1:0]	mem	[0:DEPTH-1];
+		reg	[LGDEPTH:0]	wr_addr, rd_addr;
+		reg			ro_valid;
+		wire	[LGDEPTH:0]	fill;
+		wire			w_empty, w_load, w_bypass, w_write, w_read;
+
+		assign	fill    = wr_addr - rd_addr;
+		assign	w_empty = (fill == 0);
+
+		// The output register may be (re)loaded
+		assign	w_load   = !o_valid || i_ready;
+		// Incoming data bypasses an empty FIFO
+		assign	w_bypass = w_load && w_empty;
+		assign	w_write  = i_valid && o_ready && !w_bypass;
+		assign	w_read   = w_load && !w_empty;
+
+		// Pointers
+		// {{{
+		initial if (OPT_INITIAL) wr_addr = 0;
+		always @(posedge i_clk)
+		if (i_reset)
+			wr_addr <= 0;
+		else if (w_write)
+			wr_addr <= wr_addr + 1;
+
+		initial if (OPT_INITIAL) rd_addr = 0;
+		always @(posedge i_clk)
+		if (i_reset)
+			rd_addr <= 0;
+		else if (w_read)
+			rd_addr <= rd_addr + 1;
+		// }}}
+
+		// The FIFO memory itself
+		// {{{
+		always @(posedge i_clk)
+		if (w_write)
+			mem[wr_addr[LGDEPTH-1:0]] <= i_data;
+		// }}}
+
+		// o_ready
+		// {{{
+		assign	o_ready = !fill[LGDEPTH];
+		// }}}
+
+		// o_valid
+		// {{{
+		initial if (OPT_INITIAL) ro_valid = 0;
+		always @(posedge i_clk)
+		if (i_reset)
+			ro_valid <= 0;
+		else if (w_load)
+			ro_valid <= !w_empty || i_valid;
+
+		assign	o_valid = ro_valid;
+		// }}}
+
+		// o_data
+		// {{{
+		initial if (OPT_INITIAL) o_data = 0;
+		always @(posedge i_clk)
+		if (OPT_LOWPOWER && i_reset)
+			o_data <= 0;
+		else if (w_load)
+		begin
+			if (!w_empty)
+				o_data <= mem[rd_addr[LGDEPTH-1:0]];
+			else if (!OPT_LOWPOWER || i_valid)
+				o_data <= i_data;
+			else
+				o_data <= 0;
+		end
+		// }}}
+
+		assign	w_data = 0;
+
+		// Formal properties of the FIFO
+		// {{{
+`ifdef	FORMAL
+		(* anyconst *)	reg	[LGDEPTH:0]	f_addr;
+		reg	[DW-1:0]	f_data;
+		wire	[LGDEPTH:0]	f_offset;
+		reg			f_read;
+
+		// Never more than DEPTH words, and the output is never idle
+		// while any remain in the FIFO
+		always @(*)
+		if (!i_reset)
+		begin
+			assert(fill <= DEPTH);
+			if (!w_empty)
+				assert(o_valid);
+		end
+
+		// Follow one word, written to f_addr, through the FIFO
+		always @(posedge i_clk)
+		if (w_write && wr_addr == f_addr)
+			f_data <= i_data;
+
+		assign	f_offset = f_addr - rd_addr;
+
+		always @(*)
+		if (!i_reset && f_offset < fill)
+			assert(mem[f_addr[LGDEPTH-1:0]] == f_data);
+
+		initial	f_read = 0;
+		always @(posedge i_clk)
+			f_read <= !i_reset && w_read && rd_addr == f_addr;
+
+		always @(*)
+		if (!i_reset && f_read)
+			assert(o_valid && o_data == f_data);
+`endif
+		// }}}
+		// }}}
 	end else begin : LOGIC
 		// We'll start with skid buffer itself
 		// {{{
@@ -336,26 +471,32 @@ module qoi_skid #(
 
 		// Rule #2:
 		//	All incoming data must either go directly to the
-		//	output port, or into the skid buffer
+		//	output port, or into the skid buffer.  (The FIFO's
+		//	own properties are found with it, above.)
 		// {{{
+		if (LGDEPTH == 0)
+		begin : F_SKID
 `ifndef	VERIFIC
-		always @(posedge i_clk)
-		if (f_past_valid && !$past(i_reset) && $past(i_valid && o_ready
-			&& (!OPT_OUTREG || o_valid) && !i_ready))
-			assert(!o_ready && w_data == $past(i_data));
+			always @(posedge i_clk)
+			if (f_past_valid && !$past(i_reset)
+				&& $past(i_valid && o_ready
+				&& (!OPT_OUTREG || o_valid) && !i_ready))
+				assert(!o_ready && w_data == $past(i_data));
 `else
-		assert property (@(posedge i_clk)
-			disable iff (i_reset)
-			(i_valid && o_ready
+			assert property (@(posedge i_clk)
+				disable iff (i_reset)
+				(i_valid && o_ready
 				&& (!OPT_OUTREG || o_valid) && !i_ready)
 				|=> (!o_ready && w_data == $past(i_data)));
 `endif
+		end
 		// }}}
 
 		// Rule #3:
-		//	After the last transaction, o_valid should become idle
+		//	After the last transaction, o_valid should become idle,
+		//	unless there's more waiting in the FIFO
 		// {{{
-		if (!OPT_OUTREG)
+		if (LGDEPTH == 0 && !OPT_OUTREG)
 		begin
 			// {{{
 			always @(posedge i_clk)
@@ -374,7 +515,8 @@ module qoi_skid #(
 				if ($past(i_valid && o_ready))
 					assert(o_valid);
 
-				if ($past(!i_valid && o_ready && i_ready))
+				if (LGDEPTH == 0
+					&& $past(!i_valid && o_ready && i_ready))
 					assert(!o_valid);
 			end
 			// }}}
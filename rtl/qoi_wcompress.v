@@ -0,0 +1,936 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	rtl/qoi_wcompress.v
+// {{{
+// Project:	Quite OK image compression (QOI)
+//
+// Purpose:	A multiple pixel per clock version of qoi_compress.  This
+//		encoder accepts PIXELS_PER_CLOCK pixels per beat, and produces
+//	the same compressed stream qoi_compress would produce given the same
+//	image one pixel at a time.  As with qoi_compress, it doesn't handle
+//	header or trailer insertions, nor does it handle ALPHA.
+//
+//	The input is an AXI video stream, where each beat contains
+//	PIXELS_PER_CLOCK pixels.  The first pixel (in time) is found in the
+//	MSBs of the beat, so ...
+//		s_vid_data[24*PIXELS_PER_CLOCK-1 -: 24] is the first pixel,
+//		s_vid_data[23:0] is the last pixel.
+//	HLAST and VLAST are as in qoi_compress, save that they apply to the
+//	beat as a whole.  Image widths must therefore be a multiple of
+//	PIXELS_PER_CLOCK, and HLAST && VLAST is only ever true for the beat
+//	containing the last pixel of the frame.
+//
+//	The output is an AXI byte stream containing between 1 and
+//	4*PIXELS_PER_CLOCK bytes per beat, with the first byte always packed
+//	into the MSB.  BYTES contains the number of valid bytes in each beat,
+//	with 0 representing a full beat.  LAST is true on the last DATA beat
+//	of any image.
+//
+//	Internally, lane k of any beat is held in bits [24*k +: 24] of the
+//	pixel registers, in bit k of any per-lane flags, and in [w*k +: w]
+//	of any other per-lane values.  Higher lanes therefore come first in
+//	time.
+//
+//	Every pixel generates at most one QOI op.  Pixels that are repeats of
+//	the pixel before them generate a RUN op only on the last pixel of
+//	their run--as determined by looking at the next pixel, at the run
+//	length, or at the end of the frame.  Other pixels generate a single
+//	INDEX, DIFF, LUMA, or RGB op.  As a result, no beat ever needs more
+//	than 4*PIXELS_PER_CLOCK bytes, and beats containing nothing but the
+//	middle of a run generate no output at all.
+//
+//	LGINFIFO, if non-zero, replaces the input skid buffer with a FIFO of
+//	2^LGINFIFO beats (see qoi_skid), so that a burst of stalls at the output
+//	needn't be felt at once by the video source.
+//
+//	OPS counts the ops within each beat by type, in fields of
+//	$clog2(PIXELS_PER_CLOCK+1) bits each: { RUN, INDEX, DIFF, LUMA, RGB }.
+//	It is provided for gathering statistics, and may be ignored otherwise.
+//
+//	PIXELS_PER_CLOCK must be a power of two, and greater than one.  Use
+//	qoi_compress for one pixel per clock.
+//
+//	Unlike qoi_compress, an INDEX op may be used here even if the pixel
+//	before shares the same index.  Such a pixel can only match the table
+//	if it repeats the pixel before, and so becomes part of a run instead,
+//	as long as every lane's table read sees every earlier write to its
+//	index.  The formal properties below (bench/formal/qoi_wcompress.sby)
+//	check exactly that, whether the write came from an earlier beat or
+//	from an earlier lane of the same beat.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+`default_nettype none
+// }}}
+module	qoi_wcompress #(
+		// {{{
+		parameter	PIXELS_PER_CLOCK = 2,
+		parameter	LGINFIFO = 0,
+		localparam	NP = PIXELS_PER_CLOCK,
+		localparam	PW = 24*NP,	// Pixel (beat) width
+		localparam	OW = 32*NP,	// Output width
+		localparam	LGOB = $clog2(OW/8),
+		localparam	OCW = $clog2(NP+1)	// Op count width
+		// }}}
+	) (
+		// {{{
+		input	wire	i_clk, i_reset,
+		// Video stream input
+		// {{{
+		input	wire		s_vid_valid,
+		output	wire		s_vid_ready,
+		input	wire	[PW-1:0]	s_vid_data,
+		input	wire		s_vid_hlast,
+		input	wire		s_vid_vlast,
+		// }}}
+		// QOI compressed output stream
+		// {{{
+		output	reg		m_valid,
+		input	wire		m_ready,
+		output	reg	[OW-1:0]	m_data,
+		output	reg	[LGOB-1:0]	m_bytes,
+		output	reg		m_last,
+		output	reg	[5*OCW-1:0]	m_ops
+		// }}}
+		// }}}
+	);
+
+	// Local declarations
+	// {{{
+	integer		ik, lk, lj, rk, pk, tk;
+
+	wire		skd_valid, skd_ready, skd_hlast, skd_vlast;
+	wire	[PW-1:0]	skd_data;
+
+	reg		s1_valid, s1_last;
+	reg	[6*NP-1:0]	s1_rhash, s1_ghash, s1_bhash;
+	reg	[PW-1:0]	s1_pixel;
+	wire	[PW-1:0]	s1_prev;
+	wire		s1_ready;
+
+	reg		s2_valid, s2_last;
+	reg	[6*NP-1:0]	s2_tbl_index;
+	reg	[PW-1:0]	s2_pixel;
+	wire	[PW-1:0]	s2_prev;
+	reg	[8*NP-1:0]	s2_gdiff;
+	reg	[PW-1:0]	s2_tbl_lookup;
+	reg	[NP-1:0]	s2_tbl_hit;
+	wire		s2_ready;
+
+	reg		s3_valid, s3_last;
+	reg	[NP-1:0]	s3_tbl_valid, s3_eq;
+	reg	[PW-1:0]	s3_pixel, s3_tbl_pixel;
+	reg	[6*NP-1:0]	s3_tblidx;
+	reg	[8*NP-1:0]	s3_rdiff, s3_gdiff, s3_bdiff,
+				s3_rgdiff, s3_bgdiff;
+	reg	[5:0]	s3_rcount, rcount;
+	reg	[6*NP-1:0]	s3_runlen;
+	reg	[NP-1:0]	s3_next_eq, s3_runend;
+	wire		s3_ready;
+
+	reg	[63:0]	tbl_valid;
+	reg	[23:0]	tbl_pixel	[0:63];
+
+	reg		s4_valid, s4_last;
+	reg	[NP-1:0]	s4_emit, s4_tblset, s4_rptset, s4_small, s4_bigdf;
+	reg	[6*NP-1:0]	s4_tblidx, s4_repeats, s4_gdiff;
+	reg	[PW-1:0]	s4_pixel;
+	reg	[4*NP-1:0]	s4_rgdiff, s4_bgdiff;
+	reg	[2*NP-1:0]	s4_rdiff, s4_bdiff;
+	wire		s4_ready;
+
+	reg	[31:0]		op_data;
+	reg	[2:0]		op_bytes;
+	reg	[OW-1:0]	pk_data;
+	reg	[LGOB:0]	pk_fill;
+	reg	[4:0]		op_type;
+	reg	[5*OCW-1:0]	pk_ops;
+
+	wire		gbl_ready;
+	reg		gbl_last;
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Skidbuffer
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	qoi_skid #(
+`ifdef	FORMAL
+		.OPT_PASSTHROUGH(1'b1),
+`endif
+		.OPT_OUTREG(1'b0), .LGDEPTH(LGINFIFO), .DW(2+PW)
+	) u_skid (
+		// {{{
+		.i_clk(i_clk), .i_reset(i_reset),
+		.i_valid(s_vid_valid), .o_ready(s_vid_ready),
+		.i_data({ s_vid_hlast, s_vid_vlast, s_vid_data }),
+		.o_valid(skd_valid), .i_ready(skd_ready),
+		.o_data({ skd_hlast, skd_vlast, skd_data })
+		// }}}
+	);
+
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step #1: Pre-calculate hash data
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	initial	s1_valid = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s1_valid <= 0;
+	else if (skd_valid && skd_ready)
+		s1_valid <= skd_valid;
+	else if (s1_ready)
+		s1_valid <= 0;
+
+	initial	s1_last = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s1_last <= 0;
+	else if (skd_valid && skd_ready)
+		s1_last <= skd_hlast && skd_vlast;
+	else if (s1_ready)
+		s1_last <= 0;
+
+	initial	s1_pixel = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s1_pixel <= 0;
+	else if (skd_valid && skd_ready)
+		s1_pixel <= skd_data;
+	else if (s1_ready && s1_last)
+		s1_pixel <= 0;
+
+	always @(posedge i_clk)
+	if (skd_valid && skd_ready)
+	for(ik=0; ik<NP; ik=ik+1)
+	begin
+		s1_rhash[6*ik +: 6] <= skd_data[24*ik+16 +: 6]
+					+ { skd_data[24*ik+16 +: 5], 1'b0 };
+		s1_ghash[6*ik +: 6] <= skd_data[24*ik+ 8 +: 6]
+					+ { skd_data[24*ik+ 8 +: 4], 2'b0 };
+		s1_bhash[6*ik +: 6] <= { skd_data[24*ik +: 3], 3'h0 }
+					- skd_data[24*ik +: 6];
+	end
+
+	// The pixel prior to each lane: the lane above it, or the last lane
+	// of the beat before
+	assign	s1_prev = { s2_pixel[23:0], s1_pixel[PW-1:24] };
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step #2: Finish calculating the hash table index
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	initial	s2_valid = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s2_valid <= 0;
+	else if (s1_valid && s1_ready)
+		s2_valid <= 1'b1;
+	else if (s2_ready)
+		s2_valid <= 1'b0;
+
+	initial	s2_pixel = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s2_pixel <= 0;
+	else if (s1_valid && s1_ready)
+		s2_pixel <= s1_pixel;
+	else if (s2_ready && s2_last)
+		s2_pixel <= 0;
+
+	always @(posedge i_clk)
+	if (i_reset)
+		s2_last <= 1'b0;
+	else if (s1_valid && s1_ready)
+		s2_last <= s1_last;
+	else if (s2_ready)
+		s2_last <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s1_valid && s1_ready)
+	for(ik=0; ik<NP; ik=ik+1)
+	begin
+		s2_tbl_index[6*ik +: 6] <= s1_rhash[6*ik +: 6]
+				+ s1_ghash[6*ik +: 6] + s1_bhash[6*ik +: 6]
+				+ 6'h35;
+
+		s2_gdiff[8*ik +: 8] <= s1_pixel[24*ik+8 +: 8]
+						- s1_prev[24*ik+8 +: 8];
+	end
+
+	assign	s2_prev = { s3_pixel[23:0], s2_pixel[PW-1:24] };
+
+	// Table lookup, with forwarding
+	// {{{
+	// The table only contains pixels from prior beats.  Pixels from
+	// earlier lanes within this beat must be forwarded.  When several
+	// earlier lanes map to the same index, the most recent one (i.e. the
+	// lowest lane above us) wins.
+	always @(*)
+	for(lk=0; lk<NP; lk=lk+1)
+	begin
+		s2_tbl_lookup[24*lk +: 24] = tbl_pixel[s2_tbl_index[6*lk +: 6]];
+		s2_tbl_hit[lk] = tbl_valid[s2_tbl_index[6*lk +: 6]];
+
+		for(lj=NP-1; lj>lk; lj=lj-1)
+		if (s2_tbl_index[6*lj +: 6] == s2_tbl_index[6*lk +: 6])
+		begin
+			s2_tbl_lookup[24*lk +: 24] = s2_pixel[24*lj +: 24];
+			s2_tbl_hit[lk] = 1'b1;
+		end
+	end
+	// }}}
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step #3: Hash table lookup, calc differences, count repeats
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	initial	s3_valid = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s3_valid <= 0;
+	else if (s2_valid && s2_ready)
+		s3_valid <= 1'b1;
+	else if (s3_ready)
+		s3_valid <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s2_valid && s2_ready)
+	begin
+		s3_tbl_valid <= s2_tbl_hit;
+		s3_tbl_pixel <= s2_tbl_lookup;
+	end
+
+	// Write back to the table
+	// {{{
+	// All lanes write at once.  Since later statements take priority,
+	// writing the table from the first lane (in time) to the last lets
+	// the most recent pixel win any collisions.
+	initial	tbl_valid = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		tbl_valid <= 0;
+	else if (s2_valid && s2_ready && s2_last)
+		tbl_valid <= 0;
+	else if (s2_valid && s2_ready)
+	begin
+		for(ik=NP-1; ik>=0; ik=ik-1)
+			tbl_valid[s2_tbl_index[6*ik +: 6]] <= 1'b1;
+	end
+
+	always @(posedge i_clk)
+	if (s2_valid && s2_ready)
+	begin
+		for(ik=NP-1; ik>=0; ik=ik-1)
+			tbl_pixel[s2_tbl_index[6*ik +: 6]] <= s2_pixel[24*ik +: 24];
+	end
+	// }}}
+
+	// s3_(everything else): tblidx, xdiff, xgdiff, xlast, && pixel
+	// {{{
+	initial	s3_pixel = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s3_pixel <= 0;
+	else if (s2_valid && s2_ready)
+		s3_pixel <= s2_pixel;
+	else if (s3_ready && s3_last)
+		s3_pixel <= 0;
+
+	always @(posedge i_clk)
+	if (i_reset)
+		s3_last <= 1'b0;
+	else if (s2_valid && s2_ready)
+		s3_last <= s2_last;
+	else if (s3_ready)
+		s3_last <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s2_valid && s2_ready)
+	begin
+		s3_tblidx <= s2_tbl_index;
+		s3_gdiff  <= s2_gdiff;
+
+		for(ik=0; ik<NP; ik=ik+1)
+		begin
+			s3_eq[ik] <= (s2_pixel[24*ik +: 24] == s2_prev[24*ik +: 24]);
+
+			s3_rdiff[8*ik +: 8] <= s2_pixel[24*ik+16 +: 8]
+						- s2_prev[24*ik+16 +: 8];
+			s3_bdiff[8*ik +: 8] <= s2_pixel[24*ik +: 8]
+						- s2_prev[24*ik +: 8];
+
+			s3_rgdiff[8*ik +: 8] <= (s2_pixel[24*ik+16 +: 8]
+						- s2_prev[24*ik+16 +: 8])
+						- s2_gdiff[8*ik +: 8];
+			s3_bgdiff[8*ik +: 8] <= (s2_pixel[24*ik +: 8]
+						- s2_prev[24*ik +: 8])
+						- s2_gdiff[8*ik +: 8];
+		end
+	end
+	// }}}
+
+	// Run lengths
+	// {{{
+	// s3_rcount is the length of any run ending with the last pixel of
+	// the prior beat.  Runs are chained through every lane, starting over
+	// at any pixel that differs from its predecessor or after the maximum
+	// run length of 62.  A run ends (and so generates an op) when the next
+	// pixel differs, when it reaches 62 pixels, or at the end of the frame.
+	// Since the pipeline moves in lockstep, the next beat is always in
+	// stage two, so we can look one pixel ahead even from the last lane.
+	always @(*)
+	begin
+		rcount = s3_rcount;
+		for(rk=NP-1; rk>=0; rk=rk-1)
+		begin
+			if (!s3_eq[rk])
+				rcount = 0;
+			else if (rcount >= 6'd62)
+				rcount = 1;
+			else
+				rcount = rcount + 1;
+			s3_runlen[6*rk +: 6] = rcount;
+		end
+
+		s3_next_eq = { s3_eq[NP-2:0],
+			(s2_pixel[PW-1:PW-24] == s3_pixel[23:0]) && !s3_last };
+
+		for(rk=0; rk<NP; rk=rk+1)
+			s3_runend[rk]= s3_eq[rk] && (!s3_next_eq[rk]
+					|| (s3_runlen[6*rk +: 6] >= 6'd62));
+	end
+
+	initial	s3_rcount  = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s3_rcount <= 0;
+	else if (s3_valid && s3_ready)
+		s3_rcount <= (s3_last) ? 6'h0 : s3_runlen[5:0];
+	// }}}
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step #4: Hash table compare, difference check
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	initial	s4_valid = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+		s4_valid <= 0;
+	else if (s3_valid && s3_ready)
+		s4_valid <= |((~s3_eq) | s3_runend);
+	else if (s4_ready)
+		s4_valid <= 1'b0;
+
+	always @(posedge i_clk)
+	if (i_reset)
+		s4_last <= 1'b0;
+	else if (s3_valid && s3_ready)
+		s4_last <= s3_last;
+	else if (s4_ready)
+		s4_last <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s3_valid && s3_ready)
+	begin
+		s4_emit   <= (~s3_eq) | s3_runend;
+		s4_rptset <= s3_runend;
+		s4_tblidx <= s3_tblidx;
+		s4_pixel  <= s3_pixel;
+
+		for(ik=0; ik<NP; ik=ik+1)
+		begin
+			s4_repeats[6*ik +: 6] <= s3_runlen[6*ik +: 6] - 1;
+
+			s4_tblset[ik] <= s3_tbl_valid[ik]
+				&& (s3_pixel[24*ik +: 24]==s3_tbl_pixel[24*ik +: 24]);
+
+			s4_small[ik] <= ((&s3_rdiff[8*ik+1 +: 7])
+						|| (s3_rdiff[8*ik +: 8] <= 1))
+				&& ((&s3_gdiff[8*ik+1 +: 7])
+						|| (s3_gdiff[8*ik +: 8] <= 1))
+				&& ((&s3_bdiff[8*ik+1 +: 7])
+						|| (s3_bdiff[8*ik +: 8] <= 1));
+			s4_bigdf[ik] <= ((&s3_gdiff[8*ik+5 +: 3])
+					|| (s3_gdiff[8*ik +: 8] <= 8'd31))
+				&& ((&s3_rgdiff[8*ik+3 +: 5])
+					|| (s3_rgdiff[8*ik +: 8] <= 8'd7))
+				&& ((&s3_bgdiff[8*ik+3 +: 5])
+					|| (s3_bgdiff[8*ik +: 8] <= 8'd7));
+
+			s4_rdiff[2*ik +: 2] <= s3_rdiff[8*ik +: 2];
+			s4_gdiff[6*ik +: 6] <= s3_gdiff[8*ik +: 6];
+			s4_bdiff[2*ik +: 2] <= s3_bdiff[8*ik +: 2];
+			//
+			s4_rgdiff[4*ik +: 4] <= s3_rgdiff[8*ik +: 4];
+			s4_bgdiff[4*ik +: 4] <= s3_bgdiff[8*ik +: 4];
+		end
+	end
+
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Step #5: Encode the output
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+
+	// Generate one op per lane, and pack them together, first lane
+	// first, into a single output beat
+	always @(*)
+	begin
+		pk_data = 0;
+		pk_fill = 0;
+		pk_ops  = 0;
+
+		for(pk=NP-1; pk>=0; pk=pk-1)
+		begin
+			op_data  = 32'h0;
+			op_bytes = 3'd1;
+			op_type  = 5'b00001;
+			if (s4_rptset[pk])
+			begin
+				op_data[31:24] = { 2'b11, s4_repeats[6*pk +: 6] };
+				op_type = 5'b10000;
+			end else if (s4_tblset[pk])
+			begin
+				op_data[31:24] = { 2'b00, s4_tblidx[6*pk +: 6] };
+				op_type = 5'b01000;
+			end else if (s4_small[pk])
+			begin
+				op_data[31:30] = 2'b01;
+				op_data[29:28] = s4_rdiff[2*pk +: 2] + 2'b10;
+				op_data[27:26] = s4_gdiff[6*pk +: 2] + 2'b10;
+				op_data[25:24] = s4_bdiff[2*pk +: 2] + 2'b10;
+				op_type = 5'b00100;
+			end else if (s4_bigdf[pk])
+			begin
+				op_data[31:30] = 2'b10;
+				op_data[29:24] = s4_gdiff[6*pk +: 6] + 6'h20;
+				op_data[23:20] = s4_rgdiff[4*pk +: 4] + 4'h8;
+				op_data[19:16] = s4_bgdiff[4*pk +: 4] + 4'h8;
+				op_bytes = 3'd2;
+				op_type = 5'b00010;
+			end else begin
+				op_data = { 8'hfe, s4_pixel[24*pk +: 24] };
+				op_bytes = 3'd4;
+			end
+
+			if (s4_emit[pk])
+			begin
+				pk_data = pk_data | ({ op_data, {(OW-32){1'b0}} }
+							>> (8*pk_fill));
+				pk_fill = pk_fill + op_bytes;
+				for(tk=0; tk<5; tk=tk+1)
+				if (op_type[tk])
+					pk_ops[OCW*tk +: OCW]
+						= pk_ops[OCW*tk +: OCW] + 1;
+			end
+		end
+	end
+
+	initial	m_valid = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		m_valid <= 1'b0;
+	else if (!m_valid || m_ready)
+		m_valid <= s4_valid && s4_ready;
+
+	always @(posedge i_clk)
+	if (i_reset)
+		m_last <= 1'b0;
+	else if (s4_valid && s4_ready)
+		m_last <= s4_last;
+	else if (m_ready)
+		m_last <= 1'b0;
+
+	always @(posedge i_clk)
+	if (s4_valid && s4_ready)
+	begin
+		m_data  <= pk_data;
+		m_bytes <= pk_fill[LGOB-1:0];
+		m_ops   <= pk_ops;
+	end
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Pipeline control (i.e. ready signals)
+	// {{{
+
+	assign	skd_ready = skd_valid && (!m_valid || m_ready) && !gbl_last;
+	assign	s1_ready = gbl_ready;
+	assign	s2_ready = gbl_ready;
+	assign	s3_ready = gbl_ready;
+	assign	s4_ready = gbl_ready;
+	assign	gbl_ready = (skd_valid || gbl_last) && (!m_valid || m_ready);
+
+	initial	gbl_last = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		gbl_last <= 1'b0;
+	else if (skd_valid && skd_ready)
+		gbl_last <= skd_hlast && skd_vlast;
+	else if (m_valid && m_ready && m_last)
+		gbl_last <= 1'b0;
+	// }}}
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// Formal properties
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+`ifdef	FORMAL
+	// These properties cover the hash table: that every lane's read sees
+	// every write to its index from the pixels before it, whether from an
+	// earlier beat, through the table, or from an earlier lane of the
+	// same beat, by forwarding.  fc_index is arbitrary, so whatever is
+	// proven of it holds of every table entry.
+	integer		fk, fj;
+	reg		f_past_valid;
+	(* anyconst *)	reg	[5:0]	fc_index;
+	reg		fc_valid, f2_found, f3_found;
+	reg	[23:0]	fc_pixel, f3_lastpx;
+	reg		f_nfirst, f1_first, f2_first, f3_first, f4_first;
+	reg	[5:0]	f2_index, f3_index, f4_previdx;
+	reg	[NP-1:0]	f2_hit, f3_hit;
+	reg	[PW-1:0]	f2_lookup, f3_lookup;
+
+	initial	f_past_valid = 1'b0;
+	always @(posedge i_clk)
+		f_past_valid <= 1'b1;
+
+	always @(*)
+	if (!f_past_valid)
+		assume(i_reset);
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Incoming properties
+	// {{{
+	always @(posedge i_clk)
+	if (!f_past_valid || $past(i_reset))
+		assume(!s_vid_valid);
+	else if ($past(s_vid_valid && !s_vid_ready))
+	begin
+		assume(s_vid_valid);
+		assume($stable(s_vid_data));
+		assume($stable(s_vid_hlast));
+		assume($stable(s_vid_vlast));
+	end
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Frame boundaries
+	// {{{
+	// Only one frame is ever in the pipeline, and only the first beat of
+	// a frame ever follows a bubble
+	always @(*)
+	if (f_past_valid)
+	begin
+		if (!s1_valid) assert(!s1_last);
+		if (!s2_valid) assert(!s2_last);
+		if (!s3_valid) assert(!s3_last);
+		if (!s4_valid) assert(!s4_last);
+		if (!m_valid)  assert(!m_last);
+
+		if (s1_last || s2_last || s3_last || s4_last || m_last)
+			assert(gbl_last);
+		if (gbl_last)
+			assert(s1_last || s2_last || s3_last || s4_last
+								|| m_last);
+		if (s1_last)
+			assert(!s2_last && !s3_last && !s4_last && !m_last);
+		if (s2_last)
+			assert(!s3_last && !s4_last && !m_last);
+		if (s3_last)
+			assert(!s4_last && !m_last);
+		if (s4_last)
+			assert(!m_last);
+	end
+
+	// fN_first is true if the beat in step N is the first of its frame.
+	// f_nfirst is true if the next beat to enter will be.
+	initial	f_nfirst = 1'b1;
+	always @(posedge i_clk)
+	if (i_reset)
+		f_nfirst <= 1'b1;
+	else if (skd_valid && skd_ready)
+		f_nfirst <= skd_hlast && skd_vlast;
+
+	always @(posedge i_clk)
+	if (skd_valid && skd_ready)
+		f1_first <= f_nfirst;
+
+	always @(posedge i_clk)
+	if (s1_valid && s1_ready)
+		f2_first <= f1_first;
+
+	always @(posedge i_clk)
+	if (s2_valid && s2_ready)
+		f3_first <= f2_first;
+
+	always @(posedge i_clk)
+	if (s3_valid && s3_ready)
+		f4_first <= f3_first;
+
+	always @(*)
+	if (f_past_valid)
+	begin
+		if (gbl_last)
+			assert(f_nfirst);
+		else if (f_nfirst)
+			assert(!s1_valid && !s2_valid && !s3_valid && !s4_valid
+				&& !m_valid && tbl_valid == 0);
+
+		if (s1_valid && f1_first)
+			assert(!s2_valid && !s3_valid && !s4_valid && !m_valid
+				&& tbl_valid == 0);
+		else if (s1_valid)
+			assert(s2_valid && !s2_last);
+
+		if (s2_valid && f2_first)
+			assert(!s3_valid && !s4_valid && !m_valid
+				&& tbl_valid == 0);
+		else if (s2_valid)
+			assert(s3_valid && !s3_last);
+
+		if (s3_valid && f3_first)
+			assert(!s4_valid && !m_valid);
+
+		if (!s3_valid)
+			assert(s3_pixel == 0);
+	end
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// The hash table index
+	// {{{
+	always @(*)
+	if (s2_valid)
+	for(fk=0; fk<NP; fk=fk+1)
+	begin
+		f2_index = (s2_pixel[24*fk+16 +: 8] * 3)
+				+ (s2_pixel[24*fk+8 +: 8] * 5)
+				+ (s2_pixel[24*fk +: 8] * 7) + 6'h35;
+		assert(s2_tbl_index[6*fk +: 6] == f2_index);
+	end
+
+	always @(*)
+	if (s3_valid)
+	for(fk=0; fk<NP; fk=fk+1)
+	begin
+		f3_index = (s3_pixel[24*fk+16 +: 8] * 3)
+				+ (s3_pixel[24*fk+8 +: 8] * 5)
+				+ (s3_pixel[24*fk +: 8] * 7) + 6'h35;
+		assert(s3_tblidx[6*fk +: 6] == f3_index);
+	end
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// The hash table, at fc_index
+	// {{{
+	// Writes are made one pixel at a time, in order, so the last pixel (in
+	// time) of any beat with this index is the one left in the table
+	initial	fc_valid = 1'b0;
+	always @(posedge i_clk)
+	if (i_reset)
+		fc_valid <= 1'b0;
+	else if (s2_valid && s2_ready)
+	begin
+		for(fk=NP-1; fk>=0; fk=fk-1)
+		if (s2_tbl_index[6*fk +: 6] == fc_index)
+			fc_valid <= 1'b1;
+		if (s2_last)
+			fc_valid <= 1'b0;
+	end
+
+	always @(posedge i_clk)
+	if (s2_valid && s2_ready)
+	for(fk=NP-1; fk>=0; fk=fk-1)
+	if (s2_tbl_index[6*fk +: 6] == fc_index)
+		fc_pixel <= s2_pixel[24*fk +: 24];
+
+	always @(*)
+	if (f_past_valid)
+	begin
+		assert(tbl_valid[fc_index] == fc_valid);
+		if (fc_valid)
+			assert(tbl_pixel[fc_index] == fc_pixel);
+	end
+
+	// The table, once step three's beat has been written to it
+	always @(*)
+	begin
+		f3_found = 1'b0;
+		f3_lastpx = 0;
+		for(fk=0; fk<NP; fk=fk+1)
+		if (!f3_found && s3_tblidx[6*fk +: 6] == fc_index)
+		begin
+			f3_found = 1'b1;
+			f3_lastpx = s3_pixel[24*fk +: 24];
+		end
+
+		if (s3_valid && s3_last)
+			assert(tbl_valid == 0);
+		else if (s3_valid && f3_found)
+			assert(fc_valid && fc_pixel == f3_lastpx);
+	end
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Table reads
+	// {{{
+	// Each lane should find the most recent earlier lane of its own beat
+	// with the same index, or else whatever the table holds.
+	always @(*)
+	for(fk=0; fk<NP; fk=fk+1)
+	begin
+		f2_found = 1'b0;
+		f2_hit[fk] = fc_valid;
+		f2_lookup[24*fk +: 24] = fc_pixel;
+		for(fj=fk+1; fj<NP; fj=fj+1)
+		if (!f2_found && s2_tbl_index[6*fj +: 6] == fc_index)
+		begin
+			f2_found = 1'b1;
+			f2_hit[fk] = 1'b1;
+			f2_lookup[24*fk +: 24] = s2_pixel[24*fj +: 24];
+		end
+	end
+
+	always @(*)
+	if (s2_valid)
+	for(fk=0; fk<NP; fk=fk+1)
+	if (s2_tbl_index[6*fk +: 6] == fc_index)
+	begin
+		assert(s2_tbl_hit[fk] == f2_hit[fk]);
+		if (f2_hit[fk])
+			assert(s2_tbl_lookup[24*fk +: 24]
+						== f2_lookup[24*fk +: 24]);
+	end
+
+	always @(posedge i_clk)
+	if (s2_valid && s2_ready)
+	begin
+		f3_hit    <= f2_hit;
+		f3_lookup <= f2_lookup;
+	end
+
+	always @(*)
+	if (s3_valid)
+	for(fk=0; fk<NP; fk=fk+1)
+	if (s3_tblidx[6*fk +: 6] == fc_index)
+	begin
+		assert(s3_tbl_valid[fk] == f3_hit[fk]);
+		if (f3_hit[fk])
+			assert(s3_tbl_pixel[24*fk +: 24]
+						== f3_lookup[24*fk +: 24]);
+	end
+	// }}}
+	////////////////////////////////////////////////////////////////////////
+	//
+	// The pixel before each lane
+	// {{{
+	// The pixel before lane k is lane k+1, or lane 0 of the beat before,
+	// which by now has moved on to step four.  Each lane's repeat flag
+	// compares against it, and if it shares the lane's index, so must the
+	// lane's table read.
+	always @(*)
+	if (s3_valid)
+	begin
+		for(fk=0; fk<NP-1; fk=fk+1)
+		begin
+			assert(s3_eq[fk] == (s3_pixel[24*fk +: 24]
+					== s3_pixel[24*(fk+1) +: 24]));
+			if (s3_tblidx[6*fk +: 6] == fc_index
+				&& s3_tblidx[6*(fk+1) +: 6] == fc_index)
+				assert(s3_tbl_valid[fk] && s3_tbl_pixel[24*fk +: 24]
+					== s3_pixel[24*(fk+1) +: 24]);
+		end
+
+		if (f3_first)
+			assert(s3_eq[NP-1] == (s3_pixel[PW-1 -: 24] == 0));
+		else begin
+			assert(s3_eq[NP-1] == (s3_pixel[PW-1 -: 24]
+							== s4_pixel[23:0]));
+			if (s3_tblidx[6*NP-1 -: 6] == fc_index
+					&& s4_tblidx[5:0] == fc_index)
+				assert(s3_tbl_valid[NP-1]
+					&& s3_tbl_pixel[PW-1 -: 24]
+							== s4_pixel[23:0]);
+		end
+	end
+
+	// qoi_compress only uses an INDEX op if the index differs from that
+	// of the pixel before.  Here, a pixel that shares its index with the
+	// pixel before, yet differs from it, can never match the table, so
+	// that check isn't needed.
+	always @(posedge i_clk)
+	if (s3_valid && s3_ready)
+		f4_previdx <= s4_tblidx[5:0];
+
+	always @(*)
+	if (s4_valid)
+	begin
+		for(fk=0; fk<NP-1; fk=fk+1)
+		if (s4_emit[fk] && !s4_rptset[fk] && s4_tblset[fk]
+				&& s4_tblidx[6*fk +: 6] == fc_index)
+			assert(s4_tblidx[6*(fk+1) +: 6] != fc_index);
+
+		if (s4_emit[NP-1] && !s4_rptset[NP-1] && s4_tblset[NP-1]
+				&& s4_tblidx[6*NP-1 -: 6] == fc_index
+				&& !f4_first)
+			assert(f4_previdx != fc_index);
+	end
+	// }}}
+`endif
+// }}}
+endmodule
@@ -0,0 +1,1161 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoi.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	The qoi::Encoder and qoi::Decoder classes.  See qoi.h for a
+//		description of how these model the hardware.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <string.h>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "qoi.h"
+
+namespace qoi {
+
+// Pixels are scanned in blocks of this size, so the scan results stay in
+// the cache for the (sequential) table pass that follows
+static	const	size_t	BLKSZ = 2048;
+static	const	unsigned MAXRUN = 62;
+
+static	void	put32(std::vector<uint8_t> &out, uint32_t v) {
+	out.push_back((v >> 24) & 0x0ff);
+	out.push_back((v >> 16) & 0x0ff);
+	out.push_back((v >>  8) & 0x0ff);
+	out.push_back( v        & 0x0ff);
+}
+
+static	uint32_t get32(const uint8_t *d) {
+	return (d[0] << 24) | (d[1] << 16) | (d[2] << 8) | d[3];
+}
+
+// Runs fn(thread, k) for k = 0 ... n-1, spread across as many threads as
+// the host has, and returns the number of threads used.  Thread t handles
+// every k where k % nthreads == t.
+template<class F> static unsigned parallel(unsigned n, F fn) {
+	unsigned	nthreads = std::thread::hardware_concurrency();
+	std::vector<std::thread>	threads;
+
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > n)
+		nthreads = (n < 1) ? 1 : n;
+
+	for(unsigned t=1; t<nthreads; t++)
+		threads.emplace_back([=]() {
+			for(unsigned k=t; k<n; k+=nthreads)
+				fn(t, k);
+		});
+	for(unsigned k=0; k<n; k+=nthreads)
+		fn(0, k);
+	for(auto &th : threads)
+		th.join();
+
+	return nthreads;
+}
+
+// op_length
+// {{{
+// The number of bytes in the op beginning with this byte
+static	unsigned op_length(uint8_t op) {
+	if (op == OP_RGB)
+		return 4;
+	if (op == OP_RGBA)
+		return 5;
+	if ((op & 0xc0) == OP_LUMA)
+		return 2;
+	return 1;
+}
+// }}}
+
+// op_type
+// {{{
+// The OPTYPE (count index) of the op beginning with this byte
+static	unsigned op_type(uint8_t op) {
+	if (op == OP_RGB)
+		return T_RGB;
+	if (op == OP_RGBA)
+		return T_RGBA;
+	switch(op & 0xc0) {
+	case OP_INDEX:	return T_INDEX;
+	case OP_DIFF:	return T_DIFF;
+	case OP_LUMA:	return T_LUMA;
+	default:	return T_RUN;
+	}
+}
+// }}}
+
+// The table index of a pixel, alpha included
+static	unsigned hash_alpha(uint32_t px) {
+	return (((px >> 16) & 0x0ff) * 3 + ((px >> 8) & 0x0ff) * 5
+		+ (px & 0x0ff) * 7 + (px >> 24) * 11) & 0x3f;
+}
+
+// line_crc
+// {{{
+// CRC-32's polynomial, MSB first, a byte at a time.  The table is built on
+// first use.
+static	uint32_t	crc_table[256];
+static	std::once_flag	crc_once;
+
+uint32_t line_crc(const uint32_t *px, size_t n) {
+	uint32_t	crc = 0xffffffff;
+
+	std::call_once(crc_once, []() {
+		for(unsigned b=0; b<256; b++) {
+			uint32_t	c = b << 24;
+
+			for(unsigned k=0; k<8; k++)
+				c = (c & 0x80000000) ? ((c << 1) ^ 0x04c11db7)
+						: (c << 1);
+			crc_table[b] = c;
+		}
+	});
+
+	for(size_t k=0; k<n; k++)
+	for(int sh=16; sh>=0; sh-=8)
+		crc = (crc << 8) ^ crc_table[((crc >> 24) ^ (px[k] >> sh))
+						& 0x0ff];
+	return crc;
+}
+// }}}
+
+// The number of rows in each stripe, given the number of stripes asked for.
+// nstripes is adjusted so that no stripe is ever empty.
+static	unsigned stripe_rows(unsigned height, unsigned &nstripes) {
+	unsigned	rows;
+
+	if (height == 0) {
+		nstripes = 1;
+		return 0;
+	} if (nstripes > height)
+		nstripes = height;
+	rows = (height + nstripes - 1) / nstripes;
+	nstripes = (height + rows - 1) / rows;
+	return rows;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Encoder
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+Encoder::Encoder(void) {
+	m_simd = true;
+	m_alpha = false;
+	m_stripes = 1;
+	m_valid = 0;
+	memset(m_table, 0, sizeof(m_table));
+	m_delta = m_key = m_refok = false;
+	m_keyint = m_since = 0;
+	m_maxops = 63;
+	m_maxlines = 2048;
+	m_refw = m_refh = m_linew = 0;
+	m_above = false;
+	m_abvmax = 2048;
+	m_abvw = 0;
+	clear_counts();
+}
+
+void	Encoder::delta(bool enable, unsigned keyint, unsigned maxops,
+		unsigned maxlines) {
+	m_delta    = enable;
+	m_keyint   = keyint;
+	m_maxops   = maxops;
+	m_maxlines = maxlines;
+	m_refok    = false;
+	m_since    = 0;
+}
+
+void	Encoder::clear_counts(void) {
+	for(unsigned k=0; k<NOPTYPES; k++)
+		m_counts[k] = 0;
+}
+
+void	Encoder::encode(unsigned width, unsigned height,
+		const uint32_t *pixels, std::vector<uint8_t> &out) {
+	// {{{
+	if (m_stripes > 1) {
+		encode_striped(width, height, pixels, out);
+		return;
+	} else if (m_delta && !m_alpha) {
+		encode_delta(width, height, pixels, out);
+		return;
+	}
+
+	out.clear();
+	put32(out, (m_above) ? 0x716f6976 : 0x716f6966);  // "qoiv"/"qoif"
+	put32(out, width);
+	put32(out, height);
+	// The hardware always claims a linear colorspace
+	out.push_back(m_alpha ? 4 : 3);
+	out.push_back(1);
+
+	m_abvw = (m_above) ? width : 0;
+	compress(pixels, (size_t)width * height, out);
+	m_abvw = 0;
+
+	put32(out, 0);
+	put32(out, 1);
+}
+// }}}
+
+void	Encoder::encode_striped(unsigned width, unsigned height,
+		const uint32_t *pixels, std::vector<uint8_t> &out) {
+	// {{{
+	unsigned	nstripes = m_stripes, rows, nthreads;
+	std::vector<std::vector<uint8_t>>	stripe;
+	std::vector<Encoder>	sub(nstripes);
+	size_t		offset;
+
+	rows = stripe_rows(height, nstripes);
+	stripe.resize(nstripes);
+
+	// Each thread gets an encoder of its own, since compress() keeps its
+	// table in the encoder
+	for(auto &e : sub) {
+		e.m_simd  = m_simd;
+		e.m_alpha = m_alpha;
+	}
+
+	nthreads = parallel(nstripes, [&](unsigned t, unsigned k) {
+		unsigned	r0 = k * rows, r1 = r0 + rows;
+
+		if (r1 > height)
+			r1 = height;
+		sub[t].compress(&pixels[(size_t)r0 * width],
+				(size_t)(r1 - r0) * width, stripe[k]);
+	});
+
+	out.clear();
+	put32(out, 0x716f6973);		// "qois"
+	put32(out, width);
+	put32(out, height);
+	out.push_back(m_alpha ? 4 : 3);
+	out.push_back(1);
+
+	put32(out, nstripes);
+	offset = out.size() + 4 * nstripes;
+	for(unsigned k=0; k<nstripes; k++) {
+		put32(out, (uint32_t)offset);
+		offset += stripe[k].size();
+	}
+
+	for(unsigned k=0; k<nstripes; k++)
+		out.insert(out.end(), stripe[k].begin(), stripe[k].end());
+
+	put32(out, 0);
+	put32(out, 1);
+
+	for(unsigned t=0; t<nthreads; t++)
+	for(unsigned k=0; k<NOPTYPES; k++)
+		m_counts[k] += sub[t].m_counts[k];
+}
+// }}}
+
+void	Encoder::encode_delta(unsigned width, unsigned height,
+		const uint32_t *pixels, std::vector<uint8_t> &out) {
+	// {{{
+	std::vector<uint8_t>	ops;
+	bool		isdelta;
+	size_t		pos = 0;
+
+	// As in the hardware, the frame before must have been the same size,
+	// and a key frame may have been asked for
+	isdelta = m_refok && width == m_refw && height == m_refh && !m_key
+			&& (m_keyint == 0 || m_since + 1 < m_keyint);
+	m_since = (isdelta) ? m_since + 1 : 0;
+	m_key = false;
+
+	out.clear();
+	put32(out, (isdelta) ? 0x716f6964 : 0x716f6966);	// "qoid"/"qoif"
+	put32(out, width);
+	put32(out, height);
+	out.push_back(3);
+	out.push_back(1);
+
+	// Compress the frame, ending runs at the end of every line, and
+	// noting where each line's ops end
+	m_linew = width;
+	m_eol.clear();
+	compress(pixels, (size_t)width * height, ops);
+	m_linew = 0;
+
+	if (m_lcrc.size() < m_maxlines)
+		m_lcrc.resize(m_maxlines);
+
+	for(unsigned y=0; y<height && width > 0; y++) {
+		size_t		end = m_eol[y], nops = 0;
+		uint32_t	crc = line_crc(&pixels[(size_t)y * width], width);
+
+		for(size_t p=pos; p<end; p += op_length(ops[p]))
+			nops++;
+
+		if (isdelta && y < m_maxlines && crc == m_lcrc[y]
+				&& nops <= m_maxops) {
+			// Replace the line, and its op counts, with one
+			// OP_SAME--counted as a run
+			for(size_t p=pos; p<end; p += op_length(ops[p]))
+				m_counts[op_type(ops[p])]--;
+			out.push_back(OP_SAME);
+			m_counts[T_RUN]++;
+		} else
+			out.insert(out.end(), &ops[pos], &ops[end]);
+
+		if (y < m_maxlines)
+			m_lcrc[y] = crc;
+		pos = end;
+	}
+
+	put32(out, 0);
+	put32(out, 1);
+
+	m_refok = true;
+	m_refw  = width;
+	m_refh  = height;
+}
+// }}}
+
+void	Encoder::compress(const uint32_t *pixels, size_t npix,
+		std::vector<uint8_t> &out) {
+	// {{{
+	uint8_t		hsh[BLKSZ];
+	uint16_t	ops[BLKSZ];
+	// Every frame starts from (opaque) black, with an empty table.
+	// lastidx is kept out of range, since no pixel has come before the
+	// first.
+	const uint32_t	mask = m_alpha ? 0xffffffff : 0x0ffffff;
+	uint32_t	prev = m_alpha ? 0xff000000 : 0, last = prev;
+	unsigned	run = 0, lastidx = 64, x = 0, ax = 0;
+	// For delta frames, runs stop one short, leaving OP_SAME free, and
+	// end at the end of every line.  When predicting from the line above,
+	// they stop two short, leaving OP_ABOVE free.
+	const unsigned	maxrun = (m_linew) ? MAXRUN-1
+				: (m_abvw) ? MAXRUN-2 : MAXRUN;
+
+	m_valid = 0;
+	for(size_t base=0; base < npix; base += BLKSZ) {
+		size_t	n = npix - base;
+
+		if (n > BLKSZ)
+			n = BLKSZ;
+		if (m_simd)
+			scan(&pixels[base], n, prev, hsh, ops);
+		else
+			scan_scalar(&pixels[base], n, prev, hsh, ops);
+
+		for(size_t k=0; k<n; k++) {
+			uint32_t	px = pixels[base+k] & mask;
+			unsigned	idx = hsh[k], op = ops[k];
+			bool		eol = false, abv = false;
+
+			if (m_linew && ++x >= m_linew) {
+				eol = true;
+				x = 0;
+			}
+
+			// Pixels past the hardware's line buffer, or on the
+			// first line, have nothing above them
+			if (m_abvw) {
+				abv = (base+k >= m_abvw) && ax < m_abvmax;
+				if (++ax >= m_abvw)
+					ax = 0;
+			}
+
+			if (m_alpha) {
+				// scan() assumes an alpha of 255, contributing
+				// 53 to the hash.  Replace it.  A change of
+				// alpha requires an RGBA op in place of any
+				// DIFF, LUMA, or RGB op--or run.
+				idx = (idx + (px >> 24) * 11 + 64 - 53) & 0x3f;
+				if ((px >> 24) != (last >> 24))
+					op = OP_RGBA << 8;
+			}
+
+			if (op == 0) {
+				// {{{
+				run++;
+				if (run >= maxrun || base+k+1 >= npix || eol) {
+					out.push_back(OP_RUN | (run-1));
+					m_counts[T_RUN]++;
+					run = 0;
+				}
+				// }}}
+			} else {
+				// {{{
+				// Close any run before this pixel.  (The
+				// hardware looks ahead, and closes the run at
+				// its last pixel, but the result is the same.)
+				if (run > 0) {
+					out.push_back(OP_RUN | (run-1));
+					m_counts[T_RUN]++;
+					run = 0;
+				}
+
+				// The hardware compares this table index
+				// against the one before it
+				if (((m_valid >> idx) & 1) && m_table[idx] == px
+						&& idx != lastidx) {
+					out.push_back(OP_INDEX | idx);
+					m_counts[T_INDEX]++;
+				} else if (abv && px == (pixels[base+k-m_abvw]
+								& mask)) {
+					out.push_back(OP_ABOVE);
+					m_counts[T_ABOVE]++;
+				} else if ((op >> 8) == OP_RGBA) {
+					out.push_back(OP_RGBA);
+					out.push_back((px >> 16) & 0x0ff);
+					out.push_back((px >>  8) & 0x0ff);
+					out.push_back( px        & 0x0ff);
+					out.push_back( px >> 24);
+					m_counts[T_RGBA]++;
+				} else if ((op >> 14) == 1) {
+					out.push_back(op >> 8);
+					m_counts[T_DIFF]++;
+				} else if ((op >> 14) == 2) {
+					out.push_back(op >> 8);
+					out.push_back(op & 0x0ff);
+					m_counts[T_LUMA]++;
+				} else {
+					out.push_back(OP_RGB);
+					out.push_back((px >> 16) & 0x0ff);
+					out.push_back((px >>  8) & 0x0ff);
+					out.push_back( px        & 0x0ff);
+					m_counts[T_RGB]++;
+				}
+				// }}}
+			}
+
+			// Every pixel is written to the table, even those
+			// within runs
+			m_table[idx] = px;
+			m_valid |= (1ull << idx);
+			lastidx = idx;
+			last = px;
+			if (eol)
+				m_eol.push_back(out.size());
+		}
+
+		prev = pixels[base+n-1] & mask;
+	}
+}
+// }}}
+// }}}
+// apply_op
+// {{{
+// Decodes one (complete) op from op[], updating the pixel px and the table.
+// Returns the number of pixels remaining in any run, beyond this one.
+static	unsigned apply_op(const uint8_t *op, uint32_t &px, uint32_t *table,
+		uint64_t *counts) {
+	unsigned	run = 0;
+
+	if (op[0] == OP_RGB) {
+		px = (px & 0xff000000) | (op[1] << 16) | (op[2] << 8) | op[3];
+		counts[T_RGB]++;
+	} else if (op[0] == OP_RGBA) {
+		px = ((uint32_t)op[4] << 24) | (op[1] << 16) | (op[2] << 8)
+				| op[3];
+		counts[T_RGBA]++;
+	} else switch(op[0] & 0xc0) {
+	case OP_INDEX:
+		px = table[op[0] & 0x3f];
+		counts[T_INDEX]++;
+		break;
+	case OP_DIFF: {
+		// {{{
+		unsigned r, g, b;
+
+		r = ((px >> 16) + ((op[0] >> 4) & 3) - 2) & 0x0ff;
+		g = ((px >>  8) + ((op[0] >> 2) & 3) - 2) & 0x0ff;
+		b = ( px        + ( op[0]       & 3) - 2) & 0x0ff;
+		px = (px & 0xff000000) | (r << 16) | (g << 8) | b;
+		counts[T_DIFF]++;
+		} break;
+		// }}}
+	case OP_LUMA: {
+		// {{{
+		unsigned r, g, b, dg;
+
+		dg = (op[0] & 0x3f) - 32;
+		r = ((px >> 16) + dg + (op[1] >> 4) - 8) & 0x0ff;
+		g = ((px >>  8) + dg) & 0x0ff;
+		b = ( px        + dg + (op[1] & 0x0f) - 8) & 0x0ff;
+		px = (px & 0xff000000) | (r << 16) | (g << 8) | b;
+		counts[T_LUMA]++;
+		} break;
+		// }}}
+	default: // OP_RUN
+		run = op[0] & 0x3f;
+		counts[T_RUN]++;
+		break;
+	}
+
+	table[hash_alpha(px)] = px;
+
+	return run;
+}
+// }}}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Decoder
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+Decoder::Decoder(void) {
+	m_error = NULL;
+	m_alpha = false;
+	memset(m_table, 0, sizeof(m_table));
+	clear_counts();
+}
+
+void	Decoder::clear_counts(void) {
+	for(unsigned k=0; k<NOPTYPES; k++)
+		m_counts[k] = 0;
+	m_frame_errors = 0;
+}
+
+bool	Decoder::decode(const uint8_t *data, size_t len,
+		unsigned &width, unsigned &height,
+		std::vector<uint32_t> &pixels,
+		const std::vector<uint32_t> *ref) {
+	// {{{
+	static const uint8_t	trailer[8] = { 0,0,0,0, 0,0,0,1 };
+	size_t	nused;
+	bool	isdelta, isabove;
+
+	m_error = NULL;
+	if (len < 14 + 8) {
+		m_error = "File is too short";
+		return false;
+	}
+
+	isdelta = (get32(data) == 0x716f6964);
+	isabove = (get32(data) == 0x716f6976);
+	if (!isdelta && !isabove && get32(data) != 0x716f6966
+			&& get32(data) != 0x716f6973) {
+		m_error = "Missing qoif magic";
+		return false;
+	}
+
+	width  = get32(&data[4]);
+	height = get32(&data[8]);
+	if (data[12] != 3 && data[12] != 4) {
+		m_error = "Invalid channel count";
+		return false;
+	} if (isdelta) {
+		// Every line takes at least one byte
+		if (data[12] != 3) {
+			m_error = "Delta frames must have three channels";
+			return false;
+		} if (!ref || ref->size() != (size_t)width * height) {
+			m_error = "Delta frame without a reference";
+			return false;
+		} if (height > len - 14 - 8) {
+			m_error = "Image size is larger than the file could hold";
+			return false;
+		}
+	} else if ((uint64_t)width * height > (len - 14 - 8) * 62ull) {
+		// Even if every op were a maximum length run, the file would
+		// still be too short to hold this many pixels
+		m_error = "Image size is larger than the file could hold";
+		return false;
+	}
+
+	if (get32(data) == 0x716f6973)
+		return decode_striped(data, len, width, height, pixels);
+
+	if (isdelta) {
+		pixels.resize((size_t)width * height);
+		nused = decompress_delta(&data[14], len - 14 - 8, width,
+				height, ref->data(), pixels.data());
+	} else if (isabove) {
+		pixels.resize((size_t)width * height);
+		nused = decompress_above(&data[14], len - 14 - 8, width,
+				height, pixels.data());
+	} else
+		nused = decompress(&data[14], len - 14 - 8,
+				(size_t)width * height, pixels);
+	if (nused == 0 && width * height != 0)
+		return false;
+
+	if (nused + 14 + 8 != len
+			|| memcmp(&data[14+nused], trailer, 8) != 0) {
+		m_error = "Invalid trailer";
+		return false;
+	}
+
+	return true;
+}
+// }}}
+
+bool	Decoder::decode_next(const uint8_t *data, size_t len, size_t &pos,
+		unsigned &width, unsigned &height,
+		std::vector<uint32_t> &pixels) {
+	// {{{
+	static const uint8_t	magic[4] = { 'q', 'o', 'i', 'f' },
+				trailer[8] = { 0,0,0,0, 0,0,0,1 };
+	const uint8_t	*m;
+	size_t		start, end, nused;
+	uint64_t	npix, count;
+
+	m_error = NULL;
+	m = (pos < len) ? (const uint8_t *)memmem(&data[pos], len - pos,
+						magic, sizeof(magic)) : NULL;
+	if (!m || (size_t)(m - data) + 14 + 8 > len) {
+		m_error = "No more frames";
+		pos = len;
+		return false;
+	}
+
+	// As with the hardware, the channels and colorspace are ignored
+	start  = m - data + 14;
+	width  = get32(&m[4]);
+	height = get32(&m[8]);
+	npix   = (uint64_t)width * height;
+
+	// Walk the ops, as qoi_decoder.v does, until either the trailer or
+	// the header's last pixel.  The trailer is only recognized between
+	// ops.  An empty image still takes an op before it can overrun.
+	end = start;
+	count = 0;
+	while(end + 8 <= len && memcmp(&data[end], trailer, 8) != 0
+			&& (count < npix || (count == 0 && npix == 0))) {
+		uint8_t	op = data[end];
+
+		end += op_length(op);
+		count += (op_type(op) == T_RUN) ? (op & 0x3f) + 1 : 1;
+	}
+
+	if (end + 8 > len) {
+		m_error = "Ran out of data";
+		m_frame_errors++;
+		pos = len;
+		return false;
+	} else if (count < npix) {
+		// The stream ended early.  The search for the next frame
+		// carries on after its trailer.
+		m_error = "Stream ends before the header's last pixel";
+		m_frame_errors++;
+		pos = end + 8;
+		return false;
+	} else if (count > npix || memcmp(&data[end], trailer, 8) != 0) {
+		// The stream carries on past the header's last pixel.  The
+		// frame ends there, and the search for the next carries on
+		// after the op holding that pixel.
+		m_error = "Stream carries on past the header's last pixel";
+		m_frame_errors++;
+		pos = end;
+		return false;
+	}
+
+	nused = decompress(&data[start], end - start, (size_t)npix, pixels);
+	if (nused == 0 && npix != 0) {
+		m_frame_errors++;
+		pos = end + 8;
+		return false;
+	}
+
+	pos = end + 8;
+	return true;
+}
+// }}}
+
+bool	Decoder::decode_striped(const uint8_t *data, size_t len,
+		unsigned width, unsigned height,
+		std::vector<uint32_t> &pixels) {
+	// {{{
+	static const uint8_t	trailer[8] = { 0,0,0,0, 0,0,0,1 };
+	unsigned	nstripes, rows, nthreads;
+	size_t		hdrlen;
+	std::vector<size_t>	start, end;
+	std::vector<const char *>	err;
+	std::vector<Decoder>	sub;
+
+	if (len < 18 + 8) {
+		m_error = "File is too short";
+		return false;
+	}
+
+	nstripes = get32(&data[14]);
+	{
+		unsigned	n = nstripes;
+
+		rows = stripe_rows(height, n);
+		if (nstripes == 0 || n != nstripes) {
+			m_error = "Invalid stripe count";
+			return false;
+		}
+	}
+
+	hdrlen = 18 + 4 * (size_t)nstripes;
+	if (hdrlen + 8 > len) {
+		m_error = "File is too short";
+		return false;
+	}
+
+	// Every stripe must start where the one before it ends
+	start.resize(nstripes);
+	end.resize(nstripes);
+	for(unsigned k=0; k<nstripes; k++)
+		start[k] = get32(&data[18 + 4*k]);
+	for(unsigned k=0; k<nstripes; k++) {
+		end[k] = (k+1 < nstripes) ? start[k+1] : len - 8;
+		if (start[k] < ((k == 0) ? hdrlen : start[k-1])
+				|| start[k] > end[k] || end[k] > len - 8
+				|| (k == 0 && start[k] != hdrlen)) {
+			m_error = "Invalid stripe offset";
+			return false;
+		}
+	}
+
+	if (memcmp(&data[len-8], trailer, 8) != 0) {
+		m_error = "Invalid trailer";
+		return false;
+	}
+
+	pixels.resize((size_t)width * height);
+	err.assign(nstripes, NULL);
+
+	sub.resize(nstripes);
+	for(auto &d : sub)
+		d.m_alpha = m_alpha;
+
+	nthreads = parallel(nstripes, [&](unsigned t, unsigned k) {
+		unsigned	r0 = k * rows, r1 = r0 + rows;
+		size_t		npix, nused;
+
+		if (r1 > height)
+			r1 = height;
+		npix = (size_t)(r1 - r0) * width;
+		nused = sub[t].decompress(&data[start[k]], end[k] - start[k],
+				npix, &pixels[(size_t)r0 * width]);
+		if (nused == 0 && npix != 0)
+			err[k] = sub[t].m_error;
+		else if (nused != end[k] - start[k])
+			err[k] = "Invalid stripe length";
+	});
+
+	for(unsigned t=0; t<nthreads; t++)
+	for(unsigned k=0; k<NOPTYPES; k++)
+		m_counts[k] += sub[t].m_counts[k];
+
+	for(unsigned k=0; k<nstripes; k++)
+	if (err[k]) {
+		m_error = err[k];
+		return false;
+	}
+
+	return true;
+}
+// }}}
+
+size_t	Decoder::decompress(const uint8_t *data, size_t len, size_t npix,
+		std::vector<uint32_t> &pixels) {
+	// {{{
+	pixels.resize(npix);
+	return decompress(data, len, npix, pixels.data());
+}
+// }}}
+
+size_t	Decoder::decompress(const uint8_t *data, size_t len, size_t npix,
+		uint32_t *pixels) {
+	// {{{
+	// As with the encoder, track pixels with their alpha in the MSBs,
+	// starting from opaque black and an empty (all zero) table
+	uint32_t	px = 0xff000000;
+	size_t		pos = 0, k = 0;
+	unsigned	run = 0;
+
+	m_error = NULL;
+	memset(m_table, 0, sizeof(m_table));
+
+	while(k < npix) {
+		if (run > 0) {
+			run--;
+		} else {
+			uint8_t		op;
+			unsigned	n;
+
+			if (pos >= len) {
+				m_error = "Ran out of data";
+				return 0;
+			}
+
+			op = data[pos];
+			n  = op_length(op);
+			if (pos + n > len) {
+				m_error = (op == OP_RGB) ? "Truncated RGB op"
+					: (op == OP_RGBA) ? "Truncated RGBA op"
+					: "Truncated LUMA op";
+				return 0;
+			}
+
+			run = apply_op(&data[pos], px, m_table, m_counts);
+			pos += n;
+		}
+
+		pixels[k++] = m_alpha ? px : (px & 0x0ffffff);
+	}
+
+	if (run > 0) {
+		m_error = "Run extends past the end of the image";
+		return 0;
+	}
+
+	return pos;
+}
+// }}}
+
+size_t	Decoder::decompress_above(const uint8_t *data, size_t len,
+		unsigned width, unsigned height, uint32_t *pixels) {
+	// {{{
+	// The pixel above becomes the prior pixel, alpha and all, so pixels
+	// keep their alpha until the whole image has been decoded
+	const size_t	npix = (size_t)width * height;
+	uint32_t	px = 0xff000000;
+	size_t		pos = 0, k = 0;
+	unsigned	run = 0;
+
+	m_error = NULL;
+	memset(m_table, 0, sizeof(m_table));
+
+	while(k < npix) {
+		if (run > 0) {
+			run--;
+		} else if (pos >= len) {
+			m_error = "Ran out of data";
+			return 0;
+		} else if (data[pos] == OP_ABOVE) {
+			if (k < width) {
+				m_error = "ABOVE op on the first line";
+				return 0;
+			}
+
+			px = pixels[k - width];
+			m_table[hash_alpha(px)] = px;
+			m_counts[T_ABOVE]++;
+			pos++;
+		} else {
+			uint8_t		op = data[pos];
+			unsigned	n  = op_length(op);
+
+			if (pos + n > len) {
+				m_error = (op == OP_RGB) ? "Truncated RGB op"
+					: (op == OP_RGBA) ? "Truncated RGBA op"
+					: "Truncated LUMA op";
+				return 0;
+			}
+
+			run = apply_op(&data[pos], px, m_table, m_counts);
+			pos += n;
+		}
+
+		pixels[k++] = px;
+	}
+
+	if (run > 0) {
+		m_error = "Run extends past the end of the image";
+		return 0;
+	}
+
+	if (!m_alpha)
+		for(k=0; k<npix; k++)
+			pixels[k] &= 0x0ffffff;
+
+	return pos;
+}
+// }}}
+
+size_t	Decoder::decompress_delta(const uint8_t *data, size_t len,
+		unsigned width, unsigned height, const uint32_t *ref,
+		uint32_t *pixels) {
+	// {{{
+	uint32_t	px = 0xff000000;
+	size_t		pos = 0;
+	unsigned	run = 0;
+
+	m_error = NULL;
+	memset(m_table, 0, sizeof(m_table));
+
+	for(unsigned y=0; y<height; y++) {
+		uint32_t	*row = &pixels[(size_t)y * width];
+
+		if (run == 0 && width > 0 && pos < len
+				&& data[pos] == OP_SAME) {
+			// Copy the line from the reference, as though each of
+			// its (opaque) pixels had been decoded
+			for(unsigned x=0; x<width; x++) {
+				px = ref[(size_t)y * width + x] | 0xff000000;
+				m_table[hash(px & 0x0ffffff)] = px;
+				row[x] = m_alpha ? px : (px & 0x0ffffff);
+			}
+			m_counts[T_RUN]++;
+			pos++;
+			continue;
+		}
+
+		for(unsigned x=0; x<width; x++) {
+			if (run > 0) {
+				run--;
+			} else {
+				uint8_t		op;
+				unsigned	n;
+
+				if (pos >= len) {
+					m_error = "Ran out of data";
+					return 0;
+				}
+
+				op = data[pos];
+				n  = op_length(op);
+				if (pos + n > len) {
+					m_error = (op == OP_RGB) ? "Truncated RGB op"
+						: "Truncated LUMA op";
+					return 0;
+				}
+
+				run = apply_op(&data[pos], px, m_table,
+						m_counts);
+				pos += n;
+			}
+
+			row[x] = m_alpha ? px : (px & 0x0ffffff);
+		}
+	}
+
+	if (run > 0) {
+		m_error = "Run extends past the end of the image";
+		return 0;
+	}
+
+	return pos;
+}
+// }}}
+// }}}
+////////////////////////////////////////////////////////////////////////////////
+//
+// StreamDecoder
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+StreamDecoder::StreamDecoder(void) {
+	m_alpha = false;
+	clear_counts();
+	reset();
+}
+
+void	StreamDecoder::clear_counts(void) {
+	for(unsigned k=0; k<NOPTYPES; k++)
+		m_counts[k] = 0;
+}
+
+void	StreamDecoder::reset(void) {
+	// {{{
+	m_state = S_HEADER;
+	m_nhdr = m_ncarry = 0;
+	m_width = m_height = m_channels = 0;
+	m_px = 0xff000000;
+	m_run = m_x = m_y = 0;
+	m_left = 0;
+	m_hdr_valid = m_row_ready = false;
+	m_error = NULL;
+	memset(m_table, 0, sizeof(m_table));
+}
+// }}}
+
+// Adds the current pixel to the row in progress
+void	StreamDecoder::emit(void) {
+	// {{{
+	m_row[m_x++] = m_alpha ? m_px : (m_px & 0x0ffffff);
+	m_left--;
+	if (m_x >= m_width) {
+		m_x = 0;
+		m_row_ready = true;
+	}
+
+	if (m_left == 0) {
+		if (m_run > 0)
+			fail("Run extends past the end of the image");
+		else
+			m_state = S_TRAILER;
+	}
+}
+// }}}
+
+size_t	StreamDecoder::push(const uint8_t *data, size_t len) {
+	// {{{
+	static const uint8_t	trailer[8] = { 0,0,0,0, 0,0,0,1 };
+	size_t	pos = 0;
+
+	// Runs may be expanded without any more data
+	while(pos < len || (m_state == S_DATA && m_run > 0)) {
+		switch(m_state) {
+		case S_HEADER: {
+			// {{{
+			unsigned	n = 14 - m_nhdr;
+
+			if (n > len - pos)
+				n = len - pos;
+			memcpy(&m_hdr[m_nhdr], &data[pos], n);
+			m_nhdr += n;
+			pos += n;
+			if (m_nhdr < 14)
+				break;
+
+			if (get32(m_hdr) != 0x716f6966) {
+				fail("Missing qoif magic");
+				break;
+			} if (m_hdr[12] != 3 && m_hdr[12] != 4) {
+				fail("Invalid channel count");
+				break;
+			}
+
+			m_width    = get32(&m_hdr[4]);
+			m_height   = get32(&m_hdr[8]);
+			m_channels = m_hdr[12];
+
+			// The row is allocated from the header's width, so a
+			// damaged header must be caught before it's trusted
+			if (m_width == 0 || m_height == 0) {
+				fail("Empty image");
+				break;
+			} if (m_width > MAXDIM || m_height > MAXDIM) {
+				fail("Image size is too large");
+				break;
+			}
+
+			try {
+				m_row.resize(m_width);
+			} catch(const std::bad_alloc &) {
+				fail("Not enough memory for a row");
+				break;
+			}
+
+			m_left     = (uint64_t)m_width * m_height;
+			m_hdr_valid= true;
+			m_state    = S_DATA;
+			} break;
+			// }}}
+		case S_DATA: {
+			// {{{
+			const uint8_t	*op;
+			unsigned	n;
+
+			// Wait for the last row to be taken
+			if (m_row_ready)
+				return pos;
+
+			if (m_run > 0) {
+				m_run--;
+				emit();
+				break;
+			}
+
+			if (m_ncarry > 0) {
+				// Finish the op left over from the last call
+				n = op_length(m_carry[0]) - m_ncarry;
+				if (n > len - pos)
+					n = len - pos;
+				memcpy(&m_carry[m_ncarry], &data[pos], n);
+				m_ncarry += n;
+				pos += n;
+				if (m_ncarry < op_length(m_carry[0]))
+					break;
+				op = m_carry;
+				m_ncarry = 0;
+			} else if (pos + op_length(data[pos]) > len) {
+				// Keep a partial op until the rest arrives
+				m_ncarry = len - pos;
+				memcpy(m_carry, &data[pos], m_ncarry);
+				pos = len;
+				break;
+			} else {
+				op = &data[pos];
+				pos += op_length(*op);
+			}
+
+			m_run = apply_op(op, m_px, m_table, m_counts);
+			emit();
+			} break;
+			// }}}
+		case S_TRAILER: {
+			// {{{
+			unsigned	n = 8 - m_ncarry;
+
+			if (n > len - pos)
+				n = len - pos;
+			memcpy(&m_carry[m_ncarry], &data[pos], n);
+			m_ncarry += n;
+			pos += n;
+			if (m_ncarry < 8)
+				break;
+
+			m_ncarry = 0;
+			if (memcmp(m_carry, trailer, 8) != 0)
+				fail("Invalid trailer");
+			else
+				m_state = S_DONE;
+			} break;
+			// }}}
+		default:
+			// S_DONE or S_ERROR
+			return pos;
+		}
+	}
+
+	return pos;
+}
+// }}}
+
+const uint32_t	*StreamDecoder::row(void) {
+	// {{{
+	if (!m_row_ready)
+		return NULL;
+
+	m_row_ready = false;
+	m_y++;
+	return m_row.data();
+}
+// }}}
+// }}}
+}
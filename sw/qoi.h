@@ -0,0 +1,404 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoi.h
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A host side, bit-exact, model of the QOI hardware.  The
+//		qoi::Encoder produces the same bytes as qoi_encoder.v (and
+//	so also qoi_compress.v and qoi_wcompress.v), op for op.  Where more
+//	than one QOI op would be legal, it makes the same choice the hardware
+//	makes:
+//
+//	1. Runs take priority over everything else.  As in the hardware, the
+//		first pixel of a frame is compared against black, and a run
+//		ends at 62 pixels or at the end of the frame.
+//	2. INDEX ops come next, but only if the table entry was written by a
+//		prior pixel of the same frame, and only if this pixel's
+//		table index differs from that of the pixel before it.
+//	3. Then DIFF, LUMA, and finally RGB ops.  RGBA ops are only used
+//		with alpha enabled (OPT_ALPHA in the hardware), whenever
+//		alpha differs from the pixel before, and they take the
+//		place of DIFF, LUMA, and RGB ops.
+//
+//	Unlike the reference QOI encoder, the hardware writes every pixel
+//	into its table--even those within a run.  The only time this makes a
+//	difference is for a run of black pixels at the start of a frame, after
+//	which the hardware may use an INDEX op for black where the reference
+//	encoder would not.  Both streams decode to the same image.
+//
+//	The qoi::Decoder decodes any valid QOI stream, whether from the
+//	hardware or not, and so can be used to check qoi_decompress.v.  It
+//	can also walk a stream of frames, resynchronizing after any frame
+//	whose pixel count doesn't match its header, as qoi_decoder.v does.
+//
+//	Pixels are passed as one 32-bit word each, 0x00RRGGBB, in raster order.
+//	Alpha is always assumed to be 255--unless alpha has been enabled, in
+//	which case pixels are 0xAARRGGBB, and images have four channels.
+//
+//	The hash and difference calculations, which don't depend upon the
+//	table, are done ahead of time in blocks by qoi::scan().  This is the
+//	software equivalent of the hardware's first pipeline stages, and it is
+//	vectorized with AVX2, SSE4.1, or NEON if the compiler targets any of
+//	them.  See qoiscan.cpp.
+//
+//	Striped files are an extension to QOI, for encoding and decoding
+//	one image with several threads at once.  The image is split into K
+//	horizontal stripes of ceil(height/K) rows each (the last may be
+//	shorter), and each stripe is compressed as though it were a frame of
+//	its own: starting from opaque black, with an empty table, and with any
+//	run ending at the stripe's end.  A striped file is:
+//
+//	   "qois", width, height, channels, colorspace	(as for "qoif")
+//	   K						(four bytes)
+//	   Offset of each stripe, from the file start	(four bytes each)
+//	   Stripe data, in stripe order
+//	   The usual eight byte end marker
+//
+//	Any stripe may then be decoded without any of the others.  The cost
+//	is the table and run restart at every stripe boundary, which is small
+//	if the stripes are tall.  The different magic number keeps standard
+//	QOI decoders from misreading these files.  No hardware produces them
+//	(yet).
+//
+//	Delta frames are a second extension, produced by qoi_encoder.v with
+//	OPT_DELTA, for video that changes little from one frame to the next.
+//	They have the magic number "qoid", but are otherwise laid out as any
+//	other QOI file.  Within them, the op byte 0xfd (OP_SAME), which would
+//	otherwise be a run of 62, may begin any line.  It stands for the whole
+//	line, which is the same as the line at the same place in the frame
+//	before--the reference frame, which must have the same size.  The
+//	decoder copies the line from the reference, and treats its pixels as
+//	though they had been decoded: each is written to the table, and the
+//	last becomes the prior pixel.  To keep 0xfd free, runs are no longer
+//	than 61 pixels, and to keep every line starting on an op, runs end at
+//	the end of each line.  Key frames, encoded without any reference, are
+//	ordinary "qoif" files, save for these two limits on runs.
+//
+//	The encoder decides a line is unchanged if its CRC matches that of the
+//	same line of the frame before.  The CRC is CRC-32's polynomial,
+//	0x04c11db7, but taken MSB first over the 24 bits of each pixel, R, G,
+//	then B, starting from all ones with no final inversion.  Any change of
+//	a single pixel is always caught.  Only lines of at most maxops ops may
+//	be replaced, since the hardware must hold a line's ops until it knows.
+//	Delta frames are only available with three channel images.
+//
+//	Prediction from the line above is a third extension, produced by
+//	qoi_encoder.v with OPT_ABOVE.  Such files have the magic number
+//	"qoiv", and are otherwise laid out as any "qoif" file.  Within them,
+//	the op byte 0xfc (OP_ABOVE), which would otherwise be a run of 61,
+//	stands for a single pixel equal to the one directly above it, alpha
+//	included.  It may not be used on the first line.  As with any other
+//	pixel, the decoder writes it to the table, and it becomes the prior
+//	pixel.  To keep 0xfc free, runs are no longer than 60 pixels.  The
+//	encoder uses OP_ABOVE only where neither a run nor an INDEX op may be
+//	used, and only within the first maxwidth pixels of each line, the
+//	size of the hardware's line buffer.  These files can't be striped,
+//	nor can they be delta frames.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#ifndef	QOI_H
+#define	QOI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace qoi {
+	// QOI op codes
+	// {{{
+	enum	OPCODE {
+		OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80,
+		OP_RUN = 0xc0, OP_RGB = 0xfe, OP_RGBA = 0xff,
+		// Delta frames only: this line is the reference frame's
+		OP_SAME = 0xfd,
+		// "qoiv" files only: this pixel is the one above it
+		OP_ABOVE = 0xfc
+	};
+
+	// Indexes into the op count arrays below
+	enum	OPTYPE { T_RGB = 0, T_INDEX, T_DIFF, T_LUMA, T_RUN, T_RGBA,
+			T_ABOVE, NOPTYPES };
+	// }}}
+
+	// Table index of a (fully opaque) pixel
+	inline	unsigned hash(uint32_t px) {
+		return ((px >> 16) * 3 + ((px >> 8) & 0x0ff) * 5
+				+ (px & 0x0ff) * 7 + 255 * 11) & 0x3f;
+	}
+
+	// scan()
+	// {{{
+	// Calculates the table index, hash[k], of each of n pixels, together
+	// with the op that would encode each pixel from the one before it,
+	// op[k], without using the table.  The first byte of this op is in
+	// op[k]'s MSBs, and the second (if any) in its LSBs:
+	//
+	//	0x0000	The pixel is the same as the one before it (a run)
+	//	0x4000	A DIFF op, found in op[k] >> 8
+	//	0x8000	A LUMA op, both bytes
+	//	0xfe00	Neither: an RGB op is required
+	//
+	// prev is the pixel before px[0].
+	//
+	// scan() uses the widest vector unit the library was built for, and
+	// scan_scalar() none at all.  Both produce the same results.
+	extern	void	scan(const uint32_t *px, size_t n, uint32_t prev,
+				uint8_t *hash, uint16_t *op);
+	extern	void	scan_scalar(const uint32_t *px, size_t n,
+				uint32_t prev, uint8_t *hash, uint16_t *op);
+	// The name of the vector unit scan() uses, or "scalar"
+	extern	const char *scan_unit(void);
+	// }}}
+
+	// The CRC of n pixels, as used to compare lines in delta frames
+	extern	uint32_t line_crc(const uint32_t *px, size_t n);
+
+	class	Encoder {
+		// {{{
+		uint32_t	m_table[64];
+		uint64_t	m_valid;
+		bool		m_simd, m_alpha;
+		unsigned	m_stripes;
+		// Delta frames
+		bool		m_delta, m_key, m_refok;
+		unsigned	m_keyint, m_since, m_maxops, m_maxlines,
+				m_refw, m_refh, m_linew;
+		std::vector<uint32_t>	m_lcrc;
+		std::vector<size_t>	m_eol;
+		// Prediction from the line above
+		bool		m_above;
+		unsigned	m_abvmax, m_abvw;
+
+		void	encode_striped(unsigned width, unsigned height,
+				const uint32_t *pixels,
+				std::vector<uint8_t> &out);
+		void	encode_delta(unsigned width, unsigned height,
+				const uint32_t *pixels,
+				std::vector<uint8_t> &out);
+	public:
+		// Number of each type of op generated, indexed by OPTYPE.  These
+		// accumulate across frames until clear_counts() is called.
+		uint64_t	m_counts[NOPTYPES];
+
+		Encoder(void);
+
+		// Use qoi::scan() (the default), or qoi::scan_scalar() if not
+		void	simd(bool enable) { m_simd = enable; }
+		// Encode 0xAARRGGBB pixels, as four channel images, rather than
+		// ignoring alpha
+		void	alpha(bool enable) { m_alpha = enable; }
+		// Split images into (up to) this many stripes, encoded in
+		// parallel, as striped files.  One, the default, produces
+		// standard QOI files.
+		void	stripes(unsigned nstripes) {
+			m_stripes = (nstripes < 1) ? 1 : nstripes; }
+		// Encode frames as deltas of the frame before, where they can
+		// be, as qoi_encoder.v does with OPT_DELTA and i_delta set.
+		// Every keyint frames (if not zero), a key frame is made
+		// regardless.  maxops is the longest line, in ops, that may
+		// be replaced, 2^LGLBUF-1 in the hardware, and maxlines the
+		// number of lines whose CRCs are kept, 2^LGLINES.  The first
+		// frame after this is called is always a key frame.  Delta
+		// frames are not used with alpha or stripes.
+		void	delta(bool enable, unsigned keyint = 0,
+				unsigned maxops = 63, unsigned maxlines = 2048);
+		// Forces the next frame to be a key frame, as i_keyframe does
+		void	keyframe(void) { m_key = true; }
+		// Predict pixels from the line above, as "qoiv" files, as
+		// qoi_encoder.v does with OPT_ABOVE and i_above set.  maxwidth
+		// is the size of the hardware's line buffer, 2^LGABOVE.  This
+		// is ignored with stripes, or while delta frames are enabled.
+		void	above(bool enable, unsigned maxwidth = 2048) {
+			m_above = enable; m_abvmax = maxwidth; }
+		void	clear_counts(void);
+
+		// Encodes a full frame, header, ops, and trailer, into out,
+		// exactly as qoi_encoder.v would--unless stripes have been
+		// requested.  Any prior contents of out are replaced.
+		void	encode(unsigned width, unsigned height,
+				const uint32_t *pixels,
+				std::vector<uint8_t> &out);
+
+		// Appends only the compressed ops of one frame to out, as
+		// qoi_compress.v would produce them
+		void	compress(const uint32_t *pixels, size_t npix,
+				std::vector<uint8_t> &out);
+		// }}}
+	};
+
+	class	Decoder {
+		// {{{
+		uint32_t	m_table[64];
+		const char	*m_error;
+		bool		m_alpha;
+
+		bool	decode_striped(const uint8_t *data, size_t len,
+				unsigned width, unsigned height,
+				std::vector<uint32_t> &pixels);
+		size_t	decompress(const uint8_t *data, size_t len,
+				size_t npix, uint32_t *pixels);
+		size_t	decompress_delta(const uint8_t *data, size_t len,
+				unsigned width, unsigned height,
+				const uint32_t *ref, uint32_t *pixels);
+		size_t	decompress_above(const uint8_t *data, size_t len,
+				unsigned width, unsigned height,
+				uint32_t *pixels);
+	public:
+		// Number of each type of op decoded, indexed by OPTYPE
+		uint64_t	m_counts[NOPTYPES];
+		// Number of frames decode_next() has found in error
+		uint64_t	m_frame_errors;
+
+		Decoder(void);
+		// Return 0xAARRGGBB pixels, rather than dropping alpha
+		void	alpha(bool enable) { m_alpha = enable; }
+		void	clear_counts(void);
+
+		// Decodes a full QOI file, returning false on any error.  On
+		// success, width and height are set from the header, and pixels
+		// holds width*height pixels.  On failure, error() describes
+		// the problem.  Striped files are decoded in parallel.  Delta
+		// frames require the pixels of the frame before, in ref.
+		// "qoiv" files, predicted from the line above, are accepted as
+		// well.
+		bool	decode(const uint8_t *data, size_t len,
+				unsigned &width, unsigned &height,
+				std::vector<uint32_t> &pixels,
+				const std::vector<uint32_t> *ref = NULL);
+
+		// Decodes npix pixels of compressed ops, without any header or
+		// trailer, as qoi_decompress.v would.  Returns the number of
+		// bytes consumed, or zero on error.
+		size_t	decompress(const uint8_t *data, size_t len,
+				size_t npix, std::vector<uint32_t> &pixels);
+
+		// Decodes the next frame of a stream of frames, such as a
+		// recording, the way qoi_decoder.v does: searching from pos
+		// for a "qoif" magic number, and then decoding ops until
+		// either the trailer or the header's last pixel.  Returns
+		// true, with pos just past the trailer, if the two came
+		// together.  Otherwise m_frame_errors is incremented, and pos
+		// is left where the hardware resumes its search for the next
+		// "qoif": just past the trailer, if the stream ended early,
+		// or just past the op holding the header's last pixel, if it
+		// carried on.  (The hardware may by then have read a few ops
+		// further.  These only matter if the frame's trailer was lost
+		// and the next header follows at once.)  Once no frame is
+		// left, pos is set to len.
+		bool	decode_next(const uint8_t *data, size_t len, size_t &pos,
+				unsigned &width, unsigned &height,
+				std::vector<uint32_t> &pixels);
+
+		const char *error(void) const { return m_error; }
+		// }}}
+	};
+
+	class	StreamDecoder {
+		// {{{
+		// Decodes one QOI file (qoif, not striped) incrementally, as
+		// its bytes arrive, one row of pixels at a time.  Ops are
+		// decoded straight out of the caller's buffers.  Only an op (or
+		// header) split across two calls to push() is ever copied, and
+		// only a single row of pixels is ever kept.  A typical loop is:
+		//
+		//	while(len > 0 && !sd.done()) {
+		//		n = sd.push(data, len);
+		//		data += n; len -= n;
+		//		while((row = sd.row()) != NULL)
+		//			... use the row ...
+		//		if (n == 0 && sd.error()) break;
+		//	}
+		//
+		// If the file is truncated, push(NULL, 0) expands any run the
+		// data ends with, a row at a time, until row() returns NULL.
+		// Every pixel up to the last complete op will then have been
+		// returned, either by row() or (for the last row) by partial().
+		enum	STATE { S_HEADER, S_DATA, S_TRAILER, S_DONE, S_ERROR };
+
+		STATE		m_state;
+		uint8_t		m_hdr[14], m_carry[8];
+		unsigned	m_nhdr, m_ncarry;
+		unsigned	m_width, m_height, m_channels;
+		uint32_t	m_table[64], m_px;
+		unsigned	m_run, m_x, m_y;
+		uint64_t	m_left;
+		bool		m_alpha, m_hdr_valid, m_row_ready;
+		const char	*m_error;
+		std::vector<uint32_t>	m_row;
+
+		void	fail(const char *msg) {
+			m_error = msg; m_state = S_ERROR; }
+		void	emit(void);
+	public:
+		// Number of each type of op decoded, indexed by OPTYPE.  These
+		// accumulate until clear_counts() is called.
+		uint64_t	m_counts[NOPTYPES];
+
+		// The largest width or height accepted.  Headers claiming
+		// more, or claiming an empty image, are taken to be damaged.
+		static const unsigned	MAXDIM = 65536;
+
+		StreamDecoder(void);
+		// Return 0xAARRGGBB pixels, rather than dropping alpha
+		void	alpha(bool enable) { m_alpha = enable; }
+		void	clear_counts(void);
+		// Forgets any file in progress, to start on a new one
+		void	reset(void);
+
+		// Decodes as much of data as it can, returning the number of
+		// bytes used.  This stops short once a row of pixels is ready,
+		// until that row is taken by row(), once the file is complete,
+		// or on any error.
+		size_t	push(const uint8_t *data, size_t len);
+
+		// Returns the next complete row of pixels, or NULL if there
+		// isn't one.  The row remains valid until the next push().
+		const uint32_t *row(void);
+		// The pixels decoded so far within the row in progress
+		const uint32_t *partial(unsigned &npix) const {
+			npix = (m_row_ready) ? 0 : m_x; return m_row.data(); }
+
+		// Image size, valid once the header has been read
+		bool	header_valid(void) const { return m_hdr_valid; }
+		unsigned width(void) const { return m_width; }
+		unsigned height(void) const { return m_height; }
+		unsigned channels(void) const { return m_channels; }
+		// Rows returned by row() so far
+		unsigned rows(void) const { return m_y; }
+		// True once the trailer of a complete file has been read
+		bool	done(void) const { return m_state == S_DONE; }
+		const char *error(void) const { return m_error; }
+		// }}}
+	};
+}
+
+#endif
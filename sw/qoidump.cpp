@@ -0,0 +1,428 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoidump.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	Decodes every frame found within a raw memory dump, such as a
+//		qoi_recorder capture read back from the board.  The dump is
+//	memory mapped, and searched for frames: each starts with the "qoif"
+//	magic number, and ends with the eight byte end marker qoi_encoder
+//	places in its trailer.  Anything between frames, such as the padding
+//	to the next bus word, is skipped.  (The hardware never places two
+//	INDEX ops to the same entry back to back, so seven zeros followed by a
+//	one can't appear within a frame--only at its end.)  The frames are
+//	then decoded in parallel across a pool of threads.
+//
+//	Delta frames, with the "qoid" magic number, can only be decoded from
+//	the frame before them.  Each key ("qoif") frame, together with the
+//	delta frames following it, is therefore decoded by a single thread,
+//	in order.  A delta frame whose reference didn't decode, or wasn't
+//	captured--as happens to the oldest frames of a flight recording--is
+//	reported as a failure.  Frames predicted from the line above, with
+//	the "qoiv" magic number, depend on nothing before them, and are
+//	decoded as any key frame is.
+//
+//	Usage: qoidump [-j <threads>] [-o <prefix>] [-r <file>] [-a] <dump>
+//
+//	-j	The number of decoding threads.  The default is one per CPU.
+//	-o	Writes each frame to <prefix>NNNNN.png (or .ppm, if libpng
+//		wasn't available at build time), numbered in capture order.
+//	-r	Writes all frames, one after another in capture order, to a
+//		single raw video file of 24-bit RGB pixels.
+//	-a	Makes that raw file 32-bit RGBA instead.
+//
+//	Frames that don't decode are reported, numbered, and skipped.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef	USE_PNG
+#include <png.h>
+#endif
+
+#include "qoi.h"
+
+static	const uint8_t	MAGIC[3] = { 'q', 'o', 'i' };
+static	const uint8_t	END_MARKER[8] = { 0,0,0,0, 0,0,0,1 };
+#ifdef	USE_PNG
+static	const char	IMGEXT[] = "png";
+#else
+static	const char	IMGEXT[] = "ppm";
+#endif
+
+typedef	struct	FRAME_S {
+	size_t			m_offset, m_len;
+	unsigned		m_width, m_height;
+	bool			m_delta, m_done, m_ok;
+	const char		*m_error;
+	std::vector<uint32_t>	m_pixels;
+} FRAME;
+
+static	void	usage(void) {
+	fprintf(stderr,
+"Usage: qoidump [-j <threads>] [-o <prefix>] [-r <file>] [-a] <dump>\n"
+"\n"
+"\tDecodes every QOI frame found in a raw memory dump\n"
+"\n"
+"\t-j <n>\tUse n decoding threads (default: one per CPU)\n"
+"\t-o <p>\tWrite each frame to <p>NNNNN.%s\n"
+"\t-r <f>\tWrite all frames, in order, to the raw video file <f>\n"
+"\t-a\tWrite RGBA, rather than RGB, pixels to the raw video file\n",
+		IMGEXT);
+}
+
+// find_frames
+// {{{
+// Finds the start and length of every frame in the dump.  Searching for
+// the end marker, rather than decoding each frame to find its end, keeps
+// this step fast enough to leave to one thread.
+static	void	find_frames(const uint8_t *data, size_t len,
+		std::vector<FRAME> &frames) {
+	size_t	pos = 0;
+
+	while(pos + 14 + 8 <= len) {
+		const uint8_t	*m, *e;
+
+		m = (const uint8_t *)memmem(&data[pos], len - pos,
+						MAGIC, sizeof(MAGIC));
+		if (!m || (size_t)(m - data) + 14 + 8 > len)
+			break;
+		pos = m - data;
+		if (m[3] != 'f' && m[3] != 'd' && m[3] != 'v') {
+			pos++;
+			continue;
+		}
+
+		e = (const uint8_t *)memmem(&data[pos + 14], len - pos - 14,
+						END_MARKER, sizeof(END_MARKER));
+		if (!e)
+			break;
+
+		FRAME	f;
+		f.m_offset = pos;
+		f.m_len    = (e - data) + 8 - pos;
+		f.m_width  = f.m_height = 0;
+		f.m_delta  = (m[3] == 'd');
+		f.m_done   = f.m_ok = false;
+		f.m_error  = NULL;
+		frames.push_back(f);
+
+		pos += f.m_len;
+	}
+}
+// }}}
+
+// save_image
+// {{{
+// Writes one decoded frame to disk, as a PNG file if possible, otherwise
+// as a PPM.  Alpha is kept (in a PNG) only if the frame had four channels.
+static	bool	save_image(const char *fname, const FRAME &f, bool alpha) {
+	FILE	*fp;
+
+	fp = fopen(fname, "wb");
+	if (!fp)
+		return false;
+
+#ifdef	USE_PNG
+	png_structp	png;
+	png_infop	info;
+	std::vector<png_byte>	row;
+	unsigned	nc = (alpha) ? 4 : 3;
+
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info = (png) ? png_create_info_struct(png) : NULL;
+	if (!png || !info || setjmp(png_jmpbuf(png))) {
+		png_destroy_write_struct(&png, &info);
+		fclose(fp);
+		return false;
+	}
+
+	png_init_io(png, fp);
+	png_set_IHDR(png, info, f.m_width, f.m_height, 8,
+		(alpha) ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	row.resize((size_t)nc * f.m_width);
+	for(unsigned y=0; y<f.m_height; y++) {
+		for(unsigned x=0; x<f.m_width; x++) {
+			uint32_t	px = f.m_pixels[(size_t)y*f.m_width+x];
+
+			row[nc*x  ] = (px >> 16) & 0x0ff;
+			row[nc*x+1] = (px >>  8) & 0x0ff;
+			row[nc*x+2] =  px        & 0x0ff;
+			if (alpha)
+				row[nc*x+3] = px >> 24;
+		}
+		png_write_row(png, row.data());
+	}
+
+	png_write_end(png, NULL);
+	png_destroy_write_struct(&png, &info);
+#else
+	fprintf(fp, "P6\n%u %u\n255\n", f.m_width, f.m_height);
+	for(size_t k=0; k<f.m_pixels.size(); k++) {
+		uint32_t	px = f.m_pixels[k];
+		uint8_t		rgb[3] = { (uint8_t)(px >> 16),
+					(uint8_t)(px >> 8), (uint8_t)px };
+
+		fwrite(rgb, 1, 3, fp);
+	}
+#endif
+
+	return fclose(fp) == 0;
+}
+// }}}
+
+int	main(int argc, char **argv) {
+	const char	*prefix = NULL, *rawname = NULL, *dumpname;
+	unsigned	nthreads = std::thread::hardware_concurrency();
+	bool		raw_alpha = false;
+	int		opt, fd;
+	struct stat	sb;
+	const uint8_t	*data;
+	FILE		*rawfp = NULL;
+	std::vector<FRAME>	frames;
+	std::vector<std::thread>	threads;
+	std::mutex		lock;
+	std::condition_variable	cv;
+	size_t			next = 0, written = 0, nfailed = 0, window;
+	std::chrono::steady_clock::time_point	start;
+
+	// Command line processing
+	// {{{
+	while((opt = getopt(argc, argv, "aj:o:r:h")) != -1) {
+		switch(opt) {
+		case 'a': raw_alpha = true; break;
+		case 'j': nthreads = atoi(optarg); break;
+		case 'o': prefix = optarg; break;
+		case 'r': rawname = optarg; break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind + 1 != argc) {
+		usage();
+		return EXIT_FAILURE;
+	} dumpname = argv[optind];
+
+	if (nthreads < 1)
+		nthreads = 1;
+	// }}}
+
+	// Map the dump into memory, and find the frames within it
+	// {{{
+	fd = open(dumpname, O_RDONLY);
+	if (fd < 0 || fstat(fd, &sb) != 0) {
+		fprintf(stderr, "ERR: Could not open %s\n", dumpname);
+		return EXIT_FAILURE;
+	}
+
+	if (sb.st_size == 0) {
+		printf("%s: No frames found\n", dumpname);
+		return EXIT_SUCCESS;
+	}
+
+	data = (const uint8_t *)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+					fd, 0);
+	if (data == (const uint8_t *)MAP_FAILED) {
+		fprintf(stderr, "ERR: Could not map %s\n", dumpname);
+		return EXIT_FAILURE;
+	}
+	close(fd);
+
+	if (rawname) {
+		rawfp = fopen(rawname, "wb");
+		if (!rawfp) {
+			fprintf(stderr, "ERR: Could not open %s\n", rawname);
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = std::chrono::steady_clock::now();
+	find_frames(data, sb.st_size, frames);
+	// }}}
+
+	// Decode the frames
+	// {{{
+	// Threads take the frames in order, a key frame and the delta frames
+	// following it at a time.  Decoded pixels are only kept until they've
+	// been written to the raw file, so no thread is allowed to run more
+	// than a few frames ahead of that file.
+	window = 4 * (size_t)nthreads;
+	for(unsigned t=0; t<nthreads; t++)
+		threads.emplace_back([&]() {
+			qoi::Decoder	dec;
+			std::vector<uint32_t>	ref;
+
+			while(1) {
+				size_t	k, end;
+				bool	refok = false;
+
+				{
+					std::unique_lock<std::mutex> lk(lock);
+					cv.wait(lk, [&]() {
+						return next >= frames.size()
+							|| next < written + window; });
+					if (next >= frames.size())
+						break;
+					k = next++;
+					while(next < frames.size()
+							&& frames[next].m_delta)
+						next++;
+					end = next;
+				}
+
+				for(size_t first=k; k<end; k++) {
+					FRAME	*f = &frames[k];
+					bool	alpha;
+
+					if (k > first) {
+						std::unique_lock<std::mutex> lk(lock);
+						cv.wait(lk, [&]() {
+							return k < written + window; });
+					}
+
+					alpha = data[f->m_offset + 12] == 4;
+					dec.alpha(alpha);
+					f->m_ok = dec.decode(&data[f->m_offset],
+						f->m_len, f->m_width,
+						f->m_height, f->m_pixels,
+						(refok) ? &ref : NULL);
+					f->m_error = dec.error();
+
+					// The next frame may be a delta from this one
+					refok = f->m_ok && k+1 < end;
+					if (refok)
+						ref = f->m_pixels;
+
+					if (f->m_ok && prefix) {
+						char	num[32];
+						std::string	fname = prefix;
+
+						snprintf(num, sizeof(num), "%05zu.%s",
+							k, IMGEXT);
+						fname += num;
+						if (!save_image(fname.c_str(), *f,
+								alpha)) {
+							f->m_ok = false;
+							f->m_error = "Could not write image";
+						}
+					}
+
+					if (!rawfp)
+						std::vector<uint32_t>().swap(f->m_pixels);
+
+					{
+						std::unique_lock<std::mutex> lk(lock);
+						f->m_done = true;
+					}
+					cv.notify_all();
+				}
+			}
+		});
+
+	// Collect the results, in order
+	for(size_t k=0; k<frames.size(); k++) {
+		FRAME	*f = &frames[k];
+
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			cv.wait(lk, [&]() { return f->m_done; });
+		}
+
+		if (!f->m_ok) {
+			fprintf(stderr, "ERR: Frame %zu, at offset 0x%zx: %s\n",
+				k, f->m_offset, f->m_error);
+			nfailed++;
+		} else if (rawfp) {
+			std::vector<uint8_t>	buf;
+			unsigned	nc = (raw_alpha) ? 4 : 3;
+
+			buf.resize(nc * f->m_pixels.size());
+			for(size_t p=0; p<f->m_pixels.size(); p++) {
+				uint32_t	px = f->m_pixels[p];
+
+				buf[nc*p  ] = (px >> 16) & 0x0ff;
+				buf[nc*p+1] = (px >>  8) & 0x0ff;
+				buf[nc*p+2] =  px        & 0x0ff;
+				if (raw_alpha)
+					buf[nc*p+3] = (data[f->m_offset+12] == 4)
+							? (px >> 24) : 0x0ff;
+			}
+			fwrite(buf.data(), 1, buf.size(), rawfp);
+		}
+		std::vector<uint32_t>().swap(f->m_pixels);
+
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			written++;
+		}
+		cv.notify_all();
+	}
+
+	for(auto &th : threads)
+		th.join();
+	// }}}
+
+	printf("%s: %zu frames found, %zu decoded, in %.3f seconds\n",
+		dumpname, frames.size(), frames.size() - nfailed,
+		std::chrono::duration<double>(std::chrono::steady_clock::now()
+			- start).count());
+	if (frames.size() > 0 && nfailed == 0)
+		printf("Frames are %ux%u\n", frames[0].m_width,
+			frames[0].m_height);
+
+	if (rawfp && fclose(rawfp) != 0) {
+		fprintf(stderr, "ERR: Could not write %s\n", rawname);
+		return EXIT_FAILURE;
+	}
+
+	munmap((void *)data, sb.st_size);
+	return (nfailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,290 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoirec.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	The qoi::Recorder driver for qoi_recorder.v, together with
+//		the qoi::LinuxBus it may be reached through.  See qoirec.h.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#ifdef	__linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+
+#include "qoirec.h"
+
+namespace qoi {
+#ifdef	__linux__
+	// LinuxBus
+	// {{{
+	// mmap() requires page aligned offsets, so each map starts on the page
+	// holding phys, and the pointer returned is offset into it
+	static	uint8_t	*map_phys(int fd, uint64_t phys, size_t len, int prot,
+				void *&base, size_t &maplen) {
+		uint64_t	page = sysconf(_SC_PAGESIZE), skip;
+
+		skip   = phys & (page-1);
+		maplen = len + skip;
+		base   = mmap(NULL, maplen, prot, MAP_SHARED, fd,
+							(off_t)(phys - skip));
+		if (base == MAP_FAILED) {
+			base = NULL; maplen = 0;
+			return NULL;
+		}
+
+		return (uint8_t *)base + skip;
+	}
+
+	LinuxBus::LinuxBus(uint64_t reg_phys, size_t reg_len,
+			uint64_t mem_phys, size_t mem_len, const char *uio)
+		: m_memfd(-1), m_uiofd(-1), m_regs(NULL), m_mem(NULL),
+		m_regmap(NULL), m_memmap(NULL), m_reglen(0), m_memlen(0),
+		m_memphys(mem_phys), m_memsz(mem_len), m_error(NULL) {
+		m_memfd = open("/dev/mem", O_RDWR | O_SYNC);
+		if (m_memfd < 0) {
+			m_error = "Could not open /dev/mem";
+			return;
+		}
+
+		m_regs = (volatile uint32_t *)map_phys(m_memfd, reg_phys,
+				reg_len, PROT_READ | PROT_WRITE,
+				m_regmap, m_reglen);
+		m_mem = map_phys(m_memfd, mem_phys, mem_len, PROT_READ,
+				m_memmap, m_memlen);
+		if (!m_regs || !m_mem) {
+			m_error = "Could not map the recorder from /dev/mem";
+			return;
+		}
+
+		if (uio && (m_uiofd = open(uio, O_RDWR)) < 0)
+			m_error = "Could not open the UIO device";
+	}
+
+	LinuxBus::~LinuxBus(void) {
+		if (m_regmap)
+			munmap(m_regmap, m_reglen);
+		if (m_memmap)
+			munmap(m_memmap, m_memlen);
+		if (m_memfd >= 0)
+			close(m_memfd);
+		if (m_uiofd >= 0)
+			close(m_uiofd);
+	}
+
+	void	LinuxBus::clear_interrupt(void) {
+		uint32_t	count, enable = 1;
+		int		flags;
+
+		if (m_uiofd < 0)
+			return;
+
+		// Drain any interrupt already counted, then (re)enable it.
+		// UIO disables the interrupt each time it fires.
+		flags = fcntl(m_uiofd, F_GETFL);
+		fcntl(m_uiofd, F_SETFL, flags | O_NONBLOCK);
+		while(::read(m_uiofd, &count, sizeof(count)) == sizeof(count))
+			;
+		fcntl(m_uiofd, F_SETFL, flags);
+		if (::write(m_uiofd, &enable, sizeof(enable)) != sizeof(enable))
+			m_error = "Could not enable the UIO interrupt";
+	}
+
+	bool	LinuxBus::wait_interrupt(int timeout_ms) {
+		if (m_uiofd >= 0) {
+			struct pollfd	pfd;
+			uint32_t	count;
+
+			pfd.fd = m_uiofd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, timeout_ms) <= 0)
+				return false;
+			return ::read(m_uiofd, &count, sizeof(count))
+							== sizeof(count);
+		}
+
+		// Without an interrupt, poll the status register every
+		// millisecond
+		for(int ms=0; timeout_ms < 0 || ms < timeout_ms; ms++) {
+			if ((m_regs[Recorder::R_CTRL]
+				& (Recorder::S_REQUEST|Recorder::S_BUSY)) == 0)
+				return true;
+			usleep(1000);
+		}
+
+		return (m_regs[Recorder::R_CTRL]
+				& (Recorder::S_REQUEST|Recorder::S_BUSY)) == 0;
+	}
+
+	const uint8_t *LinuxBus::map(uint64_t addr, size_t len) {
+		if (addr < m_memphys || addr - m_memphys > m_memsz
+				|| len > m_memsz - (addr - m_memphys))
+			return NULL;
+		return m_mem + (addr - m_memphys);
+	}
+	// }}}
+#endif
+
+	// Recorder
+	// {{{
+	Recorder::Recorder(RecorderBus &bus, unsigned lgindex)
+		: m_bus(bus), m_lgindex(lgindex), m_base(0), m_ringlen(0),
+		m_ring(false) {
+	}
+
+	void	Recorder::set_address(uint64_t addr) {
+		m_bus.write(R_MSW, (uint32_t)(addr >> 32));
+		m_bus.write(R_LSW, (uint32_t)addr);
+
+		// The recorder rounds the address down to a whole bus word,
+		// and frames are indexed from there
+		m_base = ((uint64_t)m_bus.read(R_MSW) << 32) | m_bus.read(R_LSW);
+	}
+
+	bool	Recorder::start(uint64_t addr, unsigned nframes, bool fast) {
+		if (busy() || nframes == 0 || nframes > 0x0ffff)
+			return false;
+
+		set_address(addr);
+		m_ring = false;
+		m_ringlen = 0;
+
+		// The interrupt is cleared before the capture starts, so that
+		// wait() can't miss it
+		m_bus.clear_interrupt();
+		m_bus.write(R_CTRL, nframes | (fast ? 0x20000 : 0));
+		return (status() & S_REQUEST) != 0;
+	}
+
+	bool	Recorder::start_ring(uint64_t addr, uint32_t ringlen,
+				uint32_t maxframe, bool fast) {
+		if (busy() || maxframe == 0 || maxframe > ringlen)
+			return false;
+
+		set_address(addr);
+		m_bus.write(R_LEN, ringlen);
+		m_bus.write(R_FRMLEN, maxframe);
+		m_ring = true;
+		m_ringlen = ringlen;
+
+		m_bus.clear_interrupt();
+		m_bus.write(R_CTRL, 0x10000 | (fast ? 0x20000 : 0));
+		return (status() & S_REQUEST) != 0;
+	}
+
+	bool	Recorder::wait(int timeout_ms) {
+		while(busy()) {
+			if (!m_bus.wait_interrupt(timeout_ms))
+				return !busy();
+		}
+
+		return true;
+	}
+
+	bool	Recorder::stats(RecorderStats &st) {
+		// The statistics count is read both before and after the
+		// statistics, and they're only kept if it didn't change.  A
+		// new frame's statistics arrive at most once per frame, so
+		// a second try will nearly always do.
+		for(unsigned tries=0; tries < 8; tries++) {
+			uint32_t	count = m_bus.read(R_STCOUNT);
+
+			st.m_bytes  = m_bus.read(R_STBYTES);
+			st.m_run    = m_bus.read(R_STRUN);
+			st.m_index  = m_bus.read(R_STINDEX);
+			st.m_diff   = m_bus.read(R_STDIFF);
+			st.m_luma   = m_bus.read(R_STLUMA);
+			st.m_rgb    = m_bus.read(R_STRGB);
+			st.m_stalls = m_bus.read(R_STSTALL);
+			st.m_budget = m_bus.read(R_STBUDGET);
+			st.m_count  = count;
+			if (m_bus.read(R_STCOUNT) == count)
+				return count != 0;
+		}
+
+		return false;
+	}
+
+	size_t	Recorder::frames(std::vector<FrameView> &frames) {
+		const unsigned	nindex = 1u << m_lgindex,
+				table  = 1u << (m_lgindex+1);
+		uint32_t	count = frame_count(), n;
+
+		frames.clear();
+		n = (count < nindex) ? count : nindex;
+
+		// Walk backwards from the most recent frame, collecting the
+		// frames in reverse order
+		for(unsigned k=0; k<n; k++) {
+			FrameView	f;
+			uint32_t	slot, start, len;
+			bool		lost = false;
+
+			f.m_frame = count - 1 - k;
+			slot  = f.m_frame & (nindex-1);
+			start = m_bus.read(table + 2*slot);
+			len   = m_bus.read(table + 2*slot + 1);
+			f.m_truncated = (len >> 31) != 0;
+			f.m_len  = len & 0x7fffffff;
+			f.m_addr = m_base + start;
+
+			if (m_ring) {
+				// Stop at the first frame overlapping any of
+				// the frames that followed it
+				if ((uint64_t)start + f.m_len > m_ringlen)
+					break;
+				for(size_t j=0; j<frames.size() && !lost; j++) {
+					uint64_t	s = frames[j].m_addr;
+
+					lost = (f.m_addr < s + frames[j].m_len)
+						&& (s < f.m_addr + f.m_len);
+				}
+
+				if (lost)
+					break;
+			}
+
+			if ((f.m_data = m_bus.map(f.m_addr, f.m_len)) == NULL)
+				break;
+			frames.push_back(f);
+		}
+
+		std::reverse(frames.begin(), frames.end());
+		return frames.size();
+	}
+	// }}}
+}
@@ -0,0 +1,237 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoirec.h
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	A driver for qoi_recorder.v.  The qoi::Recorder arms
+//		captures, either of a fixed number of frames or into a ring
+//	buffer, waits for them to end, reads the compression statistics, and
+//	walks the index table to hand back views of the captured frames.
+//	These views point straight into the capture memory: nothing is
+//	copied, so they may be passed directly to qoi::Decoder.
+//
+//	The recorder is reached through a qoi::RecorderBus, of which two are
+//	provided.  A qoi::DirectBus is for CPUs, such as the ZipCPU, where the
+//	recorder's registers and the capture memory are both within the CPU's
+//	own address space.  A qoi::LinuxBus maps them from /dev/mem instead,
+//	and uses a UIO device (if given) for the recorder's interrupt.
+//
+//	Rather than polling the status register, wait() sleeps on the
+//	recorder's interrupt, o_int, which pulses once a capture has ended
+//	and all of its data has reached memory.  Buses must latch this
+//	interrupt: wait_interrupt() must return at once if it has fired since
+//	the last clear_interrupt(), or else a capture ending between the
+//	status check and the wait would be missed.  Without an interrupt,
+//	each bus falls back to polling.
+//
+//	As with the hardware, the index only holds the last 2^LGINDEX frames.
+//	The frames of a longer (non ring) capture remain in memory, between
+//	the start and end of the capture, and may be found with
+//	qoi::Decoder::decode_next().
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#ifndef	QOIREC_H
+#define	QOIREC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace qoi {
+	class	RecorderBus {
+		// {{{
+	public:
+		virtual	~RecorderBus(void) {}
+		// Read or write the 32-bit register at this word address
+		virtual	uint32_t read(unsigned addr) = 0;
+		virtual	void	write(unsigned addr, uint32_t v) = 0;
+		// Forget any interrupt that has already fired
+		virtual	void	clear_interrupt(void) = 0;
+		// Wait for the recorder's interrupt, for up to timeout_ms
+		// milliseconds (forever, if negative).  Returns false on a
+		// timeout.  A bus without an interrupt may return early.
+		virtual	bool	wait_interrupt(int timeout_ms) = 0;
+		// A pointer to len bytes of capture memory, starting at the
+		// recorder's (bus) byte address addr, or NULL if they aren't
+		// accessible
+		virtual	const uint8_t *map(uint64_t addr, size_t len) = 0;
+		// }}}
+	};
+
+	class	DirectBus : public RecorderBus {
+		// {{{
+		// For CPUs that see the recorder's registers at regs, and its
+		// capture memory at the same addresses the recorder does.  The
+		// interrupt is left to the firmware: on the ZipCPU, clear()
+		// would clear the recorder's interrupt in the PIC, and wait()
+		// would enable it and then WAIT.  With wait == NULL, the
+		// status register is (simply) polled.
+		volatile uint32_t	*m_regs;
+		void	(*m_clear)(void), (*m_wait)(void);
+	public:
+		DirectBus(volatile uint32_t *regs, void (*clear)(void) = NULL,
+				void (*wait)(void) = NULL)
+			: m_regs(regs), m_clear(clear), m_wait(wait) {}
+
+		uint32_t read(unsigned addr) { return m_regs[addr]; }
+		void	write(unsigned addr, uint32_t v) { m_regs[addr] = v; }
+		void	clear_interrupt(void) { if (m_clear) m_clear(); }
+		bool	wait_interrupt(int /* timeout_ms */) {
+			if (m_wait) m_wait();
+			return true; }
+		const uint8_t *map(uint64_t addr, size_t /* len */) {
+			return (const uint8_t *)(uintptr_t)addr; }
+		// }}}
+	};
+
+#ifdef	__linux__
+	class	LinuxBus : public RecorderBus {
+		// {{{
+		// Maps reg_len bytes of registers from the physical address
+		// reg_phys, and mem_len bytes of capture memory from mem_phys,
+		// through /dev/mem.  The recorder's bus addresses are taken to
+		// be physical addresses.  /dev/mem maps are uncached, so the
+		// CPU always sees what the recorder wrote.  If uio is given,
+		// it names the UIO device (such as "/dev/uio0") the recorder's
+		// interrupt is wired to.  Otherwise, wait_interrupt() polls
+		// the status register every millisecond.  On failure, error()
+		// describes why.
+		int		m_memfd, m_uiofd;
+		volatile uint32_t	*m_regs;
+		const uint8_t	*m_mem;
+		void		*m_regmap, *m_memmap;
+		size_t		m_reglen, m_memlen;
+		uint64_t	m_memphys, m_memsz;
+		const char	*m_error;
+	public:
+		LinuxBus(uint64_t reg_phys, size_t reg_len,
+				uint64_t mem_phys, size_t mem_len,
+				const char *uio = NULL);
+		~LinuxBus(void);
+
+		bool	ok(void) const { return m_error == NULL; }
+		const char *error(void) const { return m_error; }
+
+		uint32_t read(unsigned addr) { return m_regs[addr]; }
+		void	write(unsigned addr, uint32_t v) { m_regs[addr] = v; }
+		void	clear_interrupt(void);
+		bool	wait_interrupt(int timeout_ms);
+		const uint8_t *map(uint64_t addr, size_t len);
+		// }}}
+	};
+#endif
+
+	// The compression statistics of one frame (OPT_STATS).  See
+	// qoi_recorder.v, registers 0x18 through 0x40.
+	struct	RecorderStats {
+		uint32_t	m_bytes, m_run, m_index, m_diff, m_luma, m_rgb,
+				m_stalls, m_count, m_budget;
+	};
+
+	// A captured frame, in place in the capture memory
+	struct	FrameView {
+		const uint8_t	*m_data;
+		size_t		m_len;
+		uint64_t	m_addr;		// Its (bus) address
+		uint32_t	m_frame;	// Frame number, from zero
+		bool		m_truncated;
+	};
+
+	class	Recorder {
+		// {{{
+		RecorderBus	&m_bus;
+		unsigned	m_lgindex;
+		uint64_t	m_base;
+		uint32_t	m_ringlen;
+		bool		m_ring;
+
+		uint32_t status(void) { return m_bus.read(R_CTRL); }
+		void	set_address(uint64_t addr);
+	public:
+		// Register word addresses
+		enum	{ R_CTRL = 0, R_MSW, R_LSW, R_LEN, R_FRMLEN, R_FRAMES,
+			R_STBYTES, R_STRUN, R_STINDEX, R_STDIFF, R_STLUMA,
+			R_STRGB, R_STSTALL, R_STCOUNT, R_LBUDGET, R_FBUDGET,
+			R_STBUDGET };
+		// Status register bits
+		enum	{ S_REQUEST = 0x80000000, S_BUSY = 0x40000000,
+			S_ERR = 0x20000000, S_ACTIVE = 0x10000000,
+			S_SYNC = 0x08000000, S_RING = 0x04000000,
+			S_STOP = 0x02000000, S_FAST = 0x01000000 };
+
+		// lgindex must match the recorder's LGINDEX
+		Recorder(RecorderBus &bus, unsigned lgindex = 5);
+
+		// Starts a capture of nframes frames, written one after
+		// another from the byte address addr, or of frames written
+		// into a ring buffer of ringlen bytes at addr, each of at most
+		// maxframe bytes (see qoi_recorder.v).  fast requests a fast
+		// start, if the recorder was built with OPT_FASTSTART.
+		// Either returns false if a capture is already in progress,
+		// or if the recorder refused to start.
+		bool	start(uint64_t addr, unsigned nframes, bool fast = false);
+		bool	start_ring(uint64_t addr, uint32_t ringlen,
+				uint32_t maxframe, bool fast = false);
+		// Stops a capture once its current frame is written.  This is
+		// how a ring buffer capture is frozen.
+		void	stop(void) { m_bus.write(R_CTRL, 0); }
+
+		// True while a capture is requested, or its DMA is busy
+		bool	busy(void) { return (status() & (S_REQUEST|S_BUSY)) != 0; }
+		// True if the last capture ended on a bus error
+		bool	bus_error(void) { return (status() & S_ERR) != 0; }
+
+		// Waits for the capture to end, for up to timeout_ms
+		// milliseconds (forever, if negative).  Returns true once it
+		// has ended.
+		bool	wait(int timeout_ms = -1);
+
+		// Frames written to the index since the capture started
+		uint32_t frame_count(void) { return m_bus.read(R_FRAMES); }
+
+		// The statistics of the most recent frame to leave the
+		// encoder.  Returns false if there haven't been any since the
+		// recorder was reset.  The statistics are read until they're
+		// consistent, as described in qoi_recorder.v.
+		bool	stats(RecorderStats &st);
+
+		// Fills frames with views of every captured frame the index
+		// (still) describes, oldest first, and returns their number.
+		// In ring buffer mode, frames that later frames have since
+		// overwritten are left out.  Call this only once the capture
+		// has ended, lest the frames change while being read.
+		size_t	frames(std::vector<FrameView> &frames);
+		// }}}
+	};
+}
+
+#endif
@@ -0,0 +1,390 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoiscan.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	The table independent part of QOI encoding: calculating each
+//		pixel's table index, and the DIFF or LUMA op (if any) that
+//	would encode it from the pixel before it.  Since every pixel can be
+//	processed independently of every other, these calculations vectorize
+//	well.  (It's the table lookup, and the runs, that do not.)  This is
+//	the same split the hardware makes, where these calculations are made
+//	in the pipeline stages before the table lookup.
+//
+//	The vector unit is chosen at compile time.  AVX2 is used if available
+//	(-mavx2), then SSE4.1 (-msse4.1), then NEON.  Otherwise, scan() falls
+//	back to the scalar version.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <string.h>
+
+#if	defined(__AVX2__)
+#include <immintrin.h>
+#define	SCAN_AVX2
+#elif	defined(__SSE4_1__)
+#include <smmintrin.h>
+#define	SCAN_SSE4
+#elif	defined(__ARM_NEON)
+#include <arm_neon.h>
+#define	SCAN_NEON
+#endif
+
+#include "qoi.h"
+
+namespace qoi {
+
+// scan1
+// {{{
+// Scans a single pixel.  This is the definition every vector version below
+// must match.
+static inline void	scan1(uint32_t px, uint32_t prev,
+		uint8_t *hsh, uint16_t *op) {
+	int	r = (px >> 16) & 0x0ff, g = (px >> 8) & 0x0ff, b = px & 0x0ff,
+		dr, dg, db, drg, dbg;
+
+	*hsh = (r * 3 + g * 5 + b * 7 + 53) & 0x3f;
+
+	dr = (int8_t)(r - ((prev >> 16) & 0x0ff));
+	dg = (int8_t)(g - ((prev >>  8) & 0x0ff));
+	db = (int8_t)(b - ( prev        & 0x0ff));
+	drg = (int8_t)(dr - dg);
+	dbg = (int8_t)(db - dg);
+
+	if (dr == 0 && dg == 0 && db == 0)
+		*op = 0;
+	else if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1
+			&& db >= -2 && db <= 1)
+		*op = (OP_DIFF | ((dr+2) << 4) | ((dg+2) << 2) | (db+2)) << 8;
+	else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7
+			&& dbg >= -8 && dbg <= 7)
+		*op = ((OP_LUMA | (dg+32)) << 8) | ((drg+8) << 4) | (dbg+8);
+	else
+		*op = OP_RGB << 8;
+}
+// }}}
+
+void	scan_scalar(const uint32_t *px, size_t n, uint32_t prev,
+		uint8_t *hsh, uint16_t *op) {
+	// {{{
+	for(size_t k=0; k<n; k++) {
+		scan1(px[k], prev, &hsh[k], &op[k]);
+		prev = px[k];
+	}
+}
+// }}}
+
+#if	defined(SCAN_AVX2)
+////////////////////////////////////////////////////////////////////////////////
+//
+// AVX2: eight pixels at a time
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+// Sign extend the bottom 8-bits of every 32-bit lane
+#define	SX8(V)	_mm256_srai_epi32(_mm256_slli_epi32((V), 24), 24)
+// Lanes where lo <= V <= hi
+#define	INRANGE(V,LO,HI) _mm256_and_si256(				\
+			_mm256_cmpgt_epi32((V), _mm256_set1_epi32((LO)-1)), \
+			_mm256_cmpgt_epi32(_mm256_set1_epi32((HI)+1), (V)))
+
+const char *scan_unit(void) { return "AVX2"; }
+
+void	scan(const uint32_t *px, size_t n, uint32_t prev,
+		uint8_t *hsh, uint16_t *op) {
+	// {{{
+	const __m256i	m8 = _mm256_set1_epi32(0x0ff);
+	size_t	k;
+
+	if (n == 0)
+		return;
+	scan1(px[0], prev, &hsh[0], &op[0]);
+
+	for(k=1; k+8 <= n; k+=8) {
+		__m256i	p = _mm256_loadu_si256((const __m256i *)&px[k]),
+			q = _mm256_loadu_si256((const __m256i *)&px[k-1]);
+		__m256i	r, g, b, h, dr, dg, db, drg, dbg;
+		__m256i	diff, luma, vop, is_eq, is_diff, is_luma;
+		__m128i	o16, h8;
+
+		r = _mm256_and_si256(_mm256_srli_epi32(p, 16), m8);
+		g = _mm256_and_si256(_mm256_srli_epi32(p,  8), m8);
+		b = _mm256_and_si256(p, m8);
+
+		// h = (3r + 5g + 7b + 53) & 63
+		h = _mm256_add_epi32(_mm256_add_epi32(r, _mm256_slli_epi32(r, 1)),
+			_mm256_add_epi32(g, _mm256_slli_epi32(g, 2)));
+		h = _mm256_add_epi32(h, _mm256_sub_epi32(_mm256_slli_epi32(b, 3), b));
+		h = _mm256_and_si256(_mm256_add_epi32(h, _mm256_set1_epi32(53)),
+				_mm256_set1_epi32(0x3f));
+
+		// Differences, as signed 8-bit values
+		dr = SX8(_mm256_sub_epi32(_mm256_srli_epi32(p, 16),
+				_mm256_srli_epi32(q, 16)));
+		dg = SX8(_mm256_sub_epi32(_mm256_srli_epi32(p,  8),
+				_mm256_srli_epi32(q,  8)));
+		db = SX8(_mm256_sub_epi32(p, q));
+		drg = SX8(_mm256_sub_epi32(dr, dg));
+		dbg = SX8(_mm256_sub_epi32(db, dg));
+
+		is_eq = _mm256_cmpeq_epi32(_mm256_or_si256(dr,
+				_mm256_or_si256(dg, db)), _mm256_setzero_si256());
+		is_diff = _mm256_and_si256(INRANGE(dr, -2, 1),
+			_mm256_and_si256(INRANGE(dg, -2, 1), INRANGE(db, -2, 1)));
+		is_luma = _mm256_and_si256(INRANGE(dg, -32, 31),
+			_mm256_and_si256(INRANGE(drg, -8, 7), INRANGE(dbg, -8, 7)));
+
+		diff = _mm256_set1_epi32(OP_DIFF);
+		diff = _mm256_add_epi32(diff, _mm256_slli_epi32(
+			_mm256_add_epi32(dr, _mm256_set1_epi32(2)), 4));
+		diff = _mm256_add_epi32(diff, _mm256_slli_epi32(
+			_mm256_add_epi32(dg, _mm256_set1_epi32(2)), 2));
+		diff = _mm256_add_epi32(diff,
+			_mm256_add_epi32(db, _mm256_set1_epi32(2)));
+		diff = _mm256_slli_epi32(diff, 8);
+
+		luma = _mm256_slli_epi32(_mm256_add_epi32(dg,
+				_mm256_set1_epi32(OP_LUMA + 32)), 8);
+		luma = _mm256_add_epi32(luma, _mm256_slli_epi32(
+			_mm256_add_epi32(drg, _mm256_set1_epi32(8)), 4));
+		luma = _mm256_add_epi32(luma,
+			_mm256_add_epi32(dbg, _mm256_set1_epi32(8)));
+
+		vop = _mm256_set1_epi32(OP_RGB << 8);
+		vop = _mm256_blendv_epi8(vop, luma, is_luma);
+		vop = _mm256_blendv_epi8(vop, diff, is_diff);
+		vop = _mm256_andnot_si256(is_eq, vop);
+
+		// Pack the results down to 16 and 8 bits, and store them
+		vop = _mm256_permute4x64_epi64(_mm256_packus_epi32(vop, vop), 0x08);
+		o16 = _mm256_castsi256_si128(vop);
+		_mm_storeu_si128((__m128i *)&op[k], o16);
+
+		h = _mm256_permute4x64_epi64(_mm256_packus_epi32(h, h), 0x08);
+		h8 = _mm_packus_epi16(_mm256_castsi256_si128(h),
+				_mm256_castsi256_si128(h));
+		_mm_storel_epi64((__m128i *)&hsh[k], h8);
+	}
+
+	for(; k<n; k++)
+		scan1(px[k], px[k-1], &hsh[k], &op[k]);
+}
+// }}}
+// }}}
+#elif	defined(SCAN_SSE4)
+////////////////////////////////////////////////////////////////////////////////
+//
+// SSE4.1: four pixels at a time
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+#define	SX8(V)	_mm_srai_epi32(_mm_slli_epi32((V), 24), 24)
+#define	INRANGE(V,LO,HI) _mm_and_si128(					\
+			_mm_cmpgt_epi32((V), _mm_set1_epi32((LO)-1)),	\
+			_mm_cmpgt_epi32(_mm_set1_epi32((HI)+1), (V)))
+
+const char *scan_unit(void) { return "SSE4.1"; }
+
+void	scan(const uint32_t *px, size_t n, uint32_t prev,
+		uint8_t *hsh, uint16_t *op) {
+	// {{{
+	const __m128i	m8 = _mm_set1_epi32(0x0ff);
+	size_t	k;
+
+	if (n == 0)
+		return;
+	scan1(px[0], prev, &hsh[0], &op[0]);
+
+	for(k=1; k+4 <= n; k+=4) {
+		__m128i	p = _mm_loadu_si128((const __m128i *)&px[k]),
+			q = _mm_loadu_si128((const __m128i *)&px[k-1]);
+		__m128i	r, g, b, h, dr, dg, db, drg, dbg;
+		__m128i	diff, luma, vop, is_eq, is_diff, is_luma;
+		int	h4;
+
+		r = _mm_and_si128(_mm_srli_epi32(p, 16), m8);
+		g = _mm_and_si128(_mm_srli_epi32(p,  8), m8);
+		b = _mm_and_si128(p, m8);
+
+		h = _mm_add_epi32(_mm_add_epi32(r, _mm_slli_epi32(r, 1)),
+			_mm_add_epi32(g, _mm_slli_epi32(g, 2)));
+		h = _mm_add_epi32(h, _mm_sub_epi32(_mm_slli_epi32(b, 3), b));
+		h = _mm_and_si128(_mm_add_epi32(h, _mm_set1_epi32(53)),
+				_mm_set1_epi32(0x3f));
+
+		dr = SX8(_mm_sub_epi32(_mm_srli_epi32(p, 16),
+				_mm_srli_epi32(q, 16)));
+		dg = SX8(_mm_sub_epi32(_mm_srli_epi32(p,  8),
+				_mm_srli_epi32(q,  8)));
+		db = SX8(_mm_sub_epi32(p, q));
+		drg = SX8(_mm_sub_epi32(dr, dg));
+		dbg = SX8(_mm_sub_epi32(db, dg));
+
+		is_eq = _mm_cmpeq_epi32(_mm_or_si128(dr, _mm_or_si128(dg, db)),
+				_mm_setzero_si128());
+		is_diff = _mm_and_si128(INRANGE(dr, -2, 1),
+			_mm_and_si128(INRANGE(dg, -2, 1), INRANGE(db, -2, 1)));
+		is_luma = _mm_and_si128(INRANGE(dg, -32, 31),
+			_mm_and_si128(INRANGE(drg, -8, 7), INRANGE(dbg, -8, 7)));
+
+		diff = _mm_set1_epi32(OP_DIFF);
+		diff = _mm_add_epi32(diff, _mm_slli_epi32(
+				_mm_add_epi32(dr, _mm_set1_epi32(2)), 4));
+		diff = _mm_add_epi32(diff, _mm_slli_epi32(
+				_mm_add_epi32(dg, _mm_set1_epi32(2)), 2));
+		diff = _mm_add_epi32(diff, _mm_add_epi32(db, _mm_set1_epi32(2)));
+		diff = _mm_slli_epi32(diff, 8);
+
+		luma = _mm_slli_epi32(_mm_add_epi32(dg,
+				_mm_set1_epi32(OP_LUMA + 32)), 8);
+		luma = _mm_add_epi32(luma, _mm_slli_epi32(
+				_mm_add_epi32(drg, _mm_set1_epi32(8)), 4));
+		luma = _mm_add_epi32(luma, _mm_add_epi32(dbg, _mm_set1_epi32(8)));
+
+		vop = _mm_set1_epi32(OP_RGB << 8);
+		vop = _mm_blendv_epi8(vop, luma, is_luma);
+		vop = _mm_blendv_epi8(vop, diff, is_diff);
+		vop = _mm_andnot_si128(is_eq, vop);
+
+		_mm_storel_epi64((__m128i *)&op[k], _mm_packus_epi32(vop, vop));
+
+		h = _mm_packus_epi32(h, h);
+		h4 = _mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+		memcpy(&hsh[k], &h4, 4);
+	}
+
+	for(; k<n; k++)
+		scan1(px[k], px[k-1], &hsh[k], &op[k]);
+}
+// }}}
+// }}}
+#elif	defined(SCAN_NEON)
+////////////////////////////////////////////////////////////////////////////////
+//
+// NEON: four pixels at a time
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+#define	SX8(V)	vshrq_n_s32(vshlq_n_s32((V), 24), 24)
+#define	INRANGE(V,LO,HI) vandq_u32(vcgeq_s32((V), vdupq_n_s32(LO)),	\
+			vcleq_s32((V), vdupq_n_s32(HI)))
+
+const char *scan_unit(void) { return "NEON"; }
+
+void	scan(const uint32_t *px, size_t n, uint32_t prev,
+		uint8_t *hsh, uint16_t *op) {
+	// {{{
+	size_t	k;
+
+	if (n == 0)
+		return;
+	scan1(px[0], prev, &hsh[0], &op[0]);
+
+	for(k=1; k+4 <= n; k+=4) {
+		int32x4_t	p = vld1q_s32((const int32_t *)&px[k]),
+				q = vld1q_s32((const int32_t *)&px[k-1]);
+		int32x4_t	r, g, b, h, dr, dg, db, drg, dbg, diff, luma;
+		uint32x4_t	vop, is_eq, is_diff, is_luma;
+		uint8x8_t	h8;
+		uint32_t	h4;
+
+		r = vandq_s32(vshrq_n_s32(p, 16), vdupq_n_s32(0x0ff));
+		g = vandq_s32(vshrq_n_s32(p,  8), vdupq_n_s32(0x0ff));
+		b = vandq_s32(p, vdupq_n_s32(0x0ff));
+
+		h = vmlaq_n_s32(vmlaq_n_s32(vmulq_n_s32(r, 3), g, 5), b, 7);
+		h = vandq_s32(vaddq_s32(h, vdupq_n_s32(53)), vdupq_n_s32(0x3f));
+
+		dr = SX8(vsubq_s32(vshrq_n_s32(p, 16), vshrq_n_s32(q, 16)));
+		dg = SX8(vsubq_s32(vshrq_n_s32(p,  8), vshrq_n_s32(q,  8)));
+		db = SX8(vsubq_s32(p, q));
+		drg = SX8(vsubq_s32(dr, dg));
+		dbg = SX8(vsubq_s32(db, dg));
+
+		is_eq = vceqq_s32(vorrq_s32(dr, vorrq_s32(dg, db)),
+				vdupq_n_s32(0));
+		is_diff = vandq_u32(INRANGE(dr, -2, 1),
+			vandq_u32(INRANGE(dg, -2, 1), INRANGE(db, -2, 1)));
+		is_luma = vandq_u32(INRANGE(dg, -32, 31),
+			vandq_u32(INRANGE(drg, -8, 7), INRANGE(dbg, -8, 7)));
+
+		diff = vdupq_n_s32(OP_DIFF);
+		diff = vaddq_s32(diff, vshlq_n_s32(vaddq_s32(dr, vdupq_n_s32(2)), 4));
+		diff = vaddq_s32(diff, vshlq_n_s32(vaddq_s32(dg, vdupq_n_s32(2)), 2));
+		diff = vaddq_s32(diff, vaddq_s32(db, vdupq_n_s32(2)));
+		diff = vshlq_n_s32(diff, 8);
+
+		luma = vshlq_n_s32(vaddq_s32(dg, vdupq_n_s32(OP_LUMA + 32)), 8);
+		luma = vaddq_s32(luma, vshlq_n_s32(vaddq_s32(drg, vdupq_n_s32(8)), 4));
+		luma = vaddq_s32(luma, vaddq_s32(dbg, vdupq_n_s32(8)));
+
+		vop = vdupq_n_u32(OP_RGB << 8);
+		vop = vbslq_u32(is_luma, vreinterpretq_u32_s32(luma), vop);
+		vop = vbslq_u32(is_diff, vreinterpretq_u32_s32(diff), vop);
+		vop = vbicq_u32(vop, is_eq);
+
+		vst1_u16(&op[k], vmovn_u32(vop));
+
+		h8 = vmovn_u16(vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(h)),
+				vmovn_u32(vreinterpretq_u32_s32(h))));
+		h4 = vget_lane_u32(vreinterpret_u32_u8(h8), 0);
+		memcpy(&hsh[k], &h4, 4);
+	}
+
+	for(; k<n; k++)
+		scan1(px[k], px[k-1], &hsh[k], &op[k]);
+}
+// }}}
+// }}}
+#else
+////////////////////////////////////////////////////////////////////////////////
+//
+// No vector unit
+// {{{
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+
+const char *scan_unit(void) { return "scalar"; }
+
+void	scan(const uint32_t *px, size_t n, uint32_t prev,
+		uint8_t *hsh, uint16_t *op) {
+	scan_scalar(px, n, prev, hsh, op);
+}
+// }}}
+#endif
+}
@@ -0,0 +1,673 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	sw/qoitest.cpp
+// {{{
+// Project:	Quite OK image compression (QOI) Verilog implementation
+//
+// Purpose:	Checks the QOI library against itself.  Pseudorandom images,
+//		of several types and sizes, are scanned with both the vector
+//	and scalar versions of qoi::scan(), which must agree, then encoded
+//	and decoded again, which must reproduce the original image.  The same
+//	round trip is then made with alpha enabled, on images given a
+//	(mostly opaque) alpha channel of their own, and again as striped
+//	files--where the last stripe must also decode on its own.  Files are
+//	also fed to the stream decoder, in pieces, both whole and cut short,
+//	and every row it returns must match the original image.  Sequences
+//	of mostly unchanging frames are then encoded as delta frames, and
+//	each must decode, given the frame before it, to the original.
+//	Images whose lines repeat, in part, the lines above them are encoded
+//	with prediction from the line above, with and without alpha, and
+//	must decode to the original.  The bytes this saves are reported.
+//	Streams of frames, some with damaged headers or trailers, are then
+//	walked frame by frame, and every undamaged frame must be recovered.
+//	The recorder driver's walk of a ring buffer's index is checked
+//	against a mock recorder, which must return every frame still intact.
+//	Finally, the encoder's speed is measured both with and without the
+//	vector unit, and with eight stripes.
+//
+//	The bit-exact comparison against the hardware itself is made by the
+//	Verilator test bench, bench/cpp/encoder_tb.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "qoi.h"
+#include "qoirec.h"
+
+// mkimage
+// {{{
+// Builds a pseudorandom test image.  Kind 0 is a plot-like image: mostly a
+// black background, with a few lines of a few colors.  Kind 1 is a smooth
+// gradient with noise, exercising DIFF and LUMA ops.  Kind 2 is pure noise.
+static	void	mkimage(unsigned kind, unsigned w, unsigned h,
+		std::vector<uint32_t> &img) {
+	img.resize((size_t)w * h);
+	for(unsigned y=0; y<h; y++)
+	for(unsigned x=0; x<w; x++) {
+		uint32_t	px;
+
+		switch(kind) {
+		case 0:
+			px = 0;
+			if ((rand() % 23) == 0)
+				px = 0x0ffffff;
+			else if ((rand() % 37) == 0)
+				px = 0x0ffa000 + (rand() & 3);
+			else if (y == h/2 || x == w/3)
+				px = 0x00ff00;
+			break;
+		case 1: {
+			unsigned r, g, b;
+
+			r = (x * 3 + (rand() % 5)) & 0x0ff;
+			g = (y * 2 + x + (rand() % 3)) & 0x0ff;
+			b = (x + y + (rand() % 9)) & 0x0ff;
+			px = (r << 16) | (g << 8) | b;
+			} break;
+		default:
+			px = rand() & 0x0ffffff;
+			break;
+		}
+
+		img[(size_t)y*w+x] = px;
+	}
+}
+// }}}
+
+// A stand in for qoi_recorder.v, holding its registers and index table as
+// the recorder would leave them after a capture
+class	MOCKBUS : public qoi::RecorderBus {
+public:
+	std::vector<uint32_t>	m_regs;
+	std::vector<uint8_t>	m_mem;
+	uint64_t		m_base;
+
+	MOCKBUS(unsigned lgindex, size_t memlen, uint64_t base)
+		: m_regs(4u << lgindex, 0), m_mem(memlen, 0), m_base(base) {}
+
+	uint32_t read(unsigned addr) { return m_regs[addr]; }
+	// Any capture request is accepted
+	void	write(unsigned addr, uint32_t v) {
+		if (addr == qoi::Recorder::R_CTRL)
+			v = (v != 0) ? (uint32_t)qoi::Recorder::S_REQUEST : 0;
+		m_regs[addr] = v; }
+	void	clear_interrupt(void) {}
+	bool	wait_interrupt(int /* timeout_ms */) { return true; }
+	const uint8_t *map(uint64_t addr, size_t len) {
+		if (addr < m_base || addr + len > m_base + m_mem.size())
+			return NULL;
+		return m_mem.data() + (addr - m_base); }
+};
+
+int	main(int, char **) {
+	qoi::Encoder		enc;
+	qoi::Decoder		dec;
+	std::vector<uint32_t>	img, out;
+	std::vector<uint8_t>	qf;
+	bool			fail = false;
+
+	printf("QOI scan unit: %s\n", qoi::scan_unit());
+
+	// Check the vector scan against the scalar one, and round trip
+	// {{{
+	for(unsigned test=0; test<300 && !fail; test++) {
+		unsigned	kind = test % 3, w, h, dw, dh;
+		std::vector<uint8_t>	hv, hs;
+		std::vector<uint16_t>	ov, os;
+		uint32_t		prev = rand() & 0x0ffffff;
+
+		w = 1 + (rand() % 97);
+		h = 1 + (rand() % 31);
+		mkimage(kind, w, h, img);
+
+		hv.resize(img.size()); hs.resize(img.size());
+		ov.resize(img.size()); os.resize(img.size());
+		qoi::scan(img.data(), img.size(), prev, hv.data(), ov.data());
+		qoi::scan_scalar(img.data(), img.size(), prev, hs.data(),
+				os.data());
+		if (hv != hs || ov != os) {
+			fprintf(stderr, "ERR: Test %d, scan mismatch\n", test);
+			fail = true;
+		}
+
+		enc.encode(w, h, img.data(), qf);
+		if (!dec.decode(qf.data(), qf.size(), dw, dh, out)) {
+			fprintf(stderr, "ERR: Test %d, decode failed: %s\n",
+				test, dec.error());
+			fail = true;
+		} else if (dw != w || dh != h || out != img) {
+			fprintf(stderr, "ERR: Test %d, %dx%d image mismatch\n",
+				test, w, h);
+			fail = true;
+		}
+	}
+	// }}}
+
+	// Round trip, with alpha
+	// {{{
+	enc.alpha(true);
+	dec.alpha(true);
+	for(unsigned test=0; test<300 && !fail; test++) {
+		unsigned	kind = test % 3, w, h, dw, dh;
+		uint32_t	a = 0xff;
+
+		w = 1 + (rand() % 97);
+		h = 1 + (rand() % 31);
+		mkimage(kind, w, h, img);
+		// Alpha changes from time to time, but otherwise stays put
+		for(size_t k=0; k<img.size(); k++) {
+			if ((rand() % 17) == 0)
+				a = ((rand() & 1) ? 0xff : (rand() & 0x0ff));
+			img[k] |= a << 24;
+		}
+
+		enc.encode(w, h, img.data(), qf);
+		if (!dec.decode(qf.data(), qf.size(), dw, dh, out)) {
+			fprintf(stderr, "ERR: Alpha test %d, decode failed: %s\n",
+				test, dec.error());
+			fail = true;
+		} else if (qf[12] != 4 || dw != w || dh != h || out != img) {
+			fprintf(stderr, "ERR: Alpha test %d, %dx%d image mismatch\n",
+				test, w, h);
+			fail = true;
+		}
+	}
+	enc.alpha(false);
+	dec.alpha(false);
+	// }}}
+
+	// Round trip, with stripes
+	// {{{
+	for(unsigned test=0; test<300 && !fail; test++) {
+		unsigned	kind = test % 3, w, h, dw, dh, nstripes, rows,
+				last;
+		std::vector<uint8_t>	sf;
+
+		w = 1 + (rand() % 97);
+		h = 1 + (rand() % 31);
+		mkimage(kind, w, h, img);
+
+		enc.stripes(2 + (rand() % 8));
+		enc.encode(w, h, img.data(), sf);
+		if (!dec.decode(sf.data(), sf.size(), dw, dh, out)) {
+			fprintf(stderr, "ERR: Stripe test %d, decode failed: %s\n",
+				test, dec.error());
+			fail = true;
+			continue;
+		} else if (dw != w || dh != h || out != img) {
+			fprintf(stderr, "ERR: Stripe test %d, %dx%d image mismatch\n",
+				test, w, h);
+			fail = true;
+			continue;
+		}
+
+		// The last stripe must decode on its own
+		nstripes = (sf[14] << 24) | (sf[15] << 16) | (sf[16] << 8) | sf[17];
+		rows = (h + nstripes - 1) / nstripes;
+		last = (sf[14+4*nstripes] << 24) | (sf[15+4*nstripes] << 16)
+			| (sf[16+4*nstripes] << 8) | sf[17+4*nstripes];
+		if (memcmp(sf.data(), "qois", 4) != 0 || nstripes < 1
+				|| (nstripes-1) * rows >= h
+				|| dec.decompress(&sf[last], sf.size() - 8 - last,
+					(size_t)w * (h - (nstripes-1) * rows), out)
+						!= sf.size() - 8 - last
+				|| memcmp(out.data(), &img[(size_t)w * (nstripes-1) * rows],
+					out.size() * sizeof(uint32_t)) != 0) {
+			fprintf(stderr, "ERR: Stripe test %d, bad stripe\n", test);
+			fail = true;
+		}
+	}
+	enc.stripes(1);
+	// }}}
+
+	// Stream decoding, in pieces, of whole and truncated files
+	// {{{
+	for(unsigned test=0; test<300 && !fail; test++) {
+		unsigned	kind = test % 3, w, h;
+		size_t		len, pos = 0;
+		qoi::StreamDecoder	sd;
+		const uint32_t	*row;
+
+		w = 1 + (rand() % 97);
+		h = 1 + (rand() % 31);
+		mkimage(kind, w, h, img);
+		enc.encode(w, h, img.data(), qf);
+
+		// Every other file is cut short
+		len = (test & 1) ? (rand() % qf.size()) : qf.size();
+		out.clear();
+		while(pos < len && !sd.error()) {
+			size_t	n = 1 + (rand() % 40);
+
+			if (n > len - pos)
+				n = len - pos;
+			pos += sd.push(&qf[pos], n);
+			while((row = sd.row()) != NULL)
+				out.insert(out.end(), row, row + w);
+		}
+
+		while(sd.push(NULL, 0), (row = sd.row()) != NULL)
+			out.insert(out.end(), row, row + w);
+
+		if (sd.header_valid()) {
+			unsigned	npix;
+
+			row = sd.partial(npix);
+			out.insert(out.end(), row, row + npix);
+		}
+
+		if (sd.error() || (len == qf.size() && (!sd.done()
+					|| sd.rows() != h || out != img))
+				|| out.size() > img.size()
+				|| memcmp(out.data(), img.data(),
+					out.size() * sizeof(uint32_t)) != 0) {
+			fprintf(stderr, "ERR: Stream test %d, %dx%d, %zu of %zu bytes: %s\n",
+				test, w, h, len, qf.size(),
+				sd.error() ? sd.error() : "image mismatch");
+			fail = true;
+		}
+	}
+
+	// A damaged header must be rejected, not trusted.  The width or
+	// height is replaced by zero, or by something far too large.
+	for(unsigned test=0; test<4 && !fail; test++) {
+		static const uint32_t	bad[2] = { 0, 0xfffffff0 };
+		uint8_t			hdr[22];
+		qoi::StreamDecoder	sd;
+
+		mkimage(0, 4, 4, img);
+		enc.encode(4, 4, img.data(), qf);
+		memcpy(hdr, qf.data(), sizeof(hdr));
+		for(unsigned b=0; b<4; b++)
+			hdr[4 + 4*(test & 1) + b] = bad[test >> 1] >> (24-8*b);
+
+		sd.push(hdr, sizeof(hdr));
+		if (!sd.error() || sd.header_valid() || sd.row() != NULL) {
+			fprintf(stderr, "ERR: Stream test, a %s of 0x%08x was accepted\n",
+				(test & 1) ? "height" : "width", bad[test >> 1]);
+			fail = true;
+		}
+	}
+	// }}}
+
+	// Delta frames, each decoded from the frame before it
+	// {{{
+	for(unsigned test=0; test<100 && !fail; test++) {
+		unsigned	kind = test % 3, w, h, dw, dh, keyint, ndelta = 0;
+		std::vector<uint32_t>	ref;
+
+		w = 1 + (rand() % 97);
+		h = 1 + (rand() % 31);
+		keyint = (test & 1) ? 0 : (2 + (rand() % 5));
+		mkimage(kind, w, h, img);
+		enc.delta(true, keyint, 1 + (rand() % 63), 1 + (rand() % 40));
+
+		for(unsigned frame=0; frame<12 && !fail; frame++) {
+			bool	isdelta;
+
+			// A few pixels change from frame to frame, on a few
+			// lines.  Now and then, a key frame is asked for.
+			for(unsigned k=rand() % 4; k>0; k--)
+				img[rand() % img.size()] = rand() & 0x0ffffff;
+			if ((rand() % 11) == 0)
+				enc.keyframe();
+
+			enc.encode(w, h, img.data(), qf);
+			isdelta = (memcmp(qf.data(), "qoid", 4) == 0);
+			if (isdelta && (frame == 0 || (keyint > 0
+					&& ndelta + 1 >= keyint))) {
+				fprintf(stderr, "ERR: Delta test %d, frame %d should be a key frame\n",
+					test, frame);
+				fail = true;
+			}
+			ndelta = (isdelta) ? ndelta + 1 : 0;
+
+			if (!dec.decode(qf.data(), qf.size(), dw, dh, out,
+					isdelta ? &ref : NULL)) {
+				fprintf(stderr, "ERR: Delta test %d, frame %d, decode failed: %s\n",
+					test, frame, dec.error());
+				fail = true;
+			} else if (dw != w || dh != h || out != img) {
+				fprintf(stderr, "ERR: Delta test %d, frame %d, %dx%d image mismatch\n",
+					test, frame, w, h);
+				fail = true;
+			}
+			ref = out;
+		}
+
+		// Without the reference, a delta frame can't be decoded
+		if (!fail && memcmp(qf.data(), "qoid", 4) == 0
+				&& dec.decode(qf.data(), qf.size(), dw, dh, out)) {
+			fprintf(stderr, "ERR: Delta test %d, decoded without a reference\n",
+				test);
+			fail = true;
+		}
+	}
+	enc.delta(false);
+	// }}}
+
+	// Prediction from the line above
+	// {{{
+	{
+		uint64_t	nqoif = 0, nqoiv = 0, nabove = 0;
+
+		for(unsigned test=0; test<300 && !fail; test++) {
+			unsigned	kind = test % 3, w, h, dw, dh, maxw;
+			bool		alpha = (test & 4) != 0;
+
+			w = 1 + (rand() % 97);
+			h = 1 + (rand() % 31);
+			mkimage(kind, w, h, img);
+			// Much of each line repeats the line above it
+			for(size_t k=w; k<img.size(); k++)
+				if ((rand() % 4) != 0)
+					img[k] = img[k-w];
+			if (alpha)
+				for(size_t k=0; k<img.size(); k++)
+					img[k] |= ((rand() % 13) ? 0xff
+						: (rand() & 0x0ff)) << 24;
+
+			// Now and then, lines are longer than the line buffer
+			maxw = (test % 5 == 0) ? 1 + (rand() % w) : 2048;
+			enc.alpha(alpha);
+			dec.alpha(alpha);
+
+			enc.encode(w, h, img.data(), qf);
+			nqoif += qf.size();
+
+			enc.clear_counts();
+			enc.above(true, maxw);
+			enc.encode(w, h, img.data(), qf);
+			enc.above(false);
+			nqoiv += qf.size();
+			nabove += enc.m_counts[qoi::T_ABOVE];
+
+			if (memcmp(qf.data(), "qoiv", 4) != 0) {
+				fprintf(stderr, "ERR: Above test %d, missing qoiv magic\n",
+					test);
+				fail = true;
+			} else if (!dec.decode(qf.data(), qf.size(), dw, dh, out)) {
+				fprintf(stderr, "ERR: Above test %d, decode failed: %s\n",
+					test, dec.error());
+				fail = true;
+			} else if (dw != w || dh != h || out != img) {
+				fprintf(stderr, "ERR: Above test %d, %dx%d image mismatch\n",
+					test, w, h);
+				fail = true;
+			}
+		}
+		enc.alpha(false);
+		dec.alpha(false);
+
+		// Nothing lies above the first line
+		{
+			static const uint8_t	bad[] = { 'q','o','i','v',
+				0,0,0,1, 0,0,0,1, 3, 1, qoi::OP_ABOVE,
+				0,0,0,0, 0,0,0,1 };
+			unsigned	dw, dh;
+
+			if (!fail && dec.decode(bad, sizeof(bad), dw, dh, out)) {
+				fprintf(stderr, "ERR: Above test, first line prediction accepted\n");
+				fail = true;
+			}
+		}
+
+		if (!fail && nabove == 0) {
+			fprintf(stderr, "ERR: Above test, no pixels predicted\n");
+			fail = true;
+		} else if (!fail)
+			printf("Above:   %lu ops predicted, %lu bytes in place of %lu (%.1f%% smaller)\n",
+				(unsigned long)nabove, (unsigned long)nqoiv,
+				(unsigned long)nqoif,
+				100.0 * (1.0 - nqoiv / (double)nqoif));
+	}
+	// }}}
+
+	// Streams of frames, with some damaged, walked a frame at a time
+	// {{{
+	for(unsigned test=0; test<100 && !fail; test++) {
+		std::vector<uint8_t>	stream;
+		std::vector<std::vector<uint32_t> >	good;
+		unsigned	ndamaged = 0, ngood = 0, dw, dh;
+		size_t		pos = 0;
+
+		for(unsigned frame=0; frame<6; frame++) {
+			unsigned	w, h, damage;
+			size_t		base;
+
+			w = 1 + (rand() % 97);
+			h = 1 + (rand() % 31);
+			mkimage(frame % 3, w, h, img);
+			enc.encode(w, h, img.data(), qf);
+
+			// Frames are separated by a few bytes of filler
+			stream.resize(stream.size() + (rand() % 8), 0);
+			base = stream.size();
+			stream.insert(stream.end(), qf.begin(), qf.end());
+
+			// Damage either the trailer, or the height given in
+			// the header--so the pixel count can't match
+			damage = rand() % 3;
+			if (damage == 1)
+				stream[base + qf.size() - 1] = 0;
+			else if (damage == 2 && h > 1)
+				stream[base + 11] = (h - 1) & 0x0ff;
+			else
+				damage = 0;
+
+			if (damage)
+				ndamaged++;
+			else
+				good.push_back(img);
+		}
+
+		dec.clear_counts();
+		while(pos < stream.size() && !fail) {
+			if (!dec.decode_next(stream.data(), stream.size(), pos,
+					dw, dh, out))
+				continue;
+			if (ngood >= good.size() || out != good[ngood]) {
+				fprintf(stderr, "ERR: Stream of frames test %d, frame %d mismatch\n",
+					test, ngood);
+				fail = true;
+			}
+			ngood++;
+		}
+
+		if (!fail && (ngood != good.size()
+				|| dec.m_frame_errors != ndamaged)) {
+			fprintf(stderr, "ERR: Stream of frames test %d, %d of %zu frames found, %lu of %d errors\n",
+				test, ngood, good.size(),
+				(unsigned long)dec.m_frame_errors, ndamaged);
+			fail = true;
+		}
+	}
+
+	// A frame that ends early must be skipped up to its trailer, as the
+	// hardware does, even if its ops happen to spell "qoif".  Here, the
+	// first two pixels give an RGB op of 0x71, 0x6f, 0x69, followed by
+	// the DIFF op 0x66.
+	if (!fail) {
+		static const uint32_t	fake[5] = { 0x716f69, 0x716e69,
+				0x10ff20, 0x10ff20, 0x808080 };
+		std::vector<uint8_t>	stream;
+		unsigned	dw, dh;
+		size_t		pos = 0, first;
+
+		enc.encode(5, 1, fake, qf);
+		if (memmem(qf.data() + 14, qf.size() - 14, "qoif", 4) == NULL) {
+			fprintf(stderr, "ERR: Resync test, no \"qoif\" within the frame\n");
+			fail = true;
+		}
+
+		// Claim one line more than the frame holds
+		qf[11] = 2;
+		stream = qf;
+		first = stream.size();
+		mkimage(0, 9, 4, img);
+		enc.encode(9, 4, img.data(), qf);
+		stream.insert(stream.end(), qf.begin(), qf.end());
+
+		if (!fail && (dec.decode_next(stream.data(), stream.size(),
+					pos, dw, dh, out) || pos != first)) {
+			fprintf(stderr, "ERR: Resync test, short frame resumed at %zu, not %zu\n",
+				pos, first);
+			fail = true;
+		} else if (!fail && (!dec.decode_next(stream.data(),
+					stream.size(), pos, dw, dh, out)
+				|| dw != 9 || dh != 4 || out != img
+				|| pos != stream.size())) {
+			fprintf(stderr, "ERR: Resync test, frame after a short frame lost\n");
+			fail = true;
+		}
+	}
+	// }}}
+
+	// Recorder index walk, in ring buffer mode
+	// {{{
+	// Frames are placed into the ring as the recorder places them, and
+	// the driver must return exactly those of the last 2^LGINDEX frames
+	// that no later frame has overwritten, oldest first
+	for(unsigned test=0; test<200 && !fail; test++) {
+		const unsigned	LGINDEX = 4 + (test % 3), NINDEX = 1u << LGINDEX;
+		const uint32_t	RINGLEN = 4096, BASE = 0x10000,
+				MAXFRAME = 256 + 4 * (rand() % 256);
+		MOCKBUS		bus(LGINDEX, RINGLEN, BASE);
+		qoi::Recorder	rec(bus, LGINDEX);
+		std::vector<qoi::FrameView>	views;
+		std::vector<uint32_t>	owner(RINGLEN, 0), start, len;
+		uint32_t	nframes = rand() % 100, addr = 0;
+		unsigned	nexp = 0;
+
+		if (!rec.start_ring(BASE, RINGLEN, MAXFRAME)) {
+			fprintf(stderr, "ERR: Recorder test %d, start failed\n",
+				test);
+			fail = true;
+			break;
+		}
+
+		for(uint32_t f=0; f<nframes; f++) {
+			uint32_t	n = 1 + (rand() % MAXFRAME);
+
+			if (addr + MAXFRAME > RINGLEN)
+				addr = 0;
+			start.push_back(addr);
+			len.push_back(n);
+			for(uint32_t k=0; k<n; k++)
+				owner[addr + k] = f;
+			bus.m_regs[(2u << LGINDEX) + 2*(f % NINDEX)] = addr;
+			bus.m_regs[(2u << LGINDEX) + 2*(f % NINDEX) + 1] = n;
+			addr = (addr + n + 3) & ~3u;
+		}
+		bus.m_regs[qoi::Recorder::R_FRAMES] = nframes;
+		bus.m_regs[qoi::Recorder::R_CTRL] = 0;
+		if (!rec.wait(0)) {
+			fprintf(stderr, "ERR: Recorder test %d, still busy\n",
+				test);
+			fail = true;
+		}
+
+		// Walking backwards, count the frames that are still intact
+		for(uint32_t f=nframes; f > 0 && nexp < NINDEX; f--) {
+			bool	intact = true;
+
+			for(uint32_t k=0; k<len[f-1] && intact; k++)
+				intact = (owner[start[f-1] + k] == f-1);
+			if (!intact)
+				break;
+			nexp++;
+		}
+
+		rec.frames(views);
+		if (views.size() != nexp) {
+			fprintf(stderr, "ERR: Recorder test %d, %zu of %d frames found\n",
+				test, views.size(), nexp);
+			fail = true;
+		}
+
+		for(unsigned k=0; k<views.size() && !fail; k++) {
+			uint32_t	f = nframes - nexp + k;
+
+			if (views[k].m_frame != f || views[k].m_len != len[f]
+				|| views[k].m_data != bus.m_mem.data() + start[f]
+				|| views[k].m_truncated) {
+				fprintf(stderr, "ERR: Recorder test %d, frame %d mismatch\n",
+					test, f);
+				fail = true;
+			}
+		}
+	}
+	// }}}
+
+	// Measure encoder throughput
+	// {{{
+	// Wall clock time is used, so the striped encoder gets credit for
+	// its threads
+	if (!fail) {
+		const unsigned	W = 1920, H = 1080, NFRAMES = 20;
+
+		for(unsigned kind=0; kind<3; kind++) {
+			mkimage(kind, W, H, img);
+			for(int mode=2; mode>=0; mode--) {
+				std::chrono::steady_clock::time_point	start;
+				double	dt;
+
+				enc.simd(mode != 0);
+				enc.stripes((mode == 2) ? 8 : 1);
+				start = std::chrono::steady_clock::now();
+				for(unsigned k=0; k<NFRAMES; k++)
+					enc.encode(W, H, img.data(), qf);
+				dt = std::chrono::duration<double>(
+					std::chrono::steady_clock::now()
+							- start).count();
+				printf("Image type %d, %-6s%s: %7.1f Mpixels/s, %5.1f%% of raw\n",
+					kind, mode ? qoi::scan_unit() : "scalar",
+					(mode == 2) ? " x8 stripes" : "           ",
+					W * H * (double)NFRAMES / dt / 1e6,
+					100.0 * qf.size() / (3.0 * W * H));
+			}
+		}
+		enc.stripes(1);
+	}
+	// }}}
+
+	if (fail) {
+		printf("FAIL!\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("SUCCESS!\n");
+	return EXIT_SUCCESS;
+}